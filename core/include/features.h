@@ -19,8 +19,18 @@
 #define FEATURES_H_
 
 
+#ifdef __linux__
+
+// Host build, the C library has the POSIX options in unistd.h
+#include_next <features.h>
+#include <unistd.h>
+
+#else
+
 #define _POSIX_TIMERS           1
 #define _POSIX_MONOTONIC_CLOCK  200112L
 
+#endif /* __linux__ */
+
 
 #endif /* FEATURES_H_ */
@@ -0,0 +1,36 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef HIBERNATE_H_
+#define HIBERNATE_H_
+
+#include <stdint.h>
+#include <time.h>
+
+/** Maximum number of memory regions included in the snapshot */
+#ifndef HIBERNATE_CONF_MAX_REGIONS
+#define HIBERNATE_CONF_MAX_REGIONS  4
+#endif /* HIBERNATE_CONF_MAX_REGIONS */
+
+#define HIBERNATE_MAGIC             0x48494245UL
+
+void HIBERNATE_SetImage (uint32_t image);
+int HIBERNATE_AddRegion (void *addr, uint32_t size);
+int HIBERNATE_Save (uint32_t *buf, int size);
+int HIBERNATE_Restore (const uint32_t *buf, int size, const struct timespec *elapsed);
+
+#endif /* HIBERNATE_H_ */
@@ -18,7 +18,49 @@
 #ifndef LPM_H_
 #define LPM_H_
 
+#include <stdint.h>
+
+/**
+ * Start HFXO ahead of the timer deadlines, so it is ready at the deadline.
+ * Has effect only while HF clock runs from HFXO, platform-main.c of efm32
+ * runs it from HFRCO.
+ */
+#ifndef LPM_CONF_PREWAKE
+#define LPM_CONF_PREWAKE            0
+#endif /* LPM_CONF_PREWAKE */
+
+/** Margin added to the measured HFXO startup time, and step for late wake-ups */
+#ifndef LPM_CONF_PREWAKE_MARGIN_US
+#define LPM_CONF_PREWAKE_MARGIN_US  100
+#endif /* LPM_CONF_PREWAKE_MARGIN_US */
+
+/** Upper limit of the pre-wake lead, late wake-ups do not grow it further */
+#ifndef LPM_CONF_PREWAKE_MAX_US
+#define LPM_CONF_PREWAKE_MAX_US     5000
+#endif /* LPM_CONF_PREWAKE_MAX_US */
+
+/**
+ * Wake-ups with HFXO ready after which the lead shrinks by a margin step,
+ * down to the measured startup time and margin
+ */
+#ifndef LPM_CONF_PREWAKE_DECAY
+#define LPM_CONF_PREWAKE_DECAY      16
+#endif /* LPM_CONF_PREWAKE_DECAY */
+
+#if LPM_CONF_PREWAKE
+typedef struct {
+    uint32_t    startup_us;     // Measured HFXO startup time
+    uint32_t    lead_us;        // Current pre-wake lead
+    uint32_t    late;           // Wake-ups where HFXO was not ready yet
+} LpmPrewakeStats;
+
+extern LpmPrewakeStats LPM_PrewakeStats;
+#endif /* LPM_CONF_PREWAKE */
+
+void LPM_Init (void);
 void LPM_RegisterEvent (void);
+void LPM_BlockEM2 (void);
+void LPM_UnblockEM2 (void);
 void LPM_WaitForEvent (void);
 
 #endif /* LPM_H_ */
@@ -0,0 +1,61 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef RATELIMIT_H_
+#define RATELIMIT_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include "protothreads.h"
+#include "systimer.h"
+
+/**
+ * Token bucket on CLOCK_MONOTONIC, kept as the theoretical arrival time of
+ * the next token (GCRA). The bucket holds up to @c burst tokens and refills
+ * with @c rate tokens per second. With a burst of one token it is a leaky
+ * bucket that spaces the output evenly.
+ */
+typedef struct {
+    struct timespec tat;
+    uint32_t        rate;
+    uint32_t        burst;
+    SYSTIMER        timer;
+} RateLimit;
+
+void RATELIMIT_Init (RateLimit *rl, uint32_t rate, uint32_t burst);
+void RATELIMIT_InitLeaky (RateLimit *rl, uint32_t rate);
+int RATELIMIT_Take (RateLimit *rl, uint32_t n);
+uint32_t RATELIMIT_Delay (RateLimit *rl, uint32_t n);
+void RATELIMIT_Arm (RateLimit *rl, uint32_t n, struct process *p);
+
+/**
+ * Block the process until @p n tokens are taken from the bucket. The
+ * process is polled when the tokens are due, one timer per bucket, other
+ * events received meanwhile are dropped. @p res is set to the result of
+ * RATELIMIT_Take (): 0 once the tokens are taken, or -1 at once if @p n
+ * exceeds the burst size, which can never be taken.
+ */
+#define PROCESS_WAIT_TOKENS(rl, n, res)                                 \
+do {                                                                    \
+    while (((res) = RATELIMIT_Take ((rl), (n))) > 0) {                  \
+        RATELIMIT_Arm ((rl), (n), PROCESS_CURRENT ());                  \
+        PROCESS_WAIT_EVENT_UNTIL (ev == PROCESS_EVENT_POLL);            \
+    }                                                                   \
+} while (0)
+
+#endif /* RATELIMIT_H_ */
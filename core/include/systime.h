@@ -24,6 +24,21 @@
 #include <time.h>
 #include <sys/time.h>
 
+/** Maximum slew rate of CLOCK_REALTIME corrections, ppm */
+#ifndef SYSTIME_CONF_SLEW_PPM
+#define SYSTIME_CONF_SLEW_PPM           500
+#endif /* SYSTIME_CONF_SLEW_PPM */
+
+/** Corrections this large or larger step the clock instead of slewing it */
+#ifndef SYSTIME_CONF_STEP_THRESHOLD_NS
+#define SYSTIME_CONF_STEP_THRESHOLD_NS  128000000LL
+#endif /* SYSTIME_CONF_STEP_THRESHOLD_NS */
+
+/** Maximum frequency trim, ppb */
+#ifndef SYSTIME_CONF_TRIM_MAX_PPB
+#define SYSTIME_CONF_TRIM_MAX_PPB       500000
+#endif /* SYSTIME_CONF_TRIM_MAX_PPB */
+
 
 typedef struct {
     uint32_t tv_sec;
@@ -69,16 +84,42 @@ do {                                        \
 #define SYSTIME_CMP(tm1, tm2) ((tm1)->tv_sec == (tm2)->tv_sec ? ((tm1)->tv_nsec ==(tm2)->tv_nsec ? 0 : ((tm1)->tv_nsec > (tm2)->tv_nsec ? 1 : -1)) : ((tm1)->tv_sec > (tm2)->tv_sec ? 1 : -1))
 #define SYSTIME_CMP_L(tm1, tm2) ((tm1).tv_sec == (tm2).tv_sec ? ((tm1).tv_nsec ==(tm2).tv_nsec ? 0 : ((tm1).tv_nsec > (tm2).tv_nsec ? 1 : -1)) : ((tm1).tv_sec > (tm2).tv_sec ? 1 : -1))
 
+/** Compare channel for the scheduler, always available */
+#define SYSTIME_CHANNEL_SCHEDULER   0
+/** Compare channel for a high priority deadline, if the backend has one */
+#define SYSTIME_CHANNEL_PRIORITY    1
+
 typedef struct {
     int         (*init) (void);
     uint32_t    (*getFrequency) (void);
     uint32_t    (*getSystemTime) (void);
     void        (*getSystemNanoTime) (SysTime *tm);
     void        (*trigger) (SysTime *tm, void (*callback) (void));
+    void        (*prewake) (SysTime *lead, void (*callback) (void));
+    unsigned int (*getChannels) (void);
+    void        (*triggerChannel) (unsigned int channel, SysTime *tm, void (*callback) (void));
+    void        (*cancel) (unsigned int channel);
+    int         (*loadOffset) (SysTime *offset);
+    void        (*storeOffset) (SysTime *offset);
+    void        (*sleep) (void);
+    void        (*wake) (void);
+    void        (*clockChanged) (void);
 } SysTimeBackend;
 
 
 int SYSTIME_Init (SysTimeBackend *backend);
 void SYSTIME_Trigger (struct timespec *trigger_time, void (*callback) (void));
+int SYSTIME_TriggerChannel (unsigned int channel, struct timespec *trigger_time, void (*callback) (void));
+void SYSTIME_Cancel (unsigned int channel);
+unsigned int SYSTIME_Channels (void);
+void SYSTIME_Rebase (const struct timespec *expected, const struct timespec *actual);
+int SYSTIME_Prewake (struct timespec *lead, void (*callback) (void));
+int SYSTIME_Trim (int32_t ppb);
+void SYSTIME_Sleep (void);
+void SYSTIME_Wake (void);
+void SYSTIME_ClockChanged (void);
+int32_t SYSTIME_GetTrim (void);
+
+int adjtime (const struct timeval *delta, struct timeval *olddelta);
 
 #endif /* SYSTIME_H_ */
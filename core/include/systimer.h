@@ -25,12 +25,50 @@ struct SYSTIMER_S
   void              *arg;
   SYSTIMER          *next;
   SYSTIMER          *prev;
+  clockid_t         clock;
+};
+
+/** Measure the wake-up jitter of the scheduler trigger, see SystimerStats */
+#ifndef SYSTIMER_CONF_STATS
+#define SYSTIMER_CONF_STATS 0
+#endif /* SYSTIMER_CONF_STATS */
+
+#if SYSTIMER_CONF_STATS
+/**
+ * Trigger jitter, the time the trigger handler runs compared to the
+ * requested one. Measured in the handler, so the scheduling delay of
+ * the timer process is not included.
+ */
+typedef struct {
+    uint32_t    expired;        // Number of triggers
+    uint32_t    late_max_ns;    // Maximum lateness
+    uint64_t    late_sum_ns;    // Sum of lateness, for the average
+} SystimerStats;
+
+extern SystimerStats SYSTIMER_Stats;
+#endif /* SYSTIMER_CONF_STATS */
+
+/** Timers of one kernel instance, see process_context. */
+typedef struct SystimerList_S SystimerList;
+struct SystimerList_S
+{
+  SYSTIMER                  *first;         // Running timers, ordered by target
+  SYSTIMER                  *monotonic;     // Running CLOCK_MONOTONIC timers
+  struct timespec           target;         // Trigger wanted by the instance
+  volatile int              armed;          // Waiting for the trigger
+  struct process_context    *context;
+  struct process            *process;       // Timer process of the instance
+  SystimerList              *child;         // Heap of armed instances
+  SystimerList              *sibling;
+  SystimerList              *prev;
+  struct process            instance;       // Storage for process
 };
 
 PROCESS_NAME (SYSTIMER_Process);
 
 void SYSTIMER_Init_NoStart (SYSTIMER *timer, uint32_t timeout, uint32_t interval, int (*callback) (void*), void *arg);
 void SYSTIMER_Init (SYSTIMER *timer, uint32_t timeout, uint32_t interval, int (*callback) (void*), void *arg);
+void SYSTIMER_SetClock (SYSTIMER *timer, clockid_t clock);
 void SYSTIMER_Set_Timeout (SYSTIMER *timer, uint32_t timeout);
 void SYSTIMER_Start (SYSTIMER *timer);
 void SYSTIMER_Pause (SYSTIMER *timer);
@@ -38,5 +76,8 @@ void SYSTIMER_Stop (SYSTIMER *timer);
 void SYSTIMER_Reset (SYSTIMER *timer);
 int SYSTIMER_IsReady (SYSTIMER *timer);
 int SYSTIMER_IsRunning (SYSTIMER *timer);
+SYSTIMER *SYSTIMER_List (void);
+SYSTIMER *SYSTIMER_ListMonotonic (void);
+void SYSTIMER_InitContext (SystimerList *list);
 
 #endif /* SYSTIMER_H_ */
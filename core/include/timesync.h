@@ -0,0 +1,75 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef TIMESYNC_H_
+#define TIMESYNC_H_
+
+#include <stdint.h>
+#include <time.h>
+
+/** Exchanges with a longer round trip delay than this are not used */
+#ifndef TIMESYNC_CONF_MAX_DELAY_NS
+#define TIMESYNC_CONF_MAX_DELAY_NS  50000000UL
+#endif /* TIMESYNC_CONF_MAX_DELAY_NS */
+
+/** Frame start marker */
+#define TIMESYNC_SYNC               0xA5
+/** Frame types */
+#define TIMESYNC_REQUEST            0x01
+#define TIMESYNC_RESPONSE           0x02
+/** Longest frame: sync, type, sequence, three timestamps, CRC */
+#define TIMESYNC_FRAME_MAX          (3 + 3 * 8 + 1)
+
+/**
+ * Two-way time transfer over a byte stream. The client sends its transmit
+ * time t1, the server answers with t1, its receive time t2 and its
+ * transmit time t3, and the client takes its receive time t4:
+ *
+ *   offset = ((t2 - t1) + (t3 - t4)) / 2
+ *   delay  = (t4 - t1) - (t3 - t2)
+ *
+ * Receive times are taken when the first byte of a frame arrives, so feed
+ * the bytes to TIMESYNC_Input () as soon as they are received.
+ */
+typedef struct {
+    int             (*write) (void *arg, const uint8_t *data, int len);
+    void            *arg;
+
+    // Frame parser
+    uint8_t         frame[TIMESYNC_FRAME_MAX];
+    int             len;
+    struct timespec rx_time;
+
+    // Client state
+    uint8_t         seq;
+    int             pending;
+    struct timespec t1;
+
+    // Result of the last exchange
+    int64_t         offset_ns;
+    uint32_t        delay_ns;
+
+    uint32_t        exchanges;  // Exchanges used to correct the clock
+    uint32_t        rejected;   // Exchanges with a too long delay
+    uint32_t        errors;     // Malformed frames
+} TimeSync;
+
+void TIMESYNC_Init (TimeSync *ts, int (*write) (void *arg, const uint8_t *data, int len), void *arg);
+int TIMESYNC_Request (TimeSync *ts);
+void TIMESYNC_Input (TimeSync *ts, const uint8_t *data, int len);
+
+#endif /* TIMESYNC_H_ */
@@ -118,8 +118,19 @@
 #ifndef __LC_H__
 #define __LC_H__
 
+/**
+ * Use the GCC "labels as values" implementation instead of the
+ * switch() based one. Resuming is cheaper and switch() statements can
+ * be used inside protothreads.
+ */
+#ifndef LC_CONF_ADDRLABELS
+#define LC_CONF_ADDRLABELS 0
+#endif /* LC_CONF_ADDRLABELS */
+
 #ifdef LC_CONF_INCLUDE
 #include LC_CONF_INCLUDE
+#elif LC_CONF_ADDRLABELS
+#include "lc-addrlabels.h"
 #else /* LC_CONF_INCLUDE */
 #include "lc-switch.h"
 #endif /* LC_CONF_INCLUDE */
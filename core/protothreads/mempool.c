@@ -0,0 +1,201 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * \file
+ *         Fixed-block memory pools.
+ */
+
+#include <stddef.h>
+
+#include "mempool.h"
+
+/* Marks a free block in the owner table */
+#define MEMPOOL_FREE ((struct process *)1)
+
+/* All initialized pools, for reclaiming the blocks of exiting processes */
+static struct mempool *pools;
+
+/*---------------------------------------------------------------------------*/
+static int
+block_index(struct mempool *m, void *ptr)
+{
+  uintptr_t offset = (uintptr_t)ptr - (uintptr_t)m->mem;
+
+  if((uintptr_t)ptr < (uintptr_t)m->mem ||
+     offset >= (uintptr_t)m->size * m->count ||
+     offset % m->size != 0) {
+    return -1;
+  }
+
+  return offset / m->size;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Initialize a pool, all blocks free.
+ */
+void
+mempool_init(struct mempool *m)
+{
+  struct mempool *i;
+  uint8_t *block;
+  uint16_t n;
+
+  m->free = NULL;
+  block = (uint8_t *)m->mem + (uint32_t)m->size * m->count;
+  for(n = m->count; n > 0; n--) {
+    block -= m->size;
+    *(void **)block = m->free;
+    m->free = block;
+#if MEMPOOL_CONF_OWNERS
+    m->owners[n - 1] = MEMPOOL_FREE;
+#endif
+  }
+
+  m->used = m->peak = 0;
+  m->allocs = m->failures = 0;
+
+  for(i = pools; i != NULL && i != m; i = i->next);
+  if(i == NULL) {
+    m->next = pools;
+    pools = m;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Allocate a block owned by the given process.
+ *
+ * \param p Owner, NULL for a block not owned by any process.
+ *
+ * \return The block, or NULL if the pool is exhausted.
+ */
+void *
+mempool_alloc_owned(struct mempool *m, struct process *p)
+{
+  void *block;
+
+  MEMPOOL_CONF_CRITICAL_ENTER();
+
+  block = m->free;
+  if(block != NULL) {
+    m->free = *(void **)block;
+    m->allocs++;
+    if(++m->used > m->peak) {
+      m->peak = m->used;
+    }
+#if MEMPOOL_CONF_OWNERS
+    m->owners[block_index(m, block)] = p;
+#endif
+  } else {
+    m->failures++;
+  }
+
+  MEMPOOL_CONF_CRITICAL_EXIT();
+
+  return block;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Allocate a block not owned by any process, e.g. from an interrupt.
+ */
+void *
+mempool_alloc(struct mempool *m)
+{
+  return mempool_alloc_owned(m, NULL);
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Release a block.
+ *
+ * \return 0 on success, -1 if the pointer is not an allocated block of
+ * the pool.
+ */
+int
+mempool_free(struct mempool *m, void *ptr)
+{
+  int i = block_index(m, ptr);
+
+  if(i < 0) {
+    return -1;
+  }
+
+  MEMPOOL_CONF_CRITICAL_ENTER();
+
+#if MEMPOOL_CONF_OWNERS
+  if(m->owners[i] == MEMPOOL_FREE) {
+    MEMPOOL_CONF_CRITICAL_EXIT();
+    return -1;
+  }
+  m->owners[i] = MEMPOOL_FREE;
+#endif
+  *(void **)ptr = m->free;
+  m->free = ptr;
+  m->used--;
+
+  MEMPOOL_CONF_CRITICAL_EXIT();
+
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Check if a pointer is a block of the pool.
+ */
+int
+mempool_inpool(struct mempool *m, void *ptr)
+{
+  return block_index(m, ptr) >= 0;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Pass the ownership of a block to another process, NULL to make it
+ * unowned.
+ */
+void
+mempool_chown(struct mempool *m, void *ptr, struct process *p)
+{
+#if MEMPOOL_CONF_OWNERS
+  int i = block_index(m, ptr);
+
+  MEMPOOL_CONF_CRITICAL_ENTER();
+  if(i >= 0 && m->owners[i] != MEMPOOL_FREE) {
+    m->owners[i] = p;
+  }
+  MEMPOOL_CONF_CRITICAL_EXIT();
+#endif
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Release all blocks owned by a process. Called when the process exits.
+ */
+void
+mempool_reclaim(struct process *p)
+{
+#if MEMPOOL_CONF_OWNERS
+  struct mempool *m;
+  uint16_t i;
+
+  for(m = pools; m != NULL; m = m->next) {
+    for(i = 0; i < m->count && m->used > 0; i++) {
+      if(m->owners[i] == p) {
+        mempool_free(m, (uint8_t *)m->mem + (uint32_t)i * m->size);
+      }
+    }
+  }
+#endif
+}
+/*---------------------------------------------------------------------------*/
+/** @} */
@@ -0,0 +1,126 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * \addtogroup process
+ * @{
+ */
+
+/**
+ * \defgroup mempool Fixed-block memory pools
+ * @{
+ *
+ * Pools of fixed size blocks for the data passed between processes.
+ * Allocation and release are O(1) through a free list kept in the free
+ * blocks themselves, and both are safe to call from interrupts.
+ *
+ * With MEMPOOL_CONF_OWNERS a block can be owned by a process. The blocks
+ * a process still owns are released when the process exits. Ownership
+ * follows the data with mempool_chown() when it is passed on. The owner
+ * is always named by the caller: PROCESS_CURRENT() is not the caller in
+ * an interrupt or outside of a dispatch.
+ *
+ * \code
+ * MEMPOOL(msgs, sizeof(struct msg), 8);
+ *
+ * mempool_init(&msgs);
+ * m = mempool_alloc_owned(&msgs, &sender);
+ * ...
+ * mempool_chown(&msgs, m, &receiver);
+ * process_post(&receiver, ev, m);
+ * \endcode
+ */
+
+/**
+ * \file
+ *         Fixed-block memory pools.
+ */
+
+#ifndef __MEMPOOL_H__
+#define __MEMPOOL_H__
+
+#include <stdint.h>
+
+#include "process.h"
+
+/** Track the owner process of every block */
+#ifndef MEMPOOL_CONF_OWNERS
+#define MEMPOOL_CONF_OWNERS 1
+#endif /* MEMPOOL_CONF_OWNERS */
+
+/** Critical section around the free list, interrupts may allocate too */
+#ifndef MEMPOOL_CONF_CRITICAL_ENTER
+#include "em_int.h"
+#define MEMPOOL_CONF_CRITICAL_ENTER() INT_Disable()
+#define MEMPOOL_CONF_CRITICAL_EXIT()  INT_Enable()
+#endif /* MEMPOOL_CONF_CRITICAL_ENTER */
+
+struct mempool {
+  uint16_t size, count;
+  uint32_t *mem;
+#if MEMPOOL_CONF_OWNERS
+  struct process **owners;
+#endif
+  void *free;
+  struct mempool *next;
+  /* Statistics */
+  uint16_t used, peak;
+  uint32_t allocs, failures;
+};
+
+/* Free blocks hold the free list link, so a block is at least a pointer */
+#define MEMPOOL_WORDS(size)                                             \
+  ((((size) > sizeof(void *) ? (size) : sizeof(void *)) +               \
+    sizeof(uint32_t) - 1) / sizeof(uint32_t))
+
+/**
+ * Declare a pool of \c num blocks of \c block_size bytes.
+ *
+ * \hideinitializer
+ */
+#if MEMPOOL_CONF_OWNERS
+#define MEMPOOL(name, block_size, num)                                  \
+  static uint32_t name##_mem[(num) * MEMPOOL_WORDS(block_size)];        \
+  static struct process *name##_owners[num];                            \
+  struct mempool name = {                                               \
+    .size = MEMPOOL_WORDS(block_size) * sizeof(uint32_t),               \
+    .count = num,                                                       \
+    .mem = name##_mem,                                                  \
+    .owners = name##_owners                                             \
+  }
+#else
+#define MEMPOOL(name, block_size, num)                                  \
+  static uint32_t name##_mem[(num) * MEMPOOL_WORDS(block_size)];        \
+  struct mempool name = {                                               \
+    .size = MEMPOOL_WORDS(block_size) * sizeof(uint32_t),               \
+    .count = num,                                                       \
+    .mem = name##_mem                                                   \
+  }
+#endif /* MEMPOOL_CONF_OWNERS */
+
+void mempool_init(struct mempool *m);
+void *mempool_alloc(struct mempool *m);
+void *mempool_alloc_owned(struct mempool *m, struct process *p);
+int mempool_free(struct mempool *m, void *ptr);
+int mempool_inpool(struct mempool *m, void *ptr);
+void mempool_chown(struct mempool *m, void *ptr, struct process *p);
+void mempool_reclaim(struct process *p);
+
+#endif /* __MEMPOOL_H__ */
+
+/** @} */
+/** @} */
@@ -0,0 +1,125 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * \file
+ *         Bounded zero-copy channels between processes.
+ */
+
+#include "process-chan.h"
+
+/*---------------------------------------------------------------------------*/
+static void
+wakeup(struct process **p, struct process_chan *ch)
+{
+  struct process *q = *p;
+
+  if(q != NULL) {
+    *p = NULL;
+    process_wakeup(q, ch);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void *
+slot(struct process_chan *ch, uint16_t i)
+{
+  return ch->slots + (uint32_t)i * ch->size;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Reserve the next free slot.
+ *
+ * \return The slot, or NULL if the channel is full. The current
+ * process is then woken up when the consumer releases a slot.
+ */
+void *
+process_chan_reserve(struct process_chan *ch)
+{
+  if(ch->reserved) {
+    return slot(ch, ch->head);
+  }
+
+  if(ch->used == ch->count) {
+    ch->producer = PROCESS_CURRENT();
+    return NULL;
+  }
+
+  ch->reserved = 1;
+  return slot(ch, ch->head);
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Pass the reserved slot to the consumer.
+ */
+void
+process_chan_commit(struct process_chan *ch)
+{
+  if(!ch->reserved) {
+    return;
+  }
+
+  ch->reserved = 0;
+  ch->head = (ch->head + 1) % ch->count;
+  ch->used++;
+
+  wakeup(&ch->consumer, ch);
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Get the oldest committed slot, it stays in the channel until
+ * released.
+ *
+ * \return The slot, or NULL if the channel is empty. The current
+ * process is then woken up when the producer commits a slot.
+ */
+void *
+process_chan_peek(struct process_chan *ch)
+{
+  if(ch->used == 0) {
+    ch->consumer = PROCESS_CURRENT();
+    return NULL;
+  }
+
+  return slot(ch, ch->tail);
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Give the oldest slot back to the producer.
+ */
+void
+process_chan_release(struct process_chan *ch)
+{
+  if(ch->used == 0) {
+    return;
+  }
+
+  ch->tail = (ch->tail + 1) % ch->count;
+  ch->used--;
+
+  wakeup(&ch->producer, ch);
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Number of committed slots not released yet.
+ */
+uint16_t
+process_chan_used(struct process_chan *ch)
+{
+  return ch->used;
+}
+/*---------------------------------------------------------------------------*/
+/** @} */
@@ -0,0 +1,134 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * \addtogroup process
+ * @{
+ */
+
+/**
+ * \defgroup processchan Process channels
+ * @{
+ *
+ * Bounded channels of fixed size slots between a producer and a
+ * consumer process. The producer reserves a slot, fills it in place and
+ * commits it; the consumer peeks at the oldest slot, reads it in place
+ * and releases it. Nothing is copied.
+ *
+ * A process blocked on a full or an empty channel is woken up with a
+ * PROCESS_EVENT_WAKEUP event when the other side commits or releases a
+ * slot, see process_wakeup(). While
+ * blocked, the process ignores all other events. One producer and one
+ * consumer per channel.
+ *
+ * \code
+ * struct sample { uint16_t value; uint32_t time; };
+ * PROCESS_CHAN(samples, struct sample, 8);
+ *
+ * // Producer
+ * static struct sample *s;
+ * PROCESS_CHAN_RESERVE(&samples, s);
+ * s->value = ...;
+ * process_chan_commit(&samples);
+ *
+ * // Consumer
+ * static struct sample *s;
+ * PROCESS_CHAN_PEEK(&samples, s);
+ * use(s->value);
+ * process_chan_release(&samples);
+ * \endcode
+ */
+
+/**
+ * \file
+ *         Bounded zero-copy channels between processes.
+ */
+
+#ifndef __PROCESS_CHAN_H__
+#define __PROCESS_CHAN_H__
+
+#include <stdint.h>
+
+#include "process.h"
+
+struct process_chan {
+  uint8_t *slots;
+  uint16_t size, count;
+  uint16_t head, tail, used;
+  unsigned char reserved;
+  struct process *producer, *consumer;
+};
+
+/**
+ * Declare a channel of \c n slots of \c type. The slot size and the
+ * count are kept in 16 bits.
+ *
+ * \hideinitializer
+ */
+#define PROCESS_CHAN(name, type, n)                                     \
+  _Static_assert(sizeof(type) <= UINT16_MAX && (n) > 0 && (n) <= UINT16_MAX, \
+                 "slots of channel " #name " do not fit in 16 bits");    \
+  static type name##_slots[n];                                          \
+  struct process_chan name = { (uint8_t *)name##_slots, sizeof(type), n }
+
+/**
+ * Wait until the process is woken up on the channel.
+ *
+ * \hideinitializer
+ */
+#define PROCESS_CHAN_WAIT(ch)                                           \
+  PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_WAKEUP && data == (process_data_t)(ch))
+
+/**
+ * Reserve a slot, block the process while the channel is full.
+ *
+ * \param ch (struct process_chan *) The channel.
+ * \param ptr Pointer variable set to the reserved slot, keep it static
+ * if the process blocks before the commit.
+ *
+ * \hideinitializer
+ */
+#define PROCESS_CHAN_RESERVE(ch, ptr)                                   \
+  do {                                                                  \
+    while(((ptr) = process_chan_reserve(ch)) == NULL) {                 \
+      PROCESS_CHAN_WAIT(ch);                                            \
+    }                                                                   \
+  } while(0)
+
+/**
+ * Get the oldest committed slot, block the process while the channel
+ * is empty.
+ *
+ * \hideinitializer
+ */
+#define PROCESS_CHAN_PEEK(ch, ptr)                                      \
+  do {                                                                  \
+    while(((ptr) = process_chan_peek(ch)) == NULL) {                    \
+      PROCESS_CHAN_WAIT(ch);                                            \
+    }                                                                   \
+  } while(0)
+
+void *process_chan_reserve(struct process_chan *ch);
+void process_chan_commit(struct process_chan *ch);
+void *process_chan_peek(struct process_chan *ch);
+void process_chan_release(struct process_chan *ch);
+uint16_t process_chan_used(struct process_chan *ch);
+
+#endif /* __PROCESS_CHAN_H__ */
+
+/** @} */
+/** @} */
@@ -0,0 +1,244 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * \file
+ *         Event recorder.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "process-record.h"
+
+#if PROCESS_CONF_RECORD
+
+static struct process_record ring[PROCESS_CONF_RECORD_SIZE];
+static uint32_t head, count, lost;
+static uint64_t seed;
+
+static struct {
+  process_event_t ev;
+  uint16_t size;
+} payloads[PROCESS_CONF_RECORD_PAYLOADS];
+
+void (*process_record_sink)(const struct process_record *r);
+
+/*---------------------------------------------------------------------------*/
+/**
+ * FNV-1a hash, of payloads and process names.
+ */
+uint32_t
+process_record_hash(const void *buf, size_t len)
+{
+  const uint8_t *b = buf;
+  uint32_t h = 2166136261UL;
+
+  while(len-- > 0) {
+    h = (h ^ *b++) * 16777619UL;
+  }
+  return h;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Id of a process in the records, a hash of its name.
+ */
+uint16_t
+process_record_id(struct process *p)
+{
+  uint32_t h;
+
+  if(p == PROCESS_BROADCAST) {
+    return PROCESS_RECORD_BROADCAST;
+  }
+
+  h = process_record_hash(PROCESS_NAME_STRING(p),
+                          strlen(PROCESS_NAME_STRING(p)));
+  h = (h ^ (h >> 16)) & 0xffff;
+
+  /* Keep clear of the reserved ids */
+  if(h == PROCESS_RECORD_BROADCAST || h == PROCESS_RECORD_NONE) {
+    h = 1;
+  }
+  return h;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Record the data of an event as bytes.
+ *
+ * \param size Size of the data the event points to.
+ *
+ * \return 0 on success, -1 if the table is full.
+ */
+int
+process_record_payload(process_event_t ev, uint16_t size)
+{
+  int i;
+
+  for(i = 0; i < PROCESS_CONF_RECORD_PAYLOADS; i++) {
+    if(payloads[i].size == 0 || payloads[i].ev == ev) {
+      payloads[i].ev = ev;
+      payloads[i].size = size;
+      return 0;
+    }
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Size of the data recorded for an event, 0 if recorded by value.
+ */
+int
+process_record_payload_size(process_event_t ev)
+{
+  int i;
+
+  for(i = 0; i < PROCESS_CONF_RECORD_PAYLOADS && payloads[i].size != 0; i++) {
+    if(payloads[i].ev == ev) {
+      return payloads[i].size;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+append(const struct process_record *r)
+{
+  ring[head] = *r;
+  head = (head + 1) % PROCESS_CONF_RECORD_SIZE;
+  if(count < PROCESS_CONF_RECORD_SIZE) {
+    count++;
+  } else {
+    lost++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Append a record, called by the kernel.
+ */
+void
+process_record(uint8_t type, process_event_t ev,
+               struct process *receiver, process_data_t data)
+{
+  struct process_record r;
+  struct timespec now;
+  const uint8_t *bytes = data;
+  int size = 0, n;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  r.time = (uint32_t)now.tv_sec * 1000000UL + now.tv_nsec / 1000;
+  r.type = type;
+  r.ev = ev;
+  r.receiver = process_record_id(receiver);
+  r.u.ev.sender = process_record_sender() != NULL ?
+    process_record_id(process_record_sender()) : PROCESS_RECORD_NONE;
+
+  if(type == PROCESS_RECORD_POST) {
+    size = process_record_payload_size(ev);
+  }
+  if(size > 0 && data != NULL) {
+    r.u.ev.len = size;
+    r.u.ev.data = process_record_hash(data, size);
+  } else {
+    size = 0;
+    r.u.ev.len = 0;
+    r.u.ev.data = (uint32_t)(uintptr_t)data;
+  }
+
+  PROCESS_RECORD_CONF_CRITICAL_ENTER();
+
+  append(&r);
+  if(process_record_sink != NULL) {
+    process_record_sink(&r);
+  }
+
+  /* The bytes follow in payload records */
+  while(size > 0) {
+    n = size < (int)sizeof(r.u.bytes) ? size : (int)sizeof(r.u.bytes);
+    r.type = PROCESS_RECORD_PAYLOAD;
+    r.ev = n;
+    memset(r.u.bytes, 0, sizeof(r.u.bytes));
+    memcpy(r.u.bytes, bytes, n);
+    bytes += n;
+    size -= n;
+    append(&r);
+  }
+
+  PROCESS_RECORD_CONF_CRITICAL_EXIT();
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Empty the ring.
+ */
+void
+process_record_clear(void)
+{
+  PROCESS_RECORD_CONF_CRITICAL_ENTER();
+  head = count = lost = 0;
+  PROCESS_RECORD_CONF_CRITICAL_EXIT();
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Set the seed of the randomness of the run, e.g. of the simulated time
+ * of the host platform, written to the header for the replayer.
+ */
+void
+process_record_seed(uint64_t s)
+{
+  seed = s;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Number of records in the ring.
+ */
+uint32_t
+process_record_count(void)
+{
+  return count;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Write the ring out, a struct process_record_header followed by the
+ * records from the oldest to the newest.
+ */
+void
+process_record_dump(void (*write)(const void *buf, size_t len, void *arg),
+                    void *arg)
+{
+  struct process_record_header hdr;
+  uint32_t i, first;
+
+  hdr.magic = PROCESS_RECORD_MAGIC;
+  hdr.version = PROCESS_RECORD_VERSION;
+  hdr.size = sizeof(struct process_record);
+  hdr.count = count;
+  hdr.lost = lost;
+  hdr.seed = seed;
+  write(&hdr, sizeof(hdr), arg);
+
+  first = (head + PROCESS_CONF_RECORD_SIZE - count) % PROCESS_CONF_RECORD_SIZE;
+  for(i = 0; i < count; i++) {
+    write(&ring[(first + i) % PROCESS_CONF_RECORD_SIZE],
+          sizeof(struct process_record), arg);
+  }
+}
+/*---------------------------------------------------------------------------*/
+
+#endif /* PROCESS_CONF_RECORD */
+
+/** @} */
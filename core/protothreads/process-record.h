@@ -0,0 +1,160 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * \addtogroup process
+ * @{
+ */
+
+/**
+ * \defgroup processrecord Event recorder
+ * @{
+ *
+ * Records the order of the kernel activity, the posted events, poll
+ * requests, event deliveries and timer expiries, in a ring in RAM. The
+ * records are compact and fixed size; the ring keeps the latest ones.
+ * process_record_dump() writes the ring out, e.g. for the replayer of
+ * the host platform, which feeds the posts and polls coming from
+ * outside the processes back into the kernel and checks that the rest
+ * of the stream comes out the same.
+ *
+ * Processes are identified by a hash of their name, event data by its
+ * value. The data of events registered with process_record_payload() is
+ * recorded as bytes instead, so that it can be replayed.
+ *
+ * Enabled with PROCESS_CONF_RECORD.
+ */
+
+/**
+ * \file
+ *         Event recorder.
+ */
+
+#ifndef __PROCESS_RECORD_H__
+#define __PROCESS_RECORD_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "process.h"
+
+/** Record the kernel activity */
+#ifndef PROCESS_CONF_RECORD
+#define PROCESS_CONF_RECORD 0
+#endif /* PROCESS_CONF_RECORD */
+
+/** Number of records in the ring */
+#ifndef PROCESS_CONF_RECORD_SIZE
+#define PROCESS_CONF_RECORD_SIZE 256
+#endif /* PROCESS_CONF_RECORD_SIZE */
+
+/** Number of events that can have their data recorded as bytes */
+#ifndef PROCESS_CONF_RECORD_PAYLOADS
+#define PROCESS_CONF_RECORD_PAYLOADS 4
+#endif /* PROCESS_CONF_RECORD_PAYLOADS */
+
+/** Critical section around the ring, interrupts post and poll too */
+#ifndef PROCESS_RECORD_CONF_CRITICAL_ENTER
+#include "em_int.h"
+#define PROCESS_RECORD_CONF_CRITICAL_ENTER() INT_Disable()
+#define PROCESS_RECORD_CONF_CRITICAL_EXIT()  INT_Enable()
+#endif /* PROCESS_RECORD_CONF_CRITICAL_ENTER */
+
+/**
+ * Non-zero in an interrupt handler. Posts and polls made there, or
+ * between the processes, are recorded as coming from outside.
+ */
+#ifndef PROCESS_RECORD_CONF_IN_INTERRUPT
+#define PROCESS_RECORD_CONF_IN_INTERRUPT() PROCESS_CONF_IN_INTERRUPT()
+#endif /* PROCESS_RECORD_CONF_IN_INTERRUPT */
+
+#define PROCESS_RECORD_POST      1
+#define PROCESS_RECORD_POLL      2
+#define PROCESS_RECORD_DISPATCH  3
+#define PROCESS_RECORD_TIMER     4
+#define PROCESS_RECORD_PAYLOAD   5
+
+/** Process id of PROCESS_BROADCAST */
+#define PROCESS_RECORD_BROADCAST 0xffff
+/** Process id when not called from a process */
+#define PROCESS_RECORD_NONE      0
+
+#define PROCESS_RECORD_MAGIC     0x50524543UL
+#define PROCESS_RECORD_VERSION   2
+
+struct process_record {
+  /* Microseconds of CLOCK_MONOTONIC, wraps around */
+  uint32_t time;
+  uint8_t type;
+  /* Event, or the number of bytes of a payload record */
+  uint8_t ev;
+  uint16_t receiver;
+  union {
+    struct {
+      uint16_t sender;
+      /* Bytes of data in the payload records that follow */
+      uint16_t len;
+      /* Data value, or a hash of the payload */
+      uint32_t data;
+    } ev;
+    uint8_t bytes[8];
+  } u;
+};
+
+/** Header of process_record_dump() */
+struct process_record_header {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t size;
+  uint32_t count;
+  /* Records overwritten before the first one */
+  uint32_t lost;
+  /* Seed of the run, see process_record_seed() */
+  uint64_t seed;
+};
+
+#if PROCESS_CONF_RECORD
+
+#define PROCESS_RECORD(type, ev, receiver, data) \
+  process_record(type, ev, receiver, data)
+
+void process_record(uint8_t type, process_event_t ev,
+                    struct process *receiver, process_data_t data);
+int process_record_payload(process_event_t ev, uint16_t size);
+void process_record_clear(void);
+void process_record_seed(uint64_t seed);
+uint32_t process_record_count(void);
+void process_record_dump(void (*write)(const void *buf, size_t len, void *arg),
+                         void *arg);
+uint16_t process_record_id(struct process *p);
+struct process *process_record_sender(void);
+uint32_t process_record_hash(const void *buf, size_t len);
+int process_record_payload_size(process_event_t ev);
+
+/** Called with every new record if set, e.g. by the replayer */
+extern void (*process_record_sink)(const struct process_record *r);
+
+#else
+
+#define PROCESS_RECORD(type, ev, receiver, data)
+
+#endif /* PROCESS_CONF_RECORD */
+
+#endif /* __PROCESS_RECORD_H__ */
+
+/** @} */
+/** @} */
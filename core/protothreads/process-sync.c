@@ -0,0 +1,291 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * \file
+ *         Event-driven semaphores, mutexes and condition variables.
+ */
+
+#include "process-sync.h"
+
+/*---------------------------------------------------------------------------*/
+static void
+waitq_add(struct process_waitq *q, struct process *p)
+{
+  /* A process waits on one object at a time */
+  process_waitq_remove(p);
+
+  p->waitq = q;
+  p->waitnext = NULL;
+  if(q->tail != NULL) {
+    q->tail->waitnext = p;
+  } else {
+    q->head = p;
+  }
+  q->tail = p;
+}
+/*---------------------------------------------------------------------------*/
+static struct process *
+waitq_take(struct process_waitq *q)
+{
+  struct process *p;
+
+  /* Skip processes that are no longer running */
+  while((p = q->head) != NULL) {
+    q->head = p->waitnext;
+    if(q->head == NULL) {
+      q->tail = NULL;
+    }
+    p->waitq = NULL;
+    p->waitnext = NULL;
+    if(process_is_running(p)) {
+      return p;
+    }
+  }
+
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+void
+process_waitq_remove(struct process *p)
+{
+  struct process_waitq *q = p->waitq;
+  struct process *prev, *i;
+
+  if(q == NULL) {
+    return;
+  }
+
+  for(prev = NULL, i = q->head; i != NULL; prev = i, i = i->waitnext) {
+    if(i == p) {
+      if(prev != NULL) {
+        prev->waitnext = p->waitnext;
+      } else {
+        q->head = p->waitnext;
+      }
+      if(q->tail == p) {
+        q->tail = prev;
+      }
+      break;
+    }
+  }
+
+  p->waitq = NULL;
+  p->waitnext = NULL;
+}
+/*---------------------------------------------------------------------------*/
+void
+process_sem_init(struct process_sem *s, unsigned int count)
+{
+  s->count = count;
+  s->waitq.head = s->waitq.tail = NULL;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Take the semaphore or queue the current process.
+ *
+ * \return 0 if taken, 1 if the process has to wait for the wakeup.
+ */
+int
+process_sem_wait(struct process_sem *s)
+{
+  if(s->count > 0) {
+    s->count--;
+    return 0;
+  }
+
+  waitq_add(&s->waitq, PROCESS_CURRENT());
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+process_sem_signal(struct process_sem *s)
+{
+  struct process *p = waitq_take(&s->waitq);
+
+  if(p != NULL) {
+    /* Hand the count over to the waiter, it is the waiter's from now */
+    p->granted = s;
+    process_wakeup(p, s);
+  } else {
+    s->count++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Pass on a semaphore count the process was woken up with but never
+ * resumed to take. Called when the process exits.
+ */
+void
+process_sem_release(struct process *p)
+{
+  struct process_sem *s = p->granted;
+
+  if(s != NULL) {
+    p->granted = NULL;
+    process_sem_signal(s);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+mutex_own(struct process_mutex *m, struct process *p)
+{
+  m->owner = p;
+  if(p != NULL) {
+    m->next = p->mutexes;
+    p->mutexes = m;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+mutex_disown(struct process_mutex *m)
+{
+  struct process_mutex **i;
+
+  if(m->owner == NULL) {
+    return;
+  }
+
+  for(i = &m->owner->mutexes; *i != NULL; i = &(*i)->next) {
+    if(*i == m) {
+      *i = m->next;
+      break;
+    }
+  }
+
+  m->owner = NULL;
+  m->next = NULL;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Pass the mutex to the first waiter, or leave it unlocked.
+ */
+static void
+mutex_handover(struct process_mutex *m)
+{
+  struct process *p;
+
+  mutex_disown(m);
+
+  p = waitq_take(&m->waitq);
+  if(p != NULL) {
+    mutex_own(m, p);
+    process_wakeup(p, m);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+process_mutex_init(struct process_mutex *m)
+{
+  m->owner = NULL;
+  m->next = NULL;
+  m->waitq.head = m->waitq.tail = NULL;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Lock the mutex or queue the current process.
+ *
+ * \return 0 if locked, 1 if the process has to wait for the wakeup.
+ */
+int
+process_mutex_lock(struct process_mutex *m)
+{
+  if(m->owner == NULL) {
+    mutex_own(m, PROCESS_CURRENT());
+    return 0;
+  }
+
+  waitq_add(&m->waitq, PROCESS_CURRENT());
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+process_mutex_unlock(struct process_mutex *m)
+{
+  /* Hand the ownership over to the waiter */
+  mutex_handover(m);
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Hand the mutexes a process owns over to their waiters. Called when
+ * the process exits.
+ */
+void
+process_mutex_release(struct process *p)
+{
+  while(p->mutexes != NULL) {
+    mutex_handover(p->mutexes);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+process_cond_init(struct process_cond *c)
+{
+  c->waitq.head = c->waitq.tail = NULL;
+  c->mutex = NULL;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Queue the current process on the condition variable and unlock the
+ * mutex. The caller waits for the wakeup on the mutex.
+ */
+void
+process_cond_wait(struct process_cond *c, struct process_mutex *m)
+{
+  c->mutex = m;
+  waitq_add(&c->waitq, PROCESS_CURRENT());
+  process_mutex_unlock(m);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Move a signaled process over to the mutex. It is woken up when it
+ * gets the mutex, not just to find out that the mutex is taken.
+ */
+static void
+cond_requeue(struct process_cond *c, struct process *p)
+{
+  struct process_mutex *m = c->mutex;
+
+  if(m->owner == NULL) {
+    mutex_own(m, p);
+    process_wakeup(p, m);
+  } else {
+    waitq_add(&m->waitq, p);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+process_cond_signal(struct process_cond *c)
+{
+  struct process *p = waitq_take(&c->waitq);
+
+  if(p != NULL) {
+    cond_requeue(c, p);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+process_cond_broadcast(struct process_cond *c)
+{
+  struct process *p;
+
+  while((p = waitq_take(&c->waitq)) != NULL) {
+    cond_requeue(c, p);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/** @} */
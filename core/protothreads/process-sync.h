@@ -0,0 +1,181 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * \addtogroup process
+ * @{
+ */
+
+/**
+ * \defgroup processsync Process synchronization
+ * @{
+ *
+ * Semaphores, mutexes and condition variables for processes. Unlike
+ * pt-sem.h, a blocked process is put in a FIFO wait queue and is woken
+ * up with a PROCESS_EVENT_WAKEUP event when it gets the semaphore or
+ * the mutex, instead of checking the condition whenever it happens to
+ * run. A signal wakes up exactly one waiter, a broadcast all of them.
+ *
+ * Semaphore counts and mutex ownership are handed over to the woken
+ * process directly, so a process that comes later cannot overtake the
+ * ones already waiting. The mutexes a process still owns when it exits
+ * are handed over the same way, and so is a semaphore count a process
+ * exits with before it resumed from the wakeup. The wakeup is never
+ * lost, see process_wakeup().
+ *
+ * The wait macros can be used only in the body of a process. While
+ * blocked, the process ignores all other events except
+ * PROCESS_EVENT_EXIT.
+ */
+
+/**
+ * \file
+ *         Event-driven semaphores, mutexes and condition variables.
+ */
+
+#ifndef __PROCESS_SYNC_H__
+#define __PROCESS_SYNC_H__
+
+#include "process.h"
+
+struct process_waitq {
+  struct process *head, *tail;
+};
+
+struct process_sem {
+  unsigned int count;
+  struct process_waitq waitq;
+};
+
+struct process_mutex {
+  struct process *owner;
+  struct process_mutex *next;   /* Next mutex of the owner */
+  struct process_waitq waitq;
+};
+
+struct process_cond {
+  struct process_waitq waitq;
+  struct process_mutex *mutex;
+};
+
+/**
+ * Wait until the process is woken up on the object.
+ *
+ * \hideinitializer
+ */
+#define PROCESS_SYNC_WAIT(obj)                                          \
+  PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_WAKEUP && data == (process_data_t)(obj))
+
+/**
+ * Initialize a semaphore with the given count.
+ *
+ * \hideinitializer
+ */
+#define PROCESS_SEM_INIT(s, c) process_sem_init(s, c)
+
+/**
+ * Wait for a semaphore, block if the count is zero.
+ *
+ * \hideinitializer
+ */
+#define PROCESS_SEM_WAIT(s)                     \
+  do {                                          \
+    if(process_sem_wait(s)) {                   \
+      PROCESS_SYNC_WAIT(s);                     \
+      PROCESS_CURRENT()->granted = NULL;        \
+    }                                           \
+  } while(0)
+
+/**
+ * Signal a semaphore, wakes up the first waiter if any. Can also be
+ * used outside of processes, but not from interrupts.
+ *
+ * \hideinitializer
+ */
+#define PROCESS_SEM_SIGNAL(s) process_sem_signal(s)
+
+#define PROCESS_MUTEX_INIT(m) process_mutex_init(m)
+
+/**
+ * Lock a mutex, block if it is owned by another process.
+ *
+ * \hideinitializer
+ */
+#define PROCESS_MUTEX_LOCK(m)                   \
+  do {                                          \
+    if(process_mutex_lock(m)) {                 \
+      PROCESS_SYNC_WAIT(m);                     \
+    }                                           \
+  } while(0)
+
+/**
+ * Unlock a mutex, the ownership passes to the first waiter if any.
+ *
+ * \hideinitializer
+ */
+#define PROCESS_MUTEX_UNLOCK(m) process_mutex_unlock(m)
+
+#define PROCESS_COND_INIT(c) process_cond_init(c)
+
+/**
+ * Unlock the mutex, wait for the condition variable to be signaled
+ * and lock the mutex again. A signaled process is moved to the wait
+ * queue of the mutex, it is woken up only once it owns the mutex.
+ *
+ * \hideinitializer
+ */
+#define PROCESS_COND_WAIT(c, m)                 \
+  do {                                          \
+    process_cond_wait(c, m);                    \
+    PROCESS_SYNC_WAIT(m);                       \
+  } while(0)
+
+/**
+ * Wake up the first process waiting on the condition variable.
+ *
+ * \hideinitializer
+ */
+#define PROCESS_COND_SIGNAL(c) process_cond_signal(c)
+
+/**
+ * Wake up all processes waiting on the condition variable.
+ *
+ * \hideinitializer
+ */
+#define PROCESS_COND_BROADCAST(c) process_cond_broadcast(c)
+
+void process_waitq_remove(struct process *p);
+void process_mutex_release(struct process *p);
+void process_sem_release(struct process *p);
+
+void process_sem_init(struct process_sem *s, unsigned int count);
+int process_sem_wait(struct process_sem *s);
+void process_sem_signal(struct process_sem *s);
+
+void process_mutex_init(struct process_mutex *m);
+int process_mutex_lock(struct process_mutex *m);
+void process_mutex_unlock(struct process_mutex *m);
+
+void process_cond_init(struct process_cond *c);
+void process_cond_wait(struct process_cond *c, struct process_mutex *m);
+void process_cond_signal(struct process_cond *c);
+void process_cond_broadcast(struct process_cond *c);
+
+#endif /* __PROCESS_SYNC_H__ */
+
+/** @} */
+/** @} */
@@ -0,0 +1,185 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * \file
+ *         Scheduling trace.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "process-trace.h"
+
+#if PROCESS_CONF_TRACE
+
+#if PROCESS_CONF_TRACE_SIZE & (PROCESS_CONF_TRACE_SIZE - 1)
+#error "PROCESS_CONF_TRACE_SIZE must be a power of two"
+#endif
+
+/* Trace points the cost is measured over, the best of the rounds */
+#define COST_POINTS 32
+#define COST_ROUNDS 4
+
+static struct process_trace_record ring[PROCESS_CONF_TRACE_SIZE];
+static uint32_t head;
+static uint32_t hz;
+static struct timespec slept;
+
+uint32_t process_trace_cost;
+
+/*---------------------------------------------------------------------------*/
+/**
+ * Start the time stamps and measure the cost of a trace point.
+ *
+ * \param freq Frequency of PROCESS_TRACE_CONF_TIMESTAMP().
+ */
+void
+process_trace_init(uint32_t freq)
+{
+  uint32_t start, cost;
+  int i, j;
+
+  PROCESS_TRACE_CONF_TIMESTAMP_INIT();
+  hz = freq;
+
+  process_trace_cost = UINT32_MAX;
+  for(j = 0; j < COST_ROUNDS; j++) {
+    start = PROCESS_TRACE_CONF_TIMESTAMP();
+    for(i = 0; i < COST_POINTS; i++) {
+      process_trace(0, 0, NULL);
+    }
+    cost = (PROCESS_TRACE_CONF_TIMESTAMP() - start) / COST_POINTS;
+    if(cost < process_trace_cost) {
+      process_trace_cost = cost;
+    }
+  }
+
+  process_trace_clear();
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Append a record, called by the trace points.
+ */
+void
+process_trace(uint8_t type, process_event_t ev, const void *arg)
+{
+  uint32_t time = PROCESS_TRACE_CONF_TIMESTAMP();
+  struct process_trace_record *r;
+
+  r = &ring[__atomic_fetch_add(&head, 1, __ATOMIC_RELAXED) &
+            (PROCESS_CONF_TRACE_SIZE - 1)];
+  r->time = time;
+  r->arg = (uint32_t)(uintptr_t)arg;
+  r->type = type;
+  r->ev = ev;
+  r->queue = process_ctx->nevents;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * The core goes to sleep, called by LPM_WaitForEvent().
+ */
+void
+process_trace_sleep(void)
+{
+  clock_gettime(CLOCK_MONOTONIC, &slept);
+  process_trace(PROCESS_TRACE_SLEEP, 0, NULL);
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * The core woke up, the record has the time slept.
+ */
+void
+process_trace_wake(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  process_trace(PROCESS_TRACE_WAKE, 0,
+                (const void *)(uintptr_t)((now.tv_sec - slept.tv_sec) * 1000000 +
+                                          (now.tv_nsec - slept.tv_nsec) / 1000));
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Empty the ring.
+ */
+void
+process_trace_clear(void)
+{
+  __atomic_store_n(&head, 0, __ATOMIC_RELAXED);
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Number of records in the ring.
+ */
+uint32_t
+process_trace_count(void)
+{
+  uint32_t n = __atomic_load_n(&head, __ATOMIC_RELAXED);
+
+  return n < PROCESS_CONF_TRACE_SIZE ? n : PROCESS_CONF_TRACE_SIZE;
+}
+/*---------------------------------------------------------------------------*/
+/**
+ * Write the ring out, see struct process_trace_header. Records written
+ * meanwhile may be torn, dump when the system is idle.
+ */
+void
+process_trace_dump(void (*write)(const void *buf, size_t len, void *arg),
+                   void *arg)
+{
+  struct process_trace_header hdr;
+  struct process *p;
+  uint32_t i, end, addr;
+  size_t len;
+  uint8_t n;
+
+  end = __atomic_load_n(&head, __ATOMIC_RELAXED);
+
+  hdr.magic = PROCESS_TRACE_MAGIC;
+  hdr.version = PROCESS_TRACE_VERSION;
+  hdr.size = sizeof(struct process_trace_record);
+  hdr.count = end < PROCESS_CONF_TRACE_SIZE ? end : PROCESS_CONF_TRACE_SIZE;
+  hdr.lost = end - hdr.count;
+  hdr.hz = hz;
+  hdr.cost = process_trace_cost;
+  hdr.budget = PROCESS_TRACE_CONF_BUDGET;
+  hdr.processes = 0;
+  for(p = PROCESS_LIST(); p != NULL; p = p->next) {
+    hdr.processes++;
+  }
+  write(&hdr, sizeof(hdr), arg);
+
+  for(i = end - hdr.count; i != end; i++) {
+    write(&ring[i & (PROCESS_CONF_TRACE_SIZE - 1)],
+          sizeof(struct process_trace_record), arg);
+  }
+
+  for(p = PROCESS_LIST(); p != NULL; p = p->next) {
+    addr = (uint32_t)(uintptr_t)p;
+    len = strlen(PROCESS_NAME_STRING(p));
+    n = len < UINT8_MAX ? len : UINT8_MAX;
+    write(&addr, sizeof(addr), arg);
+    write(&n, sizeof(n), arg);
+    write(PROCESS_NAME_STRING(p), n, arg);
+  }
+}
+/*---------------------------------------------------------------------------*/
+
+#endif /* PROCESS_CONF_TRACE */
+
+/** @} */
@@ -0,0 +1,176 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * \addtogroup process
+ * @{
+ */
+
+/**
+ * \defgroup processtrace Scheduling trace
+ * @{
+ *
+ * Trace points in the scheduler, the system timer and the low power
+ * mode write fixed size records to a ring in RAM: the start and the end
+ * of every event delivery, the polls, the posts with the length of the
+ * event queue, the timer expiries and the sleeps. The ring keeps the
+ * latest records. process_trace_dump() writes it out together with the
+ * names of the processes; trace2json of the host platform turns that into
+ * a timeline for chrome://tracing or Perfetto.
+ *
+ * The trace points take no lock, a slot of the ring is claimed with an
+ * atomic increment. A trace point, the call included, must cost no more
+ * than PROCESS_TRACE_CONF_BUDGET counter ticks. process_trace_init()
+ * measures it on the running system into process_trace_cost, trace2json
+ * warns when it is over.
+ *
+ * Time stamps come from PROCESS_TRACE_CONF_TIMESTAMP(), the DWT cycle
+ * counter on the target. It stops while the core sleeps, the trace point
+ * at wake-up records the time slept from CLOCK_MONOTONIC instead. It
+ * follows the core clock, keep the HFRCO band fixed while tracing.
+ *
+ * Enabled with PROCESS_CONF_TRACE.
+ */
+
+/**
+ * \file
+ *         Scheduling trace.
+ */
+
+#ifndef __PROCESS_TRACE_H__
+#define __PROCESS_TRACE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "process.h"
+
+/** Trace the scheduling */
+#ifndef PROCESS_CONF_TRACE
+#define PROCESS_CONF_TRACE 0
+#endif /* PROCESS_CONF_TRACE */
+
+/** Number of records in the ring, a power of two */
+#ifndef PROCESS_CONF_TRACE_SIZE
+#define PROCESS_CONF_TRACE_SIZE 512
+#endif /* PROCESS_CONF_TRACE_SIZE */
+
+/**
+ * Free running 32-bit counter of the time stamps, and its set up, the
+ * cycle counter of the core. The platform defines it for its core, see
+ * platform/efm32/common/process_conf.h.
+ */
+#ifndef PROCESS_TRACE_CONF_TIMESTAMP
+#if defined(__x86_64__) || defined(__i386__)
+#define PROCESS_TRACE_CONF_TIMESTAMP() ((uint32_t)__builtin_ia32_rdtsc())
+#elif defined(__aarch64__)
+static inline uint32_t
+process_trace_cntvct(void)
+{
+  uint64_t t;
+  __asm__ volatile("mrs %0, cntvct_el0" : "=r"(t));
+  return (uint32_t)t;
+}
+#define PROCESS_TRACE_CONF_TIMESTAMP() process_trace_cntvct()
+#else
+#define PROCESS_TRACE_CONF_TIMESTAMP() 0
+#endif
+#endif /* PROCESS_TRACE_CONF_TIMESTAMP */
+
+#ifndef PROCESS_TRACE_CONF_TIMESTAMP_INIT
+#define PROCESS_TRACE_CONF_TIMESTAMP_INIT()
+#endif /* PROCESS_TRACE_CONF_TIMESTAMP_INIT */
+
+/**
+ * Cost of a trace point allowed, counter ticks. On x86 hosts reading the
+ * time stamp counter alone takes about 40.
+ */
+#ifndef PROCESS_TRACE_CONF_BUDGET
+#define PROCESS_TRACE_CONF_BUDGET 128
+#endif /* PROCESS_TRACE_CONF_BUDGET */
+
+#define PROCESS_TRACE_BEGIN      1
+#define PROCESS_TRACE_END        2
+#define PROCESS_TRACE_POLL       3
+#define PROCESS_TRACE_POST       4
+#define PROCESS_TRACE_TIMER      5
+#define PROCESS_TRACE_SLEEP      6
+#define PROCESS_TRACE_WAKE       7
+
+#define PROCESS_TRACE_MAGIC      0x50545243UL
+#define PROCESS_TRACE_VERSION    1
+
+struct process_trace_record {
+  /* PROCESS_TRACE_CONF_TIMESTAMP() */
+  uint32_t time;
+  /* Process, timer, or microseconds slept */
+  uint32_t arg;
+  uint8_t type;
+  uint8_t ev;
+  /* Events queued */
+  uint16_t queue;
+};
+
+/**
+ * Header of process_trace_dump(). The records follow, from the oldest,
+ * then the processes, each the address of the process, the length of
+ * its name and the name.
+ */
+struct process_trace_header {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t size;
+  uint32_t count;
+  /* Records overwritten before the first one */
+  uint32_t lost;
+  /* Frequency of the time stamps */
+  uint32_t hz;
+  /* Measured cost of a trace point and its budget, ticks */
+  uint32_t cost;
+  uint32_t budget;
+  uint32_t processes;
+};
+
+#if PROCESS_CONF_TRACE
+
+#define PROCESS_TRACE(type, ev, arg) process_trace(type, ev, arg)
+#define PROCESS_TRACE_GO_SLEEP()     process_trace_sleep()
+#define PROCESS_TRACE_WAKE_UP()      process_trace_wake()
+
+extern uint32_t process_trace_cost;
+
+void process_trace_init(uint32_t hz);
+void process_trace(uint8_t type, process_event_t ev, const void *arg);
+void process_trace_sleep(void);
+void process_trace_wake(void);
+void process_trace_clear(void);
+uint32_t process_trace_count(void);
+void process_trace_dump(void (*write)(const void *buf, size_t len, void *arg),
+                        void *arg);
+
+#else
+
+#define PROCESS_TRACE(type, ev, arg)
+#define PROCESS_TRACE_GO_SLEEP()
+#define PROCESS_TRACE_WAKE_UP()
+
+#endif /* PROCESS_CONF_TRACE */
+
+#endif /* __PROCESS_TRACE_H__ */
+
+/** @} */
+/** @} */
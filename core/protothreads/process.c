@@ -46,33 +46,19 @@
 #include <stdio.h>
 
 #include "process.h"
-#include "arg.h"
+#include "process-sync.h"
+#include "mempool.h"
+#include "process-record.h"
+#include "process-trace.h"
 
 /*
- * Pointer to the currently running process structure.
+ * The scheduler state, the process list and the event queue, of the
+ * default instance and a pointer to the active one.
  */
-struct process *process_list = NULL;
-struct process *process_current = NULL;
- 
-static process_event_t lastevent;
-
-/*
- * Structure used for keeping the queue of active events.
- */
-struct event_data {
-  process_event_t ev;
-  process_data_t data;
-  struct process *p;
+struct process_context process_default_context = {
+  .lastevent = PROCESS_EVENT_MAX
 };
-
-static process_num_events_t nevents, fevent;
-static struct event_data events[PROCESS_CONF_NUMEVENTS];
-
-#if PROCESS_CONF_STATS
-process_num_events_t process_maxevents;
-#endif
-
-static volatile unsigned char poll_requested;
+PROCESS_CONF_THREAD_LOCAL struct process_context *process_ctx = &process_default_context;
 
 #define PROCESS_STATE_NONE        0
 #define PROCESS_STATE_RUNNING     1
@@ -91,7 +77,7 @@ static void call_process(struct process *p, process_event_t ev, process_data_t d
 process_event_t
 process_alloc_event(void)
 {
-  return lastevent++;
+  return process_ctx->lastevent++;
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -101,15 +87,21 @@ process_start(struct process *p, const char *arg)
 
   /* First make sure that we don't try to start a process that is
      already running. */
-  for(q = process_list; q != p && q != NULL; q = q->next);
+  for(q = process_ctx->list; q != p && q != NULL; q = q->next);
 
   /* If we found the process on the process list, we bail out. */
   if(q == p) {
     return;
   }
+  p->waitq = NULL;
+  p->waitnext = NULL;
+  p->mutexes = NULL;
+  p->granted = NULL;
+  p->wakeup = NULL;
+
   /* Put on the procs list.*/
-  p->next = process_list;
-  process_list = p;
+  p->next = process_ctx->list;
+  process_ctx->list = p;
   p->state = PROCESS_STATE_RUNNING;
   PT_INIT(&p->pt);
 
@@ -119,21 +111,45 @@ process_start(struct process *p, const char *arg)
   process_post_synch(p, PROCESS_EVENT_INIT, (process_data_t)arg);
 }
 /*---------------------------------------------------------------------------*/
+void
+process_restore(struct process *p, const struct pt *pt)
+{
+  struct process *q;
+
+  for(q = process_ctx->list; q != p && q != NULL; q = q->next);
+
+  if(q == p) {
+    return;
+  }
+
+  p->next = process_ctx->list;
+  process_ctx->list = p;
+  p->state = PROCESS_STATE_RUNNING;
+  p->needspoll = 0;
+  p->wakeup = NULL;
+  p->pt = *pt;
+
+  PRINTF("process: restoring '%s'\n", PROCESS_NAME_STRING(p));
+}
+/*---------------------------------------------------------------------------*/
 static void
 exit_process(struct process *p, struct process *fromprocess)
 {
   register struct process *q;
-  struct process *old_current = process_current;
+  struct process *old_current = process_ctx->current;
 
   PRINTF("process: exit_process '%s'\n", PROCESS_NAME_STRING(p));
 
   /* Make sure the process is in the process list before we try to
      exit it. */
-  for(q = process_list; q != p && q != NULL; q = q->next);
+  for(q = process_ctx->list; q != p && q != NULL; q = q->next);
   if(q == NULL) {
     return;
   }
 
+  /* Do not leave the process behind in a wait queue. */
+  process_waitq_remove(p);
+
   if(process_is_running(p)) {
     /* Process was running */
     p->state = PROCESS_STATE_NONE;
@@ -143,7 +159,7 @@ exit_process(struct process *p, struct process *fromprocess)
      * this process is about to exit. This will allow services to
      * deallocate state associated with this process.
      */
-    for(q = process_list; q != NULL; q = q->next) {
+    for(q = process_ctx->list; q != NULL; q = q->next) {
       if(p != q) {
 	call_process(q, PROCESS_EVENT_EXITED, (process_data_t)p);
       }
@@ -151,15 +167,24 @@ exit_process(struct process *p, struct process *fromprocess)
 
     if(p->thread != NULL && p != fromprocess) {
       /* Post the exit event to the process that is about to exit. */
-      process_current = p;
+      process_ctx->current = p;
       p->thread(&p->pt, PROCESS_EVENT_EXIT, NULL);
     }
   }
 
-  if(p == process_list) {
-    process_list = process_list->next;
+  /* Hand the mutexes over to their waiters, after the exit handler
+     has had the chance to unlock them, and give back a semaphore
+     count the process was woken up with but did not get to. */
+  process_mutex_release(p);
+  process_sem_release(p);
+
+  /* Release the pool blocks the process still owns. */
+  mempool_reclaim(p);
+
+  if(p == process_ctx->list) {
+    process_ctx->list = process_ctx->list->next;
   } else {
-    for(q = process_list; q != NULL; q = q->next) {
+    for(q = process_ctx->list; q != NULL; q = q->next) {
       if(q->next == p) {
 	q->next = p->next;
 	break;
@@ -167,7 +192,7 @@ exit_process(struct process *p, struct process *fromprocess)
     }
   }
 
-  process_current = old_current;
+  process_ctx->current = old_current;
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -184,9 +209,12 @@ call_process(struct process *p, process_event_t ev, process_data_t data)
   if((p->state & PROCESS_STATE_RUNNING) &&
      p->thread != NULL) {
     PRINTF("process: calling process '%s' with event %d\n", PROCESS_NAME_STRING(p), ev);
-    process_current = p;
+    PROCESS_RECORD(PROCESS_RECORD_DISPATCH, ev, p, data);
+    process_ctx->current = p;
     p->state = PROCESS_STATE_CALLED;
+    PROCESS_TRACE(PROCESS_TRACE_BEGIN, ev, p);
     ret = p->thread(&p->pt, ev, data);
+    PROCESS_TRACE(PROCESS_TRACE_END, ev, p);
     if(ret == PT_EXITED ||
        ret == PT_ENDED ||
        ev == PROCESS_EVENT_EXIT) {
@@ -197,6 +225,22 @@ call_process(struct process *p, process_event_t ev, process_data_t data)
   }
 }
 /*---------------------------------------------------------------------------*/
+#if PROCESS_CONF_RECORD
+/*
+ * The process being called, NULL in an interrupt or between the
+ * processes, where the current process is left from the last call.
+ */
+struct process *
+process_record_sender(void)
+{
+  if(PROCESS_RECORD_CONF_IN_INTERRUPT() || process_ctx->current == NULL ||
+     process_ctx->current->state != PROCESS_STATE_CALLED) {
+    return NULL;
+  }
+  return process_ctx->current;
+}
+#endif /* PROCESS_CONF_RECORD */
+/*---------------------------------------------------------------------------*/
 void
 process_exit(struct process *p)
 {
@@ -204,16 +248,32 @@ process_exit(struct process *p)
 }
 /*---------------------------------------------------------------------------*/
 void
-process_init(void)
+process_context_init(struct process_context *c)
 {
-  lastevent = PROCESS_EVENT_MAX;
+  c->lastevent = PROCESS_EVENT_MAX;
 
-  nevents = fevent = 0;
+  c->nevents = c->fevent = 0;
 #if PROCESS_CONF_STATS
-  process_maxevents = 0;
+  c->maxevents = 0;
 #endif /* PROCESS_CONF_STATS */
+  c->poll_requested = 0;
 
-  process_current = process_list = NULL;
+  c->current = c->list = NULL;
+}
+/*---------------------------------------------------------------------------*/
+void
+process_init(void)
+{
+  process_context_init(&process_default_context);
+}
+/*---------------------------------------------------------------------------*/
+struct process_context *
+process_context_select(struct process_context *c)
+{
+  struct process_context *old = process_ctx;
+
+  process_ctx = c;
+  return old;
 }
 /*---------------------------------------------------------------------------*/
 /*
@@ -224,10 +284,17 @@ static void
 do_poll(void)
 {
   struct process *p;
+  process_data_t data;
 
-  poll_requested = 0;
+  PROCESS_TRACE(PROCESS_TRACE_POLL, PROCESS_EVENT_POLL, NULL);
+  process_ctx->poll_requested = 0;
   /* Call the processes that needs to be polled. */
-  for(p = process_list; p != NULL; p = p->next) {
+  for(p = process_ctx->list; p != NULL; p = p->next) {
+    if(p->wakeup != NULL) {
+      data = p->wakeup;
+      p->wakeup = NULL;
+      call_process(p, PROCESS_EVENT_WAKEUP, data);
+    }
     if(p->needspoll) {
       p->state = PROCESS_STATE_RUNNING;
       p->needspoll = 0;
@@ -244,10 +311,11 @@ do_poll(void)
 static void
 do_event(void)
 {
-  static process_event_t ev;
-  static process_data_t data;
-  static struct process *receiver;
-  static struct process *p;
+  struct process_context *c = process_ctx;
+  process_event_t ev;
+  process_data_t data;
+  struct process *receiver;
+  struct process *p;
   
   /*
    * If there are any events in the queue, take the first one and walk
@@ -257,27 +325,27 @@ do_event(void)
    * call the poll handlers inbetween.
    */
 
-  if(nevents > 0) {
+  if(c->nevents > 0) {
     
     /* There are events that we should deliver. */
-    ev = events[fevent].ev;
+    ev = c->events[c->fevent].ev;
     
-    data = events[fevent].data;
-    receiver = events[fevent].p;
+    data = c->events[c->fevent].data;
+    receiver = c->events[c->fevent].p;
 
     /* Since we have seen the new event, we move pointer upwards
        and decrese the number of events. */
-    fevent = (fevent + 1) % PROCESS_CONF_NUMEVENTS;
-    --nevents;
+    c->fevent = (c->fevent + 1) % PROCESS_CONF_NUMEVENTS;
+    --c->nevents;
 
     /* If this is a broadcast event, we deliver it to all events, in
        order of their priority. */
     if(receiver == PROCESS_BROADCAST) {
-      for(p = process_list; p != NULL; p = p->next) {
+      for(p = process_ctx->list; p != NULL; p = p->next) {
 
 	/* If we have been requested to poll a process, we do this in
 	   between processing the broadcast event. */
-	if(poll_requested) {
+	if(c->poll_requested) {
 	  do_poll();
 	}
 	call_process(p, ev, data);
@@ -298,86 +366,154 @@ do_event(void)
 }
 /*---------------------------------------------------------------------------*/
 int
-process_run(void)
+process_context_run(struct process_context *c)
 {
+  struct process_context *old = process_context_select(c);
+
   /* Process poll events. */
-  if(poll_requested) {
+  if(c->poll_requested) {
     do_poll();
   }
 
   /* Process one event from the queue */
   do_event();
 
-  return nevents + poll_requested;
+  process_context_select(old);
+
+  return c->nevents + c->poll_requested;
+}
+/*---------------------------------------------------------------------------*/
+int
+process_run(void)
+{
+  return process_context_run(process_ctx);
+}
+/*---------------------------------------------------------------------------*/
+int
+process_context_nevents(struct process_context *c)
+{
+  return c->nevents + c->poll_requested;
 }
 /*---------------------------------------------------------------------------*/
 int
 process_nevents(void)
 {
-  return nevents + poll_requested;
+  return process_context_nevents(process_ctx);
 }
 /*---------------------------------------------------------------------------*/
 int
-process_post(struct process *p, process_event_t ev, process_data_t data)
+process_context_post(struct process_context *c, struct process *p,
+                     process_event_t ev, process_data_t data)
 {
-  static process_num_events_t snum;
+  process_num_events_t snum;
 
   if(PROCESS_CURRENT() == NULL) {
     PRINTF("process_post: NULL process posts event %d to process '%s', nevents %d\n",
-	   ev,PROCESS_NAME_STRING(p), nevents);
+	   ev,PROCESS_NAME_STRING(p), c->nevents);
   } else {
     PRINTF("process_post: Process '%s' posts event %d to process '%s', nevents %d\n",
 	   PROCESS_NAME_STRING(PROCESS_CURRENT()), ev,
-	   p == PROCESS_BROADCAST? "<broadcast>": PROCESS_NAME_STRING(p), nevents);
+	   p == PROCESS_BROADCAST? "<broadcast>": PROCESS_NAME_STRING(p), c->nevents);
   }
   
-  if(nevents == PROCESS_CONF_NUMEVENTS) {
+  if(c->nevents == PROCESS_CONF_NUMEVENTS) {
 #if DEBUG
     if(p == PROCESS_BROADCAST) {
-      printf("soft panic: event queue is full when broadcast event %d was posted from %s\n", ev, PROCESS_NAME_STRING(process_current));
+      printf("soft panic: event queue is full when broadcast event %d was posted from %s\n", ev, PROCESS_NAME_STRING(process_ctx->current));
     } else {
-      printf("soft panic: event queue is full when event %d was posted to %s frpm %s\n", ev, PROCESS_NAME_STRING(p), PROCESS_NAME_STRING(process_current));
+      printf("soft panic: event queue is full when event %d was posted to %s frpm %s\n", ev, PROCESS_NAME_STRING(p), PROCESS_NAME_STRING(process_ctx->current));
     }
 #endif /* DEBUG */
     return PROCESS_ERR_FULL;
   }
   
-  snum = (process_num_events_t)(fevent + nevents) % PROCESS_CONF_NUMEVENTS;
-  events[snum].ev = ev;
-  events[snum].data = data;
-  events[snum].p = p;
-  ++nevents;
+  snum = (process_num_events_t)(c->fevent + c->nevents) % PROCESS_CONF_NUMEVENTS;
+  c->events[snum].ev = ev;
+  c->events[snum].data = data;
+  c->events[snum].p = p;
+  ++c->nevents;
+
+  PROCESS_RECORD(PROCESS_RECORD_POST, ev, p, data);
+  PROCESS_TRACE(PROCESS_TRACE_POST, ev, p);
 
 #if PROCESS_CONF_STATS
-  if(nevents > process_maxevents) {
-    process_maxevents = nevents;
+  if(c->nevents > c->maxevents) {
+    c->maxevents = c->nevents;
   }
 #endif /* PROCESS_CONF_STATS */
+
+  if(c->notify != NULL) {
+    c->notify(c);
+  }
   
   return PROCESS_ERR_OK;
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * The instance process_post() and process_poll() act on: the active
+ * one, the default one from an interrupt.
+ */
+static struct process_context *
+post_context(void)
+{
+  return PROCESS_CONF_IN_INTERRUPT() ? &process_default_context : process_ctx;
+}
+/*---------------------------------------------------------------------------*/
+int
+process_post(struct process *p, process_event_t ev, process_data_t data)
+{
+  return process_context_post(post_context(), p, ev, data);
+}
+/*---------------------------------------------------------------------------*/
 void
 process_post_synch(struct process *p, process_event_t ev, process_data_t data)
 {
-  struct process *caller = process_current;
+  struct process *caller = process_ctx->current;
 
   call_process(p, ev, data);
-  process_current = caller;
+  process_ctx->current = caller;
 }
 /*---------------------------------------------------------------------------*/
 void
-process_poll(struct process *p)
+process_wakeup(struct process *p, void *obj)
+{
+  struct process_context *c;
+
+  if(process_post(p, PROCESS_EVENT_WAKEUP, (process_data_t)obj) == PROCESS_ERR_OK) {
+    return;
+  }
+
+  /* The queue is full, leave the wakeup to do_poll() */
+  c = post_context();
+  p->wakeup = (process_data_t)obj;
+  c->poll_requested = 1;
+  if(c->notify != NULL) {
+    c->notify(c);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+process_context_poll(struct process_context *c, struct process *p)
 {
   if(p != NULL) {
     if(p->state == PROCESS_STATE_RUNNING ||
        p->state == PROCESS_STATE_CALLED) {
       p->needspoll = 1;
-      poll_requested = 1;
+      c->poll_requested = 1;
+      PROCESS_RECORD(PROCESS_RECORD_POLL, PROCESS_EVENT_POLL, p, NULL);
+      if(c->notify != NULL) {
+        c->notify(c);
+      }
     }
   }
 }
 /*---------------------------------------------------------------------------*/
+void
+process_poll(struct process *p)
+{
+  process_context_poll(post_context(), p);
+}
+/*---------------------------------------------------------------------------*/
 int
 process_is_running(struct process *p)
 {
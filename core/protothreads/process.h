@@ -90,6 +90,25 @@ typedef unsigned char process_num_events_t;
 #define PROCESS_CONF_NUMEVENTS 32
 #endif /* PROCESS_CONF_NUMEVENTS */
 
+/**
+ * Non-zero in an interrupt handler, defined by the platform, see
+ * platform/efm32/common/process_conf.h. On the host the interrupts are
+ * threads, with PROCESS_CONF_THREAD_LOCAL they see the default instance
+ * anyway.
+ */
+#ifndef PROCESS_CONF_IN_INTERRUPT
+#define PROCESS_CONF_IN_INTERRUPT() 0
+#endif /* PROCESS_CONF_IN_INTERRUPT */
+
+/**
+ * Storage class of the active instance and the other per-thread state
+ * of the kernel, e.g. __thread for running instances on several threads
+ * of a host. Empty by default.
+ */
+#ifndef PROCESS_CONF_THREAD_LOCAL
+#define PROCESS_CONF_THREAD_LOCAL
+#endif /* PROCESS_CONF_THREAD_LOCAL */
+
 #define PROCESS_EVENT_NONE            0x80
 #define PROCESS_EVENT_INIT            0x81
 #define PROCESS_EVENT_POLL            0x82
@@ -100,7 +119,8 @@ typedef unsigned char process_num_events_t;
 #define PROCESS_EVENT_EXITED          0x87
 #define PROCESS_EVENT_TIMER           0x88
 #define PROCESS_EVENT_COM             0x89
-#define PROCESS_EVENT_MAX             0x8a
+#define PROCESS_EVENT_WAKEUP          0x8a
+#define PROCESS_EVENT_MAX             0x8b
 
 #define PROCESS_BROADCAST NULL
 #define PROCESS_ZOMBIE ((struct process *)0x1)
@@ -314,6 +334,10 @@ static PT_THREAD(process_thread_##name(struct pt *process_pt,	\
 
 /** @} */
 
+struct process_waitq;
+struct process_mutex;
+struct process_sem;
+
 struct process {
   struct process *next;
 #if PROCESS_CONF_NO_PROCESS_NAMES
@@ -325,8 +349,93 @@ struct process {
   PT_THREAD((* thread)(struct pt *, process_event_t, process_data_t));
   struct pt pt;
   unsigned char state, needspoll;
+  /* Wait queue the process is blocked on, see process-sync.h */
+  struct process_waitq *waitq;
+  struct process *waitnext;
+  /* Mutexes owned by the process */
+  struct process_mutex *mutexes;
+  /* Semaphore count handed over, until the process resumes */
+  struct process_sem *granted;
+  /* Wakeup left to the poll handler when the event queue was full */
+  process_data_t wakeup;
+};
+
+/**
+ * \name Kernel instances
+ *
+ * All scheduler state lives in a struct process_context. The functions
+ * of this module act on the active context, which is the default
+ * context unless another one is being run with process_context_run().
+ * Processes running in an instance therefore use the usual API and only
+ * see their own instance. process_post() and process_poll() called from
+ * an interrupt act on the default instance, whichever one the interrupt
+ * has preempted; use process_context_post() and process_context_poll()
+ * to reach another instance.
+ * @{
+ */
+
+struct process_context_event {
+  process_event_t ev;
+  process_data_t data;
+  struct process *p;
 };
 
+struct process_context {
+  struct process *list, *current;
+  process_event_t lastevent;
+  process_num_events_t nevents, fevent;
+#if PROCESS_CONF_STATS
+  process_num_events_t maxevents;
+#endif
+  volatile unsigned char poll_requested;
+  struct process_context_event events[PROCESS_CONF_NUMEVENTS];
+  /* Timer list of the instance, managed by the system timers */
+  void *systimer;
+  /* Called when the instance gets an event or a poll request, if set */
+  void (*notify)(struct process_context *c);
+};
+
+/** The instance used by the boot code and interrupts */
+CCIF extern struct process_context process_default_context;
+/** The active instance */
+CCIF extern PROCESS_CONF_THREAD_LOCAL struct process_context *process_ctx;
+
+/**
+ * Initialize an instance, same as process_init() for the default one.
+ */
+void process_context_init(struct process_context *c);
+
+/**
+ * Make an instance active.
+ *
+ * \return The previously active instance, to be selected again when
+ * done.
+ */
+struct process_context *process_context_select(struct process_context *c);
+
+/**
+ * Run an instance once, see process_run().
+ */
+int process_context_run(struct process_context *c);
+
+/**
+ * Post an event to a process of an instance, see process_post().
+ */
+int process_context_post(struct process_context *c, struct process *p,
+                         process_event_t ev, process_data_t data);
+
+/**
+ * Request a process of an instance to be polled, see process_poll().
+ */
+void process_context_poll(struct process_context *c, struct process *p);
+
+/**
+ * Number of events waiting in an instance, see process_nevents().
+ */
+int process_context_nevents(struct process_context *c);
+
+/** @} */
+
 /**
  * \name Functions called from application programs
  * @{
@@ -343,6 +452,21 @@ struct process {
  */
 CCIF void process_start(struct process *p, const char *arg);
 
+/**
+ * Restore a process to a previously saved protothread state.
+ *
+ * The process is put on the process list without being sent the
+ * PROCESS_EVENT_INIT event, and continues from the saved local
+ * continuation when it receives its next event. Used when resuming
+ * from a hibernate snapshot.
+ *
+ * \param p A pointer to a process structure.
+ *
+ * \param pt The saved protothread state.
+ *
+ */
+void process_restore(struct process *p, const struct pt *pt);
+
 /**
  * Post an asynchronous event.
  *
@@ -379,6 +503,24 @@ CCIF int process_post(struct process *p, process_event_t ev, void* data);
 CCIF void process_post_synch(struct process *p,
 			     process_event_t ev, void* data);
 
+/**
+ * Wake up a process blocked on an object.
+ *
+ * \param p A pointer to the process' process structure.
+ *
+ * \param obj The object the process waits on, sent as the data of the
+ * PROCESS_EVENT_WAKEUP event.
+ *
+ * Posts a PROCESS_EVENT_WAKEUP event to the process. The woken process
+ * waits for this event only, so it must not be lost: when the event
+ * queue is full, the wakeup is left in the process structure and
+ * delivered with the next poll instead. It is never delivered
+ * synchronously, so the caller is not re-entered by the woken process.
+ * A process is blocked on one object at a time and woken up once, one
+ * pending wakeup per process is enough.
+ */
+void process_wakeup(struct process *p, void *obj);
+
 /**
  * \brief      Cause a process to exit
  * \param p    The process that is to be exited
@@ -401,8 +543,7 @@ CCIF void process_exit(struct process *p);
  *
  * \hideinitializer
  */
-#define PROCESS_CURRENT() process_current
-CCIF extern struct process *process_current;
+#define PROCESS_CURRENT() (process_ctx->current)
 
 /**
  * Switch context to another process
@@ -427,7 +568,7 @@ CCIF extern struct process *process_current;
  */
 #define PROCESS_CONTEXT_BEGIN(p) {\
 struct process *tmp_current = PROCESS_CURRENT();\
-process_current = p
+PROCESS_CURRENT() = p
 
 /**
  * End a context switch
@@ -439,7 +580,7 @@ process_current = p
  *
  * \sa PROCESS_CONTEXT_START()
  */
-#define PROCESS_CONTEXT_END(p) process_current = tmp_current; }
+#define PROCESS_CONTEXT_END(p) PROCESS_CURRENT() = tmp_current; }
 
 /**
  * \brief      Allocate a global event number.
@@ -523,9 +664,7 @@ int process_nevents(void);
 
 /** @} */
 
-CCIF extern struct process *process_list;
-
-#define PROCESS_LIST() process_list
+#define PROCESS_LIST() (process_ctx->list)
 
 #endif /* __PROCESS_H__ */
 
@@ -159,7 +159,7 @@ PT_THREAD(driver_thread(struct pt *pt))
 #ifndef __PT_SEM_H__
 #define __PT_SEM_H__
 
-#include "sys/pt.h"
+#include "pt.h"
 
 struct pt_sem {
   unsigned int count;
@@ -0,0 +1,385 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <protothreads.h>
+
+#include "hibernate.h"
+#include "systime.h"
+#include "systimer.h"
+
+/*
+ * Snapshot layout, all fields are 32-bit words:
+ *
+ *  magic, image, length
+ *  realtime sec, realtime nsec
+ *  process count, { process, lc } ...
+ *  timer count, { timer, clock, remaining sec, remaining nsec, interval sec,
+ *                 interval nsec, timeout sec, timeout nsec, callback, arg } ...
+ *  region count, { addr, size, data ... } ...
+ *  checksum
+ *
+ * Pointers and lc take HIBERNATE_PTR_WORDS words, low word first.
+ * Processes and timers are identified by their address, so a snapshot
+ * can only be restored by the same firmware image that saved it, see
+ * HIBERNATE_SetImage ().
+ */
+
+#define HIBERNATE_PTR_WORDS         ((int)(sizeof (uintptr_t) / sizeof (uint32_t)))
+#define HIBERNATE_HEADER_WORDS      5
+#define HIBERNATE_PROCESS_WORDS     (2 * HIBERNATE_PTR_WORDS)
+#define HIBERNATE_TIMER_WORDS       (7 + 3 * HIBERNATE_PTR_WORDS)
+
+typedef struct {
+    void        *addr;
+    uint32_t    size;
+} HibernateRegion;
+
+static HibernateRegion HibernateRegions[HIBERNATE_CONF_MAX_REGIONS];
+static int HibernateRegionCount = 0;
+static uint32_t HibernateImage = 0;
+
+
+static uint32_t HIBERNATE_Checksum (const uint32_t *buf, int len)
+{
+    uint32_t sum = HIBERNATE_MAGIC;
+    int i;
+
+    for (i = 0; i < len; i++) {
+        sum = ((sum << 5) | (sum >> 27)) ^ buf[i];
+    }
+
+    return sum;
+}
+
+
+static int HIBERNATE_PutPtr (uint32_t *buf, int len, uintptr_t value)
+{
+    int i;
+
+    for (i = 0; i < HIBERNATE_PTR_WORDS; i++) {
+        buf[len++] = (uint32_t)value;
+        value = (uint64_t)value >> 32;
+    }
+
+    return len;
+}
+
+
+static uintptr_t HIBERNATE_GetPtr (const uint32_t *buf)
+{
+    uint64_t value = 0;
+    int i;
+
+    for (i = HIBERNATE_PTR_WORDS - 1; i >= 0; i--) {
+        value = (value << 32) | buf[i];
+    }
+
+    return (uintptr_t)value;
+}
+
+
+/**
+ * @brief  Check that the process, timer and region records of a snapshot
+ *         fill it up to the checksum, before any of them is used.
+ * @param  buf Snapshot, its length already checked against the buffer.
+ * @param  end Number of words before the checksum.
+ * @retval 0 if the records fit, -1 otherwise.
+ */
+static int HIBERNATE_Check (const uint32_t *buf, uint32_t end)
+{
+    uint32_t len = HIBERNATE_HEADER_WORDS;
+    uint32_t count, bytes, clock;
+
+    // Processes
+    if (len >= end) {
+        return -1;
+    }
+    count = buf[len++];
+    if (count > (end - len) / HIBERNATE_PROCESS_WORDS) {
+        return -1;
+    }
+    len += count * HIBERNATE_PROCESS_WORDS;
+
+    // Timers
+    if (len >= end) {
+        return -1;
+    }
+    count = buf[len++];
+    if (count > (end - len) / HIBERNATE_TIMER_WORDS) {
+        return -1;
+    }
+    while (count--) {
+        clock = buf[len + HIBERNATE_PTR_WORDS];
+        if (clock != (uint32_t)CLOCK_REALTIME && clock != (uint32_t)CLOCK_MONOTONIC) {
+            return -1;
+        }
+        len += HIBERNATE_TIMER_WORDS;
+    }
+
+    // Memory regions
+    if (len >= end) {
+        return -1;
+    }
+    count = buf[len++];
+    if (count > HIBERNATE_CONF_MAX_REGIONS) {
+        return -1;
+    }
+    while (count--) {
+        if (end - len < HIBERNATE_PTR_WORDS + 1) {
+            return -1;
+        }
+        bytes = buf[len + HIBERNATE_PTR_WORDS];
+        len += HIBERNATE_PTR_WORDS + 1;
+        if (bytes / 4 + ((bytes & 3) != 0) > end - len) {
+            return -1;
+        }
+        len += (bytes + 3) / 4;
+    }
+
+    return len == end ? 0 : -1;
+}
+
+
+/**
+ * @brief  Set the identity of the firmware image, e.g. its build ID or a
+ *         hash of the flash contents. Snapshots are restored only by the
+ *         image that saved them.
+ * @param  image Image identity, not 0.
+ * @retval None.
+ */
+void HIBERNATE_SetImage (uint32_t image)
+{
+    HibernateImage = image;
+}
+
+
+/**
+ * @brief  Include a memory region, e.g. process local state, in the snapshot.
+ * @param  addr Start of the region.
+ * @param  size Size of the region in bytes.
+ * @retval 0 on success, -1 if there are no free region slots.
+ */
+int HIBERNATE_AddRegion (void *addr, uint32_t size)
+{
+    if (HibernateRegionCount >= HIBERNATE_CONF_MAX_REGIONS) {
+        return -1;
+    }
+
+    HibernateRegions[HibernateRegionCount].addr = addr;
+    HibernateRegions[HibernateRegionCount].size = size;
+    HibernateRegionCount++;
+
+    return 0;
+}
+
+
+/**
+ * @brief  Serialize the process list, running timers and registered
+ *         memory regions. Must be called with an empty event queue.
+ * @param  buf Buffer for the snapshot.
+ * @param  size Size of the buffer in words.
+ * @retval Number of words used, -1 if the system is busy, the buffer is
+ *         too small or the image is not set.
+ */
+int HIBERNATE_Save (uint32_t *buf, int size)
+{
+    struct process *p;
+    SYSTIMER *timer;
+    struct timespec now, mono, remaining;
+    const struct timespec *clock;
+    int len, count_pos, i;
+
+    if (process_nevents () > 0) {
+        return -1;
+    }
+
+    if (size < HIBERNATE_HEADER_WORDS + 4 || HibernateImage == 0) {
+        return -1;
+    }
+
+    clock_gettime (CLOCK_REALTIME, &now);
+    clock_gettime (CLOCK_MONOTONIC, &mono);
+
+    buf[0] = HIBERNATE_MAGIC;
+    buf[1] = HibernateImage;
+    buf[3] = now.tv_sec;
+    buf[4] = now.tv_nsec;
+    len = HIBERNATE_HEADER_WORDS;
+
+    // Processes
+    count_pos = len++;
+    buf[count_pos] = 0;
+    for (p = PROCESS_LIST (); p != NULL; p = p->next) {
+        if (len + HIBERNATE_PROCESS_WORDS > size) {
+            return -1;
+        }
+        len = HIBERNATE_PutPtr (buf, len, (uintptr_t)p);
+        len = HIBERNATE_PutPtr (buf, len, (uintptr_t)p->pt.lc);
+        buf[count_pos]++;
+    }
+
+    // Timers, on both clocks
+    if (len + 1 > size) {
+        return -1;
+    }
+    count_pos = len++;
+    buf[count_pos] = 0;
+    for (i = 0; i < 2; i++) {
+        for (timer = (i == 0) ? SYSTIMER_List () : SYSTIMER_ListMonotonic (); timer != NULL; timer = timer->next) {
+            if (len + HIBERNATE_TIMER_WORDS > size) {
+                return -1;
+            }
+            clock = (timer->clock == CLOCK_MONOTONIC) ? &mono : &now;
+            if (SYSTIME_CMP (&timer->target, clock) > 0) {
+                SYSTIME_SUB (&remaining, &timer->target, clock);
+            } else {
+                SYSTIME_RESET (&remaining);
+            }
+            len = HIBERNATE_PutPtr (buf, len, (uintptr_t)timer);
+            buf[len++] = (uint32_t)timer->clock;
+            buf[len++] = remaining.tv_sec;
+            buf[len++] = remaining.tv_nsec;
+            buf[len++] = timer->interval.tv_sec;
+            buf[len++] = timer->interval.tv_nsec;
+            buf[len++] = timer->timeout.tv_sec;
+            buf[len++] = timer->timeout.tv_nsec;
+            len = HIBERNATE_PutPtr (buf, len, (uintptr_t)timer->callback);
+            len = HIBERNATE_PutPtr (buf, len, (uintptr_t)timer->arg);
+            buf[count_pos]++;
+        }
+    }
+
+    // Memory regions
+    if (len + 1 > size) {
+        return -1;
+    }
+    buf[len++] = HibernateRegionCount;
+    for (i = 0; i < HibernateRegionCount; i++) {
+        uint32_t words = (HibernateRegions[i].size + 3) / 4;
+        if (len + HIBERNATE_PTR_WORDS + 1 + (int)words > size) {
+            return -1;
+        }
+        len = HIBERNATE_PutPtr (buf, len, (uintptr_t)HibernateRegions[i].addr);
+        buf[len++] = HibernateRegions[i].size;
+        if (words > 0) {
+            buf[len + words - 1] = 0;
+        }
+        memcpy (&buf[len], HibernateRegions[i].addr, HibernateRegions[i].size);
+        len += words;
+    }
+
+    if (len + 1 > size) {
+        return -1;
+    }
+    buf[2] = len + 1;
+    buf[len] = HIBERNATE_Checksum (buf, len);
+
+    return len + 1;
+}
+
+
+/**
+ * @brief  Restore a snapshot taken with HIBERNATE_Save (). Must be called
+ *         after SYSTIME_Init () and process_init (), instead of starting
+ *         the processes.
+ * @param  buf Snapshot.
+ * @param  size Size of the buffer in words.
+ * @param  elapsed Time spent in hibernation.
+ * @retval 0 on success, -1 if the buffer does not hold a valid snapshot,
+ *         nothing is restored then.
+ */
+int HIBERNATE_Restore (const uint32_t *buf, int size, const struct timespec *elapsed)
+{
+    struct timespec now;
+    struct process *p;
+    struct pt pt;
+    SYSTIMER *timer;
+    uint32_t count;
+    int len, i, first;
+
+    if (size < HIBERNATE_HEADER_WORDS + 4 ||
+        buf[0] != HIBERNATE_MAGIC ||
+        HibernateImage == 0 ||
+        buf[1] != HibernateImage ||
+        buf[2] < HIBERNATE_HEADER_WORDS + 4 ||
+        buf[2] > (uint32_t)size ||
+        buf[buf[2] - 1] != HIBERNATE_Checksum (buf, buf[2] - 1) ||
+        HIBERNATE_Check (buf, buf[2] - 1) != 0) {
+        return -1;
+    }
+
+    // Continue the wall clock from where it was left
+    now.tv_sec = buf[3];
+    now.tv_nsec = buf[4];
+    SYSTIME_ADD (&now, &now, elapsed);
+    clock_settime (CLOCK_REALTIME, &now);
+
+    // Processes, pushed in reverse order to keep the list order
+    len = HIBERNATE_HEADER_WORDS;
+    count = buf[len++];
+    first = len;
+    len += count * HIBERNATE_PROCESS_WORDS;
+    for (i = count - 1; i >= 0; i--) {
+        p = (struct process *)HIBERNATE_GetPtr (&buf[first + i * HIBERNATE_PROCESS_WORDS]);
+        pt.lc = (lc_t)HIBERNATE_GetPtr (&buf[first + i * HIBERNATE_PROCESS_WORDS + HIBERNATE_PTR_WORDS]);
+        process_restore (p, &pt);
+    }
+
+    // Timers, remaining time is reduced by the time spent in hibernation
+    count = buf[len++];
+    while (count--) {
+        const uint32_t *t = &buf[len + HIBERNATE_PTR_WORDS + 1];
+
+        timer = (SYSTIMER *)HIBERNATE_GetPtr (&buf[len]);
+        SYSTIMER_Init_NoStart (timer, 0, 0,
+                               (int (*) (void *))HIBERNATE_GetPtr (&t[6]),
+                               (void *)HIBERNATE_GetPtr (&t[6 + HIBERNATE_PTR_WORDS]));
+        SYSTIMER_SetClock (timer, (clockid_t)buf[len + HIBERNATE_PTR_WORDS]);
+        timer->target.tv_sec = t[0];
+        timer->target.tv_nsec = t[1];
+        timer->interval.tv_sec = t[2];
+        timer->interval.tv_nsec = t[3];
+        timer->timeout.tv_sec = t[4];
+        timer->timeout.tv_nsec = t[5];
+        len += HIBERNATE_TIMER_WORDS;
+
+        if (SYSTIME_CMP (&timer->target, elapsed) > 0) {
+            SYSTIME_SUB (&timer->target, &timer->target, elapsed);
+        } else {
+            // Already expired, fire as soon as possible
+            timer->target.tv_sec = 0;
+            timer->target.tv_nsec = 1;
+        }
+
+        // SYSTIMER_Start () adds the current time to the remaining time
+        SYSTIME_RESET (&timer->started);
+        SYSTIMER_Start (timer);
+    }
+
+    // Memory regions
+    count = buf[len++];
+    while (count--) {
+        uint32_t bytes = buf[len + HIBERNATE_PTR_WORDS];
+        memcpy ((void *)HIBERNATE_GetPtr (&buf[len]), &buf[len + HIBERNATE_PTR_WORDS + 1], bytes);
+        len += HIBERNATE_PTR_WORDS + 1 + (bytes + 3) / 4;
+    }
+
+    return 0;
+}
@@ -15,12 +15,95 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include "em_cmu.h"
 #include "em_emu.h"
 #include "em_int.h"
 
+#include "process-trace.h"
+
 #include "lpm.h"
+#include "systime.h"
 
 static volatile int EventRegistered = 0;
+static volatile int EM2Blocked = 0;
+
+#if LPM_CONF_PREWAKE
+static volatile int PrewakeArmed = 0;
+static volatile int PrewakeStarted = 0;
+static uint32_t PrewakeReady = 0;
+
+LpmPrewakeStats LPM_PrewakeStats;
+
+
+static void LPM_Prewake (void)
+{
+    // Start HFXO without waiting, it keeps starting up in EM1
+    if (PrewakeArmed) {
+        CMU_OscillatorEnable (cmuOsc_HFXO, true, false);
+        PrewakeStarted = 1;
+    }
+}
+
+
+/**
+ * @brief  Set the pre-wake lead, kept between the measured startup time
+ *         with margin and LPM_CONF_PREWAKE_MAX_US.
+ */
+static void LPM_SetPrewakeLead (uint32_t lead_us)
+{
+    uint32_t min = LPM_PrewakeStats.startup_us + LPM_CONF_PREWAKE_MARGIN_US;
+    struct timespec lead;
+
+    if (lead_us > LPM_CONF_PREWAKE_MAX_US) {
+        lead_us = LPM_CONF_PREWAKE_MAX_US;
+    }
+    if (lead_us < min) {
+        lead_us = min;
+    }
+    if (lead_us == LPM_PrewakeStats.lead_us) {
+        return;
+    }
+
+    LPM_PrewakeStats.lead_us = lead_us;
+    lead.tv_sec = lead_us / 1000000;
+    lead.tv_nsec = (lead_us % 1000000) * 1000;
+    SYSTIME_Prewake (&lead, LPM_Prewake);
+}
+
+
+/**
+ * @brief  Measure the HFXO startup time and start waking up that much
+ *         ahead of the timer deadlines. Must be called after SYSTIME_Init ().
+ *         Pre-wake has effect only while HF clock is running from HFXO.
+ * @retval None.
+ */
+void LPM_Init (void)
+{
+    struct timespec start, ready, startup;
+
+    CMU_OscillatorEnable (cmuOsc_HFXO, false, false);
+
+    clock_gettime (CLOCK_MONOTONIC, &start);
+    CMU_OscillatorEnable (cmuOsc_HFXO, true, true);
+    clock_gettime (CLOCK_MONOTONIC, &ready);
+
+    if (CMU_ClockSelectGet (cmuClock_HF) != cmuSelect_HFXO) {
+        CMU_OscillatorEnable (cmuOsc_HFXO, false, false);
+    }
+
+    SYSTIME_SUB (&startup, &ready, &start);
+    LPM_PrewakeStats.startup_us = startup.tv_sec * 1000000 + startup.tv_nsec / 1000;
+    LPM_PrewakeStats.lead_us = 0;
+    LPM_PrewakeStats.late = 0;
+    PrewakeReady = 0;
+
+    LPM_SetPrewakeLead (0);
+}
+#else
+void LPM_Init (void)
+{
+}
+#endif /* LPM_CONF_PREWAKE */
 
 
 void LPM_RegisterEvent (void)
@@ -29,13 +112,96 @@ void LPM_RegisterEvent (void)
 }
 
 
+/**
+ * @brief  Keep the high frequency peripherals running while waiting for
+ *         events, i.e. sleep in EM1 instead of EM2. Calls nest.
+ * @retval None.
+ */
+void LPM_BlockEM2 (void)
+{
+    INT_Disable ();
+    EM2Blocked++;
+    INT_Enable ();
+}
+
+
+/**
+ * @brief  Allow EM2 again, see LPM_BlockEM2 ().
+ * @retval None.
+ */
+void LPM_UnblockEM2 (void)
+{
+    INT_Disable ();
+    if (EM2Blocked > 0) {
+        EM2Blocked--;
+    }
+    INT_Enable ();
+}
+
+
 void LPM_WaitForEvent (void)
 {
+    if (EventRegistered) {
+        EventRegistered = 0;
+        return;
+    }
+
+    SYSTIME_Sleep ();
+    PROCESS_TRACE_GO_SLEEP ();
+
+#if LPM_CONF_PREWAKE
+    int hfxo = (CMU_ClockSelectGet (cmuClock_HF) == cmuSelect_HFXO);
+
+    PrewakeArmed = hfxo;
+
     while (!EventRegistered) {
         INT_Disable ();
-        EMU_EnterEM2 (true);
+        if (EM2Blocked) {
+            EMU_EnterEM1 ();
+        } else if (!hfxo) {
+            EMU_EnterEM2 (true);
+        } else if (PrewakeStarted) {
+            // EM2 would stop HFXO again
+            EMU_EnterEM1 ();
+        } else {
+            // Do not wait for HFXO on every wake-up, only when needed
+            EMU_EnterEM2 (false);
+        }
         INT_Enable ();
     }
 
+    if (hfxo && PrewakeStarted) {
+        if (!(CMU->STATUS & CMU_STATUS_HFXORDY)) {
+            // Woke up for a timer before HFXO was ready, start earlier next time
+            PrewakeReady = 0;
+            LPM_SetPrewakeLead (LPM_PrewakeStats.lead_us + LPM_CONF_PREWAKE_MARGIN_US);
+            LPM_PrewakeStats.late++;
+        } else if (++PrewakeReady >= LPM_CONF_PREWAKE_DECAY) {
+            // Ready every time, try a shorter lead
+            PrewakeReady = 0;
+            LPM_SetPrewakeLead (LPM_PrewakeStats.lead_us - LPM_CONF_PREWAKE_MARGIN_US);
+        }
+    }
+
+    if (hfxo) {
+        CMU_ClockSelectSet (cmuClock_HF, cmuSelect_HFXO);
+        PrewakeArmed = 0;
+        PrewakeStarted = 0;
+    }
+#else
+    while (!EventRegistered) {
+        INT_Disable ();
+        if (EM2Blocked) {
+            EMU_EnterEM1 ();
+        } else {
+            EMU_EnterEM2 (true);
+        }
+        INT_Enable ();
+    }
+#endif /* LPM_CONF_PREWAKE */
+
+    PROCESS_TRACE_WAKE_UP ();
+    SYSTIME_Wake ();
+
     EventRegistered = 0;
 }
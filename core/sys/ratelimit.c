@@ -0,0 +1,177 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "ratelimit.h"
+#include "systime.h"
+
+
+/**
+ * @brief  Nanoseconds until @p n tokens are available.
+ * @param  rl Bucket.
+ * @param  n Number of tokens.
+ * @param  tat Theoretical arrival time after taking them.
+ * @retval Delay, 0 or negative if available now.
+ */
+static int64_t RATELIMIT_Check (RateLimit *rl, uint32_t n, struct timespec *tat)
+{
+    struct timespec now;
+    int64_t cost, burst;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+
+    cost = (int64_t)n * 1000000000 / rl->rate;
+    burst = (int64_t)rl->burst * 1000000000 / rl->rate;
+
+    // The bucket is full once the arrival time is in the past
+    if (SYSTIME_CMP (&rl->tat, &now) > 0) {
+        *tat = rl->tat;
+    } else {
+        *tat = now;
+    }
+
+    tat->tv_sec += (time_t)(cost / 1000000000);
+    tat->tv_nsec += (long)(cost % 1000000000);
+    if (tat->tv_nsec >= 1000000000) {
+        tat->tv_sec++;
+        tat->tv_nsec -= 1000000000;
+    }
+
+    return ((int64_t)tat->tv_sec - now.tv_sec) * 1000000000 + (tat->tv_nsec - now.tv_nsec) - burst;
+}
+
+
+/**
+ * @brief  Initialize a token bucket, full. A bucket in use may be
+ *         re-initialized, its pending wake-up is cancelled, so a new one
+ *         must be zeroed, e.g. static.
+ * @param  rl Bucket.
+ * @param  rate Tokens per second.
+ * @param  burst Bucket size in tokens.
+ * @retval None.
+ */
+void RATELIMIT_Init (RateLimit *rl, uint32_t rate, uint32_t burst)
+{
+    // The timer is linked into the SYSTIMER list while running
+    if (SYSTIMER_IsRunning (&rl->timer)) {
+        SYSTIMER_Stop (&rl->timer);
+    }
+
+    memset (rl, 0, sizeof (RateLimit));
+    rl->rate = rate > 0 ? rate : 1;
+    rl->burst = burst > 0 ? burst : 1;
+}
+
+
+/**
+ * @brief  Initialize a leaky bucket, i.e. a token bucket holding a single
+ *         token.
+ * @param  rl Bucket.
+ * @param  rate Tokens per second.
+ * @retval None.
+ */
+void RATELIMIT_InitLeaky (RateLimit *rl, uint32_t rate)
+{
+    RATELIMIT_Init (rl, rate, 1);
+}
+
+
+/**
+ * @brief  Take tokens from the bucket if available.
+ * @param  rl Bucket.
+ * @param  n Number of tokens.
+ * @retval 0 if taken, 1 if not enough tokens yet, -1 with errno set to
+ *         EINVAL if @p n exceeds the burst size.
+ */
+int RATELIMIT_Take (RateLimit *rl, uint32_t n)
+{
+    struct timespec tat;
+
+    // The bucket never holds them
+    if (n > rl->burst) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (RATELIMIT_Check (rl, n, &tat) > 0) {
+        return 1;
+    }
+
+    rl->tat = tat;
+
+    return 0;
+}
+
+
+/**
+ * @brief  Time until the tokens are available.
+ * @param  rl Bucket.
+ * @param  n Number of tokens.
+ * @retval Delay in milliseconds rounded up, 0 if available now, 0xFFFFFFFF
+ *         if @p n exceeds the burst size.
+ */
+uint32_t RATELIMIT_Delay (RateLimit *rl, uint32_t n)
+{
+    struct timespec tat;
+    int64_t delay;
+
+    if (n > rl->burst) {
+        return 0xFFFFFFFF;
+    }
+
+    delay = RATELIMIT_Check (rl, n, &tat);
+    if (delay <= 0) {
+        return 0;
+    }
+
+    delay = (delay + 999999) / 1000000;
+
+    return delay > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)delay;
+}
+
+
+static int RATELIMIT_Poll (void *arg)
+{
+    process_poll ((struct process *)arg);
+
+    return 0;
+}
+
+
+/**
+ * @brief  Poll the process once the tokens are available. Re-arming
+ *         replaces the pending wake-up, there is one timer per bucket.
+ *         The timer counts on CLOCK_MONOTONIC like the bucket, so a step
+ *         of CLOCK_REALTIME does not delay the wake-up.
+ * @param  rl Bucket.
+ * @param  n Number of tokens.
+ * @param  p Process to poll.
+ * @retval None.
+ */
+void RATELIMIT_Arm (RateLimit *rl, uint32_t n, struct process *p)
+{
+    if (SYSTIMER_IsRunning (&rl->timer)) {
+        SYSTIMER_Stop (&rl->timer);
+    }
+
+    // One millisecond more, SYSTIMER rounds the start time down
+    SYSTIMER_Init_NoStart (&rl->timer, RATELIMIT_Delay (rl, n) + 1, 0, RATELIMIT_Poll, p);
+    SYSTIMER_SetClock (&rl->timer, CLOCK_MONOTONIC);
+    SYSTIMER_Start (&rl->timer);
+}
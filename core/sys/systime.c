@@ -20,28 +20,286 @@
 
 #include "systime.h"
 
+#define SYSTIME_BARRIER()   __asm__ volatile ("" ::: "memory")
+
+/**
+ * CLOCK_REALTIME is the backend time plus an offset. Corrections are not
+ * applied to the offset at once but slewed in with a bounded rate, and a
+ * frequency trim corrects the rate of the backend clock continuously. Both
+ * are relative to the backend time at the last change (base).
+ */
+typedef struct {
+    struct timespec     offset;
+    SysTime             base;
+    int64_t             slew;       // Correction still to apply, ns
+    int32_t             trim;       // Frequency trim, ppb
+} SysTimeClock;
+
+/**
+ * The clock is kept in two copies guarded by a sequence counter. The
+ * writer updates one copy at a time and the sequence tells the readers
+ * which copy is stable, so a reader interrupting the writer (e.g. from
+ * an ISR) never has to wait for it.
+ *
+ * This assumes a single core: the readers interrupt the writer on the
+ * same core, they never run alongside it, so SYSTIME_BARRIER () only
+ * keeps the compiler from reordering the accesses. Readers on another
+ * core would need memory barriers as well.
+ */
 typedef struct {
-    SysTimeBackend  *backend;
-    struct timespec offset;
+    SysTimeBackend      *backend;
+    volatile uint32_t   seq;
+    SysTimeClock        clock[2];
 } SysTimeControl;
 
 static SysTimeControl SysTimeCtrl;
 
 
+/**
+ * @brief  Read the backend time and the CLOCK_REALTIME clock state as one
+ *         consistent snapshot.
+ * @param  tm Backend time, may be NULL.
+ * @param  clock Clock state.
+ * @retval None.
+ */
+static void SYSTIME_Snapshot (SysTime *tm, SysTimeClock *clock)
+{
+    uint32_t seq;
+
+    do {
+        seq = SysTimeCtrl.seq;
+        SYSTIME_BARRIER ();
+        if (tm != NULL) {
+            SysTimeCtrl.backend->getSystemNanoTime (tm);
+        }
+        *clock = SysTimeCtrl.clock[seq & 1];
+        SYSTIME_BARRIER ();
+    } while (seq != SysTimeCtrl.seq);
+}
+
+
+/**
+ * @brief  Replace the CLOCK_REALTIME clock state. Let the backend keep the
+ *         offset too, if it can retain it over resets. Writers must not
+ *         preempt each other, i.e. call from process context only.
+ * @param  clock New clock state.
+ * @retval None.
+ */
+static void SYSTIME_SetClock (const SysTimeClock *clock)
+{
+    // Readers use the second copy while the first one is written...
+    SysTimeCtrl.seq++;
+    SYSTIME_BARRIER ();
+    SysTimeCtrl.clock[0] = *clock;
+    SYSTIME_BARRIER ();
+
+    // ...and the first one while the second one is written
+    SysTimeCtrl.seq++;
+    SYSTIME_BARRIER ();
+    SysTimeCtrl.clock[1] = *clock;
+
+    if (SysTimeCtrl.backend->storeOffset != NULL) {
+        SysTime tm;
+        SYSTIME_SET (&tm, &clock->offset);
+        SysTimeCtrl.backend->storeOffset (&tm);
+    }
+}
+
+
+/**
+ * @brief  Add a signed number of nanoseconds to a time value.
+ * @param  tp Time value.
+ * @param  ns Nanoseconds.
+ * @retval None.
+ */
+static void SYSTIME_AddNanos (struct timespec *tp, int64_t ns)
+{
+    tp->tv_sec += (time_t)(ns / 1000000000);
+    tp->tv_nsec += (long)(ns % 1000000000);
+
+    if (tp->tv_nsec >= 1000000000) {
+        tp->tv_sec++;
+        tp->tv_nsec -= 1000000000;
+    } else if (tp->tv_nsec < 0) {
+        tp->tv_sec--;
+        tp->tv_nsec += 1000000000;
+    }
+}
+
+
+/**
+ * @brief  Correction accumulated since the clock base.
+ * @param  clock Clock state.
+ * @param  tm Backend time.
+ * @param  slewed Part of the pending slew already applied, may be NULL.
+ * @retval Total correction (slew and trim), ns.
+ */
+static int64_t SYSTIME_Correction (const SysTimeClock *clock, const SysTime *tm, int64_t *slewed)
+{
+    struct timespec elapsed;
+    int64_t slew = 0, trim = 0, limit;
+
+    if (clock->slew != 0 || clock->trim != 0) {
+
+        SYSTIME_SUB (&elapsed, tm, &clock->base);
+        if (elapsed.tv_sec < 0) {
+            SYSTIME_RESET (&elapsed);
+        }
+
+        if (clock->slew != 0) {
+            limit = (int64_t)elapsed.tv_sec * (SYSTIME_CONF_SLEW_PPM * 1000) +
+                    (int64_t)elapsed.tv_nsec * SYSTIME_CONF_SLEW_PPM / 1000000;
+            if (clock->slew > 0) {
+                slew = clock->slew < limit ? clock->slew : limit;
+            } else {
+                slew = -clock->slew < limit ? clock->slew : -limit;
+            }
+        }
+
+        if (clock->trim != 0) {
+            trim = (int64_t)elapsed.tv_sec * clock->trim +
+                   (int64_t)elapsed.tv_nsec * clock->trim / 1000000000;
+        }
+    }
+
+    if (slewed != NULL) {
+        *slewed = slew;
+    }
+
+    return slew + trim;
+}
+
+
+/**
+ * @brief  CLOCK_REALTIME at the given backend time.
+ * @param  tp Resulting time.
+ * @param  tm Backend time.
+ * @param  clock Clock state.
+ * @retval None.
+ */
+static void SYSTIME_Realtime (struct timespec *tp, const SysTime *tm, const SysTimeClock *clock)
+{
+    SYSTIME_ADD (tp, tm, &clock->offset);
+    SYSTIME_AddNanos (tp, SYSTIME_Correction (clock, tm, NULL));
+}
+
+
+/**
+ * @brief  Move the clock base to the given backend time, folding the
+ *         correction applied so far into the offset.
+ * @param  clock Clock state.
+ * @param  tm Backend time.
+ * @retval None.
+ */
+static void SYSTIME_Fold (SysTimeClock *clock, const SysTime *tm)
+{
+    int64_t slewed;
+
+    SYSTIME_AddNanos (&clock->offset, SYSTIME_Correction (clock, tm, &slewed));
+    clock->slew -= slewed;
+    clock->base = *tm;
+}
+
+
+/**
+ * @brief  Set CLOCK_REALTIME. Small corrections are slewed in, larger
+ *         ones step the clock.
+ * @param  tp New time.
+ * @retval None.
+ */
+static void SYSTIME_SetRealtime (const struct timespec *tp)
+{
+    struct timespec now;
+    SysTimeClock clock;
+    SysTime tm;
+    int64_t diff;
+
+    SYSTIME_Snapshot (&tm, &clock);
+    SYSTIME_Realtime (&now, &tm, &clock);
+
+    diff = ((int64_t)tp->tv_sec - now.tv_sec) * 1000000000 + (tp->tv_nsec - now.tv_nsec);
+
+    SYSTIME_Fold (&clock, &tm);
+
+    if (diff > -SYSTIME_CONF_STEP_THRESHOLD_NS && diff < SYSTIME_CONF_STEP_THRESHOLD_NS) {
+        clock.slew = diff;
+    } else {
+        SYSTIME_SUB (&clock.offset, tp, &tm);
+        clock.slew = 0;
+    }
+
+    SYSTIME_SetClock (&clock);
+}
+
+
 int SYSTIME_Init (SysTimeBackend *backend)
 {
-    SysTimeCtrl.offset.tv_sec = 0;
-    SysTimeCtrl.offset.tv_nsec = 0;
+    int res;
+    SysTime tm;
+
+    SysTimeCtrl.seq = 0;
+    memset (SysTimeCtrl.clock, 0, sizeof (SysTimeCtrl.clock));
     SysTimeCtrl.backend = backend;
 
-    return SysTimeCtrl.backend->init ();
+    res = SysTimeCtrl.backend->init ();
+
+    // Continue with the wall clock retained by the backend
+    if (res == 0 && SysTimeCtrl.backend->loadOffset != NULL &&
+        SysTimeCtrl.backend->loadOffset (&tm) == 0) {
+        SYSTIME_SET (&SysTimeCtrl.clock[0].offset, &tm);
+        SYSTIME_SET (&SysTimeCtrl.clock[1].offset, &tm);
+    }
+
+    SysTimeCtrl.backend->getSystemNanoTime (&tm);
+    SysTimeCtrl.clock[0].base = tm;
+    SysTimeCtrl.clock[1].base = tm;
+
+    return res;
 }
 
 
+/**
+ * @brief  Number of independent trigger channels provided by the backend.
+ * @retval Number of channels, at least 1.
+ */
+unsigned int SYSTIME_Channels (void)
+{
+    if (SysTimeCtrl.backend->getChannels == NULL) {
+        return 1;
+    }
+
+    return SysTimeCtrl.backend->getChannels ();
+}
+
+
+/**
+ * @brief  Invoke a callback at the given time on the scheduler channel.
+ * @param  trigger_time Absolute time (CLOCK_REALTIME).
+ * @param  callback Callback, invoked immediately if the time has passed.
+ * @retval None.
+ */
 void SYSTIME_Trigger (struct timespec *trigger_time, void (*callback) (void))
+{
+    SYSTIME_TriggerChannel (SYSTIME_CHANNEL_SCHEDULER, trigger_time, callback);
+}
+
+
+/**
+ * @brief  Invoke a callback at the given time. Channels are independent,
+ *         arming one does not cancel a trigger pending on another.
+ * @param  channel Trigger channel, see SYSTIME_Channels ().
+ * @param  trigger_time Absolute time (CLOCK_REALTIME).
+ * @param  callback Callback, invoked immediately if the time has passed.
+ * @retval 0 on success, -1 if the channel is not available.
+ */
+int SYSTIME_TriggerChannel (unsigned int channel, struct timespec *trigger_time, void (*callback) (void))
 {
     struct timespec current_time;
 
+    if (channel >= SYSTIME_Channels ()) {
+        return -1;
+    }
+
     clock_gettime (CLOCK_REALTIME, &current_time);
 
     if (SYSTIME_CMP (trigger_time, &current_time) > 0) {
@@ -62,23 +320,172 @@ void SYSTIME_Trigger (struct timespec *trigger_time, void (*callback) (void))
             .tv_nsec = d_nsec
         };
 
-        SysTimeCtrl.backend->trigger (&tm, callback);
+        if (SysTimeCtrl.backend->triggerChannel != NULL) {
+            SysTimeCtrl.backend->triggerChannel (channel, &tm, callback);
+        } else {
+            SysTimeCtrl.backend->trigger (&tm, callback);
+        }
 
     } else {
 
         // Requested time has already passed, trigger callback immediately
+        if (SysTimeCtrl.backend->cancel != NULL) {
+            SysTimeCtrl.backend->cancel (channel);
+        }
         callback ();
 
     }
+
+    return 0;
 }
 
 
-#if defined(_POSIX_TIMERS)
+/**
+ * @brief  Cancel a pending trigger.
+ * @param  channel Trigger channel.
+ * @retval None.
+ */
+void SYSTIME_Cancel (unsigned int channel)
+{
+    if (SysTimeCtrl.backend->cancel != NULL && channel < SYSTIME_Channels ()) {
+        SysTimeCtrl.backend->cancel (channel);
+    }
+}
 
-int clock_settime (clockid_t clock_id, const struct timespec *tp)
+
+/**
+ * @brief  Compensate CLOCK_REALTIME for a discontinuity of the backend counter,
+ *         e.g. after the backend clock source has been switched.
+ * @param  expected Monotonic time the backend should report now.
+ * @param  actual Monotonic time the backend actually reports.
+ * @retval None.
+ */
+void SYSTIME_Rebase (const struct timespec *expected, const struct timespec *actual)
+{
+    SysTimeClock clock;
+    SysTime tm;
+
+    // Fold the correction up to now on the old time line...
+    SYSTIME_Snapshot (NULL, &clock);
+    tm.tv_sec = expected->tv_sec;
+    tm.tv_nsec = expected->tv_nsec;
+    SYSTIME_Fold (&clock, &tm);
+
+    // ...and continue on the new one
+    SYSTIME_ADD (&clock.offset, &clock.offset, expected);
+    SYSTIME_SUB (&clock.offset, &clock.offset, actual);
+    clock.base.tv_sec = actual->tv_sec;
+    clock.base.tv_nsec = actual->tv_nsec;
+
+    SYSTIME_SetClock (&clock);
+}
+
+
+/**
+ * @brief  Tell the backend the core is about to sleep, e.g. to stop
+ *         clocks that do not run in the low power modes.
+ * @retval None.
+ */
+void SYSTIME_Sleep (void)
+{
+    if (SysTimeCtrl.backend->sleep != NULL) {
+        SysTimeCtrl.backend->sleep ();
+    }
+}
+
+
+/**
+ * @brief  Tell the backend the core is awake again.
+ * @retval None.
+ */
+void SYSTIME_Wake (void)
+{
+    if (SysTimeCtrl.backend->wake != NULL) {
+        SysTimeCtrl.backend->wake ();
+    }
+}
+
+
+/**
+ * @brief  Tell the backend the HF clock frequency has changed, e.g. after
+ *         an HFRCO band change.
+ * @retval None.
+ */
+void SYSTIME_ClockChanged (void)
+{
+    if (SysTimeCtrl.backend->clockChanged != NULL) {
+        SysTimeCtrl.backend->clockChanged ();
+    }
+}
+
+
+/**
+ * @brief  Trim the rate of CLOCK_REALTIME against the backend clock, e.g.
+ *         to correct a known crystal error.
+ * @param  ppb Frequency correction, parts per billion. Positive makes the
+ *         clock run faster.
+ * @retval 0 on success, -1 if the correction is out of range.
+ */
+int SYSTIME_Trim (int32_t ppb)
 {
+    SysTimeClock clock;
     SysTime tm;
 
+    if (ppb > SYSTIME_CONF_TRIM_MAX_PPB || ppb < -SYSTIME_CONF_TRIM_MAX_PPB) {
+        return -1;
+    }
+
+    SYSTIME_Snapshot (&tm, &clock);
+    SYSTIME_Fold (&clock, &tm);
+    clock.trim = ppb;
+    SYSTIME_SetClock (&clock);
+
+    return 0;
+}
+
+
+/**
+ * @brief  Current frequency trim.
+ * @retval Frequency correction, parts per billion.
+ */
+int32_t SYSTIME_GetTrim (void)
+{
+    SysTimeClock clock;
+
+    SYSTIME_Snapshot (NULL, &clock);
+
+    return clock.trim;
+}
+
+
+/**
+ * @brief  Request a callback ahead of every trigger, e.g. for starting up
+ *         oscillators before the deadline. Optional for the backend.
+ * @param  lead How long before the trigger the callback is invoked.
+ * @param  callback Callback, NULL to disable.
+ * @retval 0 on success, -1 if the backend does not support it.
+ */
+int SYSTIME_Prewake (struct timespec *lead, void (*callback) (void))
+{
+    if (SysTimeCtrl.backend->prewake == NULL) {
+        return -1;
+    }
+
+    SysTime tm = {
+        .tv_sec = lead->tv_sec,
+        .tv_nsec = lead->tv_nsec
+    };
+
+    SysTimeCtrl.backend->prewake (&tm, callback);
+
+    return 0;
+}
+
+
+#if defined(_POSIX_TIMERS)
+
+int clock_settime (clockid_t clock_id, const struct timespec *tp)
+{
     if (tp != NULL) {
 
         if (clock_id == CLOCK_REALTIME) {
@@ -88,8 +495,7 @@ int clock_settime (clockid_t clock_id, const struct timespec *tp)
                 return -1;
             }
 
-            SysTimeCtrl.backend->getSystemNanoTime (&tm);
-            SYSTIME_SUB (&SysTimeCtrl.offset, tp, &tm);
+            SYSTIME_SetRealtime (tp);
 
             return 0;
 
@@ -107,13 +513,14 @@ int clock_settime (clockid_t clock_id, const struct timespec *tp)
 
 int clock_gettime (clockid_t clock_id, struct timespec *tp)
 {
+    SysTimeClock clock;
     SysTime tm;
 
     if (tp != NULL) {
-        SysTimeCtrl.backend->getSystemNanoTime (&tm);
+        SYSTIME_Snapshot (&tm, &clock);
         switch (clock_id) {
             case CLOCK_REALTIME:
-                SYSTIME_ADD (tp, &tm, &SysTimeCtrl.offset);
+                SYSTIME_Realtime (tp, &tm, &clock);
                 return 0;
 #ifdef _POSIX_MONOTONIC_CLOCK
             case CLOCK_MONOTONIC:
@@ -171,8 +578,6 @@ int settimeofday (const struct timeval *tv, const struct timezone *tz)
 
     return clock_settime (CLOCK_REALTIME, &tp);
 #else
-    SysTime tm;
-
     if (tv != NULL) {
 
         if (tv->tv_usec >= 1000000) {
@@ -180,20 +585,12 @@ int settimeofday (const struct timeval *tv, const struct timezone *tz)
             return -1;
         }
 
-        SysTimeCtrl.backend->getSystemNanoTime (&tm);
-
         struct timespec tp = {
             .tv_sec = tv->tv_sec,
             .tv_nsec = tv->tv_usec * 1000
         };
 
-        if (tp.tv_nsec >= tm.tv_nsec) {
-            SysTimeCtrl.offset.tv_sec = tp.tv_sec - tm.tv_sec;
-            SysTimeCtrl.offset.tv_nsec = tp.tv_nsec - tm.tv_nsec;
-        } else {
-            SysTimeCtrl.offset.tv_sec = tp.tv_sec - tm.tv_sec - 1;
-            SysTimeCtrl.offset.tv_nsec = 1000000000 + tp.tv_nsec - tm.tv_nsec;
-        }
+        SYSTIME_SetRealtime (&tp);
 
         return 0;
 
@@ -221,16 +618,15 @@ int gettimeofday (struct timeval *tv, void *tz)
         return res;
     }
 #else
+    struct timespec tp;
+    SysTimeClock clock;
     SysTime tm;
 
     if (tv != NULL) {
-        SysTimeCtrl.backend->getSystemNanoTime (&tm);
-        tv->tv_sec = tm.tv_sec + SysTimeCtrl.offset.tv_sec;
-        tv->tv_usec = (tm.tv_nsec + SysTimeCtrl.offset.tv_nsec) / 1000;
-        if (tv->tv_usec >= 1000000) {
-            tv->tv_sec++;
-            tv->tv_usec -= 1000000;
-        }
+        SYSTIME_Snapshot (&tm, &clock);
+        SYSTIME_Realtime (&tp, &tm, &clock);
+        tv->tv_sec = tp.tv_sec;
+        tv->tv_usec = tp.tv_nsec / 1000;
     } else {
         errno = EFAULT;
         return -1;
@@ -244,7 +640,14 @@ int gettimeofday (struct timeval *tv, void *tz)
 
 time_t time (time_t *timer)
 {
-  time_t t = (SysTimeCtrl.backend->getSystemTime () + SysTimeCtrl.offset.tv_sec);
+  struct timespec tp;
+  SysTimeClock clock;
+  SysTime tm;
+
+  SYSTIME_Snapshot (&tm, &clock);
+  SYSTIME_Realtime (&tp, &tm, &clock);
+
+  time_t t = tp.tv_sec;
 
   /* Copy system time to timer if not NULL*/
   if (timer != NULL) {
@@ -253,3 +656,38 @@ time_t time (time_t *timer)
 
   return t;
 }
+
+
+/**
+ * @brief  Slew CLOCK_REALTIME by the given amount, at most
+ *         SYSTIME_CONF_SLEW_PPM faster or slower than the backend clock.
+ *         A new adjustment replaces the one still pending.
+ * @param  delta Correction, NULL to only query.
+ * @param  olddelta Correction still pending, may be NULL.
+ * @retval 0 on success, -1 on error.
+ */
+int adjtime (const struct timeval *delta, struct timeval *olddelta)
+{
+    SysTimeClock clock;
+    SysTime tm;
+
+    if (delta != NULL && (delta->tv_usec >= 1000000 || delta->tv_usec <= -1000000)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    SYSTIME_Snapshot (&tm, &clock);
+    SYSTIME_Fold (&clock, &tm);
+
+    if (olddelta != NULL) {
+        olddelta->tv_sec = (time_t)(clock.slew / 1000000000);
+        olddelta->tv_usec = (long)(clock.slew % 1000000000) / 1000;
+    }
+
+    if (delta != NULL) {
+        clock.slew = (int64_t)delta->tv_sec * 1000000000 + (int64_t)delta->tv_usec * 1000;
+        SYSTIME_SetClock (&clock);
+    }
+
+    return 0;
+}
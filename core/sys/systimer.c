@@ -18,40 +18,280 @@
 #include <stdint.h>
 
 #include <protothreads.h>
+#include "process-record.h"
+#include "process-trace.h"
+
+#include "em_int.h"
 
 #include "lpm.h"
 #include "systime.h"
 #include "systimer.h"
 
 
-/** Pointer to first timer. */
-static SYSTIMER *FirstTimer = NULL;
+/** Timers of the default kernel instance. */
+static PROCESS_CONF_THREAD_LOCAL SystimerList DefaultList = {
+    .context = &process_default_context,
+    .process = &SYSTIMER_Process
+};
+
+/**
+ * Instances waiting for the scheduler trigger, a pairing heap ordered by
+ * target. With PROCESS_CONF_THREAD_LOCAL every thread has its own heap and
+ * trigger.
+ */
+static PROCESS_CONF_THREAD_LOCAL SystimerList *ArmedLists = NULL;
+
+/** Target time of the scheduler trigger, the earliest one of all instances. */
+static PROCESS_CONF_THREAD_LOCAL struct timespec ArmedTarget;
+static PROCESS_CONF_THREAD_LOCAL volatile int TriggerArmed = 0;
+
+/** Timers of the active kernel instance. */
+#define TIMERS      SYSTIMER_Current ()
+#define FirstTimer  (TIMERS->first)
+
+#if SYSTIMER_CONF_STATS
+SystimerStats SYSTIMER_Stats;
+
+
+static void SYSTIMER_UpdateStats (struct timespec *target, struct timespec *current_time)
+{
+    struct timespec late;
+    uint32_t late_ns;
+
+    // The trigger rounds to the counter ticks, it may come a little early
+    if (SYSTIME_CMP (current_time, target) <= 0) {
+        late_ns = 0;
+    } else {
+        SYSTIME_SUB (&late, current_time, target);
+        late_ns = (late.tv_sec >= 4) ? 0xFFFFFFFF : late.tv_sec * 1000000000UL + late.tv_nsec;
+    }
+
+    SYSTIMER_Stats.expired++;
+    SYSTIMER_Stats.late_sum_ns += late_ns;
+    if (late_ns > SYSTIMER_Stats.late_max_ns) {
+        SYSTIMER_Stats.late_max_ns = late_ns;
+    }
+}
+#endif /* SYSTIMER_CONF_STATS */
+
+
+static SystimerList *SYSTIMER_Current (void)
+{
+    SystimerList *list = process_ctx->systimer;
+
+    return (list != NULL) ? list : &DefaultList;
+}
+
+
+static SystimerList *SYSTIMER_Meld (SystimerList *a, SystimerList *b)
+{
+    SystimerList *tmp;
+
+    if (a == NULL) {
+        return b;
+    }
+    if (b == NULL) {
+        return a;
+    }
+    if (SYSTIME_CMP (&b->target, &a->target) < 0) {
+        tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    // b becomes the first child of a
+    b->prev = a;
+    b->sibling = a->child;
+    if (a->child != NULL) {
+        a->child->prev = b;
+    }
+    a->child = b;
+
+    return a;
+}
+
+
+// Meld the children of a removed heap node, in pairs and then right to left
+static SystimerList *SYSTIMER_MergePairs (SystimerList *first)
+{
+    SystimerList *a, *b, *next, *pairs = NULL;
+
+    while (first != NULL) {
+        a = first;
+        b = a->sibling;
+        next = (b != NULL) ? b->sibling : NULL;
+        a->sibling = a->prev = NULL;
+        if (b != NULL) {
+            b->sibling = b->prev = NULL;
+        }
+        a = SYSTIMER_Meld (a, b);
+        a->sibling = pairs;
+        pairs = a;
+        first = next;
+    }
+
+    first = NULL;
+    while (pairs != NULL) {
+        next = pairs->sibling;
+        pairs->sibling = NULL;
+        first = SYSTIMER_Meld (first, pairs);
+        pairs = next;
+    }
+
+    return first;
+}
+
+
+static void SYSTIMER_Disarm (SystimerList *list)
+{
+    SystimerList *sub;
+
+    if (!list->armed) {
+        return;
+    }
+    list->armed = 0;
+
+    sub = SYSTIMER_MergePairs (list->child);
+    if (list == ArmedLists) {
+        ArmedLists = sub;
+    } else {
+        if (list->prev->child == list) {
+            list->prev->child = list->sibling;
+        } else {
+            list->prev->sibling = list->sibling;
+        }
+        if (list->sibling != NULL) {
+            list->sibling->prev = list->prev;
+        }
+        ArmedLists = SYSTIMER_Meld (ArmedLists, sub);
+    }
+    list->child = list->sibling = list->prev = NULL;
+}
+
+
+static void SYSTIMER_Arm (SystimerList *list, const struct timespec *target)
+{
+    SYSTIME_SET (&list->target, target);
+    list->child = list->sibling = list->prev = NULL;
+    list->armed = 1;
+    ArmedLists = SYSTIMER_Meld (ArmedLists, list);
+}
 
 
 static void SYSTIMER_TriggerHandler (void)
 {
-    process_poll (&SYSTIMER_Process);
+    SystimerList *list;
+#if SYSTIMER_CONF_STATS
+    struct timespec now;
+
+    clock_gettime (CLOCK_REALTIME, &now);
+    SYSTIMER_UpdateStats (&ArmedTarget, &now);
+#endif
+
+    TriggerArmed = 0;
+
+    // Poll every instance that was waiting for this trigger
+    while (ArmedLists != NULL && SYSTIME_CMP (&ArmedLists->target, &ArmedTarget) <= 0) {
+        list = ArmedLists;
+        SYSTIMER_Disarm (list);
+        process_context_poll (list->context, list->process);
+    }
     LPM_RegisterEvent ();
 }
 
 
+/**
+ * @brief  Earliest target of the running timers of an instance, on
+ *         CLOCK_REALTIME which the trigger takes. The trigger counts the
+ *         time left on the backend, so the target of a CLOCK_MONOTONIC
+ *         timer is the current time plus its time left.
+ * @param  list Timers of the instance.
+ * @param  target Earliest target.
+ * @retval 0 if a timer is running, -1 otherwise.
+ */
+static int SYSTIMER_Target (SystimerList *list, struct timespec *target)
+{
+    struct timespec now;
+
+    if (list->monotonic == NULL) {
+        if (list->first == NULL) {
+            return -1;
+        }
+        SYSTIME_SET (target, &list->first->target);
+        return 0;
+    }
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    if (SYSTIME_CMP (&list->monotonic->target, &now) > 0) {
+        SYSTIME_SUB (target, &list->monotonic->target, &now);
+    } else {
+        SYSTIME_RESET (target);
+    }
+    clock_gettime (CLOCK_REALTIME, &now);
+    SYSTIME_ADD (target, target, &now);
+
+    if (list->first != NULL && SYSTIME_CMP (&list->first->target, target) < 0) {
+        SYSTIME_SET (target, &list->first->target);
+    }
+
+    return 0;
+}
+
+
 /**
  * @brief  Set up the RTC to trigger when the next timer is to be timed out.
- * @param  current_time Current time (used to avoid another call to clock_gettime ())
  * @retval None.
  */
 static void SYSTIMER_SetTrigger ()
 {
-    if (FirstTimer != NULL) {
-        SYSTIME_Trigger (&FirstTimer->target, SYSTIMER_TriggerHandler);
+    SystimerList *list = TIMERS;
+    struct timespec target;
+    int running, armed;
+
+    running = (SYSTIMER_Target (list, &target) == 0);
+
+    // The trigger is shared, arm it for the earliest instance
+    INT_Disable ();
+    if (!list->armed || !running ||
+        SYSTIME_CMP (&list->target, &target) != 0) {
+        SYSTIMER_Disarm (list);
+        if (running) {
+            SYSTIMER_Arm (list, &target);
+        }
+    }
+    armed = (ArmedLists != NULL);
+    if (armed) {
+        SYSTIME_SET (&target, &ArmedLists->target);
+    }
+    INT_Enable ();
+
+    if (armed) {
+        // Already armed for the same target
+        if (TriggerArmed && SYSTIME_CMP (&ArmedTarget, &target) == 0) {
+            return;
+        }
+        SYSTIME_SET (&ArmedTarget, &target);
+        TriggerArmed = 1;
+        SYSTIME_Trigger (&ArmedTarget, SYSTIMER_TriggerHandler);
+    } else if (TriggerArmed) {
+        TriggerArmed = 0;
+        SYSTIME_Cancel (SYSTIME_CHANNEL_SCHEDULER);
     }
 }
 
 
+// Running timers of the active instance on the clock of the timer
+static SYSTIMER **SYSTIMER_Head (SYSTIMER *timer)
+{
+    return (timer->clock == CLOCK_MONOTONIC) ? &TIMERS->monotonic : &FirstTimer;
+}
+
+
 // Add timer to the list
 static void SYSTIMER_Add (SYSTIMER *timer)
 {
-    SYSTIMER *tmr = FirstTimer, *prv = NULL;
+    SYSTIMER **head = SYSTIMER_Head (timer);
+    SYSTIMER *tmr = *head, *prv = NULL;
     while (1) {
         if (tmr == NULL || SYSTIME_CMP (&tmr->target, &timer->target) >= 0) {
             timer->next = tmr;
@@ -62,7 +302,7 @@ static void SYSTIMER_Add (SYSTIMER *timer)
             if (prv != NULL) {
                 prv->next = timer;
             } else {
-                FirstTimer = timer;
+                *head = timer;
             }
             break;
         }
@@ -78,7 +318,7 @@ static void SYSTIMER_Remove (SYSTIMER *timer)
     if (timer->prev) {
         timer->prev->next = timer->next;
     } else {
-        FirstTimer = timer->next;
+        *SYSTIMER_Head (timer) = timer->next;
     }
     if (timer->next) {
         timer->next->prev = timer->prev;
@@ -88,6 +328,61 @@ static void SYSTIMER_Remove (SYSTIMER *timer)
 }
 
 
+/**
+ * @brief  Execute the callbacks of the timed out timers of a list and
+ *         reorder it.
+ * @param  head First timer of the list.
+ * @param  clock Clock of the timers in the list.
+ * @retval None.
+ */
+static void SYSTIMER_Expire (SYSTIMER **head, clockid_t clock)
+{
+    SYSTIMER *timer;
+    SYSTIMER *readd, *temp;
+    struct timespec current_time;
+
+    clock_gettime (clock, &current_time);
+
+    // In case we have many timers expiring at the same time
+    readd = NULL;
+
+    /* Handle timer events and reorder the list */
+    timer = *head;
+    while (timer) {
+        temp = timer->next;
+        if (SYSTIME_CMP (&timer->target, &current_time) <= 0) {
+            PROCESS_RECORD (PROCESS_RECORD_TIMER, 0, PROCESS_CURRENT (), timer->arg);
+            PROCESS_TRACE (PROCESS_TRACE_TIMER, 0, timer);
+            if (timer->callback != NULL) {
+                timer->callback (timer->arg);
+            }
+            // Check if timer was stopped inside the callback
+            if (timer->running) {
+                if (SYSTIME_ISSET (&timer->interval)) {
+                    SYSTIMER_Remove (timer);
+                    timer->next = readd;
+                    readd = timer;
+                    // SYSTIME_ADD (&timer->target, &timer->target, &timer->interval);
+                    // SYSTIMER_Add (timer);
+                } else {
+                    SYSTIMER_Stop (timer);
+                }
+            }
+        } else {
+            break;
+        }
+        timer = temp;
+    }
+
+    while (readd) {
+        temp = readd->next;
+        SYSTIME_ADD (&readd->target, &readd->target, &readd->interval);
+        SYSTIMER_Add (readd);
+        readd = temp;
+    }
+}
+
+
 /**
  * @brief  Check the timed out timers, execute their callbacks and set up next RTC trigger.
  * @retval None.
@@ -97,53 +392,14 @@ PROCESS_THREAD (SYSTIMER_Process, ev, data)
 {
     PROCESS_BEGIN ();
 
-    SYSTIMER *timer;
-    SYSTIMER *readd, *temp;
-    struct timespec current_time;
-
     while (1) {
 
         SYSTIMER_SetTrigger ();
 
         PROCESS_WAIT_EVENT_UNTIL (ev == PROCESS_EVENT_POLL);
 
-        clock_gettime (CLOCK_REALTIME, &current_time);
-
-        // In case we have many timers expiring at the same time
-        readd = NULL;
-
-        /* Handle timer events and reorder the list */
-        timer = FirstTimer;
-        while (timer) {
-            temp = timer->next;
-            if (SYSTIME_CMP (&timer->target, &current_time) <= 0) {
-                if (timer->callback != NULL) {
-                    timer->callback (timer->arg);
-                }
-                // Check if timer was stopped inside the callback
-                if (timer->running) {
-                    if (SYSTIME_ISSET (&timer->interval)) {
-                        SYSTIMER_Remove (timer);
-                        timer->next = readd;
-                        readd = timer;
-                        // SYSTIME_ADD (&timer->target, &timer->target, &timer->interval);
-                        // SYSTIMER_Add (timer);
-                    } else {
-                        SYSTIMER_Stop (timer);
-                    }
-                }
-            } else {
-                break;
-            }
-            timer = temp;
-        }
-
-        while (readd) {
-            temp = readd->next;
-            SYSTIME_ADD (&readd->target, &readd->target, &readd->interval);
-            SYSTIMER_Add (readd);
-            readd = temp;
-        }
+        SYSTIMER_Expire (&FirstTimer, CLOCK_REALTIME);
+        SYSTIMER_Expire (&TIMERS->monotonic, CLOCK_MONOTONIC);
     }
 
     PROCESS_END ();
@@ -172,6 +428,7 @@ void SYSTIMER_Init_NoStart (SYSTIMER *timer, uint32_t timeout, uint32_t interval
     timer->arg = arg;
     timer->next = NULL;
     timer->prev = NULL;
+    timer->clock = CLOCK_REALTIME;
 }
 
 
@@ -186,6 +443,22 @@ void SYSTIMER_Init (SYSTIMER *timer, uint32_t timeout, uint32_t interval, int (*
 }
 
 
+/**
+ * @brief  Select the clock a stopped timer counts on. Timers count on
+ *         CLOCK_REALTIME by default; one on CLOCK_MONOTONIC runs for its
+ *         timeout also when CLOCK_REALTIME is stepped meanwhile.
+ * @param  timer Pointer to timer structure.
+ * @param  clock CLOCK_REALTIME or CLOCK_MONOTONIC.
+ * @retval None.
+ */
+void SYSTIMER_SetClock (SYSTIMER *timer, clockid_t clock)
+{
+    if (!timer->running && !SYSTIME_ISSET (&timer->target)) {
+        timer->clock = clock;
+    }
+}
+
+
 /**
  * @brief  Start the timer.
  * @param  timer Pointer to timer structure.
@@ -201,7 +474,7 @@ void SYSTIMER_Start (SYSTIMER *timer)
     }
 
     struct timespec current_time;
-    clock_gettime (CLOCK_REALTIME, &current_time);
+    clock_gettime (timer->clock, &current_time);
 
     // Update the target, if timer is stopped
     if (timer->target.tv_sec == 0 && timer->target.tv_nsec == 0) {
@@ -214,7 +487,11 @@ void SYSTIMER_Start (SYSTIMER *timer)
     }
 
     SYSTIMER_Add (timer);
-    SYSTIMER_SetTrigger ();
+
+    // Re-arm only if the new timer became the earliest one
+    if (timer == *SYSTIMER_Head (timer)) {
+        SYSTIMER_SetTrigger ();
+    }
 }
 
 
@@ -255,7 +532,7 @@ void SYSTIMER_Stop (SYSTIMER *timer)
  */
 void SYSTIMER_Reset (SYSTIMER *timer)
 {
-    clock_gettime (CLOCK_REALTIME, &timer->started);
+    clock_gettime (timer->clock, &timer->started);
     timer->started.tv_nsec = (timer->started.tv_nsec / 1000000) * 1000000;
     SYSTIME_ADD (&timer->target, &timer->started, &timer->timeout);
 }
@@ -269,7 +546,7 @@ void SYSTIMER_Reset (SYSTIMER *timer)
 int SYSTIMER_IsReady (SYSTIMER *timer)
 {
     struct timespec current_time;
-    clock_gettime (CLOCK_REALTIME, &current_time);
+    clock_gettime (timer->clock, &current_time);
 
     if (SYSTIME_CMP (&timer->target, &current_time) <= 0) {
         return -1;
@@ -288,3 +565,68 @@ int SYSTIMER_IsRunning (SYSTIMER *timer)
 {
   return timer->running;
 }
+
+
+/**
+ * @brief  Get the list of running timers, ordered by target time.
+ * @retval Pointer to the first timer, NULL if no timers are running.
+ */
+SYSTIMER *SYSTIMER_List (void)
+{
+  return FirstTimer;
+}
+
+
+/**
+ * @brief  Get the list of running CLOCK_MONOTONIC timers, ordered by
+ *         target time.
+ * @retval Pointer to the first timer, NULL if no timers are running.
+ */
+SYSTIMER *SYSTIMER_ListMonotonic (void)
+{
+  return TIMERS->monotonic;
+}
+
+
+/**
+ * @brief  Give the active kernel instance its own timers and start its
+ *         timer process. The default instance uses SYSTIMER_Process.
+ *         Initializing again drops the timers of the instance, so a new
+ *         list must be zeroed, e.g. static.
+ * @param  list Timer list of the instance.
+ * @retval None.
+ */
+void SYSTIMER_InitContext (SystimerList *list)
+{
+    SYSTIMER *timer;
+
+    // Out of the trigger heap before its links are reset
+    INT_Disable ();
+    SYSTIMER_Disarm (list);
+    INT_Enable ();
+
+    if (process_is_running (&list->instance)) {
+        process_exit (&list->instance);
+    }
+    for (timer = list->first; timer != NULL; timer = timer->next) {
+        timer->running = 0;
+    }
+    for (timer = list->monotonic; timer != NULL; timer = timer->next) {
+        timer->running = 0;
+    }
+
+    list->first = NULL;
+    list->monotonic = NULL;
+    list->armed = 0;
+    list->child = list->sibling = list->prev = NULL;
+    list->context = process_ctx;
+    list->instance = SYSTIMER_Process;
+    list->instance.next = NULL;
+    list->instance.needspoll = 0;
+    // The copy would resume where the default instance has stopped
+    PT_INIT (&list->instance.pt);
+    list->process = &list->instance;
+
+    process_ctx->systimer = list;
+    process_start (list->process, NULL);
+}
@@ -0,0 +1,284 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "systime.h"
+#include "timesync.h"
+
+
+/**
+ * @brief  CRC-8 (polynomial 0x07) of a frame.
+ */
+static uint8_t TIMESYNC_Crc (const uint8_t *data, int len)
+{
+    uint8_t crc = 0;
+    int i;
+
+    while (len--) {
+        crc ^= *data++;
+        for (i = 0; i < 8; i++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+
+    return crc;
+}
+
+
+static uint8_t *TIMESYNC_PutTime (uint8_t *p, const struct timespec *tp)
+{
+    uint32_t sec = (uint32_t)tp->tv_sec;
+    uint32_t nsec = (uint32_t)tp->tv_nsec;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        *p++ = (uint8_t)(sec >> (8 * i));
+    }
+    for (i = 0; i < 4; i++) {
+        *p++ = (uint8_t)(nsec >> (8 * i));
+    }
+
+    return p;
+}
+
+
+static const uint8_t *TIMESYNC_GetTime (const uint8_t *p, struct timespec *tp)
+{
+    uint32_t sec = 0, nsec = 0;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        sec |= (uint32_t)*p++ << (8 * i);
+    }
+    for (i = 0; i < 4; i++) {
+        nsec |= (uint32_t)*p++ << (8 * i);
+    }
+
+    tp->tv_sec = (time_t)sec;
+    tp->tv_nsec = (long)nsec;
+
+    return p;
+}
+
+
+static int64_t TIMESYNC_Diff (const struct timespec *a, const struct timespec *b)
+{
+    return ((int64_t)a->tv_sec - b->tv_sec) * 1000000000 + (a->tv_nsec - b->tv_nsec);
+}
+
+
+/**
+ * @brief  Frame length by type, including the CRC.
+ * @retval Length, 0 for an unknown type.
+ */
+static int TIMESYNC_FrameLength (uint8_t type)
+{
+    switch (type) {
+        case TIMESYNC_REQUEST:
+            return 3 + 8 + 1;
+        case TIMESYNC_RESPONSE:
+            return 3 + 3 * 8 + 1;
+        default:
+            return 0;
+    }
+}
+
+
+/**
+ * @brief  Answer a request with the receive and the transmit time.
+ */
+static void TIMESYNC_Respond (TimeSync *ts)
+{
+    uint8_t frame[TIMESYNC_FRAME_MAX];
+    struct timespec t3;
+    uint8_t *p = frame;
+
+    *p++ = TIMESYNC_SYNC;
+    *p++ = TIMESYNC_RESPONSE;
+    *p++ = ts->frame[2];
+
+    // Echo t1 as is
+    memcpy (p, &ts->frame[3], 8);
+    p += 8;
+    p = TIMESYNC_PutTime (p, &ts->rx_time);
+
+    clock_gettime (CLOCK_REALTIME, &t3);
+    p = TIMESYNC_PutTime (p, &t3);
+
+    *p = TIMESYNC_Crc (frame, p - frame);
+    p++;
+
+    ts->write (ts->arg, frame, p - frame);
+}
+
+
+/**
+ * @brief  Complete an exchange and correct the clock by the offset.
+ */
+static void TIMESYNC_Complete (TimeSync *ts)
+{
+    struct timespec t1, t2, t3, now;
+    const uint8_t *p = &ts->frame[3];
+    int64_t delay;
+
+    if (!ts->pending || ts->frame[2] != ts->seq) {
+        return;
+    }
+
+    p = TIMESYNC_GetTime (p, &t1);
+    p = TIMESYNC_GetTime (p, &t2);
+    p = TIMESYNC_GetTime (p, &t3);
+
+    // Not the request we are waiting for
+    if (SYSTIME_CMP (&t1, &ts->t1) != 0) {
+        return;
+    }
+
+    ts->pending = 0;
+
+    delay = TIMESYNC_Diff (&ts->rx_time, &t1) - TIMESYNC_Diff (&t3, &t2);
+    if (delay < 0) {
+        delay = 0;
+    }
+
+    ts->offset_ns = (TIMESYNC_Diff (&t2, &t1) + TIMESYNC_Diff (&t3, &ts->rx_time)) / 2;
+    ts->delay_ns = delay > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)delay;
+
+    if (ts->delay_ns > TIMESYNC_CONF_MAX_DELAY_NS) {
+        ts->rejected++;
+        return;
+    }
+
+    // Small offsets are slewed in by clock_settime ()
+    clock_gettime (CLOCK_REALTIME, &now);
+    now.tv_sec += (time_t)(ts->offset_ns / 1000000000);
+    now.tv_nsec += (long)(ts->offset_ns % 1000000000);
+    if (now.tv_nsec >= 1000000000) {
+        now.tv_sec++;
+        now.tv_nsec -= 1000000000;
+    } else if (now.tv_nsec < 0) {
+        now.tv_sec--;
+        now.tv_nsec += 1000000000;
+    }
+    clock_settime (CLOCK_REALTIME, &now);
+
+    ts->exchanges++;
+}
+
+
+/**
+ * @brief  Initialize a time sync endpoint. The same endpoint answers the
+ *         requests of its peer and can request the time itself.
+ * @param  ts Endpoint.
+ * @param  write Transport, writes the whole buffer to the byte stream.
+ * @param  arg Argument passed to @p write.
+ * @retval None.
+ */
+void TIMESYNC_Init (TimeSync *ts, int (*write) (void *arg, const uint8_t *data, int len), void *arg)
+{
+    memset (ts, 0, sizeof (TimeSync));
+    ts->write = write;
+    ts->arg = arg;
+}
+
+
+/**
+ * @brief  Send a time request to the peer. The clock is corrected when the
+ *         response arrives, an earlier request still pending is dropped.
+ * @param  ts Endpoint.
+ * @retval Result of the transport write.
+ */
+int TIMESYNC_Request (TimeSync *ts)
+{
+    uint8_t frame[TIMESYNC_FRAME_MAX];
+    uint8_t *p = frame;
+
+    ts->seq++;
+    ts->pending = 1;
+
+    *p++ = TIMESYNC_SYNC;
+    *p++ = TIMESYNC_REQUEST;
+    *p++ = ts->seq;
+
+    clock_gettime (CLOCK_REALTIME, &ts->t1);
+    p = TIMESYNC_PutTime (p, &ts->t1);
+
+    // The peer echoes t1 as sent, compare against the truncated value
+    TIMESYNC_GetTime (p - 8, &ts->t1);
+
+    *p = TIMESYNC_Crc (frame, p - frame);
+    p++;
+
+    return ts->write (ts->arg, frame, p - frame);
+}
+
+
+/**
+ * @brief  Feed bytes received from the peer.
+ * @param  ts Endpoint.
+ * @param  data Received bytes.
+ * @param  len Number of bytes.
+ * @retval None.
+ */
+void TIMESYNC_Input (TimeSync *ts, const uint8_t *data, int len)
+{
+    int length;
+
+    while (len--) {
+
+        if (ts->len == 0) {
+            // Hunt for the start of a frame
+            if (*data == TIMESYNC_SYNC) {
+                clock_gettime (CLOCK_REALTIME, &ts->rx_time);
+                ts->frame[ts->len++] = *data;
+            }
+            data++;
+            continue;
+        }
+
+        ts->frame[ts->len++] = *data++;
+
+        if (ts->len < 2) {
+            continue;
+        }
+
+        length = TIMESYNC_FrameLength (ts->frame[1]);
+        if (length == 0) {
+            ts->errors++;
+            ts->len = 0;
+            continue;
+        }
+
+        if (ts->len < length) {
+            continue;
+        }
+
+        ts->len = 0;
+
+        if (TIMESYNC_Crc (ts->frame, length - 1) != ts->frame[length - 1]) {
+            ts->errors++;
+            continue;
+        }
+
+        if (ts->frame[1] == TIMESYNC_REQUEST) {
+            TIMESYNC_Respond (ts);
+        } else {
+            TIMESYNC_Complete (ts);
+        }
+    }
+}
@@ -0,0 +1,99 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <em_device.h>
+
+#include "boottime.h"
+
+/** Boot timing marks, inspect with the debugger. */
+volatile BootTime BootTiming;
+
+
+/**
+ * @brief  Start the DWT cycle counter used for boot timing.
+ *         Must be called as the first thing in main ().
+ * @retval None.
+ */
+void BOOTTIME_Start (void)
+{
+    uint32_t i;
+
+    for (i = 0; i < BOOTTIME_MARK_COUNT; i++) {
+        BootTiming.cycles[i] = 0;
+        BootTiming.frequency[i] = 0;
+    }
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    BOOTTIME_Mark (BOOTTIME_MAIN);
+}
+
+
+/**
+ * @brief  Record the cycle count and the core clock for a boot milestone.
+ *         Only the first call for every mark is recorded.
+ * @param  mark Boot milestone.
+ * @retval None.
+ */
+void BOOTTIME_Mark (BootTimeMark mark)
+{
+    if (BootTiming.frequency[mark] == 0) {
+        BootTiming.cycles[mark] = DWT->CYCCNT;
+        BootTiming.frequency[mark] = SystemCoreClock;
+    }
+}
+
+
+/**
+ * @brief  Get the time from main () to a boot milestone.
+ *
+ * The core clock may change between the marks, so the cycles are converted
+ * mark by mark, every stretch at the frequency recorded at its start. A
+ * frequency change between two marks is seen only at the next mark.
+ *
+ * @param  mark Boot milestone.
+ * @retval Microseconds elapsed, 0 if the milestone has not been reached.
+ */
+uint32_t BOOTTIME_GetMicros (BootTimeMark mark)
+{
+    uint64_t nanos = 0;
+    uint32_t i, from, next, elapsed;
+
+    if (BootTiming.frequency[BOOTTIME_MAIN] == 0 || BootTiming.frequency[mark] == 0) {
+        return 0;
+    }
+
+    // Walk the marks reached before this one in the order they were reached
+    from = BOOTTIME_MAIN;
+    while (from != mark) {
+        next = mark;
+        for (i = 0; i < BOOTTIME_MARK_COUNT; i++) {
+            elapsed = BootTiming.cycles[i] - BootTiming.cycles[from];
+            if (BootTiming.frequency[i] != 0 && i != from && elapsed > 0
+                    && elapsed < BootTiming.cycles[next] - BootTiming.cycles[from]) {
+                next = i;
+            }
+        }
+        elapsed = BootTiming.cycles[next] - BootTiming.cycles[from];
+        nanos += ((uint64_t)elapsed * 1000000000) / BootTiming.frequency[from];
+        from = next;
+    }
+
+    return (uint32_t)(nanos / 1000);
+}
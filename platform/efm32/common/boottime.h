@@ -0,0 +1,44 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef BOOTTIME_H_
+#define BOOTTIME_H_
+
+#include <stdint.h>
+
+typedef enum {
+    BOOTTIME_MAIN = 0,          // Entered main ()
+    BOOTTIME_CLOCKS,            // Clocks have been set up
+    BOOTTIME_SYSTIME,           // System time initialized
+    BOOTTIME_PROCESSES,         // Processes started
+    BOOTTIME_FIRST_EVENT,       // First pass of the scheduler has completed
+    BOOTTIME_LFXO_READY,        // RTC switched over to LFXO
+    BOOTTIME_MARK_COUNT
+} BootTimeMark;
+
+typedef struct {
+    uint32_t    cycles[BOOTTIME_MARK_COUNT];    // DWT cycle count at the mark
+    uint32_t    frequency[BOOTTIME_MARK_COUNT]; // Core clock at the mark, 0 if not reached
+} BootTime;
+
+extern volatile BootTime BootTiming;
+
+void BOOTTIME_Start (void);
+void BOOTTIME_Mark (BootTimeMark mark);
+uint32_t BOOTTIME_GetMicros (BootTimeMark mark);
+
+#endif /* BOOTTIME_H_ */
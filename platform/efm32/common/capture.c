@@ -0,0 +1,248 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stddef.h>
+
+#include <em_device.h>
+#include <em_cmu.h>
+#include <em_gpio.h>
+#include <em_int.h>
+
+#include <lpm.h>
+#include <protothreads.h>
+#include <systime.h>
+
+#include "capture.h"
+
+typedef struct {
+    struct process  *process;
+    struct timespec queue[CAPTURE_CONF_QUEUE];
+    volatile uint8_t head;
+    volatile uint8_t tail;
+    volatile uint32_t lost;
+} CaptureChannel;
+
+typedef struct {
+    CaptureChannel  channel[CAPTURE_CHANNELS];
+    unsigned int    active;
+    int             started;
+} CaptureControl;
+
+
+static CaptureControl CaptureCtrl;
+
+process_event_t CAPTURE_Event;
+
+
+/***************************************************************************//**
+ * @brief TIMER1 Interrupt Handler, timestamp the captured edges.
+ *
+ * The counter value and the system time are read together here. The age of
+ * a capture is the distance from the captured count to the current count,
+ * so the timestamp does not depend on the interrupt latency.
+ ******************************************************************************/
+void TIMER1_IRQHandler (void)
+{
+    uint32_t flags, cnt, freq, age_cnt;
+    uint16_t ccv[CAPTURE_CHANNELS][2];
+    unsigned int n[CAPTURE_CHANNELS];
+    struct timespec now, age;
+    CaptureChannel *ch;
+    unsigned int i, j;
+    uint8_t next;
+
+    flags = TIMER1->IF & TIMER1->IEN;
+    TIMER1->IFC = flags;
+
+    // Drain the capture buffers first, so that every capture is older
+    // than the counter value read below
+    for (i = 0; i < CAPTURE_CHANNELS; i++) {
+        n[i] = 0;
+        while (n[i] < 2 && (TIMER1->STATUS & (TIMER_STATUS_ICV0 << i))) {
+            ccv[i][n[i]++] = TIMER1->CC[i].CCV;
+        }
+    }
+
+    cnt = TIMER1->CNT;
+    clock_gettime (CLOCK_REALTIME, &now);
+
+    freq = CMU_ClockFreqGet (cmuClock_TIMER1) >> (CAPTURE_CONF_PRESC >> _TIMER_CTRL_PRESC_SHIFT);
+
+    for (i = 0; i < CAPTURE_CHANNELS; i++) {
+
+        ch = &CaptureCtrl.channel[i];
+
+        // Captures overwritten in the hardware buffer
+        if (flags & (TIMER_IF_ICBOF0 << i)) {
+            ch->lost++;
+        }
+
+        for (j = 0; j < n[i]; j++) {
+
+            // Queue full, drop the capture
+            next = (ch->head + 1) % CAPTURE_CONF_QUEUE;
+            if (next == ch->tail) {
+                ch->lost++;
+                continue;
+            }
+
+            age_cnt = (cnt - ccv[i][j]) & 0xFFFF;
+            age.tv_sec = age_cnt / freq;
+            age.tv_nsec = (uint32_t)(((uint64_t)(age_cnt % freq) * 1000000000) / freq);
+            SYSTIME_SUB (&ch->queue[ch->head], &now, &age);
+            ch->head = next;
+        }
+    }
+
+    process_poll (&CAPTURE_Process);
+    LPM_RegisterEvent ();
+}
+
+
+/**
+ * @brief  Start timestamping the edges of a GPIO pin. The pin is routed
+ *         through PRS to TIMER1 input capture. The process receives a
+ *         CAPTURE_Event with a CaptureEvent payload for every edge.
+ * @param  channel Capture channel, 0 .. CAPTURE_CHANNELS - 1.
+ * @param  port GPIO port.
+ * @param  pin GPIO pin. Pins with the same number on different ports
+ *         share the GPIO interrupt routing and cannot be captured together.
+ * @param  edge CAPTURE_EDGE_RISING, CAPTURE_EDGE_FALLING or CAPTURE_EDGE_BOTH.
+ * @param  p Process to deliver the events to.
+ * @retval 0 on success, -1 if the channel is not valid.
+ */
+int CAPTURE_Start (unsigned int channel, GPIO_Port_TypeDef port, unsigned int pin, uint32_t edge, struct process *p)
+{
+    unsigned int prs = CAPTURE_CONF_PRS_FIRST + channel;
+
+    if (channel >= CAPTURE_CHANNELS || prs >= PRS_CHAN_COUNT || pin > 15) {
+        return -1;
+    }
+
+    CAPTURE_Stop (channel);
+
+    if (CaptureCtrl.active == 0) {
+
+        if (!CaptureCtrl.started) {
+            CaptureCtrl.started = 1;
+            CAPTURE_Event = process_alloc_event ();
+            process_start (&CAPTURE_Process, NULL);
+        }
+
+        CMU_ClockEnable (cmuClock_HFPER, true);
+        CMU_ClockEnable (cmuClock_GPIO, true);
+        CMU_ClockEnable (cmuClock_PRS, true);
+        CMU_ClockEnable (cmuClock_TIMER1, true);
+
+        TIMER1->CTRL = TIMER_CTRL_MODE_UP | CAPTURE_CONF_PRESC;
+        TIMER1->TOP = 0xFFFF;
+        TIMER1->CMD = TIMER_CMD_START;
+
+        NVIC_ClearPendingIRQ (TIMER1_IRQn);
+        NVIC_EnableIRQ (TIMER1_IRQn);
+
+        // TIMER1 does not run in EM2
+        LPM_BlockEM2 ();
+    }
+
+    CaptureCtrl.channel[channel].process = p;
+    CaptureCtrl.channel[channel].head = 0;
+    CaptureCtrl.channel[channel].tail = 0;
+    CaptureCtrl.channel[channel].lost = 0;
+
+    // Pin edge to PRS through the GPIO interrupt routing, interrupt disabled
+    GPIO_PinModeSet (port, pin, gpioModeInput, 0);
+    GPIO_IntConfig (port, pin, false, false, false);
+
+    PRS->CH[prs].CTRL = (pin < 8) ? (PRS_GPIO_PIN0 + pin) : (PRS_GPIO_PIN8 + pin - 8);
+
+    TIMER1->CC[channel].CTRL = TIMER_CC_CTRL_MODE_INPUTCAPTURE |
+                               TIMER_CC_CTRL_INSEL |
+                               (prs << _TIMER_CC_CTRL_PRSSEL_SHIFT) |
+                               edge |
+                               TIMER_CC_CTRL_ICEVCTRL_EVERYEDGE;
+
+    TIMER1->IFC = (TIMER_IF_CC0 | TIMER_IF_ICBOF0) << channel;
+    TIMER1->IEN |= (TIMER_IEN_CC0 | TIMER_IEN_ICBOF0) << channel;
+
+    CaptureCtrl.active |= 1 << channel;
+
+    return 0;
+}
+
+
+/**
+ * @brief  Stop a capture channel, TIMER1 is stopped with the last one.
+ * @param  channel Capture channel.
+ * @retval None.
+ */
+void CAPTURE_Stop (unsigned int channel)
+{
+    if (channel >= CAPTURE_CHANNELS || !(CaptureCtrl.active & (1 << channel))) {
+        return;
+    }
+
+    INT_Disable ();
+    TIMER1->IEN &= ~((TIMER_IEN_CC0 | TIMER_IEN_ICBOF0) << channel);
+    TIMER1->CC[channel].CTRL = 0;
+    CaptureCtrl.active &= ~(1 << channel);
+    INT_Enable ();
+
+    PRS->CH[CAPTURE_CONF_PRS_FIRST + channel].CTRL = 0;
+
+    if (CaptureCtrl.active == 0) {
+        TIMER1->CMD = TIMER_CMD_STOP;
+        NVIC_DisableIRQ (TIMER1_IRQn);
+        CMU_ClockEnable (cmuClock_TIMER1, false);
+        LPM_UnblockEM2 ();
+    }
+}
+
+
+/**
+ * @brief  Deliver the captured timestamps to the processes.
+ */
+PROCESS (CAPTURE_Process, "Capture Process");
+PROCESS_THREAD (CAPTURE_Process, ev, data)
+{
+    PROCESS_BEGIN ();
+
+    static CaptureEvent event;
+    CaptureChannel *ch;
+    unsigned int i;
+
+    while (1) {
+
+        PROCESS_WAIT_EVENT_UNTIL (ev == PROCESS_EVENT_POLL);
+
+        for (i = 0; i < CAPTURE_CHANNELS; i++) {
+            ch = &CaptureCtrl.channel[i];
+            while (ch->tail != ch->head) {
+                event.time = ch->queue[ch->tail];
+                event.channel = i;
+                INT_Disable ();
+                event.lost = ch->lost;
+                ch->lost = 0;
+                INT_Enable ();
+                ch->tail = (ch->tail + 1) % CAPTURE_CONF_QUEUE;
+                process_post_synch (ch->process, CAPTURE_Event, &event);
+            }
+        }
+    }
+
+    PROCESS_END ();
+}
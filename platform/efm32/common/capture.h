@@ -0,0 +1,64 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include <em_gpio.h>
+
+#include <protothreads.h>
+
+/** TIMER1 prescaler, the counter period (65536 ticks) must exceed the ISR latency */
+#ifndef CAPTURE_CONF_PRESC
+#define CAPTURE_CONF_PRESC          TIMER_CTRL_PRESC_DIV16
+#endif /* CAPTURE_CONF_PRESC */
+
+/** First PRS channel used, capture channel n uses PRS channel n + this */
+#ifndef CAPTURE_CONF_PRS_FIRST
+#define CAPTURE_CONF_PRS_FIRST      0
+#endif /* CAPTURE_CONF_PRS_FIRST */
+
+/** Captures buffered per channel until CAPTURE_Process delivers them */
+#ifndef CAPTURE_CONF_QUEUE
+#define CAPTURE_CONF_QUEUE          4
+#endif /* CAPTURE_CONF_QUEUE */
+
+/** Number of capture channels, one per TIMER1 compare/capture channel */
+#define CAPTURE_CHANNELS            3
+
+#define CAPTURE_EDGE_RISING         TIMER_CC_CTRL_ICEDGE_RISING
+#define CAPTURE_EDGE_FALLING        TIMER_CC_CTRL_ICEDGE_FALLING
+#define CAPTURE_EDGE_BOTH           TIMER_CC_CTRL_ICEDGE_BOTH
+
+/** Payload of CAPTURE_Event, valid only while the event is handled */
+typedef struct {
+    struct timespec time;       // CLOCK_REALTIME of the edge
+    unsigned int    channel;
+    uint32_t        lost;       // Captures dropped before this one
+} CaptureEvent;
+
+extern process_event_t CAPTURE_Event;
+
+PROCESS_NAME (CAPTURE_Process);
+
+int CAPTURE_Start (unsigned int channel, GPIO_Port_TypeDef port, unsigned int pin, uint32_t edge, struct process *p);
+void CAPTURE_Stop (unsigned int channel);
+
+#endif /* CAPTURE_H_ */
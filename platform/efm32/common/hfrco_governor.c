@@ -0,0 +1,182 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <em_device.h>
+#include <em_cmu.h>
+
+#include <systime.h>
+
+#include "hfrco_governor.h"
+
+typedef struct {
+    int         band;
+    int         quiet_runs;
+    int         raise;
+    uint32_t    last_cycles;
+    uint32_t    max_dispatch_us;
+    int         max_pending;
+} GovernorControl;
+
+
+/** Available HFRCO bands, slowest first */
+static const CMU_HFRCOBand_TypeDef GovernorBands[] = {
+    cmuHFRCOBand_1MHz,
+    cmuHFRCOBand_7MHz,
+    cmuHFRCOBand_11MHz,
+    cmuHFRCOBand_14MHz,
+    cmuHFRCOBand_21MHz,
+#if defined( _CMU_HFRCOCTRL_BAND_28MHZ )
+    cmuHFRCOBand_28MHz,
+#endif
+};
+
+#define GOVERNOR_BAND_COUNT     (sizeof (GovernorBands) / sizeof (GovernorBands[0]))
+
+static GovernorControl GovernorCtrl;
+
+GovernorStats GOVERNOR_Stats;
+
+
+/**
+ * @brief  Switch to another HFRCO band. CMU_HFRCOBandSet () takes care of
+ *         the flash wait states and updates SystemCoreClock, the system
+ *         time backend is told to pick up the new HFPERCLK.
+ * @param  band Index into GovernorBands.
+ * @retval None.
+ */
+static void GOVERNOR_SetBand (int band)
+{
+    if (band < 0 || band >= (int)GOVERNOR_BAND_COUNT || band == GovernorCtrl.band) {
+        return;
+    }
+
+    CMU_HFRCOBandSet (GovernorBands[band]);
+    SYSTIME_ClockChanged ();
+
+    GovernorCtrl.band = band;
+    GOVERNOR_Stats.band_changes++;
+}
+
+
+/**
+ * @brief  Initialize the governor with the band currently in use.
+ *         HF clock must be running from HFRCO.
+ * @retval None.
+ */
+void GOVERNOR_Init (void)
+{
+    CMU_HFRCOBand_TypeDef current = CMU_HFRCOBandGet ();
+    int i;
+
+    GovernorCtrl.band = GOVERNOR_BAND_COUNT - 1;
+    for (i = 0; i < (int)GOVERNOR_BAND_COUNT; i++) {
+        if (GovernorBands[i] == current) {
+            GovernorCtrl.band = i;
+        }
+    }
+
+    GovernorCtrl.quiet_runs = 0;
+    GovernorCtrl.raise = 0;
+
+    GOVERNOR_Stats.band_changes = 0;
+    GOVERNOR_Stats.dispatches = 0;
+    GOVERNOR_Stats.max_dispatch_us = 0;
+    GOVERNOR_Stats.max_pending = 0;
+
+    // Dispatch time is measured with the DWT cycle counter
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+
+/**
+ * @brief  Call when the scheduler wakes up, before the first process_run ().
+ * @retval None.
+ */
+void GOVERNOR_RunBegin (void)
+{
+    GovernorCtrl.last_cycles = DWT->CYCCNT;
+    GovernorCtrl.max_dispatch_us = 0;
+    GovernorCtrl.max_pending = 0;
+    GovernorCtrl.raise = 0;
+}
+
+
+/**
+ * @brief  Account one dispatch. Call with the return value of process_run ().
+ *         The band is raised at once if the event queue is backing up.
+ * @param  pending Number of pending events, see process_nevents ().
+ * @retval pending
+ */
+int GOVERNOR_Dispatch (int pending)
+{
+    uint32_t now = DWT->CYCCNT;
+    uint32_t us = (uint32_t)(((uint64_t)(now - GovernorCtrl.last_cycles) * 1000000) / SystemCoreClock);
+
+    GovernorCtrl.last_cycles = now;
+
+    if (us > GovernorCtrl.max_dispatch_us) {
+        GovernorCtrl.max_dispatch_us = us;
+    }
+    if (pending > GovernorCtrl.max_pending) {
+        GovernorCtrl.max_pending = pending;
+    }
+
+    GOVERNOR_Stats.dispatches++;
+    if (us > GOVERNOR_Stats.max_dispatch_us) {
+        GOVERNOR_Stats.max_dispatch_us = us;
+    }
+    if ((uint32_t)pending > GOVERNOR_Stats.max_pending) {
+        GOVERNOR_Stats.max_pending = pending;
+    }
+
+    // Queue backing up, do not wait for the run to finish
+    if (pending >= HFRCO_GOVERNOR_CONF_QUEUE_HIGH && !GovernorCtrl.raise) {
+        GovernorCtrl.raise = 1;
+        GovernorCtrl.quiet_runs = 0;
+        GOVERNOR_SetBand (GovernorCtrl.band + 1);
+        GovernorCtrl.last_cycles = DWT->CYCCNT;
+    }
+
+    return pending;
+}
+
+
+/**
+ * @brief  Call when the scheduler has run out of events, before going to sleep.
+ *         Lowers the band after HFRCO_GOVERNOR_CONF_QUIET_RUNS quiet runs.
+ * @retval None.
+ */
+void GOVERNOR_RunEnd (void)
+{
+    if (GovernorCtrl.raise) {
+        return;
+    }
+
+    if (GovernorCtrl.max_dispatch_us > HFRCO_GOVERNOR_CONF_DISPATCH_HIGH_US) {
+        GovernorCtrl.quiet_runs = 0;
+        GOVERNOR_SetBand (GovernorCtrl.band + 1);
+    } else if (GovernorCtrl.max_pending <= 1 &&
+               GovernorCtrl.max_dispatch_us < HFRCO_GOVERNOR_CONF_DISPATCH_HIGH_US / 4) {
+        if (++GovernorCtrl.quiet_runs >= HFRCO_GOVERNOR_CONF_QUIET_RUNS) {
+            GovernorCtrl.quiet_runs = 0;
+            GOVERNOR_SetBand (GovernorCtrl.band - 1);
+        }
+    } else {
+        GovernorCtrl.quiet_runs = 0;
+    }
+}
@@ -0,0 +1,52 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef HFRCO_GOVERNOR_H_
+#define HFRCO_GOVERNOR_H_
+
+#include <stdint.h>
+
+/** Raise the band when this many events are pending */
+#ifndef HFRCO_GOVERNOR_CONF_QUEUE_HIGH
+#define HFRCO_GOVERNOR_CONF_QUEUE_HIGH        4
+#endif /* HFRCO_GOVERNOR_CONF_QUEUE_HIGH */
+
+/** Raise the band when a single dispatch takes longer than this (us) */
+#ifndef HFRCO_GOVERNOR_CONF_DISPATCH_HIGH_US
+#define HFRCO_GOVERNOR_CONF_DISPATCH_HIGH_US  500
+#endif /* HFRCO_GOVERNOR_CONF_DISPATCH_HIGH_US */
+
+/** Number of consecutive quiet runs before the band is lowered */
+#ifndef HFRCO_GOVERNOR_CONF_QUIET_RUNS
+#define HFRCO_GOVERNOR_CONF_QUIET_RUNS        8
+#endif /* HFRCO_GOVERNOR_CONF_QUIET_RUNS */
+
+typedef struct {
+    uint32_t    band_changes;
+    uint32_t    dispatches;
+    uint32_t    max_dispatch_us;
+    uint32_t    max_pending;
+} GovernorStats;
+
+extern GovernorStats GOVERNOR_Stats;
+
+void GOVERNOR_Init (void);
+void GOVERNOR_RunBegin (void);
+int GOVERNOR_Dispatch (int pending);
+void GOVERNOR_RunEnd (void);
+
+#endif /* HFRCO_GOVERNOR_H_ */
@@ -0,0 +1,191 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define HIBERNATE_BURTC_FREQ    32768U
+
+#include <em_device.h>
+#include <em_cmu.h>
+#include <em_emu.h>
+#include <em_int.h>
+
+#include <hibernate.h>
+
+#include "hibernate_em4.h"
+#include "systime_burtc.h"
+
+// The top retention registers belong to the BURTC time base, the one below
+// them keeps the counter value at EM4 entry
+#define HIBERNATE_RET_WORDS     (SYSTIME_BURTC_RET_FIRST - 1)
+#define HIBERNATE_RET_ENTRY     HIBERNATE_RET_WORDS
+
+uint32_t HIBERNATE_EM4_RestoreCycles;
+
+// Linker script symbols: the image runs from the vector table to __etext,
+// followed by the initial values of .data
+extern const uint32_t __isr_vector[];
+extern const char __etext, __data_start__, __data_end__;
+
+
+/**
+ * @brief  FNV-1a hash of the firmware image as programmed, identifies the
+ *         image that saved a snapshot. Computed once per boot.
+ */
+static uint32_t HIBERNATE_EM4_Image (void)
+{
+    static uint32_t hash = 0;
+    const uint32_t *p = __isr_vector;
+    const uint32_t *end = (const uint32_t *)(&__etext + (&__data_end__ - &__data_start__));
+
+    if (hash == 0) {
+        hash = 2166136261U;
+        while (p < end) {
+            hash = (hash ^ *p++) * 16777619U;
+        }
+        if (hash == 0) {
+            hash = 1;
+        }
+        HIBERNATE_SetImage (hash);
+    }
+
+    return hash;
+}
+
+
+/**
+ * @brief  Save the system state to the BURTC retention registers and enter
+ *         EM4. BURTC keeps running from LFXO and wakes the device up after
+ *         the given time. A running BURTC is not restarted, so that the
+ *         BURTC time base survives hibernation. The wake-up is a reset, HIBERNATE_EM4_Resume ()
+ *         restores the state.
+ * @param  seconds Time to hibernate, 1 to HIBERNATE_EM4_MAX_SECONDS.
+ * @retval -1 if the time is out of range or the state could not be saved,
+ *         does not return otherwise.
+ */
+int HIBERNATE_EM4_Enter (uint32_t seconds)
+{
+    static uint32_t snapshot[HIBERNATE_RET_WORDS];
+    EMU_EM4Init_TypeDef em4init = EMU_EM4INIT_DEFAULT;
+    uint32_t cnt;
+    int len, i;
+
+    // The compare value wraps around beyond that
+    if (seconds == 0 || seconds > HIBERNATE_EM4_MAX_SECONDS) {
+        return -1;
+    }
+
+    HIBERNATE_EM4_Image ();
+
+    len = HIBERNATE_Save (snapshot, HIBERNATE_RET_WORDS);
+    if (len < 0) {
+        return -1;
+    }
+
+    INT_Disable ();
+
+    // Release the backup domain from reset, start BURTC unless already running
+    RMU->CTRL &= ~RMU_CTRL_BURSTEN;
+    CMU_ClockEnable (cmuClock_CORELE, true);
+    if ((BURTC->CTRL & _BURTC_CTRL_MODE_MASK) != BURTC_CTRL_MODE_EM4EN) {
+        BURTC->CTRL = BURTC_CTRL_RSTEN;
+        BURTC->CTRL = BURTC_CTRL_MODE_EM4EN | BURTC_CTRL_CLKSEL_LFXO | BURTC_CTRL_PRESC_DIV1;
+    }
+
+    for (i = 0; i < len; i++) {
+        BURTC->RET[i].REG = snapshot[i];
+    }
+
+    cnt = BURTC->CNT;
+    BURTC->RET[HIBERNATE_RET_ENTRY].REG = cnt;
+
+    while (BURTC->SYNCBUSY & BURTC_SYNCBUSY_COMP0);
+    BURTC->COMP0 = cnt + seconds * HIBERNATE_BURTC_FREQ;
+    BURTC->IFC = BURTC_IFC_COMP0 | BURTC_IFC_LFXOFAIL;
+    BURTC->IEN |= BURTC_IEN_COMP0;
+
+    em4init.osc = emuEM4Osc_LFXO;
+    em4init.buRtcWakeup = true;
+    EMU_EM4Init (&em4init);
+
+    EMU_EnterEM4 ();
+
+    // Never reached
+    return 0;
+}
+
+
+/**
+ * @brief  Check the reset cause for a wake-up from EM4, interpreted like
+ *         RMU_ResetCauseGet () of emlib. The cause bits add up until
+ *         HIBERNATE_EM4_Resume () clears them, and a power-on reset leaves
+ *         the others undefined, so any other cause along with the wake-up
+ *         means the device has been reset since.
+ * @retval Non-zero if the last reset was an EM4 wake-up.
+ */
+int HIBERNATE_EM4_WokeUp (void)
+{
+    uint32_t cause = RMU->RSTCAUSE;
+
+    return (cause & RMU_RSTCAUSE_EM4WURST) &&
+           !(cause & (RMU_RSTCAUSE_PORST | RMU_RSTCAUSE_BODUNREGRST | RMU_RSTCAUSE_BODREGRST |
+                      RMU_RSTCAUSE_EXTRST | RMU_RSTCAUSE_WDOGRST | RMU_RSTCAUSE_LOCKUPRST |
+                      RMU_RSTCAUSE_SYSREQRST | RMU_RSTCAUSE_BODAVDD0 | RMU_RSTCAUSE_BODAVDD1 |
+                      RMU_RSTCAUSE_BUBODVDDDREG | RMU_RSTCAUSE_BUBODBUVIN |
+                      RMU_RSTCAUSE_BUBODUNREG | RMU_RSTCAUSE_BUBODREG | RMU_RSTCAUSE_BUMODERST));
+}
+
+
+/**
+ * @brief  Restore the system state after a wake-up from EM4. Call after
+ *         SYSTIME_Init () and process_init (), and only if
+ *         HIBERNATE_EM4_WokeUp (); start the processes as usual otherwise
+ *         or if this fails.
+ * @retval 0 if the state was restored, -1 if there was no valid snapshot.
+ */
+int HIBERNATE_EM4_Resume (void)
+{
+    static uint32_t snapshot[HIBERNATE_RET_WORDS];
+    struct timespec elapsed;
+    uint32_t start, cnt;
+    int i, res;
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    start = DWT->CYCCNT;
+
+    CMU_ClockEnable (cmuClock_CORELE, true);
+
+    cnt = BURTC->CNT - BURTC->RET[HIBERNATE_RET_ENTRY].REG;
+    elapsed.tv_sec = cnt / HIBERNATE_BURTC_FREQ;
+    elapsed.tv_nsec = ((cnt % HIBERNATE_BURTC_FREQ) * 125000 / HIBERNATE_BURTC_FREQ) * 8000;
+
+    for (i = 0; i < HIBERNATE_RET_WORDS; i++) {
+        snapshot[i] = BURTC->RET[i].REG;
+    }
+
+    // The snapshot is used only once
+    BURTC->RET[0].REG = 0;
+    BURTC->IFC = BURTC_IFC_COMP0 | BURTC_IFC_LFXOFAIL;
+
+    RMU->CMD = RMU_CMD_RCCLR;
+
+    HIBERNATE_EM4_Image ();
+    res = HIBERNATE_Restore (snapshot, HIBERNATE_RET_WORDS, &elapsed);
+
+    HIBERNATE_EM4_RestoreCycles = DWT->CYCCNT - start;
+
+    return res;
+}
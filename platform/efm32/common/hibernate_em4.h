@@ -0,0 +1,35 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef HIBERNATE_EM4_H_
+#define HIBERNATE_EM4_H_
+
+#include <stdint.h>
+
+#include <hibernate.h>
+
+/** Longest hibernation, the BURTC compare is 32 bits at 32768 Hz */
+#define HIBERNATE_EM4_MAX_SECONDS   (UINT32_MAX / 32768U)
+
+/** Cycles spent in the last HIBERNATE_EM4_Resume (), for profiling */
+extern uint32_t HIBERNATE_EM4_RestoreCycles;
+
+int HIBERNATE_EM4_Enter (uint32_t seconds);
+int HIBERNATE_EM4_WokeUp (void);
+int HIBERNATE_EM4_Resume (void);
+
+#endif /* HIBERNATE_EM4_H_ */
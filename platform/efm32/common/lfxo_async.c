@@ -0,0 +1,229 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <em_device.h>
+#include <em_cmu.h>
+#include <em_int.h>
+#include <em_rtc.h>
+
+#include <lpm.h>
+#include <protothreads.h>
+#include <systime.h>
+#include <systimer.h>
+
+#include "boottime.h"
+#include "lfxo_async.h"
+
+/** Nominal length of one LFA clock tick in nanoseconds */
+#define LFXO_TICK_NSEC      30518
+
+/** Nominal LFXO frequency */
+#define LFXO_FREQ           32768U
+
+LfxoSwitchStats LFXO_SwitchStats;
+
+
+/***************************************************************************//**
+ * @brief CMU Interrupt Handler, wake up the switch-over process when LFXO is ready.
+ ******************************************************************************/
+void CMU_IRQHandler (void)
+{
+    if (CMU_IntGet () & CMU_IF_LFXORDY) {
+
+        /* Clear and disable interrupt source, it is needed only once */
+        CMU_IntClear (CMU_IFC_LFXORDY);
+        CMU_IntDisable (CMU_IEN_LFXORDY);
+
+        process_poll (&LFXO_Process);
+        LPM_RegisterEvent ();
+
+    }
+}
+
+
+/**
+ * @brief  Clock LFA from LFRCO and start LFXO in the background. The RTC
+ *         is switched over to LFXO by LFXO_Process once the crystal is stable.
+ *         Use instead of CMU_ClockSelectSet (cmuClock_LFA, cmuSelect_LFXO).
+ * @retval None.
+ */
+void LFXO_StartAsync (void)
+{
+    CMU_ClockSelectSet (cmuClock_LFA, cmuSelect_LFRCO);
+
+    CMU_IntClear (CMU_IFC_LFXORDY);
+    CMU_IntEnable (CMU_IEN_LFXORDY);
+
+    NVIC_ClearPendingIRQ (CMU_IRQn);
+    NVIC_EnableIRQ (CMU_IRQn);
+
+    // The switch times the tick edges with the cycle counter
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    CMU_OscillatorEnable (cmuOsc_LFXO, true, false);
+}
+
+
+/**
+ * @brief  Check if LFA is already clocked from LFXO.
+ * @retval 0 if still running from LFRCO.
+ */
+int LFXO_IsSelected (void)
+{
+    return CMU_ClockSelectGet (cmuClock_LFA) == cmuSelect_LFXO;
+}
+
+
+static int LFXO_Poll (void *arg)
+{
+    process_poll (&LFXO_Process);
+
+    return 0;
+}
+
+
+/**
+ * @brief  Wait for the next RTC tick edge. The counter is polled with
+ *         interrupts enabled between the polls, a poll that was held up
+ *         by an interrupt for more than a quarter of a tick does not tell
+ *         where the edge was and the next edge is waited for instead.
+ * @param  cnt Counter value after the edge.
+ * @retval DWT cycle count at the edge, returns with interrupts disabled.
+ */
+static uint32_t LFXO_WaitEdge (uint32_t *cnt)
+{
+    uint32_t prev, now, limit;
+
+    limit = SystemCoreClock / (LFXO_FREQ * 4);
+    if (limit < 64) {
+        limit = 64;
+    }
+
+    while (1) {
+
+        *cnt = RTC_CounterGet ();
+        prev = DWT->CYCCNT;
+
+        while (1) {
+            INT_Disable ();
+            now = DWT->CYCCNT;
+            if (RTC_CounterGet () != *cnt) {
+                break;
+            }
+            INT_Enable ();
+            prev = now;
+        }
+
+        *cnt = RTC_CounterGet ();
+        if (now - prev < limit) {
+            return now;
+        }
+
+        INT_Enable ();
+        LFXO_SwitchStats.retries++;
+
+    }
+}
+
+
+/**
+ * @brief  Switch LFA over from LFRCO to LFXO.
+ *
+ * LFRCO is measured against LFXO first, the time counted so far from LFRCO
+ * is off by its error and CLOCK_REALTIME is corrected by it. The switch is
+ * done right after an RTC tick edge, so the RTC counter does not see a
+ * partial tick. The real time to the first LFXO tick edge is measured with
+ * the cycle counter, a tick that is lost or gained while the clock mux
+ * changes over is compensated in CLOCK_REALTIME as well. Interrupts are
+ * disabled only for a single poll of the counter and for the switch itself.
+ */
+PROCESS (LFXO_Process, "LFXO Switch-over Process");
+PROCESS_THREAD (LFXO_Process, ev, data)
+{
+    PROCESS_BEGIN ();
+
+    static SYSTIMER measure;
+    int32_t error;
+    uint32_t count, cnt1, cnt2, edge1, edge2;
+    int32_t ticks;
+    int64_t nsec;
+    struct timespec expected, actual;
+
+    if (!LFXO_IsSelected ()) {
+
+        // The ready interrupt may have fired before this process was started
+        if (!(CMU->STATUS & CMU_STATUS_LFXORDY)) {
+            PROCESS_WAIT_EVENT_UNTIL (ev == PROCESS_EVENT_POLL);
+        }
+
+        // Count LFRCO cycles for LFXO_CONF_CAL_CYCLES of LFXO, HF clocks
+        // have to run for the calibration counters
+        LPM_BlockEM2 ();
+        CMU_CalibrateConfig (LFXO_CONF_CAL_CYCLES, cmuOsc_LFXO, cmuOsc_LFRCO);
+        CMU_CalibrateStart ();
+
+        // The timer still runs from LFRCO, allow for its error
+        SYSTIMER_Init (&measure, (LFXO_CONF_CAL_CYCLES * 1100) / LFXO_FREQ + 2, 0, LFXO_Poll, NULL);
+        PROCESS_WAIT_EVENT_UNTIL (ev == PROCESS_EVENT_POLL);
+
+        count = CMU_CalibrateCountGet ();
+        LPM_UnblockEM2 ();
+
+        error = (int32_t)(((int64_t)count - LFXO_CONF_CAL_CYCLES) * 1000000 / LFXO_CONF_CAL_CYCLES);
+        if (error > LFXO_CONF_CAL_MAX_PPM || error < -LFXO_CONF_CAL_MAX_PPM) {
+            error = 0;
+        }
+        LFXO_SwitchStats.lfrco_ppm = error;
+
+        edge1 = LFXO_WaitEdge (&cnt1);
+
+        // Everything counted so far is LFRCO ticks, a fast LFRCO has
+        // counted more of them than the real time elapsed
+        clock_gettime (CLOCK_MONOTONIC, &expected);
+        nsec = (int64_t)expected.tv_sec * 1000000000 + expected.tv_nsec;
+        nsec -= nsec * error / (1000000 + error);
+        expected.tv_sec = nsec / 1000000000;
+        expected.tv_nsec = nsec % 1000000000;
+
+        CMU_ClockSelectSet (cmuClock_LFA, cmuSelect_LFXO);
+        INT_Enable ();
+
+        // Next edge is the first one from LFXO
+        edge2 = LFXO_WaitEdge (&cnt2);
+        clock_gettime (CLOCK_MONOTONIC, &actual);
+        INT_Enable ();
+
+        // Whole ticks really elapsed between the edges
+        nsec = (int64_t)(edge2 - edge1) * 1000000000 / SystemCoreClock;
+        ticks = (int32_t)((nsec + LFXO_TICK_NSEC / 2) / LFXO_TICK_NSEC);
+        LFXO_SwitchStats.lost_ticks = ticks - (int32_t)((cnt2 - cnt1) & _RTC_CNT_MASK);
+
+        nsec = (int64_t)ticks * LFXO_TICK_NSEC + expected.tv_nsec;
+        expected.tv_sec += nsec / 1000000000;
+        expected.tv_nsec = nsec % 1000000000;
+        SYSTIME_Rebase (&expected, &actual);
+
+        // LFRCO is no longer needed
+        CMU_OscillatorEnable (cmuOsc_LFRCO, false, false);
+
+        BOOTTIME_Mark (BOOTTIME_LFXO_READY);
+
+    }
+
+    PROCESS_END ();
+}
@@ -0,0 +1,47 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef LFXO_ASYNC_H_
+#define LFXO_ASYNC_H_
+
+#include <protothreads.h>
+
+/** LFXO cycles LFRCO is measured for before the switch, the error of
+ *  LFRCO is compensated to about 1 / LFXO_CONF_CAL_CYCLES */
+#ifndef LFXO_CONF_CAL_CYCLES
+#define LFXO_CONF_CAL_CYCLES        4096
+#endif /* LFXO_CONF_CAL_CYCLES */
+
+/** LFRCO errors larger than this (ppm) are taken as measurement errors */
+#ifndef LFXO_CONF_CAL_MAX_PPM
+#define LFXO_CONF_CAL_MAX_PPM       100000
+#endif /* LFXO_CONF_CAL_MAX_PPM */
+
+typedef struct {
+    int32_t     lfrco_ppm;      // LFRCO error measured against LFXO
+    int32_t     lost_ticks;     // Ticks lost (positive) in the clock switch
+    uint32_t    retries;        // Tick edges missed because of interrupts
+} LfxoSwitchStats;
+
+extern LfxoSwitchStats LFXO_SwitchStats;
+
+PROCESS_NAME (LFXO_Process);
+
+void LFXO_StartAsync (void);
+int LFXO_IsSelected (void);
+
+#endif /* LFXO_ASYNC_H_ */
@@ -0,0 +1,151 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <em_device.h>
+#include <em_cmu.h>
+
+#include <lpm.h>
+#include <protothreads.h>
+#include <systime.h>
+#include <systimer.h>
+
+#include "lfxo_async.h"
+#include "lfxo_cal.h"
+
+/** Nominal LFXO frequency */
+#define LFXOCAL_LFXO_FREQ   32768U
+
+LfxoCalStats LFXOCAL_Stats;
+
+
+/**
+ * @brief  LFXO error from a calibration count.
+ * @param  hf_freq Nominal frequency of the reference (HFXO).
+ * @param  cycles LFXO cycles the measurement lasted.
+ * @param  count Reference cycles counted meanwhile.
+ * @retval LFXO frequency error, ppb. Positive if LFXO is fast.
+ */
+int32_t LFXOCAL_Error (uint32_t hf_freq, uint32_t cycles, uint32_t count)
+{
+    int64_t diff, counted;
+
+    if (count == 0) {
+        return INT32_MAX;
+    }
+
+    // A fast LFXO ends the measurement early, fewer reference cycles
+    // counted. Scaled by the LFXO frequency to keep the fraction exact.
+    counted = (int64_t)count * LFXOCAL_LFXO_FREQ;
+    diff = (int64_t)cycles * hf_freq - counted;
+
+    return (int32_t)(diff * 1000000000 / counted);
+}
+
+
+/**
+ * @brief  Feed a sample to the estimator and trim CLOCK_REALTIME with the
+ *         new estimate.
+ * @param  sample_ppb LFXO error, see LFXOCAL_Error ().
+ * @retval 0 if the sample was accepted, -1 if it was rejected.
+ */
+int LFXOCAL_Update (int32_t sample_ppb)
+{
+    if (sample_ppb > LFXOCAL_CONF_MAX_PPM * 1000 || sample_ppb < -LFXOCAL_CONF_MAX_PPM * 1000) {
+        LFXOCAL_Stats.rejected++;
+        return -1;
+    }
+
+    if (LFXOCAL_Stats.samples == 0) {
+        LFXOCAL_Stats.estimate_ppb = sample_ppb;
+    } else {
+        LFXOCAL_Stats.estimate_ppb += (sample_ppb - LFXOCAL_Stats.estimate_ppb) / (1 << LFXOCAL_CONF_FILTER_SHIFT);
+    }
+
+    LFXOCAL_Stats.samples++;
+    LFXOCAL_Stats.last_ppb = sample_ppb;
+
+    // A fast LFXO makes the clock run fast, slow it down by the same amount
+    SYSTIME_Trim (-LFXOCAL_Stats.estimate_ppb);
+
+    return 0;
+}
+
+
+static int LFXOCAL_Poll (void *arg)
+{
+    process_poll (&LFXOCAL_Process);
+
+    return 0;
+}
+
+
+/**
+ * @brief  Measure LFXO against HFXO periodically and correct the rate of
+ *         CLOCK_REALTIME with the filtered error.
+ *
+ * HFXO is started for the measurement if it is not running, LFXO counts
+ * down LFXOCAL_CONF_CYCLES while the HFXO cycles are counted up. EM2 is
+ * blocked meanwhile, it would stop HFXO and the up-counter with it.
+ */
+PROCESS (LFXOCAL_Process, "LFXO Calibration Process");
+PROCESS_THREAD (LFXOCAL_Process, ev, data)
+{
+    PROCESS_BEGIN ();
+
+    static SYSTIMER period, measure;
+    static bool hfxo_started;
+    uint32_t count;
+
+    SYSTIMER_Init (&period, 0, LFXOCAL_CONF_INTERVAL_S * 1000, LFXOCAL_Poll, NULL);
+
+    while (1) {
+
+        PROCESS_WAIT_EVENT_UNTIL (ev == PROCESS_EVENT_POLL);
+
+        // LFXO has to be stable
+        if (!LFXO_IsSelected ()) {
+            continue;
+        }
+
+        LPM_BlockEM2 ();
+
+        hfxo_started = !(CMU->STATUS & CMU_STATUS_HFXOENS);
+        if (hfxo_started) {
+            CMU_OscillatorEnable (cmuOsc_HFXO, true, true);
+        }
+
+        CMU_CalibrateConfig (LFXOCAL_CONF_CYCLES, cmuOsc_LFXO, cmuOsc_HFXO);
+        CMU_CalibrateStart ();
+
+        // Wait for the measurement to complete, plus a tick of margin
+        SYSTIMER_Init (&measure, (LFXOCAL_CONF_CYCLES * 1000) / LFXOCAL_LFXO_FREQ + 2, 0, LFXOCAL_Poll, NULL);
+        PROCESS_WAIT_EVENT_UNTIL (ev == PROCESS_EVENT_POLL);
+
+        count = CMU_CalibrateCountGet ();
+
+        if (hfxo_started) {
+            CMU_OscillatorEnable (cmuOsc_HFXO, false, false);
+        }
+
+        LPM_UnblockEM2 ();
+
+        LFXOCAL_Update (LFXOCAL_Error (SystemHFXOClockGet (), LFXOCAL_CONF_CYCLES, count));
+
+    }
+
+    PROCESS_END ();
+}
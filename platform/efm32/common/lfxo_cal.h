@@ -0,0 +1,59 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef LFXO_CAL_H_
+#define LFXO_CAL_H_
+
+#include <stdint.h>
+
+#include <protothreads.h>
+
+/** Time between calibrations (s) */
+#ifndef LFXOCAL_CONF_INTERVAL_S
+#define LFXOCAL_CONF_INTERVAL_S         600
+#endif /* LFXOCAL_CONF_INTERVAL_S */
+
+/** Length of the measurement in LFXO cycles, the HFXO count must fit in 20 bits */
+#ifndef LFXOCAL_CONF_CYCLES
+#define LFXOCAL_CONF_CYCLES             512
+#endif /* LFXOCAL_CONF_CYCLES */
+
+/** Weight of a new sample in the estimate is 1 / 2^LFXOCAL_CONF_FILTER_SHIFT */
+#ifndef LFXOCAL_CONF_FILTER_SHIFT
+#define LFXOCAL_CONF_FILTER_SHIFT       2
+#endif /* LFXOCAL_CONF_FILTER_SHIFT */
+
+/** Samples further off than this (ppm) are rejected as measurement errors */
+#ifndef LFXOCAL_CONF_MAX_PPM
+#define LFXOCAL_CONF_MAX_PPM            500
+#endif /* LFXOCAL_CONF_MAX_PPM */
+
+typedef struct {
+    uint32_t    samples;        // Accepted samples
+    uint32_t    rejected;       // Rejected samples
+    int32_t     last_ppb;       // Last accepted sample, LFXO error
+    int32_t     estimate_ppb;   // Filtered LFXO error, positive if LFXO is fast
+} LfxoCalStats;
+
+extern LfxoCalStats LFXOCAL_Stats;
+
+PROCESS_NAME (LFXOCAL_Process);
+
+int32_t LFXOCAL_Error (uint32_t hf_freq, uint32_t cycles, uint32_t count);
+int LFXOCAL_Update (int32_t sample_ppb);
+
+#endif /* LFXO_CAL_H_ */
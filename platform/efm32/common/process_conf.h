@@ -0,0 +1,46 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef PROCESS_CONF_H_
+#define PROCESS_CONF_H_
+
+/*
+ * Kernel configuration of the Cortex-M3 core. The kernel headers do not
+ * include platform headers, the build includes this one ahead of every
+ * source with -include process_conf.h.
+ */
+
+#include "em_device.h"
+
+/** Non-zero in an interrupt handler, from the active exception number */
+#define PROCESS_CONF_IN_INTERRUPT() (__get_IPSR () != 0)
+
+/** Trace time stamps from the cycle counter of the core */
+#define PROCESS_TRACE_CONF_TIMESTAMP() (DWT->CYCCNT)
+#define PROCESS_TRACE_CONF_TIMESTAMP_INIT() do {                            \
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;                     \
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;                                \
+    } while (0)
+
+/**
+ * Cost of a trace point allowed, cycles. An estimate from the instruction
+ * count of the trace point, not measured on a board yet; check
+ * process_trace_cost there.
+ */
+#define PROCESS_TRACE_CONF_BUDGET 64
+
+#endif /* PROCESS_CONF_H_ */
@@ -0,0 +1,100 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define RAMPWR_BASE         0x20000000UL
+#define RAMPWR_BLOCK_SIZE   0x8000UL
+#define RAMPWR_BLOCKS       4
+
+#include <stdio.h>
+
+#include <em_device.h>
+#include <em_emu.h>
+
+#include "rampwr.h"
+
+/* Linker symbols, see efm32gg.ld */
+extern char __retained_start__, __retained_end__;
+extern char __data_start__, __data_end__;
+extern char __bss_start__, __bss_end__;
+extern char __end__, __HeapLimit;
+extern char __StackLimit, __StackTop;
+
+RamPwrReport RAMPWR_Report;
+
+/** EMU_MemPwrDown () setting by number of blocks kept powered */
+static const uint32_t RamPwrDown[RAMPWR_BLOCKS] = {
+    EMU_MEMCTRL_POWERDOWN_BLK123,
+    EMU_MEMCTRL_POWERDOWN_BLK23,
+    EMU_MEMCTRL_POWERDOWN_BLK3,
+    0
+};
+
+
+/**
+ * @brief  Power down the RAM blocks above the top of the stack. Everything
+ *         the linker places in RAM (data, bss, heap and stack) stays powered.
+ *         Only a reset powers the blocks up again.
+ * @retval None.
+ */
+void RAMPWR_Init (void)
+{
+    uint32_t top = (uint32_t)&__StackTop;
+    uint32_t blocks;
+
+    if (top < (uint32_t)&__HeapLimit) {
+        top = (uint32_t)&__HeapLimit;
+    }
+
+    blocks = (top - RAMPWR_BASE + RAMPWR_BLOCK_SIZE - 1) / RAMPWR_BLOCK_SIZE;
+    if (blocks < 1) {
+        blocks = 1;
+    }
+    if (blocks > RAMPWR_BLOCKS) {
+        blocks = RAMPWR_BLOCKS;
+    }
+
+    RAMPWR_Report.retained = &__retained_end__ - &__retained_start__;
+    RAMPWR_Report.data = &__data_end__ - &__data_start__;
+    RAMPWR_Report.bss = &__bss_end__ - &__bss_start__;
+    RAMPWR_Report.heap = &__HeapLimit - &__end__;
+    RAMPWR_Report.stack = &__StackTop - &__StackLimit;
+    RAMPWR_Report.used = top - RAMPWR_BASE;
+    RAMPWR_Report.blocks = blocks;
+
+    if (RamPwrDown[blocks - 1] != 0) {
+        EMU_MemPwrDown (RamPwrDown[blocks - 1]);
+    }
+}
+
+
+/**
+ * @brief  Print the RAM usage collected by RAMPWR_Init ().
+ * @retval None.
+ */
+void RAMPWR_PrintReport (void)
+{
+    printf ("RAM: retained %lu, data %lu, bss %lu, heap %lu, stack %lu\n",
+            (unsigned long)RAMPWR_Report.retained,
+            (unsigned long)RAMPWR_Report.data,
+            (unsigned long)RAMPWR_Report.bss,
+            (unsigned long)RAMPWR_Report.heap,
+            (unsigned long)RAMPWR_Report.stack);
+    printf ("RAM: %lu of %lu bytes used, %lu of %d blocks powered\n",
+            (unsigned long)RAMPWR_Report.used,
+            (unsigned long)(RAMPWR_BLOCKS * RAMPWR_BLOCK_SIZE),
+            (unsigned long)RAMPWR_Report.blocks, RAMPWR_BLOCKS);
+}
@@ -0,0 +1,41 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef RAMPWR_H_
+#define RAMPWR_H_
+
+#include <stdint.h>
+
+/** Place a variable in the lowest RAM block, which is never powered down */
+#define RAMPWR_RETAINED     __attribute__ ((section (".retained")))
+
+typedef struct {
+    uint32_t    retained;       // Bytes in .retained
+    uint32_t    data;           // Bytes in .data
+    uint32_t    bss;            // Bytes in .bss
+    uint32_t    heap;           // Bytes in .heap
+    uint32_t    stack;          // Bytes reserved for the stack
+    uint32_t    used;           // Bytes from start of RAM to top of stack
+    uint32_t    blocks;         // RAM blocks kept powered
+} RamPwrReport;
+
+extern RamPwrReport RAMPWR_Report;
+
+void RAMPWR_Init (void);
+void RAMPWR_PrintReport (void);
+
+#endif /* RAMPWR_H_ */
@@ -0,0 +1,265 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define BURTCDRV_FREQ           32768U
+#define BURTCDRV_CNT_MAX        0x100000000ULL
+#define BURTCDRV_SEC_PER_OF     ((uint32_t)(BURTCDRV_CNT_MAX / BURTCDRV_FREQ))
+#define BURTCDRV_COMP_SET_MIN   1
+#define BURTCDRV_MAGIC          0x42555254UL
+
+#include <stddef.h>
+
+#include <em_device.h>
+#include <em_assert.h>
+#include <em_cmu.h>
+#include <em_int.h>
+
+#include "systime_burtc.h"
+
+// Retention registers reserved for the time base
+#define BURTCDRV_RET_MAGIC      (SYSTIME_BURTC_RET_FIRST + 0)
+#define BURTCDRV_RET_OVERFLOW   (SYSTIME_BURTC_RET_FIRST + 1)
+#define BURTCDRV_RET_OFFSET_SEC (SYSTIME_BURTC_RET_FIRST + 2)
+#define BURTCDRV_RET_OFFSET_NS  (SYSTIME_BURTC_RET_FIRST + 3)
+
+typedef struct {
+    void              (*compare_callback)(void);
+} BURTCControl;
+
+
+static BURTCControl BURTCCtrl;
+
+
+/***************************************************************************//**
+ * @brief BURTC Interrupt Handler, invoke callback function if defined.
+ *  The overflow counter lives in a retention register, so that it is kept
+ *  over EM4 and resets.
+ ******************************************************************************/
+void BURTC_IRQHandler (void)
+{
+    if (BURTC->IF & BURTC_IF_OF) {
+
+        /* Clear interrupt source */
+        BURTC->IFC = BURTC_IFC_OF;
+
+        /* Increase the overflow counter */
+        BURTC->RET[BURTCDRV_RET_OVERFLOW].REG++;
+
+    }
+
+    if (BURTC->IF & BURTC->IEN & BURTC_IF_COMP0) {
+
+        /* Clear interrupt source */
+        BURTC->IFC = BURTC_IFC_COMP0;
+
+        /* Trigger callback if defined */
+        if (BURTCCtrl.compare_callback) {
+            void (*temp)(void) = BURTCCtrl.compare_callback;
+            BURTCCtrl.compare_callback = NULL;
+            temp ();
+        }
+
+    }
+}
+
+
+/***************************************************************************//**
+ * @brief
+ *  Setup BURTC clocked from LFXO. If BURTC is already running with a valid
+ *  retained state, e.g. after an EM4 wake-up or a reset, the counter is left
+ *  alone and the time base continues from where it was.
+ ******************************************************************************/
+static int BURTCDRV_Init (void)
+{
+    BURTCCtrl.compare_callback = NULL;
+
+    /* Release the backup domain from reset and ensure LE modules are accessible */
+    RMU->CTRL &= ~RMU_CTRL_BURSTEN;
+    CMU_ClockEnable (cmuClock_CORELE, true);
+
+    if ((BURTC->CTRL & _BURTC_CTRL_MODE_MASK) != BURTC_CTRL_MODE_EM4EN ||
+        BURTC->RET[BURTCDRV_RET_MAGIC].REG != BURTCDRV_MAGIC) {
+
+        /* Cold start, restart the counter from zero */
+        BURTC->CTRL = BURTC_CTRL_RSTEN;
+        BURTC->CTRL = BURTC_CTRL_MODE_EM4EN | BURTC_CTRL_CLKSEL_LFXO | BURTC_CTRL_PRESC_DIV1;
+
+        BURTC->RET[BURTCDRV_RET_OVERFLOW].REG = 0;
+        BURTC->RET[BURTCDRV_RET_OFFSET_SEC].REG = 0;
+        BURTC->RET[BURTCDRV_RET_OFFSET_NS].REG = 0;
+        BURTC->RET[BURTCDRV_RET_MAGIC].REG = BURTCDRV_MAGIC;
+
+        BURTC->IFC = BURTC_IFC_OF | BURTC_IFC_COMP0 | BURTC_IFC_LFXOFAIL;
+
+    } else if (BURTC->IF & BURTC_IF_OF) {
+
+        /* Overflow happened while nobody was listening */
+        BURTC->IFC = BURTC_IFC_OF;
+        BURTC->RET[BURTCDRV_RET_OVERFLOW].REG++;
+
+    }
+
+    BURTC->IFC = BURTC_IFC_COMP0;
+    BURTC->IEN = BURTC_IEN_OF | BURTC_IEN_COMP0;
+
+    /* Enable interrupts */
+    NVIC_ClearPendingIRQ (BURTC_IRQn);
+    NVIC_EnableIRQ (BURTC_IRQn);
+
+    return 0;
+}
+
+
+/***************************************************************************//**
+ * @brief Read the overflow counter and the BURTC counter as a consistent
+ *  pair, accounting for an overflow whose interrupt is still pending.
+ * @param ofc Overflow counter
+ * @param cnt BURTC counter
+ ******************************************************************************/
+static void BURTCDRV_GetCounter (uint32_t *ofc, uint32_t *cnt)
+{
+    uint32_t pending;
+
+    // Make sure the overflow counter does not get incremented
+    // while reading the BURTC counter value
+    do {
+        *ofc = BURTC->RET[BURTCDRV_RET_OVERFLOW].REG;
+        *cnt = BURTC->CNT;
+        pending = BURTC->IF & BURTC_IF_OF;
+    } while (*ofc != BURTC->RET[BURTCDRV_RET_OVERFLOW].REG);
+
+    // A large counter value was read before the wrap
+    if (pending && *cnt < 0x80000000UL) {
+        (*ofc)++;
+    }
+}
+
+
+static uint32_t BURTCDRV_GetSystemTime (void)
+{
+    uint32_t cnt, ofc;
+
+    BURTCDRV_GetCounter (&ofc, &cnt);
+
+    return (ofc * BURTCDRV_SEC_PER_OF) + (cnt / BURTCDRV_FREQ);
+}
+
+
+static void BURTCDRV_GetSystemNanoTime (SysTime *tm)
+{
+    uint32_t cnt, ofc;
+
+    BURTCDRV_GetCounter (&ofc, &cnt);
+
+    tm->tv_sec  = (ofc * BURTCDRV_SEC_PER_OF) + (cnt / BURTCDRV_FREQ);
+    tm->tv_nsec = ((cnt % BURTCDRV_FREQ) * 125000 / BURTCDRV_FREQ) * 8000;
+}
+
+
+static uint32_t BURTCDRV_GetFrequency ()
+{
+    return BURTCDRV_FREQ;
+}
+
+
+/***************************************************************************//**
+ * @brief BURTC trigger enable
+ * @param trigger_time Time from now until the trigger
+ * @param callback Callback invoked when @p trigger_time elapsed
+ ******************************************************************************/
+static void BURTCDRV_Trigger (SysTime *trigger_time, void (*callback) (void))
+{
+    uint32_t ticks;
+
+    BURTCCtrl.compare_callback = NULL;
+
+    if (trigger_time->tv_sec < BURTCDRV_SEC_PER_OF) {
+        ticks = (trigger_time->tv_sec * BURTCDRV_FREQ) +
+                (((trigger_time->tv_nsec / 8000) * BURTCDRV_FREQ) / 125000);
+    } else {
+        ticks = 0;
+    }
+
+    // Set some safe threshold, 1 tick should be enough...
+    if (ticks < BURTCDRV_COMP_SET_MIN) {
+        ticks = BURTCDRV_COMP_SET_MIN;
+    }
+
+    /* Register callback and set new compare value */
+    BURTCCtrl.compare_callback = callback;
+    while (BURTC->SYNCBUSY & BURTC_SYNCBUSY_COMP0);
+    BURTC->COMP0 = BURTC->CNT + ticks;
+}
+
+
+/***************************************************************************//**
+ * @brief Cancel the pending trigger
+ * @param channel Compare channel, BURTC has only one
+ ******************************************************************************/
+static void BURTCDRV_Cancel (unsigned int channel)
+{
+    EFM_ASSERT (channel == 0);
+
+    BURTCCtrl.compare_callback = NULL;
+}
+
+
+/***************************************************************************//**
+ * @brief Load the CLOCK_REALTIME offset from the retention registers
+ * @param offset Retained offset
+ * @retval 0 on success
+ ******************************************************************************/
+static int BURTCDRV_LoadOffset (SysTime *offset)
+{
+    if (BURTC->RET[BURTCDRV_RET_MAGIC].REG != BURTCDRV_MAGIC) {
+        return -1;
+    }
+
+    offset->tv_sec = BURTC->RET[BURTCDRV_RET_OFFSET_SEC].REG;
+    offset->tv_nsec = BURTC->RET[BURTCDRV_RET_OFFSET_NS].REG;
+
+    return 0;
+}
+
+
+/***************************************************************************//**
+ * @brief Store the CLOCK_REALTIME offset to the retention registers
+ * @param offset Offset to retain
+ ******************************************************************************/
+static void BURTCDRV_StoreOffset (SysTime *offset)
+{
+    // Both words have to change together, a reset in between must not
+    // leave a half written offset behind
+    INT_Disable ();
+    BURTC->RET[BURTCDRV_RET_OFFSET_SEC].REG = offset->tv_sec;
+    BURTC->RET[BURTCDRV_RET_OFFSET_NS].REG = offset->tv_nsec;
+    INT_Enable ();
+}
+
+
+SysTimeBackend _SysTimeBurtc = {
+    .init               = BURTCDRV_Init,
+    .getFrequency       = BURTCDRV_GetFrequency,
+    .getSystemTime      = BURTCDRV_GetSystemTime,
+    .getSystemNanoTime  = BURTCDRV_GetSystemNanoTime,
+    .trigger            = BURTCDRV_Trigger,
+    .cancel             = BURTCDRV_Cancel,
+    .loadOffset         = BURTCDRV_LoadOffset,
+    .storeOffset        = BURTCDRV_StoreOffset
+};
+
+SysTimeBackend *SysTimeBurtc = &_SysTimeBurtc;
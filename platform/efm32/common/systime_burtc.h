@@ -0,0 +1,29 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef SYSTIME_BURTC_H_
+#define SYSTIME_BURTC_H_
+
+#include "systime.h"
+
+/** Retention registers used by the time base, the rest are free */
+#define SYSTIME_BURTC_RET_WORDS 4
+#define SYSTIME_BURTC_RET_FIRST (128 - SYSTIME_BURTC_RET_WORDS)
+
+extern SysTimeBackend *SysTimeBurtc;
+
+#endif /* SYSTIME_BURTC_H_ */
@@ -0,0 +1,271 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stddef.h>
+
+#include <em_device.h>
+#include <em_cmu.h>
+#include <em_int.h>
+
+#include "systime_dual.h"
+#include "systime_rtc.h"
+
+typedef struct {
+    int         awake;
+    uint32_t    freq;           // TIMER2 input frequency
+    uint32_t    tick_nsec;      // RTC tick length
+    uint32_t    anchor_cnt;     // TIMER count at the anchor
+    SysTime     anchor;         // RTC time at the anchor
+    SysTime     last;           // Last time returned
+} DualControl;
+
+
+static DualControl DualCtrl;
+
+
+/**
+ * @brief  Time interpolated from the anchor with the TIMER count.
+ */
+static void DUAL_Interpolate (SysTime *tm, uint32_t cnt)
+{
+    uint64_t nsec = ((uint64_t)(cnt - DualCtrl.anchor_cnt) * 1000000000) / DualCtrl.freq;
+
+    tm->tv_sec = DualCtrl.anchor.tv_sec + (uint32_t)(nsec / 1000000000);
+    tm->tv_nsec = DualCtrl.anchor.tv_nsec + (uint32_t)(nsec % 1000000000);
+    if (tm->tv_nsec >= 1000000000) {
+        tm->tv_sec++;
+        tm->tv_nsec -= 1000000000;
+    }
+}
+
+
+static uint32_t DUAL_CounterGet (void)
+{
+    uint32_t hi, lo;
+
+    // TIMER3 counts the TIMER2 overflows
+    do {
+        hi = TIMER3->CNT;
+        lo = TIMER2->CNT;
+    } while (hi != TIMER3->CNT);
+
+    return (hi << 16) | lo;
+}
+
+
+/***************************************************************************//**
+ * @brief Start the high resolution counter, the RTC time is the anchor.
+ ******************************************************************************/
+static void DUAL_Wake (void)
+{
+    INT_Disable ();
+
+    CMU_ClockEnable (cmuClock_HFPER, true);
+    CMU_ClockEnable (cmuClock_TIMER2, true);
+    CMU_ClockEnable (cmuClock_TIMER3, true);
+
+    TIMER2->CNT = 0;
+    TIMER3->CNT = 0;
+    TIMER3->CMD = TIMER_CMD_START;
+    TIMER2->CMD = TIMER_CMD_START;
+
+    DualCtrl.freq = CMU_ClockFreqGet (cmuClock_TIMER2);
+    DualCtrl.anchor_cnt = 0;
+    SysTimeRtc->getSystemNanoTime (&DualCtrl.anchor);
+    DualCtrl.awake = 1;
+
+    INT_Enable ();
+}
+
+
+/***************************************************************************//**
+ * @brief Stop the high resolution counter, the RTC alone keeps the time.
+ ******************************************************************************/
+static void DUAL_Sleep (void)
+{
+    INT_Disable ();
+
+    DualCtrl.awake = 0;
+    TIMER2->CMD = TIMER_CMD_STOP;
+    TIMER3->CMD = TIMER_CMD_STOP;
+
+    CMU_ClockEnable (cmuClock_TIMER2, false);
+    CMU_ClockEnable (cmuClock_TIMER3, false);
+
+    INT_Enable ();
+}
+
+
+/***************************************************************************//**
+ * @brief HFPERCLK has changed: move the anchor to the time counted so far
+ *  at the old frequency, count on at the new one.
+ ******************************************************************************/
+static void DUAL_ClockChanged (void)
+{
+    SysTime tm;
+    uint32_t cnt;
+
+    INT_Disable ();
+
+    if (DualCtrl.awake) {
+        cnt = DUAL_CounterGet ();
+        DUAL_Interpolate (&tm, cnt);
+        DualCtrl.anchor = tm;
+        DualCtrl.anchor_cnt = cnt;
+        DualCtrl.freq = CMU_ClockFreqGet (cmuClock_TIMER2);
+    }
+
+    INT_Enable ();
+}
+
+
+static int DUAL_Init (void)
+{
+    int res;
+
+    res = SysTimeRtc->init ();
+    if (res != 0) {
+        return res;
+    }
+
+    DualCtrl.tick_nsec = 1000000000 / SysTimeRtc->getFrequency ();
+    SYSTIME_RESET (&DualCtrl.last);
+
+    // The registers take no writes with the clock off
+    CMU_ClockEnable (cmuClock_HFPER, true);
+    CMU_ClockEnable (cmuClock_TIMER2, true);
+    CMU_ClockEnable (cmuClock_TIMER3, true);
+
+    TIMER2->CTRL = TIMER_CTRL_MODE_UP;
+    TIMER2->TOP = 0xFFFF;
+    TIMER3->CTRL = TIMER_CTRL_MODE_UP | TIMER_CTRL_CLKSEL_TIMEROUF;
+    TIMER3->TOP = 0xFFFF;
+
+    DUAL_Wake ();
+
+    return 0;
+}
+
+
+/***************************************************************************//**
+ * @brief Time from the RTC, interpolated with the TIMER count since the
+ *  anchor while awake. The result stays within one RTC tick of the RTC
+ *  time; when it would not, the anchor is moved to the current RTC time.
+ *  It never goes back, also not over a sleep/wake handover.
+ ******************************************************************************/
+static void DUAL_GetSystemNanoTime (SysTime *tm)
+{
+    SysTime rtc;
+    uint32_t cnt;
+
+    INT_Disable ();
+
+    SysTimeRtc->getSystemNanoTime (&rtc);
+
+    if (DualCtrl.awake) {
+
+        cnt = DUAL_CounterGet ();
+        DUAL_Interpolate (tm, cnt);
+
+        // Out of the current RTC tick, discipline to the RTC
+        if (SYSTIME_CMP (tm, &rtc) < 0 ||
+            tm->tv_sec > rtc.tv_sec + 1 ||
+            (tm->tv_sec - rtc.tv_sec) * 1000000000 + tm->tv_nsec - rtc.tv_nsec >= DualCtrl.tick_nsec) {
+            DualCtrl.anchor = rtc;
+            DualCtrl.anchor_cnt = cnt;
+            *tm = rtc;
+        }
+
+    } else {
+        *tm = rtc;
+    }
+
+    if (SYSTIME_CMP (tm, &DualCtrl.last) < 0) {
+        *tm = DualCtrl.last;
+    } else {
+        DualCtrl.last = *tm;
+    }
+
+    INT_Enable ();
+}
+
+
+static uint32_t DUAL_GetSystemTime (void)
+{
+    SysTime tm;
+
+    DUAL_GetSystemNanoTime (&tm);
+
+    return tm.tv_sec;
+}
+
+
+/***************************************************************************//**
+ * @brief Current resolution, TIMER frequency while awake
+ ******************************************************************************/
+static uint32_t DUAL_GetFrequency (void)
+{
+    return DualCtrl.awake ? DualCtrl.freq : SysTimeRtc->getFrequency ();
+}
+
+
+static void DUAL_Trigger (SysTime *tm, void (*callback) (void))
+{
+    SysTimeRtc->trigger (tm, callback);
+}
+
+
+static void DUAL_Prewake (SysTime *lead, void (*callback) (void))
+{
+    SysTimeRtc->prewake (lead, callback);
+}
+
+
+static unsigned int DUAL_GetChannels (void)
+{
+    return SysTimeRtc->getChannels ();
+}
+
+
+static void DUAL_TriggerChannel (unsigned int channel, SysTime *tm, void (*callback) (void))
+{
+    SysTimeRtc->triggerChannel (channel, tm, callback);
+}
+
+
+static void DUAL_Cancel (unsigned int channel)
+{
+    SysTimeRtc->cancel (channel);
+}
+
+
+SysTimeBackend _SysTimeDual = {
+    .init               = DUAL_Init,
+    .getFrequency       = DUAL_GetFrequency,
+    .getSystemTime      = DUAL_GetSystemTime,
+    .getSystemNanoTime  = DUAL_GetSystemNanoTime,
+    .trigger            = DUAL_Trigger,
+    .prewake            = DUAL_Prewake,
+    .getChannels        = DUAL_GetChannels,
+    .triggerChannel     = DUAL_TriggerChannel,
+    .cancel             = DUAL_Cancel,
+    .sleep              = DUAL_Sleep,
+    .wake               = DUAL_Wake,
+    .clockChanged       = DUAL_ClockChanged
+};
+
+SysTimeBackend *SysTimeDual = &_SysTimeDual;
@@ -20,7 +20,9 @@
 #define RTCDRV_CNT_MASK         (_RTC_CNT_CNT_MASK >> _RTC_CNT_CNT_SHIFT)
 #define RTCDRV_CNT_MAX          (RTCDRV_CNT_MASK + 1)
 #define RTCDRV_SEC_PER_OF       (RTCDRV_CNT_MAX / RTCDRV_FREQ)
+#define RTCDRV_TICKS_MAX        (RTCDRV_CNT_MAX / 2)
 #define RTCDRC_COMP_SET_MIN     1
+#define RTCDRV_CHANNELS         2
 
 #include <stddef.h>
 #include <math.h>
@@ -28,19 +30,81 @@
 #include <em_device.h>
 #include <em_assert.h>
 #include <em_cmu.h>
+#include <em_int.h>
 #include <em_rtc.h>
 
 #include "systime_rtc.h"
 
+/**
+ * The 24-bit RTC counter is extended to 64 bits on read: the distance from
+ * the last extended value to the current count is added to it. That is
+ * correct as long as the counter is read less than a wrap apart. Reads
+ * happen at every scheduler trigger, so the overflow interrupt is enabled
+ * only while no trigger is armed within half a wrap. Triggers further away
+ * than that fire at half a wrap, early, the caller arms them again.
+ *
+ * The overflow interrupt alone reads once per wrap, a whole wrap apart
+ * looks like no time at all. Its handler adds the wrap then, unless the
+ * last read saw the overflow flag already and so came after the wrap.
+ */
 typedef struct {
-    volatile uint32_t overflow_counter;
-    void              (*compare_callback)(void);
+    uint64_t          ticks;
+    bool              of_seen;
+    void              (*compare_callback[RTCDRV_CHANNELS])(void);
+    void              (*prewake_callback)(void);
+    uint32_t          prewake_ticks;
 } RTCControl;
 
 
 static RTCControl RTCCtrl;
 
 
+/***************************************************************************//**
+ * @brief Read the RTC counter extended to 64 bits.
+ * @param wrapped The counter wrapped since the flag was last cleared
+ ******************************************************************************/
+static uint64_t RTCDRV_Extend (bool wrapped)
+{
+    uint64_t ticks;
+    uint32_t cnt;
+
+    INT_Disable ();
+
+    // Counter first, a wrap in between is seen by the flag
+    cnt = RTC_CounterGet ();
+    ticks = RTCCtrl.ticks + ((cnt - (uint32_t)RTCCtrl.ticks) & RTCDRV_CNT_MASK);
+
+    if (wrapped && !RTCCtrl.of_seen &&
+        (ticks & ~(uint64_t)RTCDRV_CNT_MASK) == (RTCCtrl.ticks & ~(uint64_t)RTCDRV_CNT_MASK)) {
+        ticks += RTCDRV_CNT_MAX;
+    }
+
+    RTCCtrl.ticks = ticks;
+    RTCCtrl.of_seen = (RTC_IntGet () & RTC_IF_OF) != 0;
+    INT_Enable ();
+
+    return ticks;
+}
+
+
+static uint64_t RTCDRV_GetTicks (void)
+{
+    return RTCDRV_Extend (false);
+}
+
+
+/***************************************************************************//**
+ * @brief Keep the counter extended with the overflow interrupt, from now on
+ *  until a trigger within half a wrap is armed.
+ ******************************************************************************/
+static void RTCDRV_KeepExtended (void)
+{
+    RTC_IntClear (RTC_IFC_OF);
+    RTCDRV_GetTicks ();
+    RTC_IntEnable (RTC_IEN_OF);
+}
+
+
 /***************************************************************************//**
  * @brief RTC Interrupt Handler, invoke callback function if defined.
  ******************************************************************************/
@@ -52,21 +116,42 @@ void RTC_IRQHandler (void)
         RTC_IntClear (RTC_IFC_COMP0);
 
         /* Trigger callback if defined */
-        if (RTCCtrl.compare_callback) {
-            void (*temp)(void) = RTCCtrl.compare_callback;
-            RTCCtrl.compare_callback = NULL;
+        if (RTCCtrl.compare_callback[0]) {
+            void (*temp)(void) = RTCCtrl.compare_callback[0];
+            RTCCtrl.compare_callback[0] = NULL;
+
+            /* Nothing reads the counter unless the callback arms again */
+            RTCDRV_KeepExtended ();
+
             temp ();
         }
 
     }
 
+    if (RTC_IntGet () & RTC->IEN & RTC_IF_COMP1) {
+
+        /* Clear interrupt source, COMP1 is armed again on demand */
+        RTC_IntClear (RTC_IFC_COMP1);
+        RTC_IntDisable (RTC_IEN_COMP1);
+
+        /* Channel 1 trigger takes precedence over pre-wake */
+        if (RTCCtrl.compare_callback[1]) {
+            void (*temp)(void) = RTCCtrl.compare_callback[1];
+            RTCCtrl.compare_callback[1] = NULL;
+            temp ();
+        } else if (RTCCtrl.prewake_callback) {
+            RTCCtrl.prewake_callback ();
+        }
+
+    }
+
     if (RTC_IntGet () & RTC_IF_OF) {
 
         /* Clear interrupt source */
         RTC_IntClear (RTC_IFC_OF);
 
-        /* Increase the overflow counter */
-        RTCCtrl.overflow_counter++;
+        /* Keep the extended counter within one wrap */
+        RTCDRV_Extend (true);
 
     }
 }
@@ -81,8 +166,12 @@ void RTC_IRQHandler (void)
  ******************************************************************************/
 static int RTCDRV_Init (void)
 {
-    RTCCtrl.overflow_counter = 0;
-    RTCCtrl.compare_callback = NULL;
+    RTCCtrl.ticks = 0;
+    RTCCtrl.of_seen = false;
+    RTCCtrl.compare_callback[0] = NULL;
+    RTCCtrl.compare_callback[1] = NULL;
+    RTCCtrl.prewake_callback = NULL;
+    RTCCtrl.prewake_ticks = 0;
 
     /* Ensure LE modules are accessible */
     CMU_ClockEnable (cmuClock_CORELE, true);
@@ -115,32 +204,16 @@ static int RTCDRV_Init (void)
 
 static uint32_t RTCDRV_GetSystemTime (void)
 {
-    uint32_t cnt, ofc;
-
-    // Make sure the overflow counter does not get incremented
-    // while reading the RTC counter value
-    do {
-        ofc = RTCCtrl.overflow_counter;
-        cnt = RTC_CounterGet ();
-    } while (ofc != RTCCtrl.overflow_counter);
-
-    return (ofc * RTCDRV_SEC_PER_OF) + (cnt / RTCDRV_FREQ);
+    return (uint32_t)(RTCDRV_GetTicks () / RTCDRV_FREQ);
 }
 
 
 static void RTCDRV_GetSystemNanoTime (SysTime *tm)
 {
-    uint32_t cnt, ofc;
+    uint64_t ticks = RTCDRV_GetTicks ();
 
-    // Make sure the overflow counter does not get incremented
-    // while reading the RTC counter value
-    do {
-        ofc = RTCCtrl.overflow_counter;
-        cnt = RTC_CounterGet ();
-    } while (ofc != RTCCtrl.overflow_counter);
-
-    tm->tv_sec  = (ofc * RTCDRV_SEC_PER_OF) + (cnt / RTCDRV_FREQ);
-    tm->tv_nsec = ((cnt % RTCDRV_FREQ) * 125000 / RTCDRV_FREQ) * 8000;
+    tm->tv_sec  = (uint32_t)(ticks / RTCDRV_FREQ);
+    tm->tv_nsec = (((uint32_t)ticks % RTCDRV_FREQ) * 125000 / RTCDRV_FREQ) * 8000;
 }
 
 
@@ -150,33 +223,123 @@ static uint32_t RTCDRV_GetFrequency ()
 }
 
 
-/***************************************************************************//**
- * @brief RTC trigger enable
- * @param msec Enable trigger in msec
- * @param callback Callback invoked when @p msec elapsed
- ******************************************************************************/
-static void RTCDRV_Trigger (SysTime *trigger_time, void (*callback) (void))
+static unsigned int RTCDRV_GetChannels ()
 {
-    uint32_t ticks;
+    return RTCDRV_CHANNELS;
+}
 
-    RTCCtrl.compare_callback = NULL;
 
-    if (trigger_time->tv_sec < RTCDRV_SEC_PER_OF) {
-        ticks = (trigger_time->tv_sec * RTCDRV_FREQ) + (((trigger_time->tv_nsec / 8000) * RTCDRV_FREQ) / 125000);
+static uint32_t RTCDRV_TimeToTicks (SysTime *tm)
+{
+    if (tm->tv_sec < RTCDRV_SEC_PER_OF / 2) {
+        return (tm->tv_sec * RTCDRV_FREQ) + (((tm->tv_nsec / 8000) * RTCDRV_FREQ) / 125000);
     } else {
-        ticks = 0;
+        return RTCDRV_TICKS_MAX;
     }
+}
 
-    /* Register callback */
-    RTCCtrl.compare_callback = callback;
+
+/***************************************************************************//**
+ * @brief RTC trigger enable on a compare channel. Channel 0 (COMP0) serves
+ *  the scheduler, channel 1 (COMP1) a separate high priority deadline. While
+ *  channel 1 is idle, COMP1 is used for pre-wake ahead of channel 0.
+ * @param channel Compare channel
+ * @param trigger_time Time from now until the trigger
+ * @param callback Callback invoked when @p trigger_time elapsed
+ ******************************************************************************/
+static void RTCDRV_TriggerChannel (unsigned int channel, SysTime *trigger_time, void (*callback) (void))
+{
+    uint32_t ticks, cnt;
+
+    EFM_ASSERT (channel < RTCDRV_CHANNELS);
+
+    RTCCtrl.compare_callback[channel] = NULL;
+
+    ticks = RTCDRV_TimeToTicks (trigger_time);
 
     // Set some safe threshold, 1 tick should be enough...
     if (ticks < RTCDRC_COMP_SET_MIN) {
         ticks = RTCDRC_COMP_SET_MIN;
     }
 
-    /* Set new compare value */
-    RTC_CompareSet (0, RTC_CounterGet () + ticks);
+    cnt = RTC_CounterGet ();
+
+    if (channel == 0) {
+
+        /* Register callback and set new compare value */
+        RTCCtrl.compare_callback[0] = callback;
+        RTC_CompareSet (0, (cnt + ticks) & RTCDRV_CNT_MASK);
+
+        /* The trigger reads the counter in time, unless it is too far away */
+        if (ticks < RTCDRV_TICKS_MAX) {
+            RTC_IntDisable (RTC_IEN_OF);
+        } else {
+            RTC_IntEnable (RTC_IEN_OF);
+        }
+
+        /* Pre-wake only if COMP1 is free and there is enough time left for it */
+        if (RTCCtrl.compare_callback[1] == NULL) {
+            RTC_IntDisable (RTC_IEN_COMP1);
+            if (RTCCtrl.prewake_callback && ticks > RTCCtrl.prewake_ticks + RTCDRC_COMP_SET_MIN) {
+                RTC_CompareSet (1, (cnt + ticks - RTCCtrl.prewake_ticks) & RTCDRV_CNT_MASK);
+                RTC_IntClear (RTC_IFC_COMP1);
+                RTC_IntEnable (RTC_IEN_COMP1);
+            }
+        }
+
+    } else {
+
+        RTC_IntDisable (RTC_IEN_COMP1);
+        RTCCtrl.compare_callback[1] = callback;
+        RTC_CompareSet (1, (cnt + ticks) & RTCDRV_CNT_MASK);
+        RTC_IntClear (RTC_IFC_COMP1);
+        RTC_IntEnable (RTC_IEN_COMP1);
+
+    }
+}
+
+
+/***************************************************************************//**
+ * @brief RTC trigger enable on the scheduler channel
+ * @param trigger_time Time from now until the trigger
+ * @param callback Callback invoked when @p trigger_time elapsed
+ ******************************************************************************/
+static void RTCDRV_Trigger (SysTime *trigger_time, void (*callback) (void))
+{
+    RTCDRV_TriggerChannel (0, trigger_time, callback);
+}
+
+
+/***************************************************************************//**
+ * @brief Cancel a pending trigger
+ * @param channel Compare channel
+ ******************************************************************************/
+static void RTCDRV_Cancel (unsigned int channel)
+{
+    EFM_ASSERT (channel < RTCDRV_CHANNELS);
+
+    if (channel == 1) {
+        RTC_IntDisable (RTC_IEN_COMP1);
+    } else {
+        /* Nothing reads the counter any more */
+        RTCDRV_KeepExtended ();
+    }
+
+    RTCCtrl.compare_callback[channel] = NULL;
+}
+
+
+/***************************************************************************//**
+ * @brief Pre-wake configuration, uses COMP1
+ * @param lead Time between the pre-wake callback and the trigger
+ * @param callback Callback invoked @p lead before every trigger
+ ******************************************************************************/
+static void RTCDRV_Prewake (SysTime *lead, void (*callback) (void))
+{
+    RTC_IntDisable (RTC_IEN_COMP1);
+
+    RTCCtrl.prewake_ticks = RTCDRV_TimeToTicks (lead);
+    RTCCtrl.prewake_callback = callback;
 }
 
 
@@ -185,7 +348,11 @@ SysTimeBackend _SysTimeRtc = {
     .getFrequency       = RTCDRV_GetFrequency,
     .getSystemTime      = RTCDRV_GetSystemTime,
     .getSystemNanoTime  = RTCDRV_GetSystemNanoTime,
-    .trigger            = RTCDRV_Trigger
+    .trigger            = RTCDRV_Trigger,
+    .prewake            = RTCDRV_Prewake,
+    .getChannels        = RTCDRV_GetChannels,
+    .triggerChannel     = RTCDRV_TriggerChannel,
+    .cancel             = RTCDRV_Cancel
 };
 
 SysTimeBackend *SysTimeRtc = &_SysTimeRtc;
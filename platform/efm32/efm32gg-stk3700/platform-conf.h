@@ -20,8 +20,56 @@
 
 #include <protothreads.h>
 
+#include "../../common/boottime.h"
+#include "../../common/capture.h"
+#include "../../common/hibernate_em4.h"
+#include "../../common/lfxo_async.h"
+#include "../../common/lfxo_cal.h"
+#include "../../common/rampwr.h"
+#include "../../common/systime_burtc.h"
+#include "../../common/systime_dual.h"
 #include "../../common/systime_rtc.h"
 
+/**
+ * Run the system time from BURTC instead of RTC. BURTC keeps counting in
+ * EM4 and over resets, so CLOCK_REALTIME stays valid after a wake-up.
+ */
+#ifndef PLATFORM_CONF_SYSTIME_BURTC
+#define PLATFORM_CONF_SYSTIME_BURTC 0
+#endif /* PLATFORM_CONF_SYSTIME_BURTC */
+
+/**
+ * Refine the RTC system time with a TIMER while the core is awake, see
+ * systime_dual.h.
+ */
+#ifndef PLATFORM_CONF_SYSTIME_DUAL
+#define PLATFORM_CONF_SYSTIME_DUAL  0
+#endif /* PLATFORM_CONF_SYSTIME_DUAL */
+
+#if PLATFORM_CONF_SYSTIME_DUAL && PLATFORM_CONF_SYSTIME_BURTC
+#error "Select only one of PLATFORM_CONF_SYSTIME_DUAL and PLATFORM_CONF_SYSTIME_BURTC"
+#endif
+
+/**
+ * Start LFXO in the background and run the RTC from LFRCO until the
+ * crystal is stable, instead of blocking the boot on LFXO startup.
+ */
+#ifndef PLATFORM_CONF_LFXO_ASYNC
+#define PLATFORM_CONF_LFXO_ASYNC    (!PLATFORM_CONF_SYSTIME_BURTC)
+#endif /* PLATFORM_CONF_LFXO_ASYNC */
+
+#if PLATFORM_CONF_LFXO_ASYNC && PLATFORM_CONF_SYSTIME_BURTC
+#error "BURTC runs from LFXO only, PLATFORM_CONF_LFXO_ASYNC is not supported"
+#endif
+
+/**
+ * Calibrate LFXO against HFXO periodically and trim the system time with
+ * the measured error, see lfxo_cal.h.
+ */
+#ifndef PLATFORM_CONF_LFXO_CAL
+#define PLATFORM_CONF_LFXO_CAL          0
+#endif /* PLATFORM_CONF_LFXO_CAL */
+
 PROCESS_NAME (MAIN_Process);
 
 #endif /* PLATFORM_CONF_H_ */
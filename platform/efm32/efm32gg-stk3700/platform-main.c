@@ -26,31 +26,87 @@
 #include <systime.h>
 #include <systimer.h>
 
+#include "process-trace.h"
+
 int main (void)
 {
+    int em4;
+
     // Chip errata
     CHIP_Init ();
 
+    // Reset cause, before anything clears it
+    em4 = HIBERNATE_EM4_WokeUp ();
+
+    BOOTTIME_Start ();
+
+    // Power down the RAM blocks the firmware does not use
+    RAMPWR_Init ();
+#if DEBUG
+    RAMPWR_PrintReport ();
+#endif
+
     // Set up clocks
     CMU_ClockSelectSet (cmuClock_HF, cmuSelect_HFRCO);
+#if PLATFORM_CONF_LFXO_ASYNC
+    LFXO_StartAsync ();
+#else
     CMU_ClockSelectSet (cmuClock_LFA, cmuSelect_LFXO);
+#endif
+
+    BOOTTIME_Mark (BOOTTIME_CLOCKS);
 
     // Initialize the system time
+#if PLATFORM_CONF_SYSTIME_BURTC
+    SYSTIME_Init (SysTimeBurtc);
+#elif PLATFORM_CONF_SYSTIME_DUAL
+    SYSTIME_Init (SysTimeDual);
+#else
     SYSTIME_Init (SysTimeRtc);
+#endif
+
+    // Calibrate low power mode wake-ups
+    LPM_Init ();
+
+    BOOTTIME_Mark (BOOTTIME_SYSTIME);
 
     // Initialize protothreads...
     process_init ();
 
-    // Activate the system timer
-    process_start (&SYSTIMER_Process, NULL);
+#if PROCESS_CONF_TRACE
+    // Time stamps in core clock cycles
+    process_trace_init (CMU_ClockFreqGet (cmuClock_CORE));
+#endif
 
-    process_start (&MAIN_Process, NULL);
+    // Continue from the hibernate snapshot after an EM4 wake-up
+    if (!em4 || HIBERNATE_EM4_Resume () != 0) {
+
+        // Activate the system timer
+        process_start (&SYSTIMER_Process, NULL);
+
+        process_start (&MAIN_Process, NULL);
+
+    }
+
+#if PLATFORM_CONF_LFXO_ASYNC
+    // Switch the RTC over to LFXO when it is ready
+    process_start (&LFXO_Process, NULL);
+#endif
+
+#if PLATFORM_CONF_LFXO_CAL
+    // Keep correcting the LFXO error
+    process_start (&LFXOCAL_Process, NULL);
+#endif
+
+    BOOTTIME_Mark (BOOTTIME_PROCESSES);
 
     while (1) {
 
         // Run processes...
         while (process_run () > 0);
 
+        BOOTTIME_Mark (BOOTTIME_FIRST_EVENT);
+
         // Sleep until the next event...
         LPM_WaitForEvent ();
 
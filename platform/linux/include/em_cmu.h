@@ -0,0 +1,44 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef EM_CMU_H_
+#define EM_CMU_H_
+
+#include <stdbool.h>
+
+/*
+ * Clock management of emlib for the host, so that applications written
+ * for the target run unchanged. The host has no clocks to manage.
+ */
+
+typedef enum {
+    cmuClock_HF,
+    cmuClock_HFPER,
+    cmuClock_CORE,
+    cmuClock_CORELE,
+    cmuClock_GPIO,
+    cmuClock_LFA,
+    cmuClock_RTC
+} CMU_Clock_TypeDef;
+
+static inline void CMU_ClockEnable (CMU_Clock_TypeDef clock, bool enable)
+{
+    (void)clock;
+    (void)enable;
+}
+
+#endif /* EM_CMU_H_ */
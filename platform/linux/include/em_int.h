@@ -0,0 +1,47 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef EM_INT_H_
+#define EM_INT_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+ * Interrupt disabling of emlib for the host. Interrupts are emulated by
+ * threads, e.g. the trigger thread of systime_posix.c, that run their
+ * handlers holding INT_Lock.
+ */
+
+extern pthread_mutex_t INT_Lock;
+extern uint32_t INT_LockCnt;
+
+static inline uint32_t INT_Disable (void)
+{
+    pthread_mutex_lock (&INT_Lock);
+    return ++INT_LockCnt;
+}
+
+static inline uint32_t INT_Enable (void)
+{
+    uint32_t cnt = --INT_LockCnt;
+
+    pthread_mutex_unlock (&INT_Lock);
+    return cnt;
+}
+
+#endif /* EM_INT_H_ */
@@ -0,0 +1,100 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <limits.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include "em_int.h"
+
+#include "platform-conf.h"
+
+#include "lpm.h"
+#include "process-trace.h"
+#include "systime.h"
+
+/*
+ * Low power modes of the host. The core waits on a futex for the events
+ * registered by the trigger thread instead of entering EM2. In simulated
+ * time the clock is advanced to the next trigger instead.
+ */
+
+static int EventRegistered = 0;
+static volatile int EM2Blocked = 0;
+
+
+void LPM_Init (void)
+{
+}
+
+
+void LPM_RegisterEvent (void)
+{
+    __atomic_store_n (&EventRegistered, 1, __ATOMIC_RELEASE);
+    syscall (SYS_futex, &EventRegistered, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+
+/**
+ * @brief  Kept for the drivers, there is nothing to keep running on the host.
+ */
+void LPM_BlockEM2 (void)
+{
+    INT_Disable ();
+    EM2Blocked++;
+    INT_Enable ();
+}
+
+
+void LPM_UnblockEM2 (void)
+{
+    INT_Disable ();
+    if (EM2Blocked > 0) {
+        EM2Blocked--;
+    }
+    INT_Enable ();
+}
+
+
+void LPM_WaitForEvent (void)
+{
+    if (__atomic_exchange_n (&EventRegistered, 0, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    SYSTIME_Sleep ();
+    PROCESS_TRACE_GO_SLEEP ();
+
+#if PLATFORM_CONF_SIM
+    while (!__atomic_load_n (&EventRegistered, __ATOMIC_ACQUIRE)) {
+        if (SIM_Advance () != 0) {
+            break;
+        }
+    }
+#else
+    // The futex returns at once if an event was registered after the check
+    while (!__atomic_load_n (&EventRegistered, __ATOMIC_ACQUIRE)) {
+        syscall (SYS_futex, &EventRegistered, FUTEX_WAIT_PRIVATE, 0, NULL, NULL, 0);
+    }
+#endif /* PLATFORM_CONF_SIM */
+
+    PROCESS_TRACE_WAKE_UP ();
+    SYSTIME_Wake ();
+
+    __atomic_store_n (&EventRegistered, 0, __ATOMIC_RELAXED);
+}
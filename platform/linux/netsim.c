@@ -0,0 +1,609 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "netsim.h"
+#include "systime_sim.h"
+
+#define NETSIM_NEVER        UINT64_MAX
+
+struct NetsimLink_S {
+    NetsimNode      *dst;
+    uint64_t        latency;
+    uint32_t        loss_ppm;
+    NetsimLink      *next;
+};
+
+/** Packet on its way, ordered by arrival, source and sequence number */
+typedef struct {
+    uint64_t        time;
+    uint32_t        seq;
+    NetsimNode      *node;
+    NetsimPacket    pkt;
+} NetsimMsg;
+
+typedef struct {
+    pthread_t       thread;
+    unsigned int    index;
+    NetsimNode      *nodes;
+    NetsimNode      *ready;
+    NetsimNode      *ready_tail;
+    pthread_mutex_t lock;
+    NetsimMsg       **heap;
+    size_t          count;
+    size_t          size;
+    uint64_t        next;
+} NetsimThread;
+
+typedef struct {
+    uint64_t            seed;
+    unsigned int        nthreads;
+    NetsimThread        *threads;
+    NetsimNode          **nodes;
+    uint32_t            count;
+    uint32_t            size;
+    uint64_t            lookahead;
+    uint64_t            end;
+    uint64_t            window;
+    pthread_barrier_t   barrier;
+    SimStats            stats;
+} NetsimControl;
+
+static NetsimControl NetsimCtrl;
+
+process_event_t NETSIM_Event;
+
+
+static uint32_t NETSIM_Random (uint64_t *rng)
+{
+    *rng ^= *rng >> 12;
+    *rng ^= *rng << 25;
+    *rng ^= *rng >> 27;
+
+    return (uint32_t)((*rng * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+
+static int NETSIM_Before (const NetsimMsg *a, const NetsimMsg *b)
+{
+    if (a->time != b->time) {
+        return a->time < b->time;
+    }
+    if (a->pkt.src != b->pkt.src) {
+        return a->pkt.src < b->pkt.src;
+    }
+    return a->seq < b->seq;
+}
+
+
+static int NETSIM_Push (NetsimThread *t, NetsimMsg *msg)
+{
+    NetsimMsg *tmp;
+    size_t i;
+
+    pthread_mutex_lock (&t->lock);
+
+    if (t->count == t->size) {
+        size_t size = t->size ? t->size * 2 : 64;
+        NetsimMsg **heap = realloc (t->heap, size * sizeof (*heap));
+        if (heap == NULL) {
+            pthread_mutex_unlock (&t->lock);
+            return -1;
+        }
+        t->heap = heap;
+        t->size = size;
+    }
+
+    i = t->count++;
+    t->heap[i] = msg;
+    while (i > 0 && NETSIM_Before (t->heap[i], t->heap[(i - 1) / 2])) {
+        tmp = t->heap[i];
+        t->heap[i] = t->heap[(i - 1) / 2];
+        t->heap[(i - 1) / 2] = tmp;
+        i = (i - 1) / 2;
+    }
+
+    pthread_mutex_unlock (&t->lock);
+
+    return 0;
+}
+
+
+/**
+ * @brief  Take the earliest packet of the thread, the owner thread only.
+ *         Other threads push only packets after the current window.
+ */
+static NetsimMsg *NETSIM_Pop (NetsimThread *t)
+{
+    NetsimMsg *msg, *tmp;
+    size_t i = 0, c;
+
+    pthread_mutex_lock (&t->lock);
+
+    msg = t->heap[0];
+    t->heap[0] = t->heap[--t->count];
+    while ((c = 2 * i + 1) < t->count) {
+        if (c + 1 < t->count && NETSIM_Before (t->heap[c + 1], t->heap[c])) {
+            c++;
+        }
+        if (!NETSIM_Before (t->heap[c], t->heap[i])) {
+            break;
+        }
+        tmp = t->heap[i];
+        t->heap[i] = t->heap[c];
+        t->heap[c] = tmp;
+        i = c;
+    }
+
+    pthread_mutex_unlock (&t->lock);
+
+    return msg;
+}
+
+
+static uint64_t NETSIM_NextMsg (NetsimThread *t)
+{
+    uint64_t next;
+
+    pthread_mutex_lock (&t->lock);
+    next = t->count ? t->heap[0]->time : NETSIM_NEVER;
+    pthread_mutex_unlock (&t->lock);
+
+    return next;
+}
+
+
+/**
+ * @brief  Set up the simulator, before adding nodes.
+ * @param  seed Seed of the run.
+ * @param  threads Number of worker threads.
+ * @retval None.
+ */
+void NETSIM_Init (uint64_t seed, unsigned int threads)
+{
+    memset (&NetsimCtrl, 0, sizeof (NetsimCtrl));
+    NetsimCtrl.seed = seed;
+    NetsimCtrl.nthreads = threads ? threads : 1;
+    NetsimCtrl.lookahead = NETSIM_NEVER;
+
+    NETSIM_Event = process_alloc_event ();
+}
+
+
+/**
+ * @brief  Add a node running its own copy of a main process.
+ * @param  main Main process of the node.
+ * @param  arg Application data of the node, see NetsimNode.
+ * @retval The node, NULL if out of memory.
+ */
+NetsimNode *NETSIM_AddNode (const struct process *main, void *arg)
+{
+    NetsimNode *node;
+
+    if (NetsimCtrl.count == NetsimCtrl.size) {
+        uint32_t size = NetsimCtrl.size ? NetsimCtrl.size * 2 : 64;
+        NetsimNode **nodes = realloc (NetsimCtrl.nodes, size * sizeof (*nodes));
+        if (nodes == NULL) {
+            return NULL;
+        }
+        NetsimCtrl.nodes = nodes;
+        NetsimCtrl.size = size;
+    }
+
+    node = calloc (1, sizeof (*node));
+    if (node == NULL) {
+        return NULL;
+    }
+
+    node->id = NetsimCtrl.count;
+    node->main = *main;
+    node->arg = arg;
+    node->rng = (NetsimCtrl.seed ^ 0x9E3779B97F4A7C15ULL) + node->id * 0xBF58476D1CE4E5B9ULL;
+    if (node->rng == 0) {
+        node->rng = 1;
+    }
+
+    NetsimCtrl.nodes[NetsimCtrl.count++] = node;
+
+    return node;
+}
+
+
+/**
+ * @brief  Connect two nodes in both directions.
+ * @param  latency_us Delivery delay, must not be 0.
+ * @param  loss_ppm Probability of losing a packet, parts per million.
+ * @retval 0 on success, -1 on error.
+ */
+int NETSIM_Link (NetsimNode *a, NetsimNode *b, uint32_t latency_us, uint32_t loss_ppm)
+{
+    NetsimLink *ab, *ba;
+
+    if (latency_us == 0 || a == b) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ab = malloc (sizeof (*ab));
+    ba = malloc (sizeof (*ba));
+    if (ab == NULL || ba == NULL) {
+        free (ab);
+        free (ba);
+        return -1;
+    }
+
+    ab->dst = b;
+    ab->latency = (uint64_t)latency_us * 1000;
+    ab->loss_ppm = loss_ppm;
+    ab->next = a->links;
+    a->links = ab;
+
+    *ba = *ab;
+    ba->dst = a;
+    ba->next = b->links;
+    b->links = ba;
+
+    if (ab->latency < NetsimCtrl.lookahead) {
+        NetsimCtrl.lookahead = ab->latency;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief  Add nodes connected to their neighbours in a square grid, with
+ *         NETSIM_CONF_LATENCY_US and NETSIM_CONF_LOSS_PPM.
+ * @param  main Main process of the nodes.
+ * @param  nodes Number of nodes.
+ * @retval 0 on success, -1 on error.
+ */
+int NETSIM_Grid (const struct process *main, unsigned int nodes)
+{
+    unsigned int width = 1, first = NetsimCtrl.count, i;
+    NetsimNode *node;
+
+    while (width * width < nodes) {
+        width++;
+    }
+
+    for (i = 0; i < nodes; i++) {
+        node = NETSIM_AddNode (main, NULL);
+        if (node == NULL) {
+            return -1;
+        }
+        if (i % width != 0 &&
+            NETSIM_Link (NetsimCtrl.nodes[first + i - 1], node, NETSIM_CONF_LATENCY_US, NETSIM_CONF_LOSS_PPM) != 0) {
+            return -1;
+        }
+        if (i >= width &&
+            NETSIM_Link (NetsimCtrl.nodes[first + i - width], node, NETSIM_CONF_LATENCY_US, NETSIM_CONF_LOSS_PPM) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief  The node of the running process.
+ */
+NetsimNode *NETSIM_Self (void)
+{
+    return (NetsimNode *)process_ctx;
+}
+
+
+/**
+ * @brief  Deliver the received packets of the node to a process.
+ */
+void NETSIM_Listen (struct process *p)
+{
+    NETSIM_Self ()->listener = p;
+}
+
+
+/**
+ * @brief  Send a packet to a neighbour of the node.
+ * @param  dst Node id, or NETSIM_BROADCAST for all neighbours.
+ * @param  data Payload.
+ * @param  len Payload length, up to NETSIM_CONF_MTU.
+ * @retval 0 if sent, even if lost on the way, -1 on error.
+ */
+int NETSIM_Send (uint32_t dst, const void *data, size_t len)
+{
+    NetsimNode *self = NETSIM_Self ();
+    NetsimLink *link;
+    NetsimMsg *msg;
+    int found = 0;
+
+    if (len > NETSIM_CONF_MTU) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    for (link = self->links; link != NULL; link = link->next) {
+        if (dst != NETSIM_BROADCAST && link->dst->id != dst) {
+            continue;
+        }
+        found = 1;
+        self->sent++;
+
+        if (NETSIM_Random (&self->rng) % 1000000 < link->loss_ppm) {
+            self->lost++;
+            continue;
+        }
+
+        msg = malloc (sizeof (*msg));
+        if (msg == NULL) {
+            return -1;
+        }
+        msg->time = SIM_Now () + link->latency;
+        msg->seq = self->seq++;
+        msg->node = link->dst;
+        msg->pkt.src = self->id;
+        msg->pkt.dst = dst;
+        msg->pkt.len = len;
+        memcpy (msg->pkt.data, data, len);
+
+        if (NETSIM_Push (&NetsimCtrl.threads[link->dst->thread], msg) != 0) {
+            free (msg);
+            return -1;
+        }
+    }
+
+    if (!found) {
+        errno = EHOSTUNREACH;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief  Queue a node that got an event for running, see process_context.
+ */
+static void NETSIM_Notify (struct process_context *c)
+{
+    NetsimNode *node = (NetsimNode *)c;
+    NetsimThread *t = &NetsimCtrl.threads[node->thread];
+
+    if (node->queued) {
+        return;
+    }
+    node->queued = 1;
+    node->ready = NULL;
+    if (t->ready == NULL) {
+        t->ready = node;
+    } else {
+        t->ready_tail->ready = node;
+    }
+    t->ready_tail = node;
+}
+
+
+/**
+ * @brief  Run the nodes of a thread until none has anything to do.
+ */
+static void NETSIM_RunNodes (NetsimThread *t)
+{
+    NetsimNode *node;
+
+    while (t->ready != NULL) {
+        node = t->ready;
+        t->ready = node->ready;
+        node->queued = 0;
+        while (process_context_run (&node->ctx) > 0);
+    }
+}
+
+
+static void NETSIM_Deliver (NetsimMsg *msg)
+{
+    NetsimNode *node = msg->node;
+    struct process_context *old;
+
+    SIM_SetTime (msg->time);
+    node->received++;
+
+    if (node->listener != NULL) {
+        old = process_context_select (&node->ctx);
+        process_post_synch (node->listener, NETSIM_Event, &msg->pkt);
+        process_context_select (old);
+    }
+    free (msg);
+}
+
+
+static void *NETSIM_Thread (void *arg)
+{
+    NetsimThread *t = arg;
+    NetsimNode *node;
+    struct process_context *old;
+    uint64_t trigger, next;
+    unsigned int i;
+
+    SIM_Init (NetsimCtrl.seed + t->index, 0);
+
+    for (node = t->nodes; node != NULL; node = node->next) {
+        process_context_init (&node->ctx);
+        // Keep the events of the node clear of the simulator
+        node->ctx.lastevent = NETSIM_Event + 1;
+        node->ctx.notify = NETSIM_Notify;
+        old = process_context_select (&node->ctx);
+        SYSTIMER_InitContext (&node->timers);
+        process_start (&node->main, NULL);
+        process_context_select (old);
+    }
+
+    while (1) {
+        NETSIM_RunNodes (t);
+
+        // Agree on the next window
+        trigger = SIM_NextTrigger ();
+        next = NETSIM_NextMsg (t);
+        t->next = (trigger < next) ? trigger : next;
+
+        pthread_barrier_wait (&NetsimCtrl.barrier);
+        if (t->index == 0) {
+            next = NETSIM_NEVER;
+            for (i = 0; i < NetsimCtrl.nthreads; i++) {
+                if (NetsimCtrl.threads[i].next < next) {
+                    next = NetsimCtrl.threads[i].next;
+                }
+            }
+            if (next >= NetsimCtrl.end) {
+                NetsimCtrl.window = NETSIM_NEVER;
+            } else if (NetsimCtrl.end - next <= NetsimCtrl.lookahead) {
+                NetsimCtrl.window = NetsimCtrl.end;
+            } else {
+                NetsimCtrl.window = next + NetsimCtrl.lookahead;
+            }
+        }
+        pthread_barrier_wait (&NetsimCtrl.barrier);
+
+        if (NetsimCtrl.window == NETSIM_NEVER) {
+            break;
+        }
+
+        // Run everything before the end of the window
+        while (1) {
+            trigger = SIM_NextTrigger ();
+            next = NETSIM_NextMsg (t);
+            if (trigger >= NetsimCtrl.window && next >= NetsimCtrl.window) {
+                break;
+            }
+            if (next <= trigger) {
+                NETSIM_Deliver (NETSIM_Pop (t));
+            } else {
+                SIM_Advance ();
+            }
+            NETSIM_RunNodes (t);
+        }
+    }
+
+    if (t->index == 0) {
+        SIM_GetStats (&NetsimCtrl.stats);
+        NetsimCtrl.stats.sim_ns = NetsimCtrl.end;
+    }
+
+    return NULL;
+}
+
+
+/**
+ * @brief  Run the network.
+ * @param  duration_s Simulated time.
+ * @retval 0 on success, -1 on error.
+ */
+int NETSIM_Run (uint32_t duration_s)
+{
+    unsigned int i;
+
+    if (NetsimCtrl.count == 0) {
+        return 0;
+    }
+    if (NetsimCtrl.nthreads > NetsimCtrl.count) {
+        NetsimCtrl.nthreads = NetsimCtrl.count;
+    }
+
+    NetsimCtrl.end = (uint64_t)duration_s * 1000000000ULL;
+    if (NetsimCtrl.lookahead == NETSIM_NEVER) {
+        NetsimCtrl.lookahead = NetsimCtrl.end;
+    }
+
+    NetsimCtrl.threads = calloc (NetsimCtrl.nthreads, sizeof (NetsimThread));
+    if (NetsimCtrl.threads == NULL) {
+        return -1;
+    }
+
+    // Spread the nodes over the threads, keeping the order of the ids
+    for (i = NetsimCtrl.count; i > 0; i--) {
+        NetsimNode *node = NetsimCtrl.nodes[i - 1];
+        NetsimThread *t = &NetsimCtrl.threads[(i - 1) % NetsimCtrl.nthreads];
+        node->thread = t->index = (i - 1) % NetsimCtrl.nthreads;
+        node->next = t->nodes;
+        t->nodes = node;
+    }
+
+    pthread_barrier_init (&NetsimCtrl.barrier, NULL, NetsimCtrl.nthreads);
+    for (i = 0; i < NetsimCtrl.nthreads; i++) {
+        pthread_mutex_init (&NetsimCtrl.threads[i].lock, NULL);
+    }
+    for (i = 0; i < NetsimCtrl.nthreads; i++) {
+        if (pthread_create (&NetsimCtrl.threads[i].thread, NULL, NETSIM_Thread, &NetsimCtrl.threads[i]) != 0) {
+            // The barrier cannot be passed without all threads
+            abort ();
+        }
+    }
+    for (i = 0; i < NetsimCtrl.nthreads; i++) {
+        pthread_join (NetsimCtrl.threads[i].thread, NULL);
+    }
+    pthread_barrier_destroy (&NetsimCtrl.barrier);
+
+    return 0;
+}
+
+
+/**
+ * @brief  Totals of the run.
+ * @param  stats Totals.
+ * @retval None.
+ */
+void NETSIM_GetStats (NetsimStats *stats)
+{
+    uint32_t i;
+
+    memset (stats, 0, sizeof (*stats));
+    for (i = 0; i < NetsimCtrl.count; i++) {
+        stats->sent += NetsimCtrl.nodes[i]->sent;
+        stats->received += NetsimCtrl.nodes[i]->received;
+        stats->lost += NetsimCtrl.nodes[i]->lost;
+    }
+
+    stats->nodes = NetsimCtrl.count;
+    stats->threads = NetsimCtrl.nthreads;
+    stats->sim_ns = NetsimCtrl.stats.sim_ns;
+    stats->wall_ns = NetsimCtrl.stats.wall_ns;
+}
+
+
+/**
+ * @brief  Print the statistics of the run.
+ */
+void NETSIM_Report (void)
+{
+    NetsimStats stats;
+
+    NETSIM_GetStats (&stats);
+
+    printf ("%u nodes on %u threads, %llu packets sent, %llu received, %llu lost\n",
+            (unsigned)stats.nodes, stats.threads,
+            (unsigned long long)stats.sent, (unsigned long long)stats.received, (unsigned long long)stats.lost);
+    printf ("simulated %llu s in %llu.%03llu s, speedup %llu\n",
+            (unsigned long long)(stats.sim_ns / 1000000000ULL),
+            (unsigned long long)(stats.wall_ns / 1000000000ULL),
+            (unsigned long long)(stats.wall_ns / 1000000 % 1000),
+            (unsigned long long)(stats.sim_ns / (stats.wall_ns ? stats.wall_ns : 1)));
+}
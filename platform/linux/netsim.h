@@ -0,0 +1,120 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef NETSIM_H_
+#define NETSIM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <protothreads.h>
+#include <systimer.h>
+
+/**
+ * Network of simulated boards. Every node is a kernel instance with its
+ * own processes, event queue and timers, running a copy of the same main
+ * process in simulated time. Nodes exchange packets over links with a
+ * latency and a loss rate.
+ *
+ * The nodes are spread over worker threads. The threads advance in
+ * windows as long as the shortest link latency: a packet sent inside a
+ * window arrives after its end, so the threads only meet at the window
+ * boundaries. A run is reproducible for the same seed and thread count.
+ *
+ * The main process is shared by the nodes like a firmware image, so its
+ * static variables are too. Keep the per-node state in NETSIM_Self ().
+ *
+ * Requires the simulated time and PROCESS_CONF_THREAD_LOCAL, see the
+ * Makefile.
+ */
+
+/** Maximum packet payload */
+#ifndef NETSIM_CONF_MTU
+#define NETSIM_CONF_MTU         127
+#endif /* NETSIM_CONF_MTU */
+
+/** Link latency of the default grid, us */
+#ifndef NETSIM_CONF_LATENCY_US
+#define NETSIM_CONF_LATENCY_US  2000
+#endif /* NETSIM_CONF_LATENCY_US */
+
+/** Link loss of the default grid, parts per million */
+#ifndef NETSIM_CONF_LOSS_PPM
+#define NETSIM_CONF_LOSS_PPM    10000
+#endif /* NETSIM_CONF_LOSS_PPM */
+
+/** Destination of NETSIM_Send () for all neighbours */
+#define NETSIM_BROADCAST        0xFFFFFFFF
+
+typedef struct NetsimLink_S NetsimLink;
+typedef struct NetsimNode_S NetsimNode;
+
+/** Received packet, valid during the NETSIM_Event only */
+typedef struct {
+    uint32_t    src;
+    uint32_t    dst;
+    uint16_t    len;
+    uint8_t     data[NETSIM_CONF_MTU];
+} NetsimPacket;
+
+struct NetsimNode_S {
+    struct process_context  ctx;        // First, see NETSIM_Self ()
+    SystimerList            timers;
+    struct process          main;
+    struct process          *listener;
+    uint32_t                id;
+    uint64_t                rng;
+    uint32_t                seq;
+    unsigned int            thread;
+    NetsimLink              *links;
+    NetsimNode              *next;      // Next node of the thread
+    NetsimNode              *ready;     // Next node with work to do
+    int                     queued;
+    void                    *arg;       // Application data
+    // Statistics
+    uint32_t                sent;
+    uint32_t                received;
+    uint32_t                lost;
+};
+
+/** Totals of a run */
+typedef struct {
+    uint32_t        nodes;
+    unsigned int    threads;
+    uint64_t        sent;
+    uint64_t        received;
+    uint64_t        lost;
+    uint64_t        sim_ns;
+    uint64_t        wall_ns;
+} NetsimStats;
+
+/** Event of a received packet, data points to NetsimPacket */
+extern process_event_t NETSIM_Event;
+
+void NETSIM_Init (uint64_t seed, unsigned int threads);
+NetsimNode *NETSIM_AddNode (const struct process *main, void *arg);
+int NETSIM_Link (NetsimNode *a, NetsimNode *b, uint32_t latency_us, uint32_t loss_ppm);
+int NETSIM_Grid (const struct process *main, unsigned int nodes);
+int NETSIM_Run (uint32_t duration_s);
+void NETSIM_GetStats (NetsimStats *stats);
+void NETSIM_Report (void);
+
+NetsimNode *NETSIM_Self (void);
+void NETSIM_Listen (struct process *p);
+int NETSIM_Send (uint32_t dst, const void *data, size_t len);
+
+#endif /* NETSIM_H_ */
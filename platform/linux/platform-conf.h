@@ -0,0 +1,96 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef PLATFORM_CONF_H_
+#define PLATFORM_CONF_H_
+
+#include <protothreads.h>
+
+#include "netsim.h"
+#include "replay.h"
+#include "systime_posix.h"
+#include "systime_sim.h"
+#include "workload.h"
+
+/**
+ * Run in simulated time instead of the time of the host, see
+ * systime_sim.h. Usage: protothreads [seed [duration_s]]
+ */
+#ifndef PLATFORM_CONF_SIM
+#define PLATFORM_CONF_SIM               0
+#endif /* PLATFORM_CONF_SIM */
+
+/** Simulated time of a run, seconds */
+#ifndef PLATFORM_CONF_SIM_DURATION_S
+#define PLATFORM_CONF_SIM_DURATION_S    86400
+#endif /* PLATFORM_CONF_SIM_DURATION_S */
+
+/**
+ * Run a grid of simulated boards, each one running MAIN_Process, see
+ * netsim.h. Usage: protothreads [seed [duration_s [nodes [threads]]]]
+ */
+#ifndef PLATFORM_CONF_NETSIM
+#define PLATFORM_CONF_NETSIM            0
+#endif /* PLATFORM_CONF_NETSIM */
+
+/** Number of boards of the grid */
+#ifndef PLATFORM_CONF_NETSIM_NODES
+#define PLATFORM_CONF_NETSIM_NODES      100
+#endif /* PLATFORM_CONF_NETSIM_NODES */
+
+/**
+ * Replay a recording of process-record.h instead of running, see
+ * replay.h. Usage: protothreads recording [seed], by default the seed
+ * of the recording. Exits with 1 if the replay diverges.
+ */
+#ifndef PLATFORM_CONF_REPLAY
+#define PLATFORM_CONF_REPLAY            0
+#endif /* PLATFORM_CONF_REPLAY */
+
+/**
+ * Start the workload of workload.h next to MAIN_Process, in the
+ * simulated runs and the replays.
+ */
+#ifndef PLATFORM_CONF_WORKLOAD
+#define PLATFORM_CONF_WORKLOAD          0
+#endif /* PLATFORM_CONF_WORKLOAD */
+
+/** Where a simulated run with PROCESS_CONF_RECORD leaves the recording */
+#ifndef PLATFORM_CONF_RECORD_FILE
+#define PLATFORM_CONF_RECORD_FILE       "recording.bin"
+#endif /* PLATFORM_CONF_RECORD_FILE */
+
+/** Where a simulated run with PROCESS_CONF_TRACE leaves the trace */
+#ifndef PLATFORM_CONF_TRACE_FILE
+#define PLATFORM_CONF_TRACE_FILE        "trace.bin"
+#endif /* PLATFORM_CONF_TRACE_FILE */
+
+#if PLATFORM_CONF_REPLAY && !(PLATFORM_CONF_SIM && PROCESS_CONF_RECORD)
+#error "PLATFORM_CONF_REPLAY runs in simulated time, set PLATFORM_CONF_SIM and PROCESS_CONF_RECORD"
+#endif
+
+#if PLATFORM_CONF_WORKLOAD && (!PLATFORM_CONF_SIM || PLATFORM_CONF_NETSIM)
+#error "PLATFORM_CONF_WORKLOAD runs in simulated time on one board, set PLATFORM_CONF_SIM"
+#endif
+
+#if PLATFORM_CONF_NETSIM && !PLATFORM_CONF_SIM
+#error "PLATFORM_CONF_NETSIM runs in simulated time, set PLATFORM_CONF_SIM"
+#endif
+
+PROCESS_NAME (MAIN_Process);
+
+#endif /* PLATFORM_CONF_H_ */
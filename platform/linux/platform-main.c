@@ -0,0 +1,237 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "platform-conf.h"
+
+#include <em_int.h>
+
+#include <lpm.h>
+#include <process-record.h>
+#include <process-trace.h>
+#include <protothreads.h>
+#include <systime.h>
+#include <systimer.h>
+
+/** Interrupt lock of the host, see em_int.h */
+pthread_mutex_t INT_Lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+uint32_t INT_LockCnt;
+
+#if PLATFORM_CONF_SIM && !PLATFORM_CONF_NETSIM && !PLATFORM_CONF_REPLAY
+static void PLATFORM_SimReport (void)
+{
+    SimStats stats;
+
+    SIM_GetStats (&stats);
+    printf ("simulated %llu.%03llu s in %llu.%03llu s, %llu triggers, speedup %llu\n",
+            (unsigned long long)(stats.sim_ns / 1000000000ULL),
+            (unsigned long long)(stats.sim_ns / 1000000 % 1000),
+            (unsigned long long)(stats.wall_ns / 1000000000ULL),
+            (unsigned long long)(stats.wall_ns / 1000000 % 1000),
+            (unsigned long long)stats.triggers,
+            (unsigned long long)(stats.sim_ns / (stats.wall_ns ? stats.wall_ns : 1)));
+}
+#endif /* PLATFORM_CONF_SIM && !PLATFORM_CONF_NETSIM && !PLATFORM_CONF_REPLAY */
+
+#if PLATFORM_CONF_SIM && !PLATFORM_CONF_NETSIM && !PLATFORM_CONF_REPLAY && \
+    (PROCESS_CONF_RECORD || PROCESS_CONF_TRACE)
+static void PLATFORM_Write (const void *buf, size_t len, void *arg)
+{
+    fwrite (buf, len, 1, arg);
+}
+
+
+/**
+ * @brief  Save the recording or the trace at the end of a simulated run.
+ */
+static void PLATFORM_Save (const char *path,
+                           void (*dump) (void (*write) (const void *, size_t, void *), void *))
+{
+    FILE *file = fopen (path, "wb");
+
+    if (file != NULL) {
+        dump (PLATFORM_Write, file);
+        fclose (file);
+        printf ("written %s\n", path);
+    }
+}
+#endif
+
+#if PROCESS_CONF_TRACE && !PLATFORM_CONF_NETSIM && !PLATFORM_CONF_REPLAY
+/**
+ * @brief  Frequency of the trace time stamps, measured against the host
+ *         clock. clock_gettime () of the C library is replaced by the one
+ *         of systime.c.
+ */
+static uint32_t PLATFORM_TraceHz (void)
+{
+    struct timespec start, now;
+    uint32_t ticks;
+    uint64_t ns;
+
+    syscall (SYS_clock_gettime, CLOCK_MONOTONIC, &start);
+    ticks = PROCESS_TRACE_CONF_TIMESTAMP ();
+    do {
+        syscall (SYS_clock_gettime, CLOCK_MONOTONIC, &now);
+        ns = (uint64_t)(now.tv_sec - start.tv_sec) * 1000000000ULL + now.tv_nsec - start.tv_nsec;
+    } while (ns < 10000000);
+    ticks = PROCESS_TRACE_CONF_TIMESTAMP () - ticks;
+
+    return (uint32_t)((uint64_t)ticks * 1000000000ULL / ns);
+}
+#endif /* PROCESS_CONF_TRACE && !PLATFORM_CONF_NETSIM && !PLATFORM_CONF_REPLAY */
+
+#if PLATFORM_CONF_REPLAY
+int main (int argc, char *argv[])
+{
+    ReplayStats stats;
+
+    if (argc < 2) {
+        fprintf (stderr, "usage: %s recording [seed]\n", argv[0]);
+        return 1;
+    }
+
+    if (REPLAY_Load (argv[1]) != 0) {
+        perror (argv[1]);
+        return 1;
+    }
+
+    // The seed of the recording, unless another one is tried
+    SIM_Init ((argc > 2) ? strtoull (argv[2], NULL, 0) : REPLAY_Seed (), 0);
+    if (SYSTIME_Init (SysTimeSim) != 0) {
+        return 1;
+    }
+
+    process_init ();
+    process_start (&SYSTIMER_Process, NULL);
+    process_start (&MAIN_Process, NULL);
+#if PLATFORM_CONF_WORKLOAD
+    WORKLOAD_Init ();
+#endif
+
+    if (REPLAY_Run () != 0) {
+        return 1;
+    }
+
+    REPLAY_Report ();
+    REPLAY_GetStats (&stats);
+
+    return (stats.diverged >= 0) ? 1 : 0;
+}
+#elif PLATFORM_CONF_NETSIM
+int main (int argc, char *argv[])
+{
+    long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+
+    SIM_Init (0, 0);
+    if (SYSTIME_Init (SysTimeSim) != 0) {
+        return 1;
+    }
+
+    process_init ();
+
+    NETSIM_Init ((argc > 1) ? strtoull (argv[1], NULL, 0) : 1,
+                 (argc > 4) ? strtoul (argv[4], NULL, 0) : (cpus > 0 ? cpus : 1));
+    if (NETSIM_Grid (&MAIN_Process, (argc > 3) ? strtoul (argv[3], NULL, 0) : PLATFORM_CONF_NETSIM_NODES) != 0) {
+        return 1;
+    }
+    if (NETSIM_Run ((argc > 2) ? strtoul (argv[2], NULL, 0) : PLATFORM_CONF_SIM_DURATION_S) != 0) {
+        return 1;
+    }
+
+    NETSIM_Report ();
+
+    return 0;
+}
+#else
+int main (int argc, char *argv[])
+{
+    // Initialize the system time
+#if PLATFORM_CONF_SIM
+    uint64_t seed = (argc > 1) ? strtoull (argv[1], NULL, 0) : 1;
+
+    SIM_Init (seed, (argc > 2) ? strtoul (argv[2], NULL, 0) : PLATFORM_CONF_SIM_DURATION_S);
+    if (SYSTIME_Init (SysTimeSim) != 0) {
+        return 1;
+    }
+#if PROCESS_CONF_RECORD
+    // For the replayer
+    process_record_seed (seed);
+#endif
+
+#else
+    if (SYSTIME_Init (SysTimePosix) != 0) {
+        return 1;
+    }
+#endif
+
+    LPM_Init ();
+
+    // Initialize protothreads...
+    process_init ();
+
+#if PROCESS_CONF_TRACE
+    process_trace_init (PLATFORM_TraceHz ());
+#endif
+
+    // Activate the system timer
+    process_start (&SYSTIMER_Process, NULL);
+
+    process_start (&MAIN_Process, NULL);
+#if PLATFORM_CONF_WORKLOAD
+    WORKLOAD_Init ();
+#endif
+
+    while (1) {
+
+        // Run processes...
+        while (process_run () > 0);
+
+#if PLATFORM_CONF_SIM
+        if (SIM_Stopped ()) {
+            break;
+        }
+#endif
+
+        // Sleep until the next event...
+        LPM_WaitForEvent ();
+
+    }
+
+#if PLATFORM_CONF_SIM
+    PLATFORM_SimReport ();
+#if PLATFORM_CONF_WORKLOAD
+    WORKLOAD_Report ();
+#endif
+#if PROCESS_CONF_RECORD
+    PLATFORM_Save (PLATFORM_CONF_RECORD_FILE, process_record_dump);
+#endif
+#if PROCESS_CONF_TRACE
+    printf ("trace point cost %u ticks, budget %u\n", (unsigned)process_trace_cost, PROCESS_TRACE_CONF_BUDGET);
+    PLATFORM_Save (PLATFORM_CONF_TRACE_FILE, process_trace_dump);
+#endif
+#endif
+
+    return 0;
+}
+#endif /* PLATFORM_CONF_REPLAY */
@@ -0,0 +1,356 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <protothreads.h>
+#include <process-record.h>
+
+#include "replay.h"
+#include "systime.h"
+#include "systime_sim.h"
+
+#if PROCESS_CONF_RECORD
+
+typedef struct {
+    struct process_record   *records;
+    uint64_t                *time;
+    uint32_t                count;
+    uint32_t                lost;
+    uint64_t                seed;
+    uint32_t                expected;
+    int                     verify;
+    uint8_t                 payload[UINT16_MAX];
+    ReplayStats             stats;
+} ReplayControl;
+
+static ReplayControl ReplayCtrl;
+
+
+/**
+ * @brief  Compare a record of the replay with the recording.
+ */
+static void REPLAY_Check (const struct process_record *r)
+{
+    const struct process_record *e;
+    uint64_t now, skew;
+
+    if (!ReplayCtrl.verify) {
+        return;
+    }
+
+    while (ReplayCtrl.expected < ReplayCtrl.count &&
+           ReplayCtrl.records[ReplayCtrl.expected].type == PROCESS_RECORD_PAYLOAD) {
+        ReplayCtrl.expected++;
+    }
+    if (ReplayCtrl.expected == ReplayCtrl.count) {
+        // The replay runs on past the end of the recording
+        return;
+    }
+
+    e = &ReplayCtrl.records[ReplayCtrl.expected];
+    if (r->type != e->type || r->ev != e->ev || r->receiver != e->receiver ||
+        r->u.ev.sender != e->u.ev.sender || r->u.ev.len != e->u.ev.len ||
+        (e->u.ev.len > 0 && r->u.ev.data != e->u.ev.data)) {
+        ReplayCtrl.stats.diverged = ReplayCtrl.expected;
+        ReplayCtrl.verify = 0;
+        return;
+    }
+
+    // At the resolution of the records
+    now = SIM_Now () / 1000 * 1000;
+    skew = (now > ReplayCtrl.time[ReplayCtrl.expected]) ?
+           now - ReplayCtrl.time[ReplayCtrl.expected] :
+           ReplayCtrl.time[ReplayCtrl.expected] - now;
+    if (skew > ReplayCtrl.stats.max_skew_ns) {
+        ReplayCtrl.stats.max_skew_ns = skew;
+    }
+
+    ReplayCtrl.stats.checked++;
+    ReplayCtrl.expected++;
+}
+
+
+/**
+ * @brief  Load a recording written by process_record_dump (), before the
+ *         kernel is started.
+ * @param  path File of the recording.
+ * @retval 0 on success, -1 on error with errno set.
+ */
+int REPLAY_Load (const char *path)
+{
+    struct process_record_header hdr;
+    uint64_t time;
+    uint32_t i;
+    FILE *file;
+
+    file = fopen (path, "rb");
+    if (file == NULL) {
+        return -1;
+    }
+
+    if (fread (&hdr, sizeof (hdr), 1, file) != 1 ||
+        hdr.magic != PROCESS_RECORD_MAGIC ||
+        hdr.version != PROCESS_RECORD_VERSION ||
+        hdr.size != sizeof (struct process_record)) {
+        fclose (file);
+        errno = EINVAL;
+        return -1;
+    }
+
+    free (ReplayCtrl.records);
+    free (ReplayCtrl.time);
+    memset (&ReplayCtrl, 0, sizeof (ReplayCtrl));
+
+    ReplayCtrl.records = malloc ((hdr.count + 1) * sizeof (struct process_record));
+    ReplayCtrl.time = malloc ((hdr.count + 1) * sizeof (uint64_t));
+    if (ReplayCtrl.records == NULL || ReplayCtrl.time == NULL) {
+        fclose (file);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    if (fread (ReplayCtrl.records, sizeof (struct process_record), hdr.count, file) != hdr.count) {
+        fclose (file);
+        errno = EINVAL;
+        return -1;
+    }
+    fclose (file);
+
+    // The recorded microseconds wrap around every 71 minutes
+    time = hdr.count ? ReplayCtrl.records[0].time : 0;
+    for (i = 0; i < hdr.count; i++) {
+        if (i > 0) {
+            time += (uint32_t)(ReplayCtrl.records[i].time - ReplayCtrl.records[i - 1].time);
+        }
+        ReplayCtrl.time[i] = time * 1000;
+    }
+
+    ReplayCtrl.count = hdr.count;
+    ReplayCtrl.lost = hdr.lost;
+    ReplayCtrl.seed = hdr.seed;
+    ReplayCtrl.verify = (hdr.lost == 0);
+    ReplayCtrl.stats.records = hdr.count;
+    ReplayCtrl.stats.diverged = -1;
+
+    // Compare from the first process started
+    process_record_sink = REPLAY_Check;
+
+    return 0;
+}
+
+
+/**
+ * @brief  Seed of the recorded run, for SIM_Init ().
+ * @retval The seed of the loaded recording.
+ */
+uint64_t REPLAY_Seed (void)
+{
+    return ReplayCtrl.seed;
+}
+
+
+/**
+ * @brief  Process of a recorded id.
+ * @retval The process, NULL if no running process has the id.
+ */
+static struct process *REPLAY_Process (uint16_t id)
+{
+    struct process *p;
+
+    if (id == PROCESS_RECORD_BROADCAST) {
+        return PROCESS_BROADCAST;
+    }
+
+    for (p = PROCESS_LIST (); p != NULL; p = p->next) {
+        if (process_record_id (p) == id) {
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ * @brief  Run the processes and deliver the triggers up to a time.
+ * @param  ns Simulated time to stop at.
+ * @retval None.
+ */
+static void REPLAY_RunUntil (uint64_t ns)
+{
+    while (1) {
+        while (process_run () > 0);
+
+        if (SIM_NextTrigger () > ns) {
+            break;
+        }
+
+        SYSTIME_Sleep ();
+        SIM_Advance ();
+        SYSTIME_Wake ();
+    }
+
+    SIM_SetTime (ns);
+}
+
+
+/**
+ * @brief  Post an event of the recording again.
+ * @param  i Index of the record.
+ * @retval 0 on success, -1 if it can not be posted.
+ */
+static int REPLAY_Inject (uint32_t i)
+{
+    const struct process_record *r = &ReplayCtrl.records[i];
+    struct process *p;
+    process_data_t data;
+    uint32_t len = 0;
+
+    p = REPLAY_Process (r->receiver);
+    if (p == NULL) {
+        return -1;
+    }
+
+    if (r->type == PROCESS_RECORD_POLL) {
+        process_poll (p);
+        return 0;
+    }
+
+    if (r->u.ev.len > 0) {
+        // The bytes follow in the payload records
+        while (++i < ReplayCtrl.count && len < r->u.ev.len &&
+               ReplayCtrl.records[i].type == PROCESS_RECORD_PAYLOAD) {
+            memcpy (&ReplayCtrl.payload[len], ReplayCtrl.records[i].u.bytes, ReplayCtrl.records[i].ev);
+            len += ReplayCtrl.records[i].ev;
+        }
+        if (len != r->u.ev.len) {
+            return -1;
+        }
+        data = ReplayCtrl.payload;
+    } else {
+        data = (process_data_t)(uintptr_t)r->u.ev.data;
+    }
+
+    return (process_post (p, r->ev, data) == PROCESS_ERR_OK) ? 0 : -1;
+}
+
+
+/**
+ * @brief  Replay the loaded recording. The kernel, the system timer and
+ *         the main process must have been started since REPLAY_Load (),
+ *         in simulated time.
+ * @retval 0 on success, -1 if an event could not be fed in.
+ */
+int REPLAY_Run (void)
+{
+    const struct process_record *r;
+    uint64_t start = 0;
+    SimStats stats;
+    uint32_t i;
+    int res = 0;
+
+    SIM_GetStats (&stats);
+    start = stats.wall_ns;
+
+    for (i = 0; i < ReplayCtrl.count; i++) {
+        r = &ReplayCtrl.records[i];
+
+        if ((r->type != PROCESS_RECORD_POST && r->type != PROCESS_RECORD_POLL) ||
+            r->u.ev.sender != PROCESS_RECORD_NONE) {
+            continue;
+        }
+
+        REPLAY_RunUntil (ReplayCtrl.time[i]);
+
+        // Already made again, e.g. the polls of the timer interrupts
+        if (ReplayCtrl.verify && ReplayCtrl.expected > i) {
+            continue;
+        }
+
+        if (REPLAY_Inject (i) != 0) {
+            fprintf (stderr, "replay: record %u can not be posted\n", (unsigned)i);
+            res = -1;
+            break;
+        }
+        ReplayCtrl.stats.injected++;
+    }
+
+    if (res == 0 && ReplayCtrl.count > 0) {
+        REPLAY_RunUntil (ReplayCtrl.time[ReplayCtrl.count - 1]);
+    }
+
+    process_record_sink = NULL;
+
+    // Records missing from the end of the replay
+    while (ReplayCtrl.expected < ReplayCtrl.count &&
+           ReplayCtrl.records[ReplayCtrl.expected].type == PROCESS_RECORD_PAYLOAD) {
+        ReplayCtrl.expected++;
+    }
+    if (ReplayCtrl.verify && ReplayCtrl.expected < ReplayCtrl.count) {
+        ReplayCtrl.stats.diverged = ReplayCtrl.expected;
+    }
+
+    SIM_GetStats (&stats);
+    ReplayCtrl.stats.wall_ns = stats.wall_ns - start;
+
+    return res;
+}
+
+
+/**
+ * @brief  Statistics of the last replay.
+ * @param  stats Statistics.
+ * @retval None.
+ */
+void REPLAY_GetStats (ReplayStats *stats)
+{
+    *stats = ReplayCtrl.stats;
+}
+
+
+/**
+ * @brief  Print the statistics of the last replay.
+ */
+void REPLAY_Report (void)
+{
+    ReplayStats *stats = &ReplayCtrl.stats;
+    const struct process_record *r;
+    uint64_t wall = stats->wall_ns ? stats->wall_ns : 1;
+
+    printf ("replayed %u records, %u fed in, in %llu.%03llu s, %llu records/s\n",
+            (unsigned)stats->records, (unsigned)stats->injected,
+            (unsigned long long)(stats->wall_ns / 1000000000ULL),
+            (unsigned long long)(stats->wall_ns / 1000000 % 1000),
+            (unsigned long long)(stats->records * 1000000000ULL / wall));
+
+    if (ReplayCtrl.lost > 0) {
+        printf ("%u records lost before the recording, not compared\n", (unsigned)ReplayCtrl.lost);
+    } else if (stats->diverged >= 0) {
+        r = &ReplayCtrl.records[stats->diverged];
+        printf ("diverged at record %d: type %u event %u receiver %04x sender %04x\n",
+                (int)stats->diverged, r->type, r->ev, r->receiver, r->u.ev.sender);
+    } else {
+        printf ("%u records match, largest time difference %llu us\n",
+                (unsigned)stats->checked, (unsigned long long)(stats->max_skew_ns / 1000));
+    }
+}
+
+#endif /* PROCESS_CONF_RECORD */
@@ -0,0 +1,63 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include <stdint.h>
+
+#include <protothreads.h>
+
+/**
+ * Replay of a recording of process-record.h in simulated time. The
+ * events posted and the polls requested from outside the processes, by
+ * the interrupts, are posted again at their recorded time, unless the
+ * simulated timers have already done so. Everything else the processes
+ * and the timers do again by themselves; the records
+ * of that are compared with the recording and the first difference is
+ * reported. Data given by value, mostly pointers, is not compared, the
+ * payloads of process_record_payload () are.
+ *
+ * A recording made from the boot replays as a whole. If the ring
+ * overflowed, the beginning is missing and the events are only fed in.
+ *
+ * The header carries the seed of the recorded run, see REPLAY_Seed ().
+ * Replayed with it, the timers expire at the same nanosecond as in the
+ * recording, and the events fed in at their recorded microsecond. Times
+ * are compared at the microsecond of the records, so a faithful replay
+ * has no time difference. An event that was posted within a microsecond
+ * could come before a timer that followed it; that is a divergence.
+ *
+ * Requires the simulated time and PROCESS_CONF_RECORD, see the Makefile.
+ */
+
+typedef struct {
+    uint32_t    records;        // Records of the recording
+    uint32_t    injected;       // Posts and polls fed in
+    uint32_t    checked;        // Records compared
+    int32_t     diverged;       // Index of the first difference, -1 if none
+    uint64_t    max_skew_ns;    // Largest difference in time, in whole us
+    uint64_t    wall_ns;        // Host time spent
+} ReplayStats;
+
+int REPLAY_Load (const char *path);
+uint64_t REPLAY_Seed (void);
+int REPLAY_Run (void);
+void REPLAY_GetStats (ReplayStats *stats);
+void REPLAY_Report (void);
+
+#endif /* REPLAY_H_ */
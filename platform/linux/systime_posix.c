@@ -0,0 +1,205 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+
+#include "em_int.h"
+
+#include "systime_posix.h"
+
+#define POSIX_CHANNELS      2
+#define POSIX_FREQ          1000000000UL
+
+typedef struct {
+    int                 fd[POSIX_CHANNELS];
+    void                (*callback[POSIX_CHANNELS]) (void);
+    struct timespec     base;
+    int                 epfd;
+    pthread_t           thread;
+} PosixControl;
+
+static PosixControl PosixCtrl;
+
+
+/**
+ * @brief  Read the kernel clock. clock_gettime () of the C library is
+ *         replaced by the one of systime.c, so go to the kernel directly.
+ */
+static void POSIX_Monotonic (struct timespec *tp)
+{
+    syscall (SYS_clock_gettime, CLOCK_MONOTONIC, tp);
+}
+
+
+/**
+ * @brief  Deliver the expired triggers, the interrupt handler of the host.
+ */
+static void *POSIX_Thread (void *arg)
+{
+    struct epoll_event ev;
+    struct itimerspec its;
+    uint64_t expirations;
+    unsigned int channel;
+    void (*callback) (void);
+
+    while (1) {
+        if (epoll_wait (PosixCtrl.epfd, &ev, 1, -1) <= 0) {
+            continue;
+        }
+        channel = ev.data.u32;
+        if (read (PosixCtrl.fd[channel], &expirations, sizeof (expirations)) < 0) {
+            continue;
+        }
+
+        INT_Disable ();
+        // Skip if the channel was re-armed or cancelled in the meantime
+        timerfd_gettime (PosixCtrl.fd[channel], &its);
+        callback = PosixCtrl.callback[channel];
+        if (callback != NULL && its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {
+            PosixCtrl.callback[channel] = NULL;
+            callback ();
+        }
+        INT_Enable ();
+    }
+
+    return NULL;
+}
+
+
+static int POSIX_Init (void)
+{
+    struct epoll_event ev;
+    unsigned int i;
+
+    POSIX_Monotonic (&PosixCtrl.base);
+
+    PosixCtrl.epfd = epoll_create1 (EPOLL_CLOEXEC);
+    if (PosixCtrl.epfd < 0) {
+        return -1;
+    }
+
+    for (i = 0; i < POSIX_CHANNELS; i++) {
+        PosixCtrl.callback[i] = NULL;
+        PosixCtrl.fd[i] = timerfd_create (CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (PosixCtrl.fd[i] < 0) {
+            return -1;
+        }
+        ev.events = EPOLLIN;
+        ev.data.u32 = i;
+        if (epoll_ctl (PosixCtrl.epfd, EPOLL_CTL_ADD, PosixCtrl.fd[i], &ev) < 0) {
+            return -1;
+        }
+    }
+
+    if (pthread_create (&PosixCtrl.thread, NULL, POSIX_Thread, NULL) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static uint32_t POSIX_GetFrequency (void)
+{
+    return POSIX_FREQ;
+}
+
+
+static void POSIX_GetSystemNanoTime (SysTime *tm)
+{
+    struct timespec now;
+
+    POSIX_Monotonic (&now);
+    SYSTIME_SUB (&now, &now, &PosixCtrl.base);
+    SYSTIME_SET (tm, &now);
+}
+
+
+static uint32_t POSIX_GetSystemTime (void)
+{
+    SysTime tm;
+
+    POSIX_GetSystemNanoTime (&tm);
+
+    return tm.tv_sec;
+}
+
+
+static unsigned int POSIX_GetChannels (void)
+{
+    return POSIX_CHANNELS;
+}
+
+
+/**
+ * @brief  Arm a channel.
+ * @param  channel Trigger channel.
+ * @param  trigger_time Time from now until the trigger.
+ * @param  callback Callback invoked when @p trigger_time elapsed.
+ */
+static void POSIX_TriggerChannel (unsigned int channel, SysTime *trigger_time, void (*callback) (void))
+{
+    struct itimerspec its;
+
+    memset (&its, 0, sizeof (its));
+    POSIX_Monotonic (&its.it_value);
+    SYSTIME_ADD (&its.it_value, &its.it_value, trigger_time);
+
+    INT_Disable ();
+    PosixCtrl.callback[channel] = callback;
+    timerfd_settime (PosixCtrl.fd[channel], TFD_TIMER_ABSTIME, &its, NULL);
+    INT_Enable ();
+}
+
+
+static void POSIX_Trigger (SysTime *trigger_time, void (*callback) (void))
+{
+    POSIX_TriggerChannel (SYSTIME_CHANNEL_SCHEDULER, trigger_time, callback);
+}
+
+
+static void POSIX_Cancel (unsigned int channel)
+{
+    struct itimerspec its;
+
+    memset (&its, 0, sizeof (its));
+
+    INT_Disable ();
+    PosixCtrl.callback[channel] = NULL;
+    timerfd_settime (PosixCtrl.fd[channel], 0, &its, NULL);
+    INT_Enable ();
+}
+
+
+SysTimeBackend _SysTimePosix = {
+    .init               = POSIX_Init,
+    .getFrequency       = POSIX_GetFrequency,
+    .getSystemTime      = POSIX_GetSystemTime,
+    .getSystemNanoTime  = POSIX_GetSystemNanoTime,
+    .trigger            = POSIX_Trigger,
+    .getChannels        = POSIX_GetChannels,
+    .triggerChannel     = POSIX_TriggerChannel,
+    .cancel             = POSIX_Cancel
+};
+
+SysTimeBackend *SysTimePosix = &_SysTimePosix;
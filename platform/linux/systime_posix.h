@@ -0,0 +1,31 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef SYSTIME_POSIX_H_
+#define SYSTIME_POSIX_H_
+
+#include "systime.h"
+
+/**
+ * System time of the host, CLOCK_MONOTONIC of the kernel with a timerfd
+ * per trigger channel. Expired triggers are delivered from a separate
+ * thread, under the interrupt lock of em_int.h, like interrupts on the
+ * target.
+ */
+extern SysTimeBackend *SysTimePosix;
+
+#endif /* SYSTIME_POSIX_H_ */
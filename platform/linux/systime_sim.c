@@ -0,0 +1,255 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "systime_sim.h"
+
+#define SIM_CHANNELS        2
+#define SIM_FREQ            1000000000UL
+
+typedef struct {
+    uint64_t            now;
+    uint64_t            end;
+    uint64_t            deadline[SIM_CHANNELS];
+    void                (*callback[SIM_CHANNELS]) (void);
+    uint64_t            rng;
+    uint64_t            triggers;
+    uint64_t            start;
+    int                 stopped;
+} SimControl;
+
+static PROCESS_CONF_THREAD_LOCAL SimControl SimCtrl;
+
+
+/**
+ * @brief  Host time, for the statistics only. clock_gettime () of the C
+ *         library is replaced by the one of systime.c.
+ */
+static uint64_t SIM_Wall (void)
+{
+    struct timespec tp;
+
+    syscall (SYS_clock_gettime, CLOCK_MONOTONIC, &tp);
+
+    return (uint64_t)tp.tv_sec * 1000000000ULL + tp.tv_nsec;
+}
+
+
+/**
+ * @brief  Set up the simulation, before SYSTIME_Init ().
+ * @param  seed Seed of all randomness of the run.
+ * @param  duration_s Simulated time after which the simulation stops,
+ *         0 to run until there are no triggers left.
+ * @retval None.
+ */
+void SIM_Init (uint64_t seed, uint32_t duration_s)
+{
+    memset (&SimCtrl, 0, sizeof (SimCtrl));
+
+    // xorshift gets stuck on zero
+    SimCtrl.rng = seed ^ 0x9E3779B97F4A7C15ULL;
+    SimCtrl.end = duration_s ? (uint64_t)duration_s * 1000000000ULL : UINT64_MAX;
+    SimCtrl.start = SIM_Wall ();
+}
+
+
+/**
+ * @brief  Pseudo random number from the seed of the run.
+ * @retval Random number.
+ */
+uint32_t SIM_Random (void)
+{
+    SimCtrl.rng ^= SimCtrl.rng >> 12;
+    SimCtrl.rng ^= SimCtrl.rng << 25;
+    SimCtrl.rng ^= SimCtrl.rng >> 27;
+
+    return (uint32_t)((SimCtrl.rng * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+
+/**
+ * @brief  Advance the clock to the earliest pending trigger and deliver it.
+ *         Called by LPM_WaitForEvent () instead of sleeping.
+ * @retval 0 if a trigger was delivered, -1 if the simulation has stopped.
+ */
+int SIM_Advance (void)
+{
+    unsigned int i, next = SIM_CHANNELS;
+    void (*callback) (void);
+
+    for (i = 0; i < SIM_CHANNELS; i++) {
+        if (SimCtrl.callback[i] != NULL &&
+            (next == SIM_CHANNELS || SimCtrl.deadline[i] < SimCtrl.deadline[next])) {
+            next = i;
+        }
+    }
+
+    if (next == SIM_CHANNELS || SimCtrl.deadline[next] > SimCtrl.end) {
+        SimCtrl.stopped = 1;
+        return -1;
+    }
+
+    if (SimCtrl.deadline[next] > SimCtrl.now) {
+        SimCtrl.now = SimCtrl.deadline[next];
+    }
+    callback = SimCtrl.callback[next];
+    SimCtrl.callback[next] = NULL;
+    SimCtrl.triggers++;
+    callback ();
+
+    return 0;
+}
+
+
+/**
+ * @brief  Current simulated time.
+ * @retval Nanoseconds since SIM_Init ().
+ */
+uint64_t SIM_Now (void)
+{
+    return SimCtrl.now;
+}
+
+
+/**
+ * @brief  Time of the earliest pending trigger.
+ * @retval Nanoseconds since SIM_Init (), UINT64_MAX if nothing is pending.
+ */
+uint64_t SIM_NextTrigger (void)
+{
+    uint64_t next = UINT64_MAX;
+    unsigned int i;
+
+    for (i = 0; i < SIM_CHANNELS; i++) {
+        if (SimCtrl.callback[i] != NULL && SimCtrl.deadline[i] < next) {
+            next = SimCtrl.deadline[i];
+        }
+    }
+
+    return next;
+}
+
+
+/**
+ * @brief  Advance the clock without delivering triggers, e.g. to the
+ *         arrival of an external event. The clock never goes back.
+ * @param  ns Nanoseconds since SIM_Init ().
+ * @retval None.
+ */
+void SIM_SetTime (uint64_t ns)
+{
+    if (ns > SimCtrl.now) {
+        SimCtrl.now = ns;
+    }
+}
+
+
+/**
+ * @brief  Check if the simulated time is over or nothing is left to run.
+ * @retval Non-zero if the simulation has stopped.
+ */
+int SIM_Stopped (void)
+{
+    return SimCtrl.stopped;
+}
+
+
+/**
+ * @brief  Statistics of the run so far.
+ * @param  stats Statistics.
+ * @retval None.
+ */
+void SIM_GetStats (SimStats *stats)
+{
+    stats->triggers = SimCtrl.triggers;
+    stats->sim_ns = SimCtrl.now;
+    stats->wall_ns = SIM_Wall () - SimCtrl.start;
+}
+
+
+static int SIMDRV_Init (void)
+{
+    return 0;
+}
+
+
+static uint32_t SIMDRV_GetFrequency (void)
+{
+    return SIM_FREQ;
+}
+
+
+static uint32_t SIMDRV_GetSystemTime (void)
+{
+    return (uint32_t)(SimCtrl.now / 1000000000ULL);
+}
+
+
+static void SIMDRV_GetSystemNanoTime (SysTime *tm)
+{
+    tm->tv_sec = (uint32_t)(SimCtrl.now / 1000000000ULL);
+    tm->tv_nsec = (uint32_t)(SimCtrl.now % 1000000000ULL);
+}
+
+
+static unsigned int SIMDRV_GetChannels (void)
+{
+    return SIM_CHANNELS;
+}
+
+
+static void SIMDRV_TriggerChannel (unsigned int channel, SysTime *trigger_time, void (*callback) (void))
+{
+    uint64_t ns = (uint64_t)trigger_time->tv_sec * 1000000000ULL + trigger_time->tv_nsec;
+
+#if SIM_CONF_JITTER_NS
+    ns += SIM_Random () % SIM_CONF_JITTER_NS;
+#endif
+
+    SimCtrl.deadline[channel] = SimCtrl.now + ns;
+    SimCtrl.callback[channel] = callback;
+}
+
+
+static void SIMDRV_Trigger (SysTime *trigger_time, void (*callback) (void))
+{
+    SIMDRV_TriggerChannel (SYSTIME_CHANNEL_SCHEDULER, trigger_time, callback);
+}
+
+
+static void SIMDRV_Cancel (unsigned int channel)
+{
+    SimCtrl.callback[channel] = NULL;
+}
+
+
+SysTimeBackend _SysTimeSim = {
+    .init               = SIMDRV_Init,
+    .getFrequency       = SIMDRV_GetFrequency,
+    .getSystemTime      = SIMDRV_GetSystemTime,
+    .getSystemNanoTime  = SIMDRV_GetSystemNanoTime,
+    .trigger            = SIMDRV_Trigger,
+    .getChannels        = SIMDRV_GetChannels,
+    .triggerChannel     = SIMDRV_TriggerChannel,
+    .cancel             = SIMDRV_Cancel
+};
+
+SysTimeBackend *SysTimeSim = &_SysTimeSim;
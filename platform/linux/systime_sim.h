@@ -0,0 +1,56 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef SYSTIME_SIM_H_
+#define SYSTIME_SIM_H_
+
+#include <stdint.h>
+
+#include <protothreads.h>
+
+#include "systime.h"
+
+/** Latency added to every trigger, uniformly random up to this */
+#ifndef SIM_CONF_JITTER_NS
+#define SIM_CONF_JITTER_NS      30000
+#endif /* SIM_CONF_JITTER_NS */
+
+/**
+ * Simulated system time. The clock stands still while the processes run
+ * and jumps to the next trigger when the system goes idle, see
+ * SIM_Advance (). Triggers are delivered synchronously, so a run depends
+ * only on the seed given to SIM_Init (). With PROCESS_CONF_THREAD_LOCAL
+ * every thread runs its own simulated clock, see netsim.h.
+ */
+extern SysTimeBackend *SysTimeSim;
+
+typedef struct {
+    uint64_t    triggers;       // Delivered triggers
+    uint64_t    sim_ns;         // Simulated time
+    uint64_t    wall_ns;        // Host time spent
+} SimStats;
+
+void SIM_Init (uint64_t seed, uint32_t duration_s);
+int SIM_Advance (void);
+uint64_t SIM_Now (void);
+uint64_t SIM_NextTrigger (void);
+void SIM_SetTime (uint64_t ns);
+int SIM_Stopped (void);
+uint32_t SIM_Random (void);
+void SIM_GetStats (SimStats *stats);
+
+#endif /* SYSTIME_SIM_H_ */
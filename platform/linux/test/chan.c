@@ -0,0 +1,141 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * Throughput of process-chan.h by slot size: a producer fills every slot
+ * it reserves, a consumer reads every slot it peeks, through a channel
+ * of BENCH_DEPTH slots. Host figures, the kernel overhead per message
+ * against the cost of touching the data.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <protothreads.h>
+#include <process-chan.h>
+
+#define BENCH_DEPTH         8
+#define BENCH_BYTES         (64UL << 20)
+#define BENCH_MESSAGES_MIN  100000UL
+
+typedef struct { uint8_t data[4]; } BenchSlot4;
+typedef struct { uint8_t data[16]; } BenchSlot16;
+typedef struct { uint8_t data[64]; } BenchSlot64;
+typedef struct { uint8_t data[256]; } BenchSlot256;
+typedef struct { uint8_t data[1024]; } BenchSlot1024;
+
+PROCESS_CHAN (BenchChan4, BenchSlot4, BENCH_DEPTH);
+PROCESS_CHAN (BenchChan16, BenchSlot16, BENCH_DEPTH);
+PROCESS_CHAN (BenchChan64, BenchSlot64, BENCH_DEPTH);
+PROCESS_CHAN (BenchChan256, BenchSlot256, BENCH_DEPTH);
+PROCESS_CHAN (BenchChan1024, BenchSlot1024, BENCH_DEPTH);
+
+static struct process_chan *const BenchChans[] = {
+    &BenchChan4, &BenchChan16, &BenchChan64, &BenchChan256, &BenchChan1024
+};
+
+static struct process_chan *Chan;
+static uint32_t Messages;
+static uint32_t Received;
+static uint32_t Sum;
+
+PROCESS (BENCH_Producer, "Producer");
+PROCESS (BENCH_Consumer, "Consumer");
+
+
+static uint64_t BENCH_Ns (void)
+{
+    struct timespec t;
+
+    // The host clock_gettime () is replaced by systime.c
+    syscall (SYS_clock_gettime, CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+
+PROCESS_THREAD (BENCH_Producer, ev, data)
+{
+    static uint8_t *slot;
+    static uint32_t i;
+
+    PROCESS_BEGIN ();
+
+    for (i = 0; i < Messages; i++) {
+        PROCESS_CHAN_RESERVE (Chan, slot);
+        memset (slot, (uint8_t)i, Chan->size);
+        process_chan_commit (Chan);
+    }
+
+    PROCESS_END ();
+}
+
+
+PROCESS_THREAD (BENCH_Consumer, ev, data)
+{
+    static uint8_t *slot;
+    uint16_t j;
+
+    PROCESS_BEGIN ();
+
+    while (Received < Messages) {
+        PROCESS_CHAN_PEEK (Chan, slot);
+        for (j = 0; j < Chan->size; j++) {
+            Sum += slot[j];
+        }
+        process_chan_release (Chan);
+        Received++;
+    }
+
+    PROCESS_END ();
+}
+
+
+int main (void)
+{
+    uint64_t start, ns;
+    unsigned int i;
+
+    printf ("chan: %d slots\n", BENCH_DEPTH);
+    printf ("%6s %10s %10s %10s\n", "bytes", "messages", "ns/msg", "MB/s");
+
+    for (i = 0; i < sizeof (BenchChans) / sizeof (BenchChans[0]); i++) {
+        Chan = BenchChans[i];
+        Messages = BENCH_BYTES / Chan->size;
+        Messages = Messages < BENCH_MESSAGES_MIN ? BENCH_MESSAGES_MIN : Messages;
+        Received = 0;
+
+        process_init ();
+        start = BENCH_Ns ();
+        process_start (&BENCH_Consumer, NULL);
+        process_start (&BENCH_Producer, NULL);
+        while (process_run () > 0);
+        ns = BENCH_Ns () - start;
+
+        if (Received != Messages || process_chan_used (Chan) != 0) {
+            fprintf (stderr, "chan: %u of %u messages received\n", Received, Messages);
+            return 1;
+        }
+
+        printf ("%6u %10u %10.1f %10.1f\n", Chan->size, Messages, (double)ns / Messages,
+                (double)Messages * Chan->size * 1000 / ns);
+    }
+
+    return 0;
+}
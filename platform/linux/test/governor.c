@@ -0,0 +1,264 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * Energy and latency of the HFRCO governor against fixed HFRCO bands. The
+ * efm32 main loop runs on the register model with the RTC system time and
+ * the low power modes. Jobs arrive as interrupts, are posted to a worker
+ * process one event each and burn their cycles there. Every configuration
+ * runs in a child process, so that each one starts from a clean kernel.
+ *
+ * None of the loads lets the governor beat the 28 MHz band: the EM0 current
+ * has a part that does not scale with the clock, so racing to EM2 is cheapest.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <em_device.h>
+#include <em_cmu.h>
+
+#include <lpm.h>
+#include <protothreads.h>
+#include <systime.h>
+
+#include "hfrco_governor.h"
+#include "systime_rtc.h"
+
+#include "model/model.h"
+
+#define BENCH_JOBS          4096
+#define BENCH_RUN_NS        (20ULL * 1000000000ULL)
+
+/** Covers the LFXO startup before the measurement */
+#define BENCH_START_NS      (400ULL * 1000000ULL)
+
+typedef struct {
+    const char  *name;
+    uint32_t    interval_us;    // Mean time between bursts, exponential
+    uint32_t    burst;          // Jobs per burst
+    uint32_t    cycles;         // Mean cycles per job, uniform 0.5x - 1.5x
+} BenchLoad;
+
+typedef struct {
+    ModelTime   arrival;
+    uint32_t    cycles;
+} BenchJob;
+
+static const BenchLoad BenchLoads[] = {
+    { "light",   50000,  1,  20000 },
+    { "steady",  10000,  1,  60000 },
+    { "bursty", 200000, 12, 150000 },
+};
+
+/** Fixed bands, -1 for the governor */
+static const int BenchBands[] = {
+    cmuHFRCOBand_1MHz, cmuHFRCOBand_7MHz, cmuHFRCOBand_14MHz, cmuHFRCOBand_28MHz, -1
+};
+
+static const char *const BenchBandNames[] = { "1 MHz", "7 MHz", "14 MHz", "28 MHz", "governor" };
+
+static const BenchLoad *Load;
+static int Band;
+static uint64_t Seed;
+
+static BenchJob Jobs[BENCH_JOBS];
+static int JobsArrived;
+static int JobsDropped;
+static ModelTime Latency[BENCH_JOBS];
+static int JobsDone;
+static ModelTime RunEnd;
+
+PROCESS (BENCH_Worker, "Worker");
+
+
+static uint32_t BENCH_Random (void)
+{
+    Seed = Seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (uint32_t)(Seed >> 33);
+}
+
+
+static void BENCH_Burst (void *arg);
+
+
+/**
+ * @brief  Schedule the next burst after an exponential interval.
+ */
+static void BENCH_Schedule (void)
+{
+    // Uniform (0, 1]
+    double u = (BENCH_Random () + 1.0) / 2147483648.0;
+    ModelTime t = MODEL_Now () + (ModelTime)(-log (u) * Load->interval_us * 1000);
+
+    if (t < RunEnd && JobsArrived + Load->burst <= BENCH_JOBS) {
+        MODEL_Interrupt (t, BENCH_Burst, NULL);
+    }
+}
+
+
+/**
+ * @brief  Interrupt of a burst of arriving jobs.
+ */
+static void BENCH_Burst (void *arg)
+{
+    uint32_t i;
+
+    for (i = 0; i < Load->burst; i++) {
+        BenchJob *job = &Jobs[JobsArrived++];
+
+        job->arrival = MODEL_Now ();
+        job->cycles = Load->cycles / 2 + BENCH_Random () % Load->cycles;
+        if (process_post (&BENCH_Worker, PROCESS_EVENT_CONTINUE, job) != PROCESS_ERR_OK) {
+            JobsDropped++;
+        }
+    }
+    LPM_RegisterEvent ();
+
+    BENCH_Schedule ();
+}
+
+
+PROCESS_THREAD (BENCH_Worker, ev, data)
+{
+    PROCESS_BEGIN ();
+
+    while (1) {
+        PROCESS_WAIT_EVENT_UNTIL (ev == PROCESS_EVENT_CONTINUE);
+
+        BenchJob *job = data;
+        MODEL_Burn (job->cycles);
+        Latency[JobsDone++] = MODEL_Now () - job->arrival;
+    }
+
+    PROCESS_END ();
+}
+
+
+/**
+ * @brief  Start-up of platform-main.c with the band under test.
+ */
+static void BENCH_Main (void)
+{
+    CMU_ClockSelectSet (cmuClock_HF, cmuSelect_HFRCO);
+    CMU_ClockSelectSet (cmuClock_LFA, cmuSelect_LFXO);
+
+    CMU_HFRCOBandSet (Band < 0 ? cmuHFRCOBand_14MHz : (CMU_HFRCOBand_TypeDef)Band);
+    if (Band < 0) {
+        GOVERNOR_Init ();
+    }
+
+    SYSTIME_Init (SysTimeRtc);
+    LPM_Init ();
+
+    process_init ();
+    process_start (&BENCH_Worker, NULL);
+
+    // Measure from here on
+    MODEL_Stats.energy_uj = 0;
+    RunEnd = MODEL_Now () + BENCH_RUN_NS;
+    BENCH_Schedule ();
+
+    while (1) {
+        if (Band < 0) {
+            GOVERNOR_RunBegin ();
+            while (GOVERNOR_Dispatch (process_run ()) > 0);
+            GOVERNOR_RunEnd ();
+        } else {
+            while (process_run () > 0);
+        }
+
+        LPM_WaitForEvent ();
+    }
+}
+
+
+static int BENCH_Compare (const void *a, const void *b)
+{
+    ModelTime x = *(const ModelTime *)a;
+    ModelTime y = *(const ModelTime *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+
+static void BENCH_Run (const BenchLoad *load, int band, const char *name)
+{
+    double mean = 0;
+    int i;
+
+    Load = load;
+    Band = band;
+    Seed = 1;
+    JobsArrived = JobsDropped = JobsDone = 0;
+
+    MODEL_Reset ();
+    RunEnd = MODEL_NEVER;
+    MODEL_Run (BENCH_Main, BENCH_START_NS + BENCH_RUN_NS);
+
+    if (JobsDone == 0) {
+        printf ("%-8s %-9s no jobs done\n", load->name, name);
+        return;
+    }
+
+    qsort (Latency, JobsDone, sizeof (Latency[0]), BENCH_Compare);
+    for (i = 0; i < JobsDone; i++) {
+        mean += Latency[i];
+    }
+    mean /= JobsDone;
+
+    printf ("%-8s %-9s %10.1f %10.1f %10.1f %10.1f %6d %6d %6u\n",
+            load->name, name, MODEL_Stats.energy_uj,
+            mean / 1000, Latency[JobsDone * 99 / 100] / 1000.0, Latency[JobsDone - 1] / 1000.0,
+            JobsDone, JobsArrived - JobsDone, band < 0 ? GOVERNOR_Stats.band_changes : 0);
+}
+
+
+int main (void)
+{
+    unsigned int l, b;
+
+    MODEL_Init ();
+
+    printf ("%-8s %-9s %10s %10s %10s %10s %6s %6s %6s\n",
+            "load", "band", "energy uJ", "mean us", "p99 us", "max us", "jobs", "lost", "steps");
+
+    for (l = 0; l < sizeof (BenchLoads) / sizeof (BenchLoads[0]); l++) {
+        for (b = 0; b < sizeof (BenchBands) / sizeof (BenchBands[0]); b++) {
+            pid_t pid;
+            int status;
+
+            fflush (stdout);
+            pid = fork ();
+            if (pid == 0) {
+                BENCH_Run (&BenchLoads[l], BenchBands[b], BenchBandNames[b]);
+                fflush (stdout);
+                _exit (0);
+            }
+            if (pid < 0 || waitpid (pid, &status, 0) != pid || !WIFEXITED (status) ||
+                WEXITSTATUS (status) != 0) {
+                fprintf (stderr, "governor: %s %s failed\n", BenchLoads[l].name, BenchBandNames[b]);
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
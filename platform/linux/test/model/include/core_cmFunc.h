@@ -0,0 +1,90 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __CORE_CMFUNC_H
+#define __CORE_CMFUNC_H
+
+/**
+ * Host version of the CMSIS core register access for the register model,
+ * found before the one of CMSIS on the include path. PRIMASK masks the
+ * interrupts of the model.
+ */
+
+void MODEL_DisableIrq (void);
+void MODEL_EnableIrq (void);
+uint32_t MODEL_GetPrimask (void);
+void MODEL_SetPrimask (uint32_t primask);
+int MODEL_InHandler (void);
+
+__attribute__((always_inline)) static inline void __enable_irq (void)
+{
+    __asm volatile ("" : : : "memory");
+    MODEL_EnableIrq ();
+}
+
+__attribute__((always_inline)) static inline void __disable_irq (void)
+{
+    MODEL_DisableIrq ();
+    __asm volatile ("" : : : "memory");
+}
+
+__attribute__((always_inline)) static inline uint32_t __get_PRIMASK (void)
+{
+    return MODEL_GetPrimask ();
+}
+
+__attribute__((always_inline)) static inline void __set_PRIMASK (uint32_t priMask)
+{
+    MODEL_SetPrimask (priMask);
+}
+
+__attribute__((always_inline)) static inline uint32_t __get_IPSR (void)
+{
+    return (uint32_t)MODEL_InHandler ();
+}
+
+__attribute__((always_inline)) static inline uint32_t __get_CONTROL (void)
+{
+    return 0;
+}
+
+__attribute__((always_inline)) static inline void __set_CONTROL (uint32_t control)
+{
+    (void)control;
+}
+
+__attribute__((always_inline)) static inline uint32_t __get_BASEPRI (void)
+{
+    return 0;
+}
+
+__attribute__((always_inline)) static inline void __set_BASEPRI (uint32_t basePri)
+{
+    (void)basePri;
+}
+
+__attribute__((always_inline)) static inline uint32_t __get_FAULTMASK (void)
+{
+    return 0;
+}
+
+__attribute__((always_inline)) static inline void __set_FAULTMASK (uint32_t faultMask)
+{
+    (void)faultMask;
+}
+
+#endif /* __CORE_CMFUNC_H */
@@ -0,0 +1,99 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __CORE_CMINSTR_H
+#define __CORE_CMINSTR_H
+
+/**
+ * Host version of the CMSIS core instructions for the register model,
+ * found before the one of CMSIS on the include path.
+ */
+
+void MODEL_Wfi (void);
+
+__attribute__((always_inline)) static inline void __NOP (void)
+{
+}
+
+__attribute__((always_inline)) static inline void __WFI (void)
+{
+    MODEL_Wfi ();
+}
+
+__attribute__((always_inline)) static inline void __WFE (void)
+{
+    MODEL_Wfi ();
+}
+
+__attribute__((always_inline)) static inline void __SEV (void)
+{
+}
+
+__attribute__((always_inline)) static inline void __ISB (void)
+{
+    __asm volatile ("" : : : "memory");
+}
+
+__attribute__((always_inline)) static inline void __DSB (void)
+{
+    __asm volatile ("" : : : "memory");
+}
+
+__attribute__((always_inline)) static inline void __DMB (void)
+{
+    __asm volatile ("" : : : "memory");
+}
+
+__attribute__((always_inline)) static inline uint32_t __REV (uint32_t value)
+{
+    return __builtin_bswap32 (value);
+}
+
+__attribute__((always_inline)) static inline uint32_t __REV16 (uint32_t value)
+{
+    return ((value & 0x00FF00FFU) << 8) | ((value >> 8) & 0x00FF00FFU);
+}
+
+__attribute__((always_inline)) static inline int32_t __REVSH (int32_t value)
+{
+    return (int16_t)__builtin_bswap16 ((uint16_t)value);
+}
+
+__attribute__((always_inline)) static inline uint32_t __ROR (uint32_t op1, uint32_t op2)
+{
+    op2 &= 31;
+    return op2 ? (op1 >> op2) | (op1 << (32 - op2)) : op1;
+}
+
+__attribute__((always_inline)) static inline uint32_t __RBIT (uint32_t value)
+{
+    uint32_t result = 0;
+    int i;
+
+    for (i = 0; i < 32; i++) {
+        result = (result << 1) | ((value >> i) & 1);
+    }
+
+    return result;
+}
+
+__attribute__((always_inline)) static inline uint8_t __CLZ (uint32_t value)
+{
+    return value ? (uint8_t)__builtin_clz (value) : 32;
+}
+
+#endif /* __CORE_CMINSTR_H */
@@ -0,0 +1,30 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __EM_ASSERT_H
+#define __EM_ASSERT_H
+
+/**
+ * Host version of emlib em_assert.h for the register model. The asserts
+ * are always on and do not return, see assertEFM () in model.c.
+ */
+
+void assertEFM (const char *file, int line) __attribute__((noreturn));
+
+#define EFM_ASSERT(expr)    ((expr) ? ((void)0) : assertEFM (__FILE__, __LINE__))
+
+#endif /* __EM_ASSERT_H */
@@ -0,0 +1,48 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __EM_BITBAND_H
+#define __EM_BITBAND_H
+
+#include "em_device.h"
+
+/**
+ * Host version of emlib em_bitband.h for the register model, which has no
+ * bit-band alias regions: the bit is read, modified and written back.
+ */
+
+__STATIC_INLINE void BITBAND_Peripheral (volatile uint32_t *addr, uint32_t bit, uint32_t val)
+{
+    *addr = (*addr & ~(1UL << bit)) | ((val & 1UL) << bit);
+}
+
+__STATIC_INLINE uint32_t BITBAND_PeripheralRead (volatile uint32_t *addr, uint32_t bit)
+{
+    return (*addr >> bit) & 1UL;
+}
+
+__STATIC_INLINE void BITBAND_SRAM (uint32_t *addr, uint32_t bit, uint32_t val)
+{
+    *addr = (*addr & ~(1UL << bit)) | ((val & 1UL) << bit);
+}
+
+__STATIC_INLINE uint32_t BITBAND_SRAMRead (uint32_t *addr, uint32_t bit)
+{
+    return (*addr >> bit) & 1UL;
+}
+
+#endif /* __EM_BITBAND_H */
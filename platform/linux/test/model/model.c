@@ -0,0 +1,925 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#if !defined(__x86_64__) || !defined(__linux__)
+#error "The register model single-steps with the x86-64 trap flag on Linux"
+#endif
+
+#include <setjmp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+
+#include "model.h"
+
+#define MODEL_PAGE              4096U
+#define MODEL_REGION_SIZE       0x100000U
+#define MODEL_TRAP_FLAG         0x100
+#define MODEL_IRQ_COUNT         64
+#define MODEL_EVENTS            1024
+#define MODEL_STORM             100000
+#define MODEL_RUNAWAY_NS        (60ULL * 1000000000ULL)
+
+typedef struct {
+    uint32_t    base;
+    uint8_t     *backing;
+} ModelRegion;
+
+typedef struct {
+    ModelTime   t;
+    void        (*fn) (void *);
+    void        *arg;
+    int         interrupt;
+} ModelEvent;
+
+typedef struct {
+    ModelTime   now;
+    uintptr_t   open_page;      // Page being single-stepped, 0 if none
+    uintptr_t   fault;          // Address of the access
+    uint64_t    enabled;        // NVIC
+    uint64_t    pending;
+    uint32_t    primask;
+    int         active;         // Exception number of the handler, 0 in thread mode
+    int         depth;
+    ModelEvent  events[MODEL_EVENTS];
+    int         nevents;
+    ModelEvent  irqs[MODEL_EVENTS];
+    int         nirqs;
+    uintptr_t   spin_addr;
+    uint32_t    spin_value;
+    uint32_t    spin_reads;
+    sigjmp_buf  run;
+    int         running;
+    ModelTime   until;
+    ModelPhase  cyccnt;
+} ModelControl;
+
+static uint8_t ModelPer[MODEL_REGION_SIZE] __attribute__((aligned (MODEL_PAGE)));
+static uint8_t ModelScs[MODEL_REGION_SIZE] __attribute__((aligned (MODEL_PAGE)));
+
+static const ModelRegion ModelRegions[] = {
+    { PER_MEM_BASE, ModelPer },
+    { SCS_BASE & ~(MODEL_REGION_SIZE - 1), ModelScs },
+};
+
+static ModelControl ModelCtrl;
+
+ModelConf MODEL_Conf;
+volatile ModelStats MODEL_Stats;
+
+/* Handlers of the device, the ones not linked in are NULL */
+extern void GPIO_EVEN_IRQHandler (void) __attribute__((weak));
+extern void TIMER0_IRQHandler (void) __attribute__((weak));
+extern void GPIO_ODD_IRQHandler (void) __attribute__((weak));
+extern void TIMER1_IRQHandler (void) __attribute__((weak));
+extern void TIMER2_IRQHandler (void) __attribute__((weak));
+extern void TIMER3_IRQHandler (void) __attribute__((weak));
+extern void LETIMER0_IRQHandler (void) __attribute__((weak));
+extern void RTC_IRQHandler (void) __attribute__((weak));
+extern void BURTC_IRQHandler (void) __attribute__((weak));
+extern void CMU_IRQHandler (void) __attribute__((weak));
+extern void EMU_IRQHandler (void) __attribute__((weak));
+
+static void (*const ModelHandlers[MODEL_IRQ_COUNT]) (void) = {
+    [GPIO_EVEN_IRQn]    = GPIO_EVEN_IRQHandler,
+    [TIMER0_IRQn]       = TIMER0_IRQHandler,
+    [GPIO_ODD_IRQn]     = GPIO_ODD_IRQHandler,
+    [TIMER1_IRQn]       = TIMER1_IRQHandler,
+    [TIMER2_IRQn]       = TIMER2_IRQHandler,
+    [TIMER3_IRQn]       = TIMER3_IRQHandler,
+    [LETIMER0_IRQn]     = LETIMER0_IRQHandler,
+    [RTC_IRQn]          = RTC_IRQHandler,
+    [BURTC_IRQn]        = BURTC_IRQHandler,
+    [CMU_IRQn]          = CMU_IRQHandler,
+    [EMU_IRQn]          = EMU_IRQHandler,
+};
+
+static ModelPeriph MODEL_System;
+static ModelPeriph MODEL_Dwt;
+
+static ModelPeriph *const ModelPeriphs[] = {
+    &MODEL_System,
+    &MODEL_Dwt,
+    &MODEL_Cmu,
+    &MODEL_Rtc,
+    &MODEL_Burtc,
+    &MODEL_Rmu,
+    &MODEL_Timer0,
+    &MODEL_Timer1,
+    &MODEL_Timer2,
+    &MODEL_Timer3,
+    &MODEL_Gpio,
+    &MODEL_Prs,
+};
+
+#define MODEL_PERIPH_COUNT      (sizeof (ModelPeriphs) / sizeof (ModelPeriphs[0]))
+
+
+static void MODEL_Fatal (const char *msg, uintptr_t addr) __attribute__((noreturn));
+
+static void MODEL_Fatal (const char *msg, uintptr_t addr)
+{
+    fprintf (stderr, "model: %s at 0x%08lx, %llu ns\n", msg, (unsigned long)addr,
+             (unsigned long long)ModelCtrl.now);
+    abort ();
+}
+
+
+void assertEFM (const char *file, int line)
+{
+    fprintf (stderr, "model: EFM_ASSERT failed in %s:%d\n", file, line);
+    abort ();
+}
+
+
+static const ModelRegion *MODEL_Region (uintptr_t addr)
+{
+    unsigned int i;
+
+    for (i = 0; i < sizeof (ModelRegions) / sizeof (ModelRegions[0]); i++) {
+        if (addr >= ModelRegions[i].base && addr < ModelRegions[i].base + MODEL_REGION_SIZE) {
+            return &ModelRegions[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+uint32_t *MODEL_Backing (const volatile void *addr)
+{
+    uintptr_t a = (uintptr_t)addr;
+    const ModelRegion *region = MODEL_Region (a);
+
+    if (region == NULL) {
+        // DEVINFO is plain memory
+        return (uint32_t *)a;
+    }
+
+    return (uint32_t *)(region->backing + (a - region->base));
+}
+
+
+static ModelPeriph *MODEL_Periph (uintptr_t addr)
+{
+    unsigned int i;
+
+    for (i = 0; i < MODEL_PERIPH_COUNT; i++) {
+        if (addr >= ModelPeriphs[i]->base && addr < ModelPeriphs[i]->base + ModelPeriphs[i]->size) {
+            return ModelPeriphs[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ * @brief  Count the ticks of a clock over dt.
+ * @param  phase Phase of the counter, keeps the fraction of a tick.
+ * @param  freq Clock frequency in uHz, 0 if stopped.
+ * @param  div Clock divider.
+ * @param  dt Time, ns.
+ * @retval Number of ticks.
+ */
+uint64_t MODEL_Count (ModelPhase *phase, uint64_t freq, uint32_t div, ModelTime dt)
+{
+    unsigned __int128 unit = (unsigned __int128)div * 1000000000000000ULL;
+    uint64_t ticks;
+
+    if (freq == 0 || dt == 0) {
+        return 0;
+    }
+
+    phase->acc += (unsigned __int128)freq * dt;
+    ticks = (uint64_t)(phase->acc / unit);
+    phase->acc -= (unsigned __int128)ticks * unit;
+
+    return ticks;
+}
+
+
+/**
+ * @brief  Time until a clock has ticked.
+ * @param  ticks Number of ticks, at least 1.
+ * @retval Time, ns, MODEL_NEVER if the clock is stopped.
+ */
+ModelTime MODEL_TimeTo (const ModelPhase *phase, uint64_t freq, uint32_t div, uint64_t ticks)
+{
+    unsigned __int128 unit = (unsigned __int128)div * 1000000000000000ULL;
+    unsigned __int128 need, dt;
+
+    if (freq == 0) {
+        return MODEL_NEVER;
+    }
+
+    need = (unsigned __int128)ticks * unit - phase->acc;
+    dt = (need + freq - 1) / freq;
+
+    return dt >= MODEL_NEVER ? MODEL_NEVER - 1 : (ModelTime)dt;
+}
+
+
+ModelTime MODEL_Now (void)
+{
+    return ModelCtrl.now;
+}
+
+
+int MODEL_InHandler (void)
+{
+    return ModelCtrl.active;
+}
+
+
+/**
+ * @brief  Latch the asserted interrupt lines into NVIC pending. The line
+ *         of the running handler pends again only if still asserted when
+ *         the handler returns.
+ */
+static void MODEL_UpdateLines (void)
+{
+    unsigned int i;
+    int j;
+
+    for (i = 0; i < MODEL_PERIPH_COUNT; i++) {
+        if (ModelPeriphs[i]->lines) {
+            uint32_t lines = ModelPeriphs[i]->lines ();
+            for (j = 0; j < 2; j++) {
+                if ((lines & (1U << j)) && ModelPeriphs[i]->irq[j] >= 0 &&
+                    ModelPeriphs[i]->irq[j] + 16 != ModelCtrl.active) {
+                    ModelCtrl.pending |= 1ULL << ModelPeriphs[i]->irq[j];
+                }
+            }
+        }
+    }
+}
+
+
+static ModelTime MODEL_NextEvent (void)
+{
+    ModelTime next = MODEL_NEVER;
+    unsigned int i;
+    int j;
+
+    for (i = 0; i < MODEL_PERIPH_COUNT; i++) {
+        if (ModelPeriphs[i]->next) {
+            ModelTime t = ModelPeriphs[i]->next ();
+            if (t != MODEL_NEVER && t < next - ModelCtrl.now) {
+                next = ModelCtrl.now + t;
+            }
+        }
+    }
+
+    for (j = 0; j < ModelCtrl.nevents; j++) {
+        if (ModelCtrl.events[j].t < next) {
+            next = ModelCtrl.events[j].t;
+        }
+    }
+
+    return next;
+}
+
+
+static void MODEL_RunEvents (void)
+{
+    int i = 0;
+
+    while (i < ModelCtrl.nevents) {
+        if (ModelCtrl.events[i].t <= ModelCtrl.now) {
+            ModelEvent ev = ModelCtrl.events[i];
+            ModelCtrl.events[i] = ModelCtrl.events[--ModelCtrl.nevents];
+            if (ev.interrupt) {
+                if (ModelCtrl.nirqs == MODEL_EVENTS) {
+                    MODEL_Fatal ("too many pending interrupts", 0);
+                }
+                ModelCtrl.irqs[ModelCtrl.nirqs++] = ev;
+            } else {
+                ev.fn (ev.arg);
+            }
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+}
+
+
+/**
+ * @brief  Advance the model time, stopping at every event on the way.
+ * @param  dt Time, ns.
+ */
+void MODEL_Advance (ModelTime dt)
+{
+    ModelTime target = ModelCtrl.now + dt;
+
+    if (ModelCtrl.running && target > ModelCtrl.until + MODEL_RUNAWAY_NS) {
+        MODEL_Fatal ("run did not go idle before the deadline", 0);
+    }
+
+    do {
+        ModelTime next = MODEL_NextEvent ();
+        ModelTime step = (next < target ? next : target) - ModelCtrl.now;
+        unsigned int i;
+
+        if (next < ModelCtrl.now) {
+            step = 0;
+        }
+
+        if (step > 0) {
+            int em = MODEL_EnergyMode ();
+
+            MODEL_Stats.energy_uj += MODEL_Current (em) * 3.0 * step * 1e-9;
+            MODEL_Stats.em_ns[em] += step;
+
+            for (i = 0; i < MODEL_PERIPH_COUNT; i++) {
+                if (ModelPeriphs[i]->advance) {
+                    ModelPeriphs[i]->advance (step);
+                }
+            }
+            ModelCtrl.now += step;
+        }
+
+        MODEL_RunEvents ();
+        MODEL_UpdateLines ();
+
+    } while (ModelCtrl.now < target);
+}
+
+
+/**
+ * @brief  Deliver the pending interrupts, unless masked or in a handler.
+ */
+static void MODEL_Deliver (void)
+{
+    uint32_t storm = 0;
+    int last = -1;
+
+    if (ModelCtrl.primask || ModelCtrl.depth) {
+        return;
+    }
+
+    for (;;) {
+        uint64_t active;
+
+        MODEL_UpdateLines ();
+        active = ModelCtrl.pending & ModelCtrl.enabled;
+
+        ModelCtrl.depth++;
+        if (active) {
+            int irq = __builtin_ctzll (active);
+
+            if (ModelHandlers[irq] == NULL) {
+                MODEL_Fatal ("interrupt without a handler", irq);
+            }
+            if (irq == last && ++storm > MODEL_STORM) {
+                MODEL_Fatal ("interrupt keeps firing", irq);
+            }
+            last = irq;
+
+            ModelCtrl.pending &= ~(1ULL << irq);
+            ModelCtrl.active = 16 + irq;
+            ModelHandlers[irq] ();
+        } else if (ModelCtrl.nirqs > 0) {
+            ModelEvent ev = ModelCtrl.irqs[0];
+
+            memmove (&ModelCtrl.irqs[0], &ModelCtrl.irqs[1], --ModelCtrl.nirqs * sizeof (ModelEvent));
+            ModelCtrl.active = 16 + MODEL_IRQ_COUNT;
+            ev.fn (ev.arg);
+        } else {
+            ModelCtrl.depth--;
+            break;
+        }
+        ModelCtrl.active = 0;
+        ModelCtrl.depth--;
+        MODEL_Stats.interrupts++;
+
+        // Handlers do not run with PRIMASK set, but may leave it set
+        if (ModelCtrl.primask) {
+            break;
+        }
+    }
+}
+
+
+static int MODEL_WakeUp (void)
+{
+    MODEL_UpdateLines ();
+
+    return (ModelCtrl.pending & ModelCtrl.enabled) || ModelCtrl.nirqs > 0;
+}
+
+
+/**
+ * @brief  Burn core clock cycles, e.g. the work of a process. Interrupts
+ *         preempt the burn.
+ */
+void MODEL_Burn (uint32_t cycles)
+{
+    uint64_t left = cycles;
+
+    while (left > 0) {
+        uint64_t freq = MODEL_CoreFreq ();
+        ModelTime next = MODEL_NextEvent ();
+        ModelTime dt = (ModelTime)(((unsigned __int128)left * 1000000000000000ULL + freq - 1) / freq);
+        uint64_t done;
+
+        if (next > ModelCtrl.now && next - ModelCtrl.now < dt) {
+            dt = next - ModelCtrl.now;
+        }
+
+        MODEL_Advance (dt);
+
+        done = (uint64_t)(((unsigned __int128)dt * freq) / 1000000000000000ULL);
+        left = done >= left ? 0 : left - done;
+        if (dt > 0 && done == 0) {
+            left--;
+        }
+
+        MODEL_Deliver ();
+    }
+}
+
+
+void MODEL_At (ModelTime t, void (*fn) (void *), void *arg)
+{
+    if (ModelCtrl.nevents == MODEL_EVENTS) {
+        MODEL_Fatal ("too many events", 0);
+    }
+
+    ModelCtrl.events[ModelCtrl.nevents++] = (ModelEvent) {
+        .t = t, .fn = fn, .arg = arg, .interrupt = 0
+    };
+}
+
+
+/**
+ * @brief  Call fn as an interrupt handler at time t, for workloads that do
+ *         not come from a modelled peripheral. Wakes up WFI.
+ */
+void MODEL_Interrupt (ModelTime t, void (*fn) (void *), void *arg)
+{
+    MODEL_At (t, fn, arg);
+    ModelCtrl.events[ModelCtrl.nevents - 1].interrupt = 1;
+}
+
+
+/**
+ * @brief  Run main until it waits for an interrupt at or after until.
+ * @retval 0 when stopped at the deadline, 1 if main returned.
+ */
+int MODEL_Run (void (*main) (void), ModelTime until)
+{
+    ModelCtrl.until = until;
+    ModelCtrl.running = 1;
+
+    if (sigsetjmp (ModelCtrl.run, 1) == 0) {
+        main ();
+        ModelCtrl.running = 0;
+        return 1;
+    }
+
+    ModelCtrl.running = 0;
+    return 0;
+}
+
+
+void MODEL_Wfi (void)
+{
+    int em = (MODEL_REG (SCB->SCR) & SCB_SCR_SLEEPDEEP_Msk) ? 2 : 1;
+
+    MODEL_EnterEM (em);
+
+    while (!MODEL_WakeUp ()) {
+        ModelTime next = MODEL_NextEvent ();
+
+        if (ModelCtrl.running && next >= ModelCtrl.until) {
+            if (ModelCtrl.until > ModelCtrl.now) {
+                MODEL_Advance (ModelCtrl.until - ModelCtrl.now);
+            }
+            MODEL_EnterEM (0);
+            siglongjmp (ModelCtrl.run, 1);
+        }
+        if (next == MODEL_NEVER) {
+            MODEL_Fatal ("WFI without a wake-up source", 0);
+        }
+
+        MODEL_Advance (next - ModelCtrl.now);
+    }
+
+    MODEL_EnterEM (0);
+    MODEL_Stats.wakeups++;
+
+    MODEL_Deliver ();
+}
+
+
+void MODEL_DisableIrq (void)
+{
+    ModelCtrl.primask = 1;
+}
+
+
+void MODEL_EnableIrq (void)
+{
+    ModelCtrl.primask = 0;
+    MODEL_Deliver ();
+}
+
+
+uint32_t MODEL_GetPrimask (void)
+{
+    return ModelCtrl.primask;
+}
+
+
+void MODEL_SetPrimask (uint32_t primask)
+{
+    if (primask) {
+        MODEL_DisableIrq ();
+    } else {
+        MODEL_EnableIrq ();
+    }
+}
+
+
+/**
+ * @brief  An access faulted: present the registers of the page and let the
+ *         access run with the trap flag set.
+ */
+static void MODEL_Fault (int sig, siginfo_t *info, void *context)
+{
+    ucontext_t *uc = context;
+    uintptr_t addr = (uintptr_t)info->si_addr;
+    const ModelRegion *region = MODEL_Region (addr);
+    uintptr_t page = addr & ~(uintptr_t)(MODEL_PAGE - 1);
+    unsigned int i;
+
+    if (region == NULL || ModelCtrl.open_page != 0) {
+        // A real crash, let it happen
+        signal (SIGSEGV, SIG_DFL);
+        return;
+    }
+
+    for (i = 0; i < MODEL_PERIPH_COUNT; i++) {
+        ModelPeriph *p = ModelPeriphs[i];
+        if (p->present && p->base < page + MODEL_PAGE && p->base + p->size > page) {
+            p->present ();
+        }
+    }
+
+    ModelCtrl.open_page = page;
+    ModelCtrl.fault = addr;
+
+    mprotect ((void *)page, MODEL_PAGE, PROT_READ | PROT_WRITE);
+    memcpy ((void *)page, region->backing + (page - region->base), MODEL_PAGE);
+
+    uc->uc_mcontext.gregs[REG_EFL] |= MODEL_TRAP_FLAG;
+}
+
+
+/**
+ * @brief  The access is done: apply what was written, advance the time
+ *         and deliver the interrupts it raised.
+ */
+static void MODEL_Step (int sig, siginfo_t *info, void *context)
+{
+    ucontext_t *uc = context;
+    uintptr_t page = ModelCtrl.open_page;
+    uintptr_t addr = ModelCtrl.fault & ~(uintptr_t)3;
+    ModelTime dt;
+    ModelPeriph *p;
+    int written = 0;
+    uintptr_t a;
+
+    uc->uc_mcontext.gregs[REG_EFL] &= ~MODEL_TRAP_FLAG;
+
+    if (page == 0) {
+        MODEL_Fatal ("unexpected trap", 0);
+    }
+
+    // An access touches at most two words
+    for (a = addr; a < addr + 8 && a < page + MODEL_PAGE; a += 4) {
+        uint32_t value = *(volatile uint32_t *)a;
+        uint32_t *backing = MODEL_Backing ((void *)a);
+        uint32_t old = *backing;
+
+        if (value == old) {
+            continue;
+        }
+
+        written = 1;
+        p = MODEL_Periph (a);
+        if (p && p->clocked && !p->clocked ()) {
+            if (MODEL_Stats.unclocked++ < 8 || MODEL_Conf.verbose) {
+                fprintf (stderr, "model: write to %s+0x%03lx dropped, clock off\n",
+                         p->name, (unsigned long)(a - p->base));
+            }
+        } else if (p && p->write) {
+            p->write ((volatile uint32_t *)a, old, value);
+        } else {
+            *backing = value;
+        }
+    }
+
+    mprotect ((void *)page, MODEL_PAGE, PROT_NONE);
+    ModelCtrl.open_page = 0;
+    MODEL_Stats.accesses++;
+
+    dt = ((ModelTime)MODEL_CONF_ACCESS_CYCLES * 1000000000000000ULL) / (MODEL_CoreFreq () + 1) + 1;
+    p = MODEL_Periph (addr);
+
+    if (written) {
+        ModelCtrl.spin_reads = 0;
+        MODEL_UpdateLines ();
+    } else {
+        uint32_t value = *MODEL_Backing ((void *)addr);
+
+        if (p && p->read) {
+            p->read ((volatile uint32_t *)addr);
+        }
+
+        // Polling an unchanged register, skip to when it can change
+        if (addr == ModelCtrl.spin_addr && value == ModelCtrl.spin_value) {
+            if (++ModelCtrl.spin_reads >= MODEL_CONF_SPIN_READS) {
+                ModelTime next = MODEL_NextEvent ();
+                ModelTime change = p && p->changes ? p->changes ((volatile uint32_t *)addr) : MODEL_NEVER;
+
+                if (next != MODEL_NEVER && next > ModelCtrl.now && next - ModelCtrl.now < change) {
+                    change = next - ModelCtrl.now;
+                }
+                if (change == MODEL_NEVER) {
+                    MODEL_Fatal ("polling a register that never changes", addr);
+                }
+                if (change > dt) {
+                    dt = change;
+                }
+                MODEL_Stats.spins++;
+            }
+        } else {
+            ModelCtrl.spin_addr = addr;
+            ModelCtrl.spin_value = value;
+            ModelCtrl.spin_reads = 0;
+        }
+    }
+
+    MODEL_Advance (dt);
+    MODEL_Deliver ();
+}
+
+
+/*
+ * System control space: NVIC, SCB, CoreDebug and SysTick. The set and
+ * clear registers of the NVIC read as 0, so that writing the mask read
+ * back is still seen as a write.
+ */
+
+static void MODEL_SystemPresent (void)
+{
+    MODEL_REG (NVIC->ISER[0]) = (uint32_t)ModelCtrl.enabled;
+    MODEL_REG (NVIC->ISER[1]) = (uint32_t)(ModelCtrl.enabled >> 32);
+    MODEL_REG (NVIC->ICER[0]) = 0;
+    MODEL_REG (NVIC->ICER[1]) = 0;
+    MODEL_REG (NVIC->ISPR[0]) = 0;
+    MODEL_REG (NVIC->ISPR[1]) = 0;
+    MODEL_REG (NVIC->ICPR[0]) = 0;
+    MODEL_REG (NVIC->ICPR[1]) = 0;
+    MODEL_REG (SCB->ICSR) = ModelCtrl.active;
+}
+
+
+static void MODEL_SystemWrite (volatile uint32_t *reg, uint32_t old, uint32_t value)
+{
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        uint64_t mask = (uint64_t)value << (32 * i);
+        if (reg == &NVIC->ISER[i]) {
+            ModelCtrl.enabled |= mask;
+            return;
+        } else if (reg == &NVIC->ICER[i]) {
+            ModelCtrl.enabled &= ~mask;
+            return;
+        } else if (reg == &NVIC->ISPR[i]) {
+            ModelCtrl.pending |= mask;
+            return;
+        } else if (reg == &NVIC->ICPR[i]) {
+            ModelCtrl.pending &= ~mask;
+            return;
+        }
+    }
+
+    *MODEL_Backing (reg) = value;
+}
+
+
+static ModelPeriph MODEL_System = {
+    .name       = "SCS",
+    .base       = SCS_BASE,
+    .size       = 0x1000,
+    .irq        = { -1, -1 },
+    .present    = MODEL_SystemPresent,
+    .write      = MODEL_SystemWrite,
+};
+
+
+/*
+ * DWT cycle counter, counts the core clock in EM0 while enabled.
+ */
+
+static int MODEL_DwtCounting (void)
+{
+    return (MODEL_REG (CoreDebug->DEMCR) & CoreDebug_DEMCR_TRCENA_Msk) &&
+           (MODEL_REG (DWT->CTRL) & DWT_CTRL_CYCCNTENA_Msk) &&
+           MODEL_EnergyMode () == 0;
+}
+
+
+static void MODEL_DwtAdvance (ModelTime dt)
+{
+    if (MODEL_DwtCounting ()) {
+        MODEL_REG (DWT->CYCCNT) += (uint32_t)MODEL_Count (&ModelCtrl.cyccnt, MODEL_CoreFreq (), 1, dt);
+    }
+}
+
+
+static ModelTime MODEL_DwtChanges (volatile uint32_t *reg)
+{
+    if (reg == &DWT->CYCCNT && MODEL_DwtCounting ()) {
+        return MODEL_TimeTo (&ModelCtrl.cyccnt, MODEL_CoreFreq (), 1, 1);
+    }
+
+    return MODEL_NEVER;
+}
+
+
+static ModelPeriph MODEL_Dwt = {
+    .name       = "DWT",
+    .base       = DWT_BASE,
+    .size       = 0x1000,
+    .irq        = { -1, -1 },
+    .changes    = MODEL_DwtChanges,
+    .advance    = MODEL_DwtAdvance,
+};
+
+
+/**
+ * @brief  Device information page, read by emlib and system_efm32.c.
+ */
+static void MODEL_DevInfo (void)
+{
+    memset ((void *)(DEVINFO_BASE & ~(MODEL_PAGE - 1)), 0xFF, MODEL_PAGE);
+
+    // Production revision 18 keeps the nominal 1 and 7 MHz HFRCO bands
+    MODEL_REG (DEVINFO->PART) = (18U << _DEVINFO_PART_PROD_REV_SHIFT) |
+                 (_DEVINFO_PART_DEVICE_FAMILY_GG << _DEVINFO_PART_DEVICE_FAMILY_SHIFT) |
+                 (990U << _DEVINFO_PART_DEVICE_NUMBER_SHIFT);
+    MODEL_REG (DEVINFO->MSIZE) = (128U << 16) | 1024U;
+    MODEL_REG (DEVINFO->UNIQUEL) = 0x4d4f444cU;
+    MODEL_REG (DEVINFO->UNIQUEH) = 0x00000001U;
+    MODEL_REG (DEVINFO->HFRCOCAL0) = 0x7f7f7f7fU;
+    MODEL_REG (DEVINFO->HFRCOCAL1) = 0x7f7f7f7fU;
+    MODEL_REG (DEVINFO->AUXHFRCOCAL0) = 0x7f7f7f7fU;
+    MODEL_REG (DEVINFO->AUXHFRCOCAL1) = 0x7f7f7f7fU;
+}
+
+
+/**
+ * @brief  Reset the registers and NVIC, the ones of the backup domain too
+ *         if backup is set.
+ */
+static void MODEL_ResetDomains (int backup)
+{
+    unsigned int i;
+
+    memset (ModelPer, 0, sizeof (ModelPer));
+    memset (ModelScs, 0, sizeof (ModelScs));
+    memset (&ModelCtrl.cyccnt, 0, sizeof (ModelCtrl.cyccnt));
+
+    ModelCtrl.enabled = 0;
+    ModelCtrl.pending = 0;
+    ModelCtrl.primask = 0;
+    ModelCtrl.active = 0;
+    ModelCtrl.depth = 0;
+    ModelCtrl.nevents = 0;
+    ModelCtrl.nirqs = 0;
+    ModelCtrl.spin_addr = 0;
+    ModelCtrl.spin_reads = 0;
+    ModelCtrl.running = 0;
+
+    MODEL_DevInfo ();
+
+    MODEL_REG (MSC->READCTRL) = _MSC_READCTRL_RESETVALUE;
+
+    for (i = 0; i < MODEL_PERIPH_COUNT; i++) {
+        if (ModelPeriphs[i]->reset && (backup || !ModelPeriphs[i]->backup)) {
+            ModelPeriphs[i]->reset ();
+        }
+    }
+}
+
+
+/**
+ * @brief  Power-on reset: registers, NVIC, time and statistics.
+ */
+void MODEL_Reset (void)
+{
+    memset ((void *)&MODEL_Stats, 0, sizeof (MODEL_Stats));
+    ModelCtrl.now = 0;
+
+    MODEL_ResetDomains (1);
+}
+
+
+/**
+ * @brief  System reset, e.g. a pin or watchdog reset: the backup domain,
+ *         the time and the statistics are kept, the rest starts over.
+ * @param  cause RMU_RSTCAUSE bit added to the reset cause.
+ */
+void MODEL_SystemReset (uint32_t cause)
+{
+    static uint8_t kept[MODEL_PERIPH_COUNT][MODEL_PAGE];
+    unsigned int i;
+
+    for (i = 0; i < MODEL_PERIPH_COUNT; i++) {
+        if (ModelPeriphs[i]->backup) {
+            memcpy (kept[i], MODEL_Backing ((void *)(uintptr_t)ModelPeriphs[i]->base), ModelPeriphs[i]->size);
+        }
+    }
+
+    MODEL_ResetDomains (0);
+
+    for (i = 0; i < MODEL_PERIPH_COUNT; i++) {
+        if (ModelPeriphs[i]->backup) {
+            memcpy (MODEL_Backing ((void *)(uintptr_t)ModelPeriphs[i]->base), kept[i], ModelPeriphs[i]->size);
+        }
+    }
+
+    MODEL_REG (RMU->RSTCAUSE) |= cause;
+}
+
+
+/**
+ * @brief  Map the register space and install the trap handlers. Keeps
+ *         MODEL_Conf, sets the defaults of the fields left 0.
+ */
+void MODEL_Init (void)
+{
+    struct sigaction sa;
+    unsigned int i;
+
+    for (i = 0; i < sizeof (ModelRegions) / sizeof (ModelRegions[0]); i++) {
+        void *p = mmap ((void *)(uintptr_t)ModelRegions[i].base, MODEL_REGION_SIZE, PROT_NONE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+        if (p != (void *)(uintptr_t)ModelRegions[i].base) {
+            MODEL_Fatal ("cannot map the register space", ModelRegions[i].base);
+        }
+    }
+
+    if (mmap ((void *)(DEVINFO_BASE & ~(MODEL_PAGE - 1)), MODEL_PAGE, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0) == MAP_FAILED) {
+        MODEL_Fatal ("cannot map DEVINFO", DEVINFO_BASE);
+    }
+
+    if (MODEL_Conf.hfxo_hz == 0) {
+        MODEL_Conf.hfxo_hz = 48000000;
+    }
+    if (MODEL_Conf.lfxo_hz == 0) {
+        MODEL_Conf.lfxo_hz = 32768;
+    }
+    if (MODEL_Conf.startup_us[MODEL_HFXO] == 0) {
+        MODEL_Conf.startup_us[MODEL_HFXO] = 400;
+    }
+    if (MODEL_Conf.startup_us[MODEL_LFXO] == 0) {
+        MODEL_Conf.startup_us[MODEL_LFXO] = 300000;
+    }
+    if (MODEL_Conf.startup_us[MODEL_LFRCO] == 0) {
+        MODEL_Conf.startup_us[MODEL_LFRCO] = 150;
+    }
+
+    memset (&sa, 0, sizeof (sa));
+    sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sa.sa_sigaction = MODEL_Fault;
+    sigaction (SIGSEGV, &sa, NULL);
+    sa.sa_sigaction = MODEL_Step;
+    sigaction (SIGTRAP, &sa, NULL);
+
+    MODEL_Reset ();
+}
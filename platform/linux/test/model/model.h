@@ -0,0 +1,186 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MODEL_H_
+#define MODEL_H_
+
+#include <stdint.h>
+
+#include <em_device.h>
+
+/**
+ * Register model of the EFM32GG for running the efm32 drivers and emlib
+ * unmodified on the host. The peripheral and the system control space
+ * are mapped at their real addresses without access rights. Every access
+ * faults, the model presents the current register values on the page and
+ * single-steps the access, then applies what was written. Model time
+ * advances by MODEL_CONF_ACCESS_CYCLES per access and by MODEL_Burn ()
+ * only, code in between takes no time.
+ *
+ * Interrupts are delivered after the access that raised them, unless
+ * PRIMASK is set, and preempt the code like on the device. WFI advances
+ * the time to the next interrupt, with SLEEPDEEP in EM2: HF oscillators
+ * and the core clock stop, HFXO is disabled and HFRCO selected.
+ *
+ * The clocks run with the errors of ModelConf. The energy is accounted
+ * with approximate datasheet currents at 3 V, good for comparing
+ * configurations rather than for absolute figures.
+ *
+ * Modelled: CMU (oscillators, HFCLK, HFRCO bands, clock gating, LFA,
+ * calibration), MSC, EMU, DWT cycle counter, NVIC, SCB, RTC, BURTC with
+ * the retention registers, RMU, TIMER0-3 (up and down counting, cascading,
+ * compare and input capture from PRS), GPIO inputs and external
+ * interrupts driven with MODEL_GpioSet () and PRS routing GPIO pins.
+ * An input is captured at the edge, without the synchronization delay.
+ * x86-64 Linux only, the access is single-stepped with the trap flag.
+ */
+
+/** Core clock cycles taken by a peripheral access */
+#ifndef MODEL_CONF_ACCESS_CYCLES
+#define MODEL_CONF_ACCESS_CYCLES    4
+#endif /* MODEL_CONF_ACCESS_CYCLES */
+
+/** Reads of an unchanged register after which a polling loop is skipped ahead */
+#ifndef MODEL_CONF_SPIN_READS
+#define MODEL_CONF_SPIN_READS       4
+#endif /* MODEL_CONF_SPIN_READS */
+
+/** Backing store of a register, for the model and the tests, never faults */
+#define MODEL_REG(reg)              (*MODEL_Backing ((const volatile void *)&(reg)))
+
+/** Oscillators */
+typedef enum {
+    MODEL_HFRCO,
+    MODEL_HFXO,
+    MODEL_AUXHFRCO,
+    MODEL_LFRCO,
+    MODEL_LFXO,
+    MODEL_ULFRCO,
+    MODEL_OSC_COUNT
+} ModelOsc;
+
+typedef struct {
+    int32_t     error_ppb[MODEL_OSC_COUNT]; // Frequency error of the oscillators
+    uint32_t    startup_us[MODEL_OSC_COUNT];// Time from enable to ready
+    uint32_t    hfxo_hz;                    // Crystal frequencies
+    uint32_t    lfxo_hz;
+    uint32_t    verbose;                    // Print the unclocked accesses
+} ModelConf;
+
+typedef struct {
+    uint64_t    accesses;       // Peripheral register accesses
+    uint64_t    spins;          // Polling loops skipped ahead
+    uint32_t    unclocked;      // Writes dropped, the peripheral clock was off
+    uint32_t    interrupts;     // Interrupt handlers called
+    uint32_t    wakeups;        // WFI wake-ups
+    uint64_t    em_ns[3];       // Time spent in EM0, EM1 and EM2
+    double      energy_uj;      // Energy at 3 V
+} ModelStats;
+
+/** Model time, ns */
+typedef uint64_t ModelTime;
+
+/** Time of an event that never comes */
+#define MODEL_NEVER                 UINT64_MAX
+
+/**
+ * Peripheral of the model. The handlers are called with the model time
+ * at the access, the registers are read and written with MODEL_REG ().
+ */
+typedef struct {
+    const char  *name;
+    uint32_t    base;
+    uint32_t    size;
+    int         irq[2];                             // Interrupt lines, -1 if none
+    int         backup;                             // Backup domain, kept by a system reset
+    void        (*reset) (void);                    // Power-on reset
+    int         (*clocked) (void);                  // Register interface clocked
+    void        (*present) (void);                  // Update the registers for reading
+    void        (*write) (volatile uint32_t *reg, uint32_t old, uint32_t value);
+    void        (*read) (volatile uint32_t *reg);   // Read with side effects
+    ModelTime   (*next) (void);                     // Time to the next event
+    ModelTime   (*changes) (volatile uint32_t *reg);// Time until the register can change
+    void        (*advance) (ModelTime dt);          // Run for dt
+    uint32_t    (*lines) (void);                    // Asserted interrupt lines, bit per irq[]
+} ModelPeriph;
+
+/**
+ * Phase of a counter driven by a clock, see MODEL_Count (). Frequencies
+ * are in uHz, fine enough for errors of a fraction of ppb.
+ */
+typedef struct {
+    unsigned __int128 acc;
+} ModelPhase;
+
+/** Peripherals of the model */
+extern ModelPeriph MODEL_Cmu;
+extern ModelPeriph MODEL_Rtc;
+extern ModelPeriph MODEL_Burtc;
+extern ModelPeriph MODEL_Rmu;
+extern ModelPeriph MODEL_Timer0;
+extern ModelPeriph MODEL_Timer1;
+extern ModelPeriph MODEL_Timer2;
+extern ModelPeriph MODEL_Timer3;
+extern ModelPeriph MODEL_Gpio;
+extern ModelPeriph MODEL_Prs;
+
+/** Volatile, the accesses update it behind the back of the compiler */
+extern ModelConf MODEL_Conf;
+extern volatile ModelStats MODEL_Stats;
+
+void MODEL_Init (void);
+void MODEL_Reset (void);
+void MODEL_SystemReset (uint32_t cause);
+uint32_t *MODEL_Backing (const volatile void *addr);
+
+ModelTime MODEL_Now (void);
+void MODEL_Advance (ModelTime dt);
+void MODEL_Burn (uint32_t cycles);
+int MODEL_Run (void (*main) (void), ModelTime until);
+void MODEL_At (ModelTime t, void (*fn) (void *), void *arg);
+void MODEL_Interrupt (ModelTime t, void (*fn) (void *), void *arg);
+int MODEL_InHandler (void);
+
+uint64_t MODEL_Count (ModelPhase *phase, uint64_t freq, uint32_t div, ModelTime dt);
+ModelTime MODEL_TimeTo (const ModelPhase *phase, uint64_t freq, uint32_t div, uint64_t ticks);
+
+/** Implemented by model_cmu.c */
+int MODEL_EnergyMode (void);
+uint64_t MODEL_OscFreq (ModelOsc osc);
+uint64_t MODEL_HfclkFreq (void);
+uint64_t MODEL_CoreFreq (void);
+uint64_t MODEL_HfperFreq (uint32_t clken);
+uint64_t MODEL_LfaFreq (uint32_t clken, uint32_t presc_shift, uint32_t *div);
+int MODEL_LeClocked (void);
+double MODEL_Current (int em);
+void MODEL_EnterEM (int em);
+
+/** Implemented by model_gpio.c, model_prs.c and model_timer.c */
+void MODEL_GpioSet (unsigned int port, unsigned int pin, int level);
+int MODEL_GpioGet (unsigned int port, unsigned int pin);
+int MODEL_GpioPrsLevel (unsigned int pin);
+void MODEL_PrsUpdate (void);
+void MODEL_TimerPrsEdge (unsigned int prs, int level);
+
+/** Called by the host CMSIS headers */
+void MODEL_Wfi (void);
+void MODEL_DisableIrq (void);
+void MODEL_EnableIrq (void);
+uint32_t MODEL_GetPrimask (void);
+void MODEL_SetPrimask (uint32_t primask);
+
+#endif /* MODEL_H_ */
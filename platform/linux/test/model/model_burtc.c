@@ -0,0 +1,286 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "model.h"
+
+#define BURTC_MODEL_WRAP        (_BURTC_CNT_MASK + 1ULL)
+
+/*
+ * Backup domain: the BURTC with its retention registers and the control
+ * register of the RMU are kept by MODEL_SystemReset (). The oscillator of
+ * the BURTC is kept running by the backup domain, so it counts through a
+ * system reset whatever the CMU does. EM4 is not modelled.
+ */
+
+typedef struct {
+    ModelPhase  phase;
+    uint32_t    cnt;
+} BurtcModel;
+
+static BurtcModel BurtcMdl;
+
+
+/**
+ * @brief  Counter frequency, uHz, 0 while disabled or held in reset.
+ */
+static uint64_t MODEL_BurtcFreq (uint32_t *div)
+{
+    uint32_t ctrl = MODEL_REG (BURTC->CTRL);
+    uint64_t hz;
+
+    *div = 1U << ((ctrl & _BURTC_CTRL_PRESC_MASK) >> _BURTC_CTRL_PRESC_SHIFT);
+
+    if ((ctrl & _BURTC_CTRL_MODE_MASK) == BURTC_CTRL_MODE_DISABLE || (ctrl & BURTC_CTRL_RSTEN) ||
+        (MODEL_REG (RMU->CTRL) & RMU_CTRL_BURSTEN)) {
+        return 0;
+    }
+
+    switch ((ctrl & _BURTC_CTRL_CLKSEL_MASK) >> _BURTC_CTRL_CLKSEL_SHIFT) {
+        case _BURTC_CTRL_CLKSEL_LFRCO:
+            hz = 32768;
+            return hz * 1000000 + (int64_t)hz * MODEL_Conf.error_ppb[MODEL_LFRCO] / 1000;
+        case _BURTC_CTRL_CLKSEL_LFXO:
+            hz = MODEL_Conf.lfxo_hz;
+            return hz * 1000000 + (int64_t)hz * MODEL_Conf.error_ppb[MODEL_LFXO] / 1000;
+        case _BURTC_CTRL_CLKSEL_ULFRCO:
+            hz = 1000;
+            return hz * 1000000 + (int64_t)hz * MODEL_Conf.error_ppb[MODEL_ULFRCO] / 1000;
+        default:
+            return 0;
+    }
+}
+
+
+/**
+ * @brief  Counter period, COMP0 + 1 in COMP0TOP mode.
+ */
+static uint64_t MODEL_BurtcPeriod (void)
+{
+    if (MODEL_REG (BURTC->CTRL) & BURTC_CTRL_COMP0TOP) {
+        return MODEL_REG (BURTC->COMP0) + 1ULL;
+    }
+
+    return BURTC_MODEL_WRAP;
+}
+
+
+/**
+ * @brief  Ticks from now until the counter reaches value, a full period
+ *         if it is there already.
+ */
+static uint64_t MODEL_BurtcTicksTo (uint32_t value)
+{
+    uint64_t period = MODEL_BurtcPeriod ();
+    uint64_t ticks = (value + period - BurtcMdl.cnt) % period;
+
+    return ticks ? ticks : period;
+}
+
+
+/**
+ * @brief  Ticks from now until the flags set.
+ */
+static uint64_t MODEL_BurtcTicksToFlags (uint32_t flags)
+{
+    uint64_t ticks = UINT64_MAX;
+    uint64_t t;
+
+    if (flags & BURTC_IF_COMP0) {
+        ticks = MODEL_BurtcTicksTo (MODEL_REG (BURTC->COMP0));
+    }
+    if ((flags & BURTC_IF_OF) && !(MODEL_REG (BURTC->CTRL) & BURTC_CTRL_COMP0TOP)) {
+        t = BURTC_MODEL_WRAP - BurtcMdl.cnt;
+        ticks = t < ticks ? t : ticks;
+    }
+
+    return ticks;
+}
+
+
+static void MODEL_BurtcReset (void)
+{
+    memset (&BurtcMdl, 0, sizeof (BurtcMdl));
+    MODEL_REG (BURTC->CTRL) = _BURTC_CTRL_RESETVALUE;
+}
+
+
+/**
+ * @brief  Registers accessible with the LE interface clocked and the backup
+ *         domain out of reset.
+ */
+static int MODEL_BurtcClocked (void)
+{
+    return MODEL_LeClocked () && !(MODEL_REG (RMU->CTRL) & RMU_CTRL_BURSTEN);
+}
+
+
+static void MODEL_BurtcPresent (void)
+{
+    MODEL_REG (BURTC->CNT) = BurtcMdl.cnt;
+    MODEL_REG (BURTC->IFS) = 0;
+    MODEL_REG (BURTC->IFC) = 0;
+    MODEL_REG (BURTC->SYNCBUSY) = 0;
+    MODEL_REG (BURTC->STATUS) = 0;
+}
+
+
+static void MODEL_BurtcWrite (volatile uint32_t *reg, uint32_t old, uint32_t value)
+{
+    if (reg == &BURTC->CTRL) {
+        // Held at 0 while in reset
+        if (value & BURTC_CTRL_RSTEN) {
+            BurtcMdl.cnt = 0;
+            memset (&BurtcMdl.phase, 0, sizeof (BurtcMdl.phase));
+        }
+        MODEL_REG (BURTC->CTRL) = value & _BURTC_CTRL_MASK;
+    } else if (reg == &BURTC->COMP0) {
+        MODEL_REG (BURTC->COMP0) = value;
+    } else if (reg == &BURTC->IFS) {
+        MODEL_REG (BURTC->IF) |= value & _BURTC_IF_MASK;
+    } else if (reg == &BURTC->IFC) {
+        MODEL_REG (BURTC->IF) &= ~value;
+    } else if (reg == &BURTC->IEN || reg == &BURTC->LPMODE || reg == &BURTC->LFXOFDET ||
+               reg == &BURTC->POWERDOWN || reg == &BURTC->LOCK || reg == &BURTC->FREEZE ||
+               (reg >= &BURTC->RET[0].REG && reg <= &BURTC->RET[127].REG)) {
+        *MODEL_Backing (reg) = value;
+    }
+}
+
+
+static ModelTime MODEL_BurtcNext (void)
+{
+    uint32_t div;
+    uint64_t freq = MODEL_BurtcFreq (&div);
+    uint32_t ien = MODEL_REG (BURTC->IEN) & ~MODEL_REG (BURTC->IF);
+
+    if (freq == 0 || ien == 0) {
+        return MODEL_NEVER;
+    }
+
+    return MODEL_TimeTo (&BurtcMdl.phase, freq, div, MODEL_BurtcTicksToFlags (ien));
+}
+
+
+static ModelTime MODEL_BurtcChanges (volatile uint32_t *reg)
+{
+    uint32_t div;
+    uint64_t freq = MODEL_BurtcFreq (&div);
+
+    if (reg == &BURTC->CNT) {
+        return MODEL_TimeTo (&BurtcMdl.phase, freq, div, 1);
+    } else if (reg == &BURTC->IF) {
+        return MODEL_TimeTo (&BurtcMdl.phase, freq, div, MODEL_BurtcTicksToFlags (_BURTC_IF_MASK));
+    }
+
+    return MODEL_NEVER;
+}
+
+
+static void MODEL_BurtcAdvance (ModelTime dt)
+{
+    uint32_t div;
+    uint64_t freq = MODEL_BurtcFreq (&div);
+    uint64_t ticks = MODEL_Count (&BurtcMdl.phase, freq, div, dt);
+    uint64_t period = MODEL_BurtcPeriod ();
+    uint32_t flags = 0;
+
+    if (ticks == 0) {
+        return;
+    }
+
+    if (ticks >= MODEL_BurtcTicksTo (MODEL_REG (BURTC->COMP0))) {
+        flags |= BURTC_IF_COMP0;
+    }
+    if (!(MODEL_REG (BURTC->CTRL) & BURTC_CTRL_COMP0TOP) && ticks >= BURTC_MODEL_WRAP - BurtcMdl.cnt) {
+        flags |= BURTC_IF_OF;
+    }
+
+    BurtcMdl.cnt = (uint32_t)((BurtcMdl.cnt + ticks) % period);
+    MODEL_REG (BURTC->IF) |= flags;
+}
+
+
+static uint32_t MODEL_BurtcLines (void)
+{
+    return (MODEL_REG (BURTC->IF) & MODEL_REG (BURTC->IEN)) ? 1 : 0;
+}
+
+
+ModelPeriph MODEL_Burtc = {
+    .name       = "BURTC",
+    .base       = BURTC_BASE,
+    .size       = 0x400,
+    .irq        = { BURTC_IRQn, -1 },
+    .backup     = 1,
+    .reset      = MODEL_BurtcReset,
+    .clocked    = MODEL_BurtcClocked,
+    .present    = MODEL_BurtcPresent,
+    .write      = MODEL_BurtcWrite,
+    .next       = MODEL_BurtcNext,
+    .changes    = MODEL_BurtcChanges,
+    .advance    = MODEL_BurtcAdvance,
+    .lines      = MODEL_BurtcLines,
+};
+
+
+/*
+ * RMU: the backup domain reset and the reset cause. A system reset adds
+ * its cause to RSTCAUSE, RCCLR clears it.
+ */
+
+static void MODEL_RmuReset (void)
+{
+    MODEL_REG (RMU->CTRL) = _RMU_CTRL_RESETVALUE;
+    MODEL_REG (RMU->RSTCAUSE) = RMU_RSTCAUSE_PORST;
+}
+
+
+static void MODEL_RmuWrite (volatile uint32_t *reg, uint32_t old, uint32_t value)
+{
+    if (reg == &RMU->CTRL) {
+        // Entering the backup domain reset clears the domain
+        if ((value & RMU_CTRL_BURSTEN) && !(old & RMU_CTRL_BURSTEN)) {
+            memset ((void *)MODEL_Backing (BURTC), 0, MODEL_Burtc.size);
+            MODEL_BurtcReset ();
+        }
+        MODEL_REG (RMU->CTRL) = value & _RMU_CTRL_MASK;
+    } else if (reg == &RMU->CMD) {
+        if (value & RMU_CMD_RCCLR) {
+            MODEL_REG (RMU->RSTCAUSE) = 0;
+        }
+    }
+}
+
+
+static void MODEL_RmuPresent (void)
+{
+    MODEL_REG (RMU->CMD) = 0;
+}
+
+
+ModelPeriph MODEL_Rmu = {
+    .name       = "RMU",
+    .base       = RMU_BASE,
+    .size       = 0x400,
+    .irq        = { -1, -1 },
+    .backup     = 1,
+    .reset      = MODEL_RmuReset,
+    .present    = MODEL_RmuPresent,
+    .write      = MODEL_RmuWrite,
+};
@@ -0,0 +1,461 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "model.h"
+
+/** Oscillators with enable and ready bits in OSCENCMD and STATUS */
+#define CMU_SWITCHED_OSCS       (MODEL_LFXO + 1)
+
+#define CMU_STATUS_ENS(osc)     (1U << (2 * (osc)))
+#define CMU_STATUS_RDY(osc)     (2U << (2 * (osc)))
+#define CMU_STATUS_SEL_MASK     (CMU_STATUS_HFRCOSEL | CMU_STATUS_HFXOSEL | \
+                                 CMU_STATUS_LFRCOSEL | CMU_STATUS_LFXOSEL)
+
+typedef struct {
+    int         em;
+    ModelTime   startup[CMU_SWITCHED_OSCS]; // Left until ready, 0 if ready or off
+    int         cal_busy;
+    uint32_t    cal_down;
+    uint32_t    cal_up;
+    ModelPhase  cal_down_phase;
+    ModelPhase  cal_up_phase;
+} CmuModel;
+
+static CmuModel CmuMdl;
+
+static const uint32_t CmuReadyFlags[CMU_SWITCHED_OSCS] = {
+    [MODEL_HFRCO]       = CMU_IF_HFRCORDY,
+    [MODEL_HFXO]        = CMU_IF_HFXORDY,
+    [MODEL_AUXHFRCO]    = CMU_IF_AUXHFRCORDY,
+    [MODEL_LFRCO]       = CMU_IF_LFRCORDY,
+    [MODEL_LFXO]        = CMU_IF_LFXORDY,
+};
+
+/** HFCLK selections of CMD and STATUS, in the order of CMD HFCLKSEL */
+static const ModelOsc CmuHfclkOscs[] = { MODEL_HFRCO, MODEL_HFXO, MODEL_LFRCO, MODEL_LFXO };
+static const uint32_t CmuHfclkStatus[] = {
+    CMU_STATUS_HFRCOSEL, CMU_STATUS_HFXOSEL, CMU_STATUS_LFRCOSEL, CMU_STATUS_LFXOSEL
+};
+
+
+int MODEL_EnergyMode (void)
+{
+    return CmuMdl.em;
+}
+
+
+static uint32_t MODEL_HfrcoHz (void)
+{
+    switch ((MODEL_REG (CMU->HFRCOCTRL) & _CMU_HFRCOCTRL_BAND_MASK) >> _CMU_HFRCOCTRL_BAND_SHIFT) {
+        case _CMU_HFRCOCTRL_BAND_1MHZ:  return 1000000;
+        case _CMU_HFRCOCTRL_BAND_7MHZ:  return 7000000;
+        case _CMU_HFRCOCTRL_BAND_11MHZ: return 11000000;
+        case _CMU_HFRCOCTRL_BAND_14MHZ: return 14000000;
+        case _CMU_HFRCOCTRL_BAND_21MHZ: return 21000000;
+        case _CMU_HFRCOCTRL_BAND_28MHZ: return 28000000;
+        default:                        return 0;
+    }
+}
+
+
+/**
+ * @brief  Frequency of a running oscillator with its error, uHz.
+ * @retval 0 if the oscillator is not ready or stopped in EM2.
+ */
+uint64_t MODEL_OscFreq (ModelOsc osc)
+{
+    uint64_t hz;
+
+    if (osc < CMU_SWITCHED_OSCS && !(MODEL_REG (CMU->STATUS) & CMU_STATUS_RDY (osc))) {
+        return 0;
+    }
+
+    switch (osc) {
+        case MODEL_HFRCO:       hz = MODEL_HfrcoHz (); break;
+        case MODEL_HFXO:        hz = MODEL_Conf.hfxo_hz; break;
+        case MODEL_AUXHFRCO:    hz = 14000000; break;
+        case MODEL_LFRCO:       hz = 32768; break;
+        case MODEL_LFXO:        hz = MODEL_Conf.lfxo_hz; break;
+        case MODEL_ULFRCO:      hz = 1000; break;
+        default:                return 0;
+    }
+
+    if (CmuMdl.em == 2 && (osc == MODEL_HFRCO || osc == MODEL_HFXO || osc == MODEL_AUXHFRCO)) {
+        return 0;
+    }
+
+    return hz * 1000000 + (int64_t)hz * MODEL_Conf.error_ppb[osc] / 1000;
+}
+
+
+uint64_t MODEL_HfclkFreq (void)
+{
+    uint32_t status = MODEL_REG (CMU->STATUS);
+    uint32_t div = 1 + ((MODEL_REG (CMU->CTRL) & _CMU_CTRL_HFCLKDIV_MASK) >> _CMU_CTRL_HFCLKDIV_SHIFT);
+    unsigned int i;
+
+    for (i = 0; i < sizeof (CmuHfclkOscs) / sizeof (CmuHfclkOscs[0]); i++) {
+        if (status & CmuHfclkStatus[i]) {
+            return MODEL_OscFreq (CmuHfclkOscs[i]) / div;
+        }
+    }
+
+    return 0;
+}
+
+
+uint64_t MODEL_CoreFreq (void)
+{
+    return MODEL_HfclkFreq () >> (MODEL_REG (CMU->HFCORECLKDIV) & _CMU_HFCORECLKDIV_HFCORECLKDIV_MASK);
+}
+
+
+/**
+ * @brief  HFPERCLK frequency of a peripheral, uHz.
+ * @param  clken Bit of the peripheral in HFPERCLKEN0.
+ */
+uint64_t MODEL_HfperFreq (uint32_t clken)
+{
+    if (!(MODEL_REG (CMU->HFPERCLKDIV) & CMU_HFPERCLKDIV_HFPERCLKEN) ||
+        !(MODEL_REG (CMU->HFPERCLKEN0) & clken)) {
+        return 0;
+    }
+
+    return MODEL_HfclkFreq () >> ((MODEL_REG (CMU->HFPERCLKDIV) & _CMU_HFPERCLKDIV_HFPERCLKDIV_MASK) >>
+                                  _CMU_HFPERCLKDIV_HFPERCLKDIV_SHIFT);
+}
+
+
+/**
+ * @brief  LFACLK frequency of a peripheral, uHz, before its prescaler.
+ * @param  clken Bit of the peripheral in LFACLKEN0.
+ * @param  presc_shift Position of its prescaler in LFAPRESC0.
+ * @param  div Returns the prescaler.
+ */
+uint64_t MODEL_LfaFreq (uint32_t clken, uint32_t presc_shift, uint32_t *div)
+{
+    uint32_t sel = MODEL_REG (CMU->LFCLKSEL);
+
+    *div = 1U << ((MODEL_REG (CMU->LFAPRESC0) >> presc_shift) & 0xF);
+
+    if (!(MODEL_REG (CMU->LFACLKEN0) & clken)) {
+        return 0;
+    }
+
+    switch ((sel & _CMU_LFCLKSEL_LFA_MASK) >> _CMU_LFCLKSEL_LFA_SHIFT) {
+        case _CMU_LFCLKSEL_LFA_LFRCO:
+            return MODEL_OscFreq (MODEL_LFRCO);
+        case _CMU_LFCLKSEL_LFA_LFXO:
+            return MODEL_OscFreq (MODEL_LFXO);
+        case _CMU_LFCLKSEL_LFA_HFCORECLKLEDIV2:
+            return CmuMdl.em == 2 ? 0 : MODEL_CoreFreq () / 2;
+        default:
+            return (sel & CMU_LFCLKSEL_LFAE) ? MODEL_OscFreq (MODEL_ULFRCO) : 0;
+    }
+}
+
+
+int MODEL_LeClocked (void)
+{
+    return (MODEL_REG (CMU->HFCORECLKEN0) & CMU_HFCORECLKEN0_LE) != 0;
+}
+
+
+/**
+ * @brief  Supply current, uA. Approximate EFM32GG datasheet figures.
+ */
+double MODEL_Current (int em)
+{
+    uint32_t status = MODEL_REG (CMU->STATUS);
+    double mhz = MODEL_HfclkFreq () / 1e12;
+    double ua;
+
+    switch (em) {
+        case 0:  ua = 60.0 + 200.0 * mhz; break;
+        case 1:  ua = 30.0 + 50.0 * mhz; break;
+        default: ua = 1.1; break;
+    }
+
+    if (em < 2 && (status & CMU_STATUS_HFXOENS)) {
+        ua += 150.0;
+    }
+    if (status & CMU_STATUS_LFXOENS) {
+        ua += 0.2;
+    }
+    if (status & CMU_STATUS_LFRCOENS) {
+        ua += 0.3;
+    }
+
+    return ua;
+}
+
+
+static void MODEL_CmuSetReady (ModelOsc osc)
+{
+    CmuMdl.startup[osc] = 0;
+    MODEL_REG (CMU->STATUS) |= CMU_STATUS_RDY (osc);
+    MODEL_REG (CMU->IF) |= CmuReadyFlags[osc];
+}
+
+
+static void MODEL_CmuDisable (ModelOsc osc)
+{
+    CmuMdl.startup[osc] = 0;
+    MODEL_REG (CMU->STATUS) &= ~(CMU_STATUS_ENS (osc) | CMU_STATUS_RDY (osc));
+}
+
+
+/**
+ * @brief  Enter an energy mode, 0 when waking up. EM2 stops the HF
+ *         oscillators; HFXO is disabled and HFCLK runs from HFRCO after it.
+ */
+void MODEL_EnterEM (int em)
+{
+    if (em == 2) {
+        MODEL_CmuDisable (MODEL_HFXO);
+        MODEL_CmuDisable (MODEL_AUXHFRCO);
+        MODEL_REG (CMU->STATUS) = (MODEL_REG (CMU->STATUS) & ~CMU_STATUS_SEL_MASK) |
+                                  CMU_STATUS_HFRCOSEL | CMU_STATUS_HFRCOENS | CMU_STATUS_HFRCORDY;
+    }
+
+    CmuMdl.em = em;
+}
+
+
+static void MODEL_CmuReset (void)
+{
+    memset (&CmuMdl, 0, sizeof (CmuMdl));
+
+    MODEL_REG (CMU->CTRL) = _CMU_CTRL_RESETVALUE;
+    MODEL_REG (CMU->HFPERCLKDIV) = _CMU_HFPERCLKDIV_RESETVALUE;
+    MODEL_REG (CMU->HFRCOCTRL) = _CMU_HFRCOCTRL_RESETVALUE;
+    MODEL_REG (CMU->LFRCOCTRL) = _CMU_LFRCOCTRL_RESETVALUE;
+    MODEL_REG (CMU->AUXHFRCOCTRL) = _CMU_AUXHFRCOCTRL_RESETVALUE;
+    MODEL_REG (CMU->LFCLKSEL) = _CMU_LFCLKSEL_RESETVALUE;
+    MODEL_REG (CMU->STATUS) = _CMU_STATUS_RESETVALUE;
+    MODEL_REG (CMU->IF) = _CMU_IF_RESETVALUE;
+    MODEL_REG (CMU->LCDCTRL) = _CMU_LCDCTRL_RESETVALUE;
+}
+
+
+static void MODEL_CmuPresent (void)
+{
+    MODEL_REG (CMU->OSCENCMD) = 0;
+    MODEL_REG (CMU->CMD) = 0;
+    MODEL_REG (CMU->IFS) = 0;
+    MODEL_REG (CMU->IFC) = 0;
+    MODEL_REG (CMU->SYNCBUSY) = 0;
+
+    if (CmuMdl.cal_busy) {
+        MODEL_REG (CMU->CALCNT) = CmuMdl.cal_down;
+    }
+}
+
+
+static void MODEL_CmuOscillators (uint32_t cmd)
+{
+    int osc;
+
+    for (osc = 0; osc < CMU_SWITCHED_OSCS; osc++) {
+        uint32_t status = MODEL_REG (CMU->STATUS);
+
+        if (cmd & (1U << (2 * osc + 1))) {
+            // The oscillator of HFCLK cannot be disabled
+            if ((status & CmuHfclkStatus[0]) && osc == MODEL_HFRCO) {
+                continue;
+            }
+            if ((status & CmuHfclkStatus[1]) && osc == MODEL_HFXO) {
+                continue;
+            }
+            MODEL_CmuDisable (osc);
+        } else if ((cmd & (1U << (2 * osc))) && !(status & CMU_STATUS_ENS (osc))) {
+            MODEL_REG (CMU->STATUS) |= CMU_STATUS_ENS (osc);
+            CmuMdl.startup[osc] = (ModelTime)MODEL_Conf.startup_us[osc] * 1000;
+            if (CmuMdl.startup[osc] == 0) {
+                MODEL_CmuSetReady (osc);
+            }
+        }
+    }
+}
+
+
+static void MODEL_CmuSelect (uint32_t sel)
+{
+    ModelOsc osc;
+
+    if (sel < 1 || sel > 4) {
+        return;
+    }
+    osc = CmuHfclkOscs[sel - 1];
+
+    if (!(MODEL_REG (CMU->STATUS) & CMU_STATUS_ENS (osc))) {
+        fprintf (stderr, "model: HFCLK switched to a disabled oscillator, the core stops\n");
+        abort ();
+    }
+
+    // The core is stalled until the oscillator is ready
+    if (CmuMdl.startup[osc] > 0) {
+        MODEL_Advance (CmuMdl.startup[osc]);
+    }
+
+    MODEL_REG (CMU->STATUS) = (MODEL_REG (CMU->STATUS) & ~CMU_STATUS_SEL_MASK) | CmuHfclkStatus[sel - 1];
+}
+
+
+static uint64_t MODEL_CalFreq (int down)
+{
+    static const ModelOsc up_oscs[] = {
+        [_CMU_CALCTRL_UPSEL_HFXO] = MODEL_HFXO,
+        [_CMU_CALCTRL_UPSEL_LFXO] = MODEL_LFXO,
+        [_CMU_CALCTRL_UPSEL_HFRCO] = MODEL_HFRCO,
+        [_CMU_CALCTRL_UPSEL_LFRCO] = MODEL_LFRCO,
+        [_CMU_CALCTRL_UPSEL_AUXHFRCO] = MODEL_AUXHFRCO,
+    };
+    static const ModelOsc down_oscs[] = {
+        [_CMU_CALCTRL_DOWNSEL_HFXO] = MODEL_HFXO,
+        [_CMU_CALCTRL_DOWNSEL_LFXO] = MODEL_LFXO,
+        [_CMU_CALCTRL_DOWNSEL_HFRCO] = MODEL_HFRCO,
+        [_CMU_CALCTRL_DOWNSEL_LFRCO] = MODEL_LFRCO,
+        [_CMU_CALCTRL_DOWNSEL_AUXHFRCO] = MODEL_AUXHFRCO,
+    };
+    uint32_t ctrl = MODEL_REG (CMU->CALCTRL);
+    uint32_t sel;
+
+    if (down) {
+        sel = (ctrl & _CMU_CALCTRL_DOWNSEL_MASK) >> _CMU_CALCTRL_DOWNSEL_SHIFT;
+        if (sel == _CMU_CALCTRL_DOWNSEL_HFCLK) {
+            return CmuMdl.em == 2 ? 0 : MODEL_HfclkFreq ();
+        }
+        return sel <= _CMU_CALCTRL_DOWNSEL_AUXHFRCO ? MODEL_OscFreq (down_oscs[sel]) : 0;
+    }
+
+    sel = (ctrl & _CMU_CALCTRL_UPSEL_MASK) >> _CMU_CALCTRL_UPSEL_SHIFT;
+    return sel <= _CMU_CALCTRL_UPSEL_AUXHFRCO ? MODEL_OscFreq (up_oscs[sel]) : 0;
+}
+
+
+static void MODEL_CmuWrite (volatile uint32_t *reg, uint32_t old, uint32_t value)
+{
+    if (reg == &CMU->OSCENCMD) {
+        MODEL_CmuOscillators (value);
+    } else if (reg == &CMU->CMD) {
+        MODEL_CmuSelect ((value & _CMU_CMD_HFCLKSEL_MASK) >> _CMU_CMD_HFCLKSEL_SHIFT);
+        if (value & CMU_CMD_CALSTART) {
+            CmuMdl.cal_busy = 1;
+            CmuMdl.cal_down = MODEL_REG (CMU->CALCNT) & _CMU_CALCNT_CALCNT_MASK;
+            CmuMdl.cal_up = 0;
+            memset (&CmuMdl.cal_down_phase, 0, sizeof (ModelPhase));
+            memset (&CmuMdl.cal_up_phase, 0, sizeof (ModelPhase));
+            MODEL_REG (CMU->STATUS) |= CMU_STATUS_CALBSY;
+        }
+        if (value & CMU_CMD_CALSTOP) {
+            CmuMdl.cal_busy = 0;
+            MODEL_REG (CMU->STATUS) &= ~CMU_STATUS_CALBSY;
+        }
+    } else if (reg == &CMU->IFS) {
+        MODEL_REG (CMU->IF) |= value;
+    } else if (reg == &CMU->IFC) {
+        MODEL_REG (CMU->IF) &= ~value;
+    } else if (reg == &CMU->LOCK) {
+        MODEL_REG (CMU->LOCK) = (value == CMU_LOCK_LOCKKEY_UNLOCK) ? 0 : CMU_LOCK_LOCKKEY_LOCKED;
+    } else if (reg == &CMU->STATUS || reg == &CMU->IF || reg == &CMU->SYNCBUSY) {
+        // Read only
+    } else {
+        *MODEL_Backing (reg) = value;
+    }
+}
+
+
+static ModelTime MODEL_CmuNext (void)
+{
+    ModelTime next = MODEL_NEVER;
+    int osc;
+
+    for (osc = 0; osc < CMU_SWITCHED_OSCS; osc++) {
+        if (CmuMdl.startup[osc] > 0 && CmuMdl.startup[osc] < next) {
+            next = CmuMdl.startup[osc];
+        }
+    }
+
+    if (CmuMdl.cal_busy) {
+        ModelTime t = MODEL_TimeTo (&CmuMdl.cal_down_phase, MODEL_CalFreq (1), 1,
+                                    CmuMdl.cal_down ? CmuMdl.cal_down : 1);
+        if (t < next) {
+            next = t;
+        }
+    }
+
+    return next;
+}
+
+
+static void MODEL_CmuAdvance (ModelTime dt)
+{
+    int osc;
+
+    for (osc = 0; osc < CMU_SWITCHED_OSCS; osc++) {
+        if (CmuMdl.startup[osc] > 0) {
+            if (CmuMdl.startup[osc] <= dt) {
+                MODEL_CmuSetReady (osc);
+            } else {
+                CmuMdl.startup[osc] -= dt;
+            }
+        }
+    }
+
+    if (CmuMdl.cal_busy) {
+        uint64_t down = MODEL_Count (&CmuMdl.cal_down_phase, MODEL_CalFreq (1), 1, dt);
+
+        CmuMdl.cal_up += (uint32_t)MODEL_Count (&CmuMdl.cal_up_phase, MODEL_CalFreq (0), 1, dt);
+
+        if (down >= CmuMdl.cal_down) {
+            CmuMdl.cal_busy = 0;
+            MODEL_REG (CMU->STATUS) &= ~CMU_STATUS_CALBSY;
+            MODEL_REG (CMU->CALCNT) = CmuMdl.cal_up & _CMU_CALCNT_CALCNT_MASK;
+            MODEL_REG (CMU->IF) |= CMU_IF_CALRDY;
+            if (CmuMdl.cal_up > _CMU_CALCNT_CALCNT_MASK) {
+                MODEL_REG (CMU->IF) |= CMU_IF_CALOF;
+            }
+        } else {
+            CmuMdl.cal_down -= (uint32_t)down;
+        }
+    }
+}
+
+
+static uint32_t MODEL_CmuLines (void)
+{
+    return (MODEL_REG (CMU->IF) & MODEL_REG (CMU->IEN)) ? 1 : 0;
+}
+
+
+ModelPeriph MODEL_Cmu = {
+    .name       = "CMU",
+    .base       = CMU_BASE,
+    .size       = 0x400,
+    .irq        = { CMU_IRQn, -1 },
+    .reset      = MODEL_CmuReset,
+    .present    = MODEL_CmuPresent,
+    .write      = MODEL_CmuWrite,
+    .next       = MODEL_CmuNext,
+    .advance    = MODEL_CmuAdvance,
+    .lines      = MODEL_CmuLines,
+};
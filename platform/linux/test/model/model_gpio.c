@@ -0,0 +1,229 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "model.h"
+
+#define GPIO_MODEL_PORTS        6
+
+/** Pin modes from 4 on drive the pin */
+#define GPIO_MODEL_OUTPUT       4
+
+typedef struct {
+    uint16_t    ext[GPIO_MODEL_PORTS];  // Level the test drives the pins to
+    uint16_t    din[GPIO_MODEL_PORTS];
+} GpioModel;
+
+static GpioModel GpioMdl;
+
+
+static uint32_t MODEL_GpioMode (unsigned int port, unsigned int pin)
+{
+    uint32_t mode = pin < 8 ? MODEL_REG (GPIO->P[port].MODEL) : MODEL_REG (GPIO->P[port].MODEH);
+
+    return (mode >> (4 * (pin % 8))) & 0xF;
+}
+
+
+/**
+ * @brief  Port of an external interrupt line, the pin with the same number.
+ */
+static unsigned int MODEL_GpioExtiPort (unsigned int line)
+{
+    uint32_t sel = line < 8 ? MODEL_REG (GPIO->EXTIPSELL) : MODEL_REG (GPIO->EXTIPSELH);
+
+    return (sel >> (4 * (line % 8))) & 0x7;
+}
+
+
+/**
+ * @brief  Level of the GPIO PRS signal of a pin number, the pin selected
+ *         for its external interrupt line.
+ */
+int MODEL_GpioPrsLevel (unsigned int pin)
+{
+    unsigned int port = MODEL_GpioExtiPort (pin);
+
+    if (port >= GPIO_MODEL_PORTS || !(MODEL_REG (GPIO->INSENSE) & GPIO_INSENSE_PRS)) {
+        return 0;
+    }
+
+    return (GpioMdl.din[port] >> pin) & 1;
+}
+
+
+/**
+ * @brief  Update the inputs and raise the external interrupts on their
+ *         edges, then let PRS follow.
+ */
+static void MODEL_GpioUpdate (void)
+{
+    uint16_t old[GPIO_MODEL_PORTS];
+    unsigned int port, pin, line;
+    uint32_t mode, level, was;
+
+    memcpy (old, GpioMdl.din, sizeof (old));
+
+    for (port = 0; port < GPIO_MODEL_PORTS; port++) {
+        GpioMdl.din[port] = 0;
+        for (pin = 0; pin < 16; pin++) {
+            mode = MODEL_GpioMode (port, pin);
+            if (mode >= GPIO_MODEL_OUTPUT) {
+                level = (MODEL_REG (GPIO->P[port].DOUT) >> pin) & 1;
+            } else if (mode != 0) {
+                level = (GpioMdl.ext[port] >> pin) & 1;
+            } else {
+                level = 0;
+            }
+            GpioMdl.din[port] |= level << pin;
+        }
+    }
+
+    if (MODEL_REG (GPIO->INSENSE) & GPIO_INSENSE_INT) {
+        for (line = 0; line < 16; line++) {
+            port = MODEL_GpioExtiPort (line);
+            if (port >= GPIO_MODEL_PORTS) {
+                continue;
+            }
+            level = (GpioMdl.din[port] >> line) & 1;
+            was = (old[port] >> line) & 1;
+            if ((level && !was && (MODEL_REG (GPIO->EXTIRISE) & (1U << line))) ||
+                (!level && was && (MODEL_REG (GPIO->EXTIFALL) & (1U << line)))) {
+                MODEL_REG (GPIO->IF) |= 1U << line;
+            }
+        }
+    }
+
+    MODEL_PrsUpdate ();
+}
+
+
+/**
+ * @brief  Drive an input pin from outside, e.g. from a MODEL_At () event.
+ * @param  port GPIO port.
+ * @param  pin Pin number.
+ * @param  level 0 or 1.
+ */
+void MODEL_GpioSet (unsigned int port, unsigned int pin, int level)
+{
+    if (level) {
+        GpioMdl.ext[port] |= 1U << pin;
+    } else {
+        GpioMdl.ext[port] &= ~(1U << pin);
+    }
+
+    MODEL_GpioUpdate ();
+}
+
+
+/**
+ * @brief  Level of a pin, what the pin drives if it is an output.
+ */
+int MODEL_GpioGet (unsigned int port, unsigned int pin)
+{
+    if (MODEL_GpioMode (port, pin) >= GPIO_MODEL_OUTPUT) {
+        return (MODEL_REG (GPIO->P[port].DOUT) >> pin) & 1;
+    }
+
+    return (GpioMdl.ext[port] >> pin) & 1;
+}
+
+
+static void MODEL_GpioReset (void)
+{
+    memset (&GpioMdl, 0, sizeof (GpioMdl));
+
+    MODEL_REG (GPIO->INSENSE) = _GPIO_INSENSE_RESETVALUE;
+}
+
+
+static int MODEL_GpioClocked (void)
+{
+    return MODEL_HfperFreq (CMU_HFPERCLKEN0_GPIO) != 0;
+}
+
+
+static void MODEL_GpioPresent (void)
+{
+    unsigned int port;
+
+    for (port = 0; port < GPIO_MODEL_PORTS; port++) {
+        MODEL_REG (GPIO->P[port].DIN) = GpioMdl.din[port];
+        MODEL_REG (GPIO->P[port].DOUTSET) = 0;
+        MODEL_REG (GPIO->P[port].DOUTCLR) = 0;
+        MODEL_REG (GPIO->P[port].DOUTTGL) = 0;
+    }
+
+    MODEL_REG (GPIO->IFS) = 0;
+    MODEL_REG (GPIO->IFC) = 0;
+}
+
+
+static void MODEL_GpioWrite (volatile uint32_t *reg, uint32_t old, uint32_t value)
+{
+    unsigned int port;
+
+    for (port = 0; port < GPIO_MODEL_PORTS; port++) {
+        if (reg == &GPIO->P[port].DOUTSET) {
+            MODEL_REG (GPIO->P[port].DOUT) |= value & 0xFFFF;
+        } else if (reg == &GPIO->P[port].DOUTCLR) {
+            MODEL_REG (GPIO->P[port].DOUT) &= ~value;
+        } else if (reg == &GPIO->P[port].DOUTTGL) {
+            MODEL_REG (GPIO->P[port].DOUT) ^= value & 0xFFFF;
+        } else if (reg == &GPIO->P[port].DIN) {
+            return;
+        } else {
+            continue;
+        }
+        MODEL_GpioUpdate ();
+        return;
+    }
+
+    if (reg == &GPIO->IFS) {
+        MODEL_REG (GPIO->IF) |= value & 0xFFFF;
+    } else if (reg == &GPIO->IFC) {
+        MODEL_REG (GPIO->IF) &= ~value;
+    } else if (reg != &GPIO->IF) {
+        *MODEL_Backing (reg) = value;
+        MODEL_GpioUpdate ();
+    }
+}
+
+
+/**
+ * @brief  Even pins on the first line, odd on the second.
+ */
+static uint32_t MODEL_GpioLines (void)
+{
+    uint32_t active = MODEL_REG (GPIO->IF) & MODEL_REG (GPIO->IEN);
+
+    return ((active & 0x5555) ? 1 : 0) | ((active & 0xAAAA) ? 2 : 0);
+}
+
+
+ModelPeriph MODEL_Gpio = {
+    .name       = "GPIO",
+    .base       = GPIO_BASE,
+    .size       = 0x400,
+    .irq        = { GPIO_EVEN_IRQn, GPIO_ODD_IRQn },
+    .reset      = MODEL_GpioReset,
+    .clocked    = MODEL_GpioClocked,
+    .present    = MODEL_GpioPresent,
+    .write      = MODEL_GpioWrite,
+    .lines      = MODEL_GpioLines,
+};
@@ -0,0 +1,133 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "model.h"
+
+typedef struct {
+    uint16_t    level;      // Output of the channels
+} PrsModel;
+
+static PrsModel PrsMdl;
+
+
+/**
+ * @brief  Source signal of a channel, GPIO pins only, XOR SWLEVEL.
+ */
+static int MODEL_PrsSource (unsigned int ch)
+{
+    uint32_t ctrl = MODEL_REG (PRS->CH[ch].CTRL);
+    uint32_t source = (ctrl & _PRS_CH_CTRL_SOURCESEL_MASK) >> _PRS_CH_CTRL_SOURCESEL_SHIFT;
+    uint32_t sig = (ctrl & _PRS_CH_CTRL_SIGSEL_MASK) >> _PRS_CH_CTRL_SIGSEL_SHIFT;
+    int level = 0;
+
+    if (source == _PRS_CH_CTRL_SOURCESEL_GPIOL) {
+        level = MODEL_GpioPrsLevel (sig);
+    } else if (source == _PRS_CH_CTRL_SOURCESEL_GPIOH) {
+        level = MODEL_GpioPrsLevel (sig + 8);
+    }
+
+    return level ^ ((MODEL_REG (PRS->SWLEVEL) >> ch) & 1);
+}
+
+
+/**
+ * @brief  Pass a source edge on to the consumers: as is without edge
+ *         detection, else as a pulse of the selected edges.
+ */
+static void MODEL_PrsEdge (unsigned int ch, int level)
+{
+    uint32_t edsel = (MODEL_REG (PRS->CH[ch].CTRL) & _PRS_CH_CTRL_EDSEL_MASK) >> _PRS_CH_CTRL_EDSEL_SHIFT;
+
+    if (edsel == _PRS_CH_CTRL_EDSEL_OFF) {
+        MODEL_TimerPrsEdge (ch, level);
+    } else if ((edsel == _PRS_CH_CTRL_EDSEL_BOTHEDGES) ||
+               (edsel == _PRS_CH_CTRL_EDSEL_POSEDGE && level) ||
+               (edsel == _PRS_CH_CTRL_EDSEL_NEGEDGE && !level)) {
+        MODEL_TimerPrsEdge (ch, 1);
+        MODEL_TimerPrsEdge (ch, 0);
+    }
+}
+
+
+/**
+ * @brief  Follow the sources of the channels, called when a source
+ *         may have changed.
+ */
+void MODEL_PrsUpdate (void)
+{
+    unsigned int ch;
+    int level;
+
+    for (ch = 0; ch < PRS_CHAN_COUNT; ch++) {
+        level = MODEL_PrsSource (ch);
+        if (level != ((PrsMdl.level >> ch) & 1)) {
+            PrsMdl.level ^= 1U << ch;
+            MODEL_PrsEdge (ch, level);
+        }
+    }
+}
+
+
+static void MODEL_PrsReset (void)
+{
+    memset (&PrsMdl, 0, sizeof (PrsMdl));
+}
+
+
+static int MODEL_PrsClocked (void)
+{
+    return MODEL_HfperFreq (CMU_HFPERCLKEN0_PRS) != 0;
+}
+
+
+static void MODEL_PrsPresent (void)
+{
+    MODEL_REG (PRS->SWPULSE) = 0;
+}
+
+
+static void MODEL_PrsWrite (volatile uint32_t *reg, uint32_t old, uint32_t value)
+{
+    unsigned int ch;
+
+    if (reg == &PRS->SWPULSE) {
+        for (ch = 0; ch < PRS_CHAN_COUNT; ch++) {
+            if (value & (1U << ch)) {
+                MODEL_TimerPrsEdge (ch, 1);
+                MODEL_TimerPrsEdge (ch, 0);
+            }
+        }
+        return;
+    }
+
+    *MODEL_Backing (reg) = value;
+    MODEL_PrsUpdate ();
+}
+
+
+ModelPeriph MODEL_Prs = {
+    .name       = "PRS",
+    .base       = PRS_BASE,
+    .size       = 0x400,
+    .irq        = { -1, -1 },
+    .reset      = MODEL_PrsReset,
+    .clocked    = MODEL_PrsClocked,
+    .present    = MODEL_PrsPresent,
+    .write      = MODEL_PrsWrite,
+};
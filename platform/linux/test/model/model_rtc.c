@@ -0,0 +1,209 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "model.h"
+
+#define RTC_MODEL_WRAP          (_RTC_CNT_MASK + 1ULL)
+
+typedef struct {
+    ModelPhase  phase;
+    uint32_t    cnt;
+} RtcModel;
+
+static RtcModel RtcMdl;
+
+
+static uint64_t MODEL_RtcFreq (uint32_t *div)
+{
+    uint64_t freq = MODEL_LfaFreq (CMU_LFACLKEN0_RTC, _CMU_LFAPRESC0_RTC_SHIFT, div);
+
+    return (MODEL_REG (RTC->CTRL) & RTC_CTRL_EN) ? freq : 0;
+}
+
+
+/**
+ * @brief  Counter period, COMP0 + 1 in COMP0TOP mode.
+ */
+static uint64_t MODEL_RtcPeriod (void)
+{
+    if (MODEL_REG (RTC->CTRL) & RTC_CTRL_COMP0TOP) {
+        return MODEL_REG (RTC->COMP0) + 1ULL;
+    }
+
+    return RTC_MODEL_WRAP;
+}
+
+
+/**
+ * @brief  Ticks from now until the counter reaches value, a full period
+ *         if it is there already.
+ */
+static uint64_t MODEL_RtcTicksTo (uint32_t value)
+{
+    uint64_t period = MODEL_RtcPeriod ();
+    uint64_t ticks = (value + period - RtcMdl.cnt) % period;
+
+    return ticks ? ticks : period;
+}
+
+
+/**
+ * @brief  Ticks from now until the flags set.
+ */
+static uint64_t MODEL_RtcTicksToFlags (uint32_t flags)
+{
+    uint64_t ticks = UINT64_MAX;
+    uint64_t t;
+
+    if (flags & RTC_IF_COMP0) {
+        ticks = MODEL_RtcTicksTo (MODEL_REG (RTC->COMP0));
+    }
+    if (flags & RTC_IF_COMP1) {
+        t = MODEL_RtcTicksTo (MODEL_REG (RTC->COMP1));
+        ticks = t < ticks ? t : ticks;
+    }
+    if ((flags & RTC_IF_OF) && !(MODEL_REG (RTC->CTRL) & RTC_CTRL_COMP0TOP)) {
+        t = RTC_MODEL_WRAP - RtcMdl.cnt;
+        ticks = t < ticks ? t : ticks;
+    }
+
+    return ticks;
+}
+
+
+static void MODEL_RtcReset (void)
+{
+    memset (&RtcMdl, 0, sizeof (RtcMdl));
+}
+
+
+static int MODEL_RtcClocked (void)
+{
+    return MODEL_LeClocked () && (MODEL_REG (CMU->LFACLKEN0) & CMU_LFACLKEN0_RTC);
+}
+
+
+static void MODEL_RtcPresent (void)
+{
+    MODEL_REG (RTC->CNT) = RtcMdl.cnt;
+    MODEL_REG (RTC->IFS) = 0;
+    MODEL_REG (RTC->IFC) = 0;
+    MODEL_REG (RTC->SYNCBUSY) = 0;
+}
+
+
+static void MODEL_RtcWrite (volatile uint32_t *reg, uint32_t old, uint32_t value)
+{
+    if (reg == &RTC->CTRL) {
+        // Disabling resets the counter
+        if (!(value & RTC_CTRL_EN)) {
+            RtcMdl.cnt = 0;
+            memset (&RtcMdl.phase, 0, sizeof (RtcMdl.phase));
+        }
+        MODEL_REG (RTC->CTRL) = value & _RTC_CTRL_MASK;
+    } else if (reg == &RTC->CNT) {
+        RtcMdl.cnt = value & _RTC_CNT_MASK;
+    } else if (reg == &RTC->COMP0 || reg == &RTC->COMP1) {
+        *MODEL_Backing (reg) = value & _RTC_COMP0_MASK;
+    } else if (reg == &RTC->IFS) {
+        MODEL_REG (RTC->IF) |= value & _RTC_IF_MASK;
+    } else if (reg == &RTC->IFC) {
+        MODEL_REG (RTC->IF) &= ~value;
+    } else if (reg == &RTC->IEN || reg == &RTC->FREEZE) {
+        *MODEL_Backing (reg) = value;
+    }
+}
+
+
+static ModelTime MODEL_RtcNext (void)
+{
+    uint32_t div;
+    uint64_t freq = MODEL_RtcFreq (&div);
+    uint32_t ien = MODEL_REG (RTC->IEN) & ~MODEL_REG (RTC->IF);
+
+    if (freq == 0 || ien == 0) {
+        return MODEL_NEVER;
+    }
+
+    return MODEL_TimeTo (&RtcMdl.phase, freq, div, MODEL_RtcTicksToFlags (ien));
+}
+
+
+static ModelTime MODEL_RtcChanges (volatile uint32_t *reg)
+{
+    uint32_t div;
+    uint64_t freq = MODEL_RtcFreq (&div);
+
+    if (reg == &RTC->CNT) {
+        return MODEL_TimeTo (&RtcMdl.phase, freq, div, 1);
+    } else if (reg == &RTC->IF) {
+        return MODEL_TimeTo (&RtcMdl.phase, freq, div, MODEL_RtcTicksToFlags (_RTC_IF_MASK));
+    }
+
+    return MODEL_NEVER;
+}
+
+
+static void MODEL_RtcAdvance (ModelTime dt)
+{
+    uint32_t div;
+    uint64_t freq = MODEL_RtcFreq (&div);
+    uint64_t ticks = MODEL_Count (&RtcMdl.phase, freq, div, dt);
+    uint64_t period = MODEL_RtcPeriod ();
+    uint32_t flags = 0;
+
+    if (ticks == 0) {
+        return;
+    }
+
+    if (ticks >= MODEL_RtcTicksTo (MODEL_REG (RTC->COMP0))) {
+        flags |= RTC_IF_COMP0;
+    }
+    if (ticks >= MODEL_RtcTicksTo (MODEL_REG (RTC->COMP1))) {
+        flags |= RTC_IF_COMP1;
+    }
+    if (!(MODEL_REG (RTC->CTRL) & RTC_CTRL_COMP0TOP) && ticks >= RTC_MODEL_WRAP - RtcMdl.cnt) {
+        flags |= RTC_IF_OF;
+    }
+
+    RtcMdl.cnt = (uint32_t)((RtcMdl.cnt + ticks) % period);
+    MODEL_REG (RTC->IF) |= flags;
+}
+
+
+static uint32_t MODEL_RtcLines (void)
+{
+    return (MODEL_REG (RTC->IF) & MODEL_REG (RTC->IEN)) ? 1 : 0;
+}
+
+
+ModelPeriph MODEL_Rtc = {
+    .name       = "RTC",
+    .base       = RTC_BASE,
+    .size       = 0x400,
+    .irq        = { RTC_IRQn, -1 },
+    .reset      = MODEL_RtcReset,
+    .clocked    = MODEL_RtcClocked,
+    .present    = MODEL_RtcPresent,
+    .write      = MODEL_RtcWrite,
+    .next       = MODEL_RtcNext,
+    .changes    = MODEL_RtcChanges,
+    .advance    = MODEL_RtcAdvance,
+    .lines      = MODEL_RtcLines,
+};
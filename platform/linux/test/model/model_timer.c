@@ -0,0 +1,411 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "model.h"
+
+#define TIMER_MODEL_COUNT       4
+#define TIMER_MODEL_CC          3
+
+typedef struct {
+    ModelPhase  phase;
+    uint32_t    cnt;
+    int         running;
+    uint32_t    capture[TIMER_MODEL_CC][2]; // Input capture buffer, oldest first
+    int         captures[TIMER_MODEL_CC];
+    uint32_t    edges[TIMER_MODEL_CC];      // For ICEVCTRL EVERYSECONDEDGE
+} TimerModel;
+
+static TimerModel TimerMdl[TIMER_MODEL_COUNT];
+
+static TIMER_TypeDef *const TimerRegs[TIMER_MODEL_COUNT] = { TIMER0, TIMER1, TIMER2, TIMER3 };
+
+static const uint32_t TimerClken[TIMER_MODEL_COUNT] = {
+    CMU_HFPERCLKEN0_TIMER0, CMU_HFPERCLKEN0_TIMER1, CMU_HFPERCLKEN0_TIMER2, CMU_HFPERCLKEN0_TIMER3
+};
+
+
+static uint32_t MODEL_TimerMode (int n)
+{
+    return (MODEL_REG (TimerRegs[n]->CTRL) & _TIMER_CTRL_MODE_MASK) >> _TIMER_CTRL_MODE_SHIFT;
+}
+
+
+static uint32_t MODEL_TimerClksel (int n)
+{
+    return (MODEL_REG (TimerRegs[n]->CTRL) & _TIMER_CTRL_CLKSEL_MASK) >> _TIMER_CTRL_CLKSEL_SHIFT;
+}
+
+
+static uint64_t MODEL_TimerPeriod (int n)
+{
+    return (MODEL_REG (TimerRegs[n]->TOP) & 0xFFFF) + 1ULL;
+}
+
+
+static uint32_t MODEL_TimerCcMode (int n, int i)
+{
+    return (MODEL_REG (TimerRegs[n]->CC[i].CTRL) & _TIMER_CC_CTRL_MODE_MASK) >> _TIMER_CC_CTRL_MODE_SHIFT;
+}
+
+
+/**
+ * @brief  Ticks from now until the counter reaches value, a full period
+ *         if it is there already.
+ */
+static uint64_t MODEL_TimerTicksTo (int n, uint32_t value)
+{
+    uint64_t period = MODEL_TimerPeriod (n);
+    uint64_t ticks;
+
+    if (MODEL_TimerMode (n) == _TIMER_CTRL_MODE_DOWN) {
+        ticks = (TimerMdl[n].cnt + period - value) % period;
+    } else {
+        ticks = (value + period - TimerMdl[n].cnt) % period;
+    }
+
+    return ticks ? ticks : period;
+}
+
+
+/**
+ * @brief  Ticks from now until the counter wraps: overflows in UP mode,
+ *         underflows in DOWN mode.
+ */
+static uint64_t MODEL_TimerTicksToWrap (int n)
+{
+    if (MODEL_TimerMode (n) == _TIMER_CTRL_MODE_DOWN) {
+        return TimerMdl[n].cnt + 1ULL;
+    }
+
+    return MODEL_TimerPeriod (n) - TimerMdl[n].cnt;
+}
+
+
+/**
+ * @brief  Time until the timer has counted the ticks. A timer clocked by
+ *         the overflows of the one below it follows that one.
+ */
+static ModelTime MODEL_TimerTimeTo (int n, uint64_t ticks)
+{
+    uint32_t ctrl = MODEL_REG (TimerRegs[n]->CTRL);
+    uint64_t lower;
+
+    if (!TimerMdl[n].running) {
+        return MODEL_NEVER;
+    }
+
+    switch (MODEL_TimerClksel (n)) {
+        case _TIMER_CTRL_CLKSEL_PRESCHFPERCLK:
+            return MODEL_TimeTo (&TimerMdl[n].phase, MODEL_HfperFreq (TimerClken[n]),
+                                 1U << ((ctrl & _TIMER_CTRL_PRESC_MASK) >> _TIMER_CTRL_PRESC_SHIFT), ticks);
+        case _TIMER_CTRL_CLKSEL_TIMEROUF:
+            if (n == 0) {
+                return MODEL_NEVER;
+            }
+            lower = MODEL_TimerTicksToWrap (n - 1) + (ticks - 1) * MODEL_TimerPeriod (n - 1);
+            return MODEL_TimerTimeTo (n - 1, lower);
+        default:
+            return MODEL_NEVER;
+    }
+}
+
+
+/**
+ * @brief  Ticks from now until the flags set, UINT64_MAX if counting
+ *         does not set them.
+ */
+static uint64_t MODEL_TimerTicksToFlags (int n, uint32_t flags)
+{
+    uint64_t ticks = UINT64_MAX;
+    uint64_t t;
+    int i;
+
+    if (flags & (TIMER_IF_OF | TIMER_IF_UF)) {
+        ticks = MODEL_TimerTicksToWrap (n);
+    }
+
+    for (i = 0; i < TIMER_MODEL_CC; i++) {
+        if ((flags & (TIMER_IF_CC0 << i)) && MODEL_TimerCcMode (n, i) == _TIMER_CC_CTRL_MODE_OUTPUTCOMPARE) {
+            t = MODEL_TimerTicksTo (n, MODEL_REG (TimerRegs[n]->CC[i].CCV));
+            ticks = t < ticks ? t : ticks;
+        }
+    }
+
+    return ticks;
+}
+
+
+/**
+ * @brief  Count ticks, raising the flags on the way, and clock the timer
+ *         above with the wraps.
+ */
+static void MODEL_TimerCount (int n, uint64_t ticks)
+{
+    uint64_t period = MODEL_TimerPeriod (n);
+    uint64_t wraps = 0;
+    uint32_t flags = 0;
+    int i;
+
+    if (ticks == 0 || !TimerMdl[n].running) {
+        return;
+    }
+
+    for (i = 0; i < TIMER_MODEL_CC; i++) {
+        if (MODEL_TimerCcMode (n, i) == _TIMER_CC_CTRL_MODE_OUTPUTCOMPARE &&
+            ticks >= MODEL_TimerTicksTo (n, MODEL_REG (TimerRegs[n]->CC[i].CCV))) {
+            flags |= TIMER_IF_CC0 << i;
+        }
+    }
+
+    if (ticks >= MODEL_TimerTicksToWrap (n)) {
+        wraps = 1 + (ticks - MODEL_TimerTicksToWrap (n)) / period;
+    }
+
+    if (MODEL_TimerMode (n) == _TIMER_CTRL_MODE_DOWN) {
+        TimerMdl[n].cnt = (uint32_t)((TimerMdl[n].cnt + period - ticks % period) % period);
+        flags |= wraps ? TIMER_IF_UF : 0;
+    } else {
+        TimerMdl[n].cnt = (uint32_t)((TimerMdl[n].cnt + ticks) % period);
+        flags |= wraps ? TIMER_IF_OF : 0;
+    }
+
+    MODEL_REG (TimerRegs[n]->IF) |= flags;
+
+    if (wraps && n + 1 < TIMER_MODEL_COUNT && MODEL_TimerClksel (n + 1) == _TIMER_CTRL_CLKSEL_TIMEROUF) {
+        MODEL_TimerCount (n + 1, wraps);
+    }
+}
+
+
+/**
+ * @brief  A PRS channel changed level: the input capture channels of the
+ *         running timers listening to it capture the counter. A capture
+ *         into a full buffer replaces the newer value and sets ICBOF.
+ * @param  prs PRS channel.
+ * @param  level New level.
+ */
+void MODEL_TimerPrsEdge (unsigned int prs, int level)
+{
+    uint32_t ctrl, edge, evctrl;
+    TimerModel *t;
+    int n, i;
+
+    for (n = 0; n < TIMER_MODEL_COUNT; n++) {
+
+        t = &TimerMdl[n];
+        if (MODEL_HfperFreq (TimerClken[n]) == 0) {
+            continue;
+        }
+
+        for (i = 0; i < TIMER_MODEL_CC; i++) {
+
+            ctrl = MODEL_REG (TimerRegs[n]->CC[i].CTRL);
+            if (MODEL_TimerCcMode (n, i) != _TIMER_CC_CTRL_MODE_INPUTCAPTURE ||
+                !(ctrl & TIMER_CC_CTRL_INSEL) ||
+                ((ctrl & _TIMER_CC_CTRL_PRSSEL_MASK) >> _TIMER_CC_CTRL_PRSSEL_SHIFT) != prs) {
+                continue;
+            }
+
+            edge = (ctrl & _TIMER_CC_CTRL_ICEDGE_MASK) >> _TIMER_CC_CTRL_ICEDGE_SHIFT;
+            if (edge == _TIMER_CC_CTRL_ICEDGE_NONE ||
+                (edge == _TIMER_CC_CTRL_ICEDGE_RISING && !level) ||
+                (edge == _TIMER_CC_CTRL_ICEDGE_FALLING && level)) {
+                continue;
+            }
+
+            if (t->captures[i] < 2) {
+                t->capture[i][t->captures[i]++] = t->cnt;
+            } else {
+                t->capture[i][1] = t->cnt;
+                MODEL_REG (TimerRegs[n]->IF) |= TIMER_IF_ICBOF0 << i;
+            }
+
+            evctrl = (ctrl & _TIMER_CC_CTRL_ICEVCTRL_MASK) >> _TIMER_CC_CTRL_ICEVCTRL_SHIFT;
+            if ((evctrl == _TIMER_CC_CTRL_ICEVCTRL_EVERYEDGE) ||
+                (evctrl == _TIMER_CC_CTRL_ICEVCTRL_EVERYSECONDEDGE && (++t->edges[i] & 1) == 0) ||
+                (evctrl == _TIMER_CC_CTRL_ICEVCTRL_RISING && level) ||
+                (evctrl == _TIMER_CC_CTRL_ICEVCTRL_FALLING && !level)) {
+                MODEL_REG (TimerRegs[n]->IF) |= TIMER_IF_CC0 << i;
+            }
+        }
+    }
+}
+
+
+static void MODEL_TimerReset (int n)
+{
+    memset (&TimerMdl[n], 0, sizeof (TimerModel));
+
+    MODEL_REG (TimerRegs[n]->TOP) = _TIMER_TOP_RESETVALUE;
+}
+
+
+static int MODEL_TimerClocked (int n)
+{
+    return MODEL_HfperFreq (TimerClken[n]) != 0;
+}
+
+
+static void MODEL_TimerPresent (int n)
+{
+    TimerModel *t = &TimerMdl[n];
+    uint32_t status = t->running ? TIMER_STATUS_RUNNING : 0;
+    int i;
+
+    if (MODEL_TimerMode (n) == _TIMER_CTRL_MODE_DOWN) {
+        status |= TIMER_STATUS_DIR_DOWN;
+    }
+
+    for (i = 0; i < TIMER_MODEL_CC; i++) {
+        if (MODEL_TimerCcMode (n, i) != _TIMER_CC_CTRL_MODE_INPUTCAPTURE) {
+            MODEL_REG (TimerRegs[n]->CC[i].CCVP) = MODEL_REG (TimerRegs[n]->CC[i].CCV);
+            continue;
+        }
+        if (t->captures[i] > 0) {
+            status |= TIMER_STATUS_ICV0 << i;
+        }
+        if (t->captures[i] > 1) {
+            status |= TIMER_STATUS_CCVBV0 << i;
+        }
+        MODEL_REG (TimerRegs[n]->CC[i].CCV) = t->capture[i][0];
+        MODEL_REG (TimerRegs[n]->CC[i].CCVP) = t->capture[i][0];
+        MODEL_REG (TimerRegs[n]->CC[i].CCVB) = t->capture[i][1];
+    }
+
+    MODEL_REG (TimerRegs[n]->CNT) = t->cnt;
+    MODEL_REG (TimerRegs[n]->STATUS) = status;
+    MODEL_REG (TimerRegs[n]->CMD) = 0;
+    MODEL_REG (TimerRegs[n]->IFS) = 0;
+    MODEL_REG (TimerRegs[n]->IFC) = 0;
+}
+
+
+static void MODEL_TimerWrite (int n, volatile uint32_t *reg, uint32_t old, uint32_t value)
+{
+    TIMER_TypeDef *timer = TimerRegs[n];
+    TimerModel *t = &TimerMdl[n];
+
+    if (reg == &timer->CMD) {
+        if (value & TIMER_CMD_START) {
+            t->running = 1;
+        }
+        if (value & TIMER_CMD_STOP) {
+            t->running = 0;
+        }
+    } else if (reg == &timer->CTRL) {
+        MODEL_REG (timer->CTRL) = value & _TIMER_CTRL_MASK;
+    } else if (reg == &timer->CNT) {
+        t->cnt = value & 0xFFFF;
+    } else if (reg == &timer->TOP || reg == &timer->TOPB) {
+        MODEL_REG (timer->TOP) = value & 0xFFFF;
+    } else if (reg == &timer->IFS) {
+        MODEL_REG (timer->IF) |= value & _TIMER_IF_MASK;
+    } else if (reg == &timer->IFC) {
+        MODEL_REG (timer->IF) &= ~value;
+    } else if (reg == &timer->STATUS || reg == &timer->IF) {
+        // Read only
+    } else {
+        *MODEL_Backing (reg) = value;
+    }
+}
+
+
+/**
+ * @brief  Reading CCV of an input capture channel takes the oldest
+ *         capture out of the buffer.
+ */
+static void MODEL_TimerRead (int n, volatile uint32_t *reg)
+{
+    TimerModel *t = &TimerMdl[n];
+    int i;
+
+    for (i = 0; i < TIMER_MODEL_CC; i++) {
+        if (reg == &TimerRegs[n]->CC[i].CCV && MODEL_TimerCcMode (n, i) == _TIMER_CC_CTRL_MODE_INPUTCAPTURE &&
+            t->captures[i] > 0) {
+            t->capture[i][0] = t->capture[i][1];
+            t->captures[i]--;
+        }
+    }
+}
+
+
+/**
+ * @brief  Time until counting sets one of the flags.
+ */
+static ModelTime MODEL_TimerTimeToFlags (int n, uint32_t flags)
+{
+    uint64_t ticks = MODEL_TimerTicksToFlags (n, flags);
+
+    return ticks == UINT64_MAX ? MODEL_NEVER : MODEL_TimerTimeTo (n, ticks);
+}
+
+
+static ModelTime MODEL_TimerNext (int n)
+{
+    uint32_t ien = MODEL_REG (TimerRegs[n]->IEN) & ~MODEL_REG (TimerRegs[n]->IF);
+
+    if (ien == 0) {
+        return MODEL_NEVER;
+    }
+
+    return MODEL_TimerTimeToFlags (n, ien);
+}
+
+
+static ModelTime MODEL_TimerChanges (int n, volatile uint32_t *reg)
+{
+    if (reg == &TimerRegs[n]->CNT) {
+        return MODEL_TimerTimeTo (n, 1);
+    } else if (reg == &TimerRegs[n]->IF) {
+        return MODEL_TimerTimeToFlags (n, _TIMER_IF_MASK);
+    }
+
+    return MODEL_NEVER;
+}
+
+
+static void MODEL_TimerAdvance (int n, ModelTime dt)
+{
+    uint32_t ctrl = MODEL_REG (TimerRegs[n]->CTRL);
+    uint64_t ticks;
+
+    // Cascaded timers count in the advance of the one below
+    if (!TimerMdl[n].running || MODEL_TimerClksel (n) != _TIMER_CTRL_CLKSEL_PRESCHFPERCLK) {
+        return;
+    }
+
+    ticks = MODEL_Count (&TimerMdl[n].phase, MODEL_HfperFreq (TimerClken[n]),
+                         1U << ((ctrl & _TIMER_CTRL_PRESC_MASK) >> _TIMER_CTRL_PRESC_SHIFT), dt);
+    MODEL_TimerCount (n, ticks);
+}
+
+
+static uint32_t MODEL_TimerLines (int n)
+{
+    return (MODEL_REG (TimerRegs[n]->IF) & MODEL_REG (TimerRegs[n]->IEN)) ? 1 : 0;
+}
+
+
+/* The handlers of the model take no instance, one set per timer */
+#define MODEL_TIMER(n)     static void MODEL_Timer##n##Reset (void) { MODEL_TimerReset (n); }     static int MODEL_Timer##n##Clocked (void) { return MODEL_TimerClocked (n); }     static void MODEL_Timer##n##Present (void) { MODEL_TimerPresent (n); }     static void MODEL_Timer##n##Write (volatile uint32_t *reg, uint32_t old, uint32_t value)         { MODEL_TimerWrite (n, reg, old, value); }     static void MODEL_Timer##n##Read (volatile uint32_t *reg) { MODEL_TimerRead (n, reg); }     static ModelTime MODEL_Timer##n##Next (void) { return MODEL_TimerNext (n); }     static ModelTime MODEL_Timer##n##Changes (volatile uint32_t *reg) { return MODEL_TimerChanges (n, reg); }     static void MODEL_Timer##n##Advance (ModelTime dt) { MODEL_TimerAdvance (n, dt); }     static uint32_t MODEL_Timer##n##Lines (void) { return MODEL_TimerLines (n); }     ModelPeriph MODEL_Timer##n = {         .name       = "TIMER" #n,         .base       = TIMER##n##_BASE,         .size       = 0x400,         .irq        = { TIMER##n##_IRQn, -1 },         .reset      = MODEL_Timer##n##Reset,         .clocked    = MODEL_Timer##n##Clocked,         .present    = MODEL_Timer##n##Present,         .write      = MODEL_Timer##n##Write,         .read       = MODEL_Timer##n##Read,         .next       = MODEL_Timer##n##Next,         .changes    = MODEL_Timer##n##Changes,         .advance    = MODEL_Timer##n##Advance,         .lines      = MODEL_Timer##n##Lines,     };
+
+MODEL_TIMER (0)
+MODEL_TIMER (1)
+MODEL_TIMER (2)
+MODEL_TIMER (3)
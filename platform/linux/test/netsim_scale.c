@@ -0,0 +1,232 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * Scaling of the network simulator over worker threads. A grid of nodes
+ * floods beacons: every node broadcasts one per BENCH_PERIOD_MS, and
+ * forwards the ones it receives while their hop count lasts, doing a
+ * little work per packet. The same network runs on 1 to 8 threads, and
+ * on as many as there are cores if more, each in a child process. The
+ * runs must agree with the one on one thread packet for packet. With fewer
+ * than two cores the threads only take turns, so the runs still check the
+ * agreement but no speedup is printed; the wall times then show the cost of
+ * the window synchronization alone.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <protothreads.h>
+#include <systimer.h>
+
+#include "netsim.h"
+#include "systime_sim.h"
+
+#define BENCH_NODES         1024
+#define BENCH_RUN_S         10
+#define BENCH_PERIOD_MS     100
+#define BENCH_HOPS          2
+
+/** Rounds of the hash per received packet */
+#define BENCH_WORK          200
+
+typedef struct {
+    uint32_t    origin;
+    uint32_t    seq;
+    uint8_t     hops;
+} BenchBeacon;
+
+typedef struct {
+    SYSTIMER    timer;
+    uint32_t    seq;
+    uint32_t    hash;
+} BenchNode;
+
+/** Run on one thread, shared with the children */
+typedef struct {
+    uint64_t    wall_ns;
+    uint64_t    sent;
+    uint64_t    received;
+    int         scaling;        // More than one core to scale over
+} BenchBase;
+
+static BenchNode Nodes[BENCH_NODES];
+
+PROCESS (BENCH_Main, "Beacons");
+
+
+static int BENCH_Beacon (void *arg)
+{
+    process_poll ((struct process *)arg);
+
+    return 0;
+}
+
+
+static void BENCH_Work (BenchNode *self, const BenchBeacon *b)
+{
+    uint32_t h = self->hash ^ b->origin ^ b->seq;
+    int i;
+
+    for (i = 0; i < BENCH_WORK; i++) {
+        h = (h ^ (h >> 15)) * 0x2C1B3C6DU;
+    }
+    self->hash = h;
+}
+
+
+PROCESS_THREAD (BENCH_Main, ev, data)
+{
+    // Shared by the nodes, see netsim.h
+    BenchNode *self = NETSIM_Self ()->arg;
+    BenchBeacon beacon;
+
+    PROCESS_BEGIN ();
+
+    NETSIM_Listen (PROCESS_CURRENT ());
+
+    // Spread the beacons of the nodes over the period
+    SYSTIMER_Init (&self->timer, 1 + NETSIM_Self ()->id % BENCH_PERIOD_MS, BENCH_PERIOD_MS,
+                   BENCH_Beacon, PROCESS_CURRENT ());
+
+    while (1) {
+        PROCESS_WAIT_EVENT ();
+
+        if (ev == PROCESS_EVENT_POLL) {
+            beacon.origin = NETSIM_Self ()->id;
+            beacon.seq = self->seq++;
+            beacon.hops = BENCH_HOPS;
+            NETSIM_Send (NETSIM_BROADCAST, &beacon, sizeof (beacon));
+        } else if (ev == NETSIM_Event) {
+            beacon = *(BenchBeacon *)((NetsimPacket *)data)->data;
+            BENCH_Work (self, &beacon);
+            if (beacon.hops-- > 1) {
+                NETSIM_Send (NETSIM_BROADCAST, &beacon, sizeof (beacon));
+            }
+        }
+    }
+
+    PROCESS_END ();
+}
+
+
+/**
+ * @brief  Build the grid of NETSIM_Grid (), with the state of every node.
+ */
+static int BENCH_Grid (void)
+{
+    NetsimNode *grid[BENCH_NODES];
+    unsigned int width = 1, i;
+
+    while (width * width < BENCH_NODES) {
+        width++;
+    }
+
+    for (i = 0; i < BENCH_NODES; i++) {
+        grid[i] = NETSIM_AddNode (&BENCH_Main, &Nodes[i]);
+        if (grid[i] == NULL ||
+            (i % width != 0 && NETSIM_Link (grid[i - 1], grid[i], NETSIM_CONF_LATENCY_US, NETSIM_CONF_LOSS_PPM) != 0) ||
+            (i >= width && NETSIM_Link (grid[i - width], grid[i], NETSIM_CONF_LATENCY_US, NETSIM_CONF_LOSS_PPM) != 0)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief  Run the network on the threads, print a line of the table.
+ */
+static int BENCH_Run (unsigned int threads, BenchBase *base)
+{
+    NetsimStats stats;
+
+    SIM_Init (0, 0);
+    if (SYSTIME_Init (SysTimeSim) != 0) {
+        return -1;
+    }
+    process_init ();
+
+    NETSIM_Init (1, threads);
+    if (BENCH_Grid () != 0 || NETSIM_Run (BENCH_RUN_S) != 0) {
+        return -1;
+    }
+    NETSIM_GetStats (&stats);
+
+    if (threads == 1) {
+        base->wall_ns = stats.wall_ns;
+        base->sent = stats.sent;
+        base->received = stats.received;
+    }
+
+    printf ("%7u %10.3f ", stats.threads, stats.wall_ns / 1e9);
+    if (base->scaling) {
+        printf ("%10.2f", (double)base->wall_ns / stats.wall_ns);
+    } else {
+        printf ("%10s", "-");
+    }
+    printf (" %10llu %10llu %10.0f\n",
+            (unsigned long long)stats.sent, (unsigned long long)stats.received,
+            stats.received * 1e9 / stats.wall_ns);
+
+    return stats.sent == base->sent && stats.received == base->received ? 0 : -1;
+}
+
+
+int main (void)
+{
+    long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+    unsigned int threads;
+    BenchBase *base;
+    int status;
+    pid_t pid;
+
+    // Written by the first child
+    base = mmap (NULL, sizeof (*base), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        return 1;
+    }
+
+    base->scaling = cpus >= 2;
+
+    printf ("netsim: %u nodes, %u s simulated, %ld cores\n", BENCH_NODES, BENCH_RUN_S, cpus);
+    if (!base->scaling) {
+        printf ("netsim: single core, the threads do not run in parallel and the speedup is not measured\n");
+    }
+    printf ("%7s %10s %10s %10s %10s %10s\n", "threads", "wall s", "speedup", "sent", "received", "packets/s");
+
+    for (threads = 1; threads <= 8 || threads <= (unsigned long)cpus; threads *= 2) {
+        fflush (stdout);
+        pid = fork ();
+        if (pid == 0) {
+            status = BENCH_Run (threads, base);
+            fflush (stdout);
+            _exit (status == 0 ? 0 : 1);
+        }
+        if (pid < 0 || waitpid (pid, &status, 0) != pid || !WIFEXITED (status) ||
+            WEXITSTATUS (status) != 0) {
+            fprintf (stderr, "netsim: %u threads failed\n", threads);
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,167 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * Cost of resuming a protothread with the local continuations of lc.h,
+ * for threads of 1 to 64 yield points. Built once with lc-switch.h and
+ * once with lc-addrlabels.h. The thread cycles through all its points,
+ * the cost of an empty call is subtracted. Host figures, for comparing
+ * the backends rather than for the cycles on the device.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <pt.h>
+
+#define BENCH_RESUMES       (1UL << 24)
+#define BENCH_ROUNDS        5
+
+#define BENCH_POINT         PT_YIELD (pt); Work++
+
+static volatile uint32_t Work;
+
+/** Static like the pt of a process, GCC warns of a label address kept on the stack */
+static struct pt Pt;
+
+#define BENCH_YIELDS 1
+#define BENCH_NAME BENCH_Thread1
+#include "resume_thread.h"
+#undef BENCH_YIELDS
+#undef BENCH_NAME
+
+#define BENCH_YIELDS 2
+#define BENCH_NAME BENCH_Thread2
+#include "resume_thread.h"
+#undef BENCH_YIELDS
+#undef BENCH_NAME
+
+#define BENCH_YIELDS 4
+#define BENCH_NAME BENCH_Thread4
+#include "resume_thread.h"
+#undef BENCH_YIELDS
+#undef BENCH_NAME
+
+#define BENCH_YIELDS 8
+#define BENCH_NAME BENCH_Thread8
+#include "resume_thread.h"
+#undef BENCH_YIELDS
+#undef BENCH_NAME
+
+#define BENCH_YIELDS 16
+#define BENCH_NAME BENCH_Thread16
+#include "resume_thread.h"
+#undef BENCH_YIELDS
+#undef BENCH_NAME
+
+#define BENCH_YIELDS 32
+#define BENCH_NAME BENCH_Thread32
+#include "resume_thread.h"
+#undef BENCH_YIELDS
+#undef BENCH_NAME
+
+#define BENCH_YIELDS 64
+#define BENCH_NAME BENCH_Thread64
+#include "resume_thread.h"
+#undef BENCH_YIELDS
+#undef BENCH_NAME
+
+typedef char (*BenchThread) (struct pt *pt);
+
+typedef struct {
+    int             yields;
+    BenchThread     thread;
+} BenchCase;
+
+static const BenchCase BenchCases[] = {
+    {  1, BENCH_Thread1 },
+    {  2, BENCH_Thread2 },
+    {  4, BENCH_Thread4 },
+    {  8, BENCH_Thread8 },
+    { 16, BENCH_Thread16 },
+    { 32, BENCH_Thread32 },
+    { 64, BENCH_Thread64 },
+};
+
+
+/**
+ * @brief  Call without a protothread, the baseline.
+ */
+static char BENCH_Empty (struct pt *pt)
+{
+    Work++;
+
+    return PT_YIELDED;
+}
+
+
+static uint64_t BENCH_Ns (void)
+{
+    struct timespec t;
+
+    clock_gettime (CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+
+/**
+ * @brief  Best time of the rounds per call, ns.
+ */
+static double BENCH_Measure (BenchThread thread)
+{
+    // Called through a volatile pointer, so that it is not inlined
+    BenchThread volatile fn = thread;
+    uint64_t start, ns, best = UINT64_MAX;
+    uint32_t i;
+    int r;
+
+    for (r = 0; r < BENCH_ROUNDS; r++) {
+        PT_INIT (&Pt);
+        start = BENCH_Ns ();
+        for (i = 0; i < BENCH_RESUMES; i++) {
+            fn (&Pt);
+        }
+        ns = BENCH_Ns () - start;
+        best = ns < best ? ns : best;
+    }
+
+    return (double)best / BENCH_RESUMES;
+}
+
+
+int main (void)
+{
+    double empty, ns;
+    unsigned int i;
+
+    empty = BENCH_Measure (BENCH_Empty);
+
+#if LC_CONF_ADDRLABELS
+    printf ("resume: lc-addrlabels, empty call %.2f ns\n", empty);
+#else
+    printf ("resume: lc-switch, empty call %.2f ns\n", empty);
+#endif
+    printf ("%6s %10s %10s\n", "yields", "ns", "net ns");
+
+    for (i = 0; i < sizeof (BenchCases) / sizeof (BenchCases[0]); i++) {
+        ns = BENCH_Measure (BenchCases[i].thread);
+        printf ("%6d %10.2f %10.2f\n", BenchCases[i].yields, ns, ns - empty);
+    }
+
+    return 0;
+}
@@ -0,0 +1,108 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * Protothread of BENCH_YIELDS yield points, 1 to 64 in powers of two,
+ * named BENCH_NAME. Included by resume.c once per size: the local
+ * continuations take __LINE__, so every point needs a line of its own.
+ */
+
+static PT_THREAD (BENCH_NAME (struct pt *pt))
+{
+    PT_BEGIN (pt);
+
+    while (1) {
+        BENCH_POINT;
+#if BENCH_YIELDS > 1
+        BENCH_POINT;
+#endif
+#if BENCH_YIELDS > 2
+        BENCH_POINT;
+        BENCH_POINT;
+#endif
+#if BENCH_YIELDS > 4
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+#endif
+#if BENCH_YIELDS > 8
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+#endif
+#if BENCH_YIELDS > 16
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+#endif
+#if BENCH_YIELDS > 32
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+        BENCH_POINT;
+#endif
+    }
+
+    PT_END (pt);
+}
@@ -0,0 +1,55 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef TEST_H_
+#define TEST_H_
+
+#include <stdio.h>
+
+/**
+ * Checks of the host tests. A failed check is reported and counted, the
+ * test goes on, TEST_RESULT () gives the exit status of main ().
+ */
+
+extern int TEST_Failures;
+
+#define TEST_CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf (stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            TEST_Failures++; \
+        } \
+    } while (0)
+
+/** Check that a is within tol of b */
+#define TEST_NEAR(a, b, tol) \
+    do { \
+        double test_a = (double)(a), test_b = (double)(b); \
+        if (test_a < test_b - (tol) || test_a > test_b + (tol)) { \
+            fprintf (stderr, "%s:%d: check failed: %s = %g, expected %g +- %g\n", \
+                     __FILE__, __LINE__, #a, test_a, test_b, (double)(tol)); \
+            TEST_Failures++; \
+        } \
+    } while (0)
+
+/** Define TEST_Failures, once per test program */
+#define TEST_MAIN   int TEST_Failures = 0
+
+#define TEST_RESULT(name) \
+    (printf ("%s: %s\n", (name), TEST_Failures ? "FAILED" : "ok"), TEST_Failures ? 1 : 0)
+
+#endif /* TEST_H_ */
@@ -0,0 +1,206 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * BURTC system time backend on the register model: the trigger, the
+ * counter overflow with its interrupt held off and the wall clock kept
+ * over a system reset.
+ */
+
+#include <em_device.h>
+#include <em_cmu.h>
+#include <em_emu.h>
+#include <em_int.h>
+
+#include <systime.h>
+
+#include "systime_burtc.h"
+
+#include "model/model.h"
+#include "test.h"
+
+TEST_MAIN;
+
+/** One BURTC tick and the time to read the clock and set the compare */
+#define TEST_TOLERANCE_NS   100000
+
+/** Counter wrap, s */
+#define TEST_WRAP_S         131072ULL
+
+#define TEST_NS(s)          ((ModelTime)((s) * 1e9))
+
+static volatile ModelTime Fired;
+
+
+static void TEST_Trigger (void)
+{
+    Fired = MODEL_Now ();
+}
+
+
+static void TEST_Wake (void *arg)
+{
+}
+
+
+/**
+ * @brief  Sleep in EM2 until the model time.
+ */
+static void TEST_SleepUntil (ModelTime t)
+{
+    MODEL_Interrupt (t, TEST_Wake, NULL);
+    while (MODEL_Now () < t) {
+        EMU_EnterEM2 (true);
+    }
+}
+
+
+/**
+ * @brief  Start like the platform does, LFXO first.
+ */
+static void TEST_Start (void)
+{
+    CMU_OscillatorEnable (cmuOsc_LFXO, true, true);
+    TEST_CHECK (SYSTIME_Init (SysTimeBurtc) == 0);
+}
+
+
+/**
+ * @brief  CLOCK_REALTIME in model time, ns.
+ */
+static ModelTime TEST_Realtime (void)
+{
+    struct timespec t;
+
+    clock_gettime (CLOCK_REALTIME, &t);
+    return (ModelTime)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+
+/**
+ * @brief  Arm the trigger ms from now and check when it fires.
+ */
+static void TEST_Fires (uint32_t ms)
+{
+    struct timespec t, d = { .tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000 };
+    ModelTime start = MODEL_Now ();
+
+    Fired = 0;
+    clock_gettime (CLOCK_REALTIME, &t);
+    SYSTIME_ADD (&t, &t, &d);
+    SYSTIME_Trigger (&t, TEST_Trigger);
+    TEST_SleepUntil (start + TEST_NS (ms / 1000.0) + 10000000ULL);
+    TEST_NEAR (Fired - start, ms * 1e6, TEST_TOLERANCE_NS);
+}
+
+
+static void TEST_ColdStart (void)
+{
+    MODEL_Reset ();
+    TEST_Start ();
+
+    // Counting from zero since the init
+    TEST_CHECK ((BURTC->CTRL & _BURTC_CTRL_MODE_MASK) == BURTC_CTRL_MODE_EM4EN);
+    TEST_CHECK (BURTC->RET[SYSTIME_BURTC_RET_FIRST + 1].REG == 0);
+    TEST_NEAR (TEST_Realtime (), 0, TEST_TOLERANCE_NS);
+
+    TEST_Fires (100);
+    TEST_Fires (2500);
+}
+
+
+static void TEST_Overflow (void)
+{
+    ModelTime start, before, after;
+
+    MODEL_Reset ();
+    TEST_Start ();
+    start = MODEL_Now ();
+
+    // Sleep through the first wrap, the interrupt counts it
+    TEST_SleepUntil (start + TEST_NS (TEST_WRAP_S + 1));
+    TEST_CHECK (BURTC->RET[SYSTIME_BURTC_RET_FIRST + 1].REG == 1);
+    TEST_NEAR (TEST_Realtime (), MODEL_Now () - start, TEST_TOLERANCE_NS);
+
+    // Second wrap with the interrupt held off, the pending flag counts
+    TEST_SleepUntil (start + TEST_NS (2 * TEST_WRAP_S - 0.5));
+    INT_Disable ();
+    before = TEST_Realtime ();
+    MODEL_Advance (TEST_NS (1));
+    TEST_CHECK (BURTC->IF & BURTC_IF_OF);
+    after = TEST_Realtime ();
+    INT_Enable ();
+    TEST_NEAR (after - before, 1e9, TEST_TOLERANCE_NS);
+    TEST_CHECK (BURTC->RET[SYSTIME_BURTC_RET_FIRST + 1].REG == 2);
+    TEST_NEAR (TEST_Realtime (), MODEL_Now () - start, TEST_TOLERANCE_NS);
+
+    // Trigger across the third wrap
+    TEST_SleepUntil (start + TEST_NS (3 * TEST_WRAP_S - 1));
+    TEST_Fires (2000);
+    TEST_CHECK (BURTC->RET[SYSTIME_BURTC_RET_FIRST + 1].REG == 3);
+}
+
+
+static void TEST_SystemReset (void)
+{
+    struct timespec set = { .tv_sec = 1400000000, .tv_nsec = 500000000 };
+    ModelTime start, epoch;
+
+    MODEL_Reset ();
+    TEST_Start ();
+    start = MODEL_Now ();
+
+    TEST_CHECK (clock_settime (CLOCK_REALTIME, &set) == 0);
+    epoch = (ModelTime)set.tv_sec * 1000000000ULL + set.tv_nsec - MODEL_Now ();
+    TEST_SleepUntil (MODEL_Now () + TEST_NS (10));
+
+    // The wall clock continues, including the LFXO startup after the reset
+    RMU->CMD = RMU_CMD_RCCLR;
+    MODEL_SystemReset (RMU_RSTCAUSE_EXTRST);
+    TEST_CHECK (RMU->RSTCAUSE & RMU_RSTCAUSE_EXTRST);
+    TEST_Start ();
+    TEST_NEAR (TEST_Realtime () - epoch, MODEL_Now (), TEST_TOLERANCE_NS);
+
+    // A wrap while the system was down is counted by the init
+    TEST_SleepUntil (start + TEST_NS (TEST_WRAP_S - 1));
+    INT_Disable ();
+    MODEL_Advance (TEST_NS (2));
+    MODEL_SystemReset (RMU_RSTCAUSE_WDOGRST);
+    TEST_CHECK (BURTC->IF & BURTC_IF_OF);
+    TEST_Start ();
+    TEST_CHECK (BURTC->RET[SYSTIME_BURTC_RET_FIRST + 1].REG == 1);
+    TEST_NEAR (TEST_Realtime () - epoch, MODEL_Now (), TEST_TOLERANCE_NS);
+    TEST_Fires (100);
+
+    // Releasing the backup domain reset again is a cold start
+    RMU->CTRL |= RMU_CTRL_BURSTEN;
+    MODEL_SystemReset (RMU_RSTCAUSE_EXTRST);
+    TEST_Start ();
+    TEST_NEAR (TEST_Realtime (), 0, TEST_TOLERANCE_NS);
+}
+
+
+int main (void)
+{
+    MODEL_Init ();
+
+    TEST_ColdStart ();
+    TEST_Overflow ();
+    TEST_SystemReset ();
+
+    return TEST_RESULT ("burtc");
+}
@@ -0,0 +1,188 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * Capture of GPIO edges on the register model: PD3 through PRS into
+ * TIMER1 input capture, with the RTC system time. The timestamps have to
+ * match the edges also when the capture interrupt is held off.
+ */
+
+#include <em_device.h>
+#include <em_cmu.h>
+
+#include <lpm.h>
+#include <protothreads.h>
+#include <systime.h>
+
+#include "capture.h"
+#include "systime_rtc.h"
+
+#include "model/model.h"
+#include "test.h"
+
+TEST_MAIN;
+
+#define TEST_PORT           gpioPortD
+#define TEST_PIN            3
+
+/** Latency of the capture interrupt injected, ns */
+#define TEST_LATENCY_NS     5000000ULL
+
+/** An RTC tick of the time and a TIMER1 tick of the capture */
+#define TEST_TOLERANCE_NS   (1e9 / 32768 + 16e9 / 14e6)
+
+#define TEST_EVENTS         8
+
+typedef struct {
+    ModelTime   realtime;   // Timestamp, ns
+    uint32_t    lost;
+} TestEvent;
+
+static TestEvent Events[TEST_EVENTS];
+static int EventCount;
+
+/** CLOCK_REALTIME minus the model time */
+static int64_t Offset;
+
+static ModelTime Deadline;
+
+/** Time in EM2 when the capture stopped */
+static ModelTime StoppedEM2;
+
+PROCESS (TEST_Receiver, "Receiver");
+
+
+static void TEST_Edge (void *arg)
+{
+    MODEL_GpioSet (TEST_PORT, TEST_PIN, arg != NULL);
+}
+
+
+/**
+ * @brief  A long interrupt handler of higher priority.
+ */
+static void TEST_Busy (void *arg)
+{
+    MODEL_Burn ((uint32_t)(TEST_LATENCY_NS * 14 / 1000));
+}
+
+
+static void TEST_Pulse (ModelTime t)
+{
+    MODEL_At (t, TEST_Edge, (void *)1);
+    MODEL_At (t + 100000, TEST_Edge, NULL);
+}
+
+
+PROCESS_THREAD (TEST_Receiver, ev, data)
+{
+    PROCESS_BEGIN ();
+
+    struct timespec t;
+    ModelTime now;
+    CaptureEvent *capture;
+
+    TEST_CHECK (CAPTURE_Start (CAPTURE_CHANNELS, TEST_PORT, TEST_PIN, CAPTURE_EDGE_RISING, PROCESS_CURRENT ()) == -1);
+    TEST_CHECK (CAPTURE_Start (0, TEST_PORT, TEST_PIN, CAPTURE_EDGE_RISING, PROCESS_CURRENT ()) == 0);
+
+    clock_gettime (CLOCK_REALTIME, &t);
+    now = MODEL_Now ();
+    Offset = (int64_t)t.tv_sec * 1000000000 + t.tv_nsec - (int64_t)now;
+
+    // An edge handled at once
+    TEST_Pulse (now + 10000000);
+
+    // One with the interrupt held off
+    MODEL_Interrupt (now + 20000000 - 1000, TEST_Busy, NULL);
+    TEST_Pulse (now + 20000000);
+
+    // Three while held off, the buffer takes two
+    MODEL_Interrupt (now + 30000000 - 1000, TEST_Busy, NULL);
+    TEST_Pulse (now + 30000000);
+    TEST_Pulse (now + 31000000);
+    TEST_Pulse (now + 32000000);
+
+    Deadline = now + 100000000;
+
+    while (EventCount < 4) {
+        PROCESS_WAIT_EVENT_UNTIL (ev == CAPTURE_Event);
+        capture = data;
+        TEST_CHECK (capture->channel == 0);
+        Events[EventCount].realtime = (ModelTime)capture->time.tv_sec * 1000000000ULL + capture->time.tv_nsec;
+        Events[EventCount].lost = capture->lost;
+        EventCount++;
+    }
+
+    CAPTURE_Stop (0);
+    StoppedEM2 = MODEL_Stats.em_ns[2];
+
+    PROCESS_END ();
+}
+
+
+/**
+ * @brief  Start-up of platform-main.c.
+ */
+static void TEST_Main (void)
+{
+    CMU_ClockSelectSet (cmuClock_LFA, cmuSelect_LFXO);
+
+    SYSTIME_Init (SysTimeRtc);
+    LPM_Init ();
+
+    process_init ();
+    process_start (&TEST_Receiver, NULL);
+
+    while (1) {
+        while (process_run () > 0);
+        LPM_WaitForEvent ();
+    }
+}
+
+
+/**
+ * @brief  Timestamp of an event minus the model time of the edge.
+ */
+static double TEST_Error (int i, ModelTime edge)
+{
+    return (double)Events[i].realtime - (double)(edge + Offset);
+}
+
+
+int main (void)
+{
+    ModelTime start;
+
+    MODEL_Init ();
+    MODEL_Reset ();
+
+    MODEL_Run (TEST_Main, 2000000000ULL);
+
+    TEST_CHECK (EventCount == 4);
+    start = Deadline - 100000000;
+    TEST_NEAR (TEST_Error (0, start + 10000000), 0, TEST_TOLERANCE_NS);
+    TEST_NEAR (TEST_Error (1, start + 20000000), 0, TEST_TOLERANCE_NS);
+    TEST_NEAR (TEST_Error (2, start + 30000000), 0, TEST_TOLERANCE_NS);
+    TEST_NEAR (TEST_Error (3, start + 32000000), 0, TEST_TOLERANCE_NS);
+    TEST_CHECK (Events[0].lost == 0 && Events[1].lost == 0);
+    TEST_CHECK (Events[2].lost == 1 && Events[3].lost == 0);
+
+    // Back to EM2 once stopped
+    TEST_CHECK (MODEL_Stats.em_ns[2] - StoppedEM2 > 1000000000ULL);
+
+    return TEST_RESULT ("capture");
+}
@@ -0,0 +1,189 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * A thousand kernel instances, each with its own timer list and a worker
+ * process on a periodic timer of its own period, sharing the scheduler
+ * trigger of the simulated system time. Every worker must expire on time
+ * and in its own instance only, also after an instance has been
+ * initialized again while its timers were armed.
+ */
+
+#include <stdio.h>
+
+#include <protothreads.h>
+#include <systime.h>
+#include <systimer.h>
+
+#include "systime_sim.h"
+#include "test.h"
+
+#define TEST_INSTANCES      1000
+#define TEST_RUN_MS         1000
+
+/** Instance initialized again halfway */
+#define TEST_REINIT         7
+
+static struct process_context Contexts[TEST_INSTANCES];
+static SystimerList Lists[TEST_INSTANCES];
+static struct process Workers[TEST_INSTANCES];
+static SYSTIMER Timers[TEST_INSTANCES];
+
+typedef struct {
+    uint32_t    expired;
+    uint32_t    foreign;    // Ran in another instance
+    uint32_t    late;       // Expired more than a millisecond late
+    uint32_t    early;
+} TestInstance;
+
+static TestInstance Result[TEST_INSTANCES];
+
+PROCESS (TEST_Worker, "Worker");
+
+
+static uint32_t TEST_Period (int i)
+{
+    return 1 + i % 37;
+}
+
+
+static uint64_t TEST_Ms (void)
+{
+    return SIM_Now () / 1000000;
+}
+
+
+static int TEST_Expired (void *arg)
+{
+    process_poll ((struct process *)arg);
+
+    return 0;
+}
+
+
+PROCESS_THREAD (TEST_Worker, ev, data)
+{
+    int i = PROCESS_CURRENT () - Workers;
+    static uint64_t start[TEST_INSTANCES];
+    uint64_t due;
+
+    PROCESS_BEGIN ();
+
+    start[i] = TEST_Ms ();
+    SYSTIMER_Init (&Timers[i], TEST_Period (i), TEST_Period (i), TEST_Expired, PROCESS_CURRENT ());
+
+    while (1) {
+        PROCESS_WAIT_EVENT_UNTIL (ev == PROCESS_EVENT_POLL);
+
+        if (process_ctx != &Contexts[i]) {
+            Result[i].foreign++;
+        }
+
+        Result[i].expired++;
+        due = start[i] + (uint64_t)Result[i].expired * TEST_Period (i);
+        if (TEST_Ms () < due) {
+            Result[i].early++;
+        } else if (TEST_Ms () > due + 1) {
+            Result[i].late++;
+        }
+    }
+
+    PROCESS_END ();
+}
+
+
+/**
+ * @brief  Give the instance its timers and its worker, again if it had them.
+ */
+static void TEST_Start (int i)
+{
+    struct process_context *old = process_context_select (&Contexts[i]);
+
+    SYSTIMER_InitContext (&Lists[i]);
+
+    if (process_is_running (&Workers[i])) {
+        process_exit (&Workers[i]);
+    }
+    Workers[i] = TEST_Worker;
+    Result[i].expired = 0;
+    process_start (&Workers[i], NULL);
+
+    process_context_select (old);
+}
+
+
+/**
+ * @brief  Run the instances until none has anything left to do.
+ */
+static void TEST_RunAll (void)
+{
+    int i, busy;
+
+    do {
+        busy = 0;
+        for (i = 0; i < TEST_INSTANCES; i++) {
+            busy |= process_context_run (&Contexts[i]) > 0;
+        }
+    } while (busy);
+}
+
+
+int main (void)
+{
+    uint32_t expected, foreign = 0, late = 0, early = 0, wrong = 0;
+    int i;
+
+    SIM_Init (1, 0);
+    SYSTIME_Init (SysTimeSim);
+    process_init ();
+
+    for (i = 0; i < TEST_INSTANCES; i++) {
+        process_context_init (&Contexts[i]);
+        TEST_Start (i);
+    }
+    TEST_RunAll ();
+
+    while (TEST_Ms () < TEST_RUN_MS && SIM_Advance () == 0) {
+        TEST_RunAll ();
+
+        // Armed with timers running, starts over from now
+        if (TEST_Ms () == TEST_RUN_MS / 2 && Result[TEST_REINIT].expired > 0) {
+            TEST_Start (TEST_REINIT);
+            TEST_RunAll ();
+        }
+    }
+
+    for (i = 0; i < TEST_INSTANCES; i++) {
+        foreign += Result[i].foreign;
+        late += Result[i].late;
+        early += Result[i].early;
+
+        expected = (i == TEST_REINIT ? TEST_RUN_MS / 2 : TEST_RUN_MS) / TEST_Period (i);
+        if (Result[i].expired + 1 < expected || Result[i].expired > expected + 1) {
+            if (wrong++ < 4) {
+                printf ("context: instance %d expired %u times, %u expected\n", i, Result[i].expired, expected);
+            }
+        }
+    }
+
+    TEST_CHECK (foreign == 0);
+    TEST_CHECK (late == 0);
+    TEST_CHECK (early == 0);
+    TEST_CHECK (wrong == 0);
+
+    return TEST_RESULT ("context");
+}
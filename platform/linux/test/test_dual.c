@@ -0,0 +1,222 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * Dual RTC/TIMER system time on the register model: the efm32 main loop
+ * sleeps in EM2 between the reads of a periodic process, so every read
+ * follows a handover from the RTC to the TIMER, and interrupts read the
+ * clock while asleep. The HFRCO band changes now and then. CLOCK_REALTIME
+ * must never go back and must stay within an RTC tick of the model time.
+ */
+
+#include <em_device.h>
+#include <em_cmu.h>
+#include <em_int.h>
+
+#include <lpm.h>
+#include <protothreads.h>
+#include <systime.h>
+#include <systimer.h>
+
+#include "systime_dual.h"
+
+#include "model/model.h"
+#include "test.h"
+
+TEST_MAIN;
+
+#define TEST_RUN_NS         (2ULL * 1000000000ULL)
+
+/** Period of the reader, not a multiple of the RTC tick */
+#define TEST_PERIOD_MS      3
+
+/** Reads per period and interval of the reading interrupts */
+#define TEST_READS          20
+#define TEST_IRQ_NS         1300000ULL
+
+/** Periods between HFRCO band changes */
+#define TEST_BAND_PERIODS   16
+
+#define TEST_RTC_TICK_NS    (1000000000.0 / 32768)
+
+static const CMU_HFRCOBand_TypeDef TestBands[] = {
+    cmuHFRCOBand_14MHz, cmuHFRCOBand_28MHz, cmuHFRCOBand_7MHz, cmuHFRCOBand_21MHz
+};
+
+typedef struct {
+    uint32_t    reads;
+    uint32_t    backwards;      // Reads earlier than the one before
+    double      max_error;      // Largest distance from the model time, ns
+    uint32_t    bad_res;        // clock_getres () not the TIMER resolution
+    uint32_t    asleep_reads;   // Interrupt reads at the RTC resolution
+    uint32_t    bands;
+} TestResult;
+
+static TestResult Result;
+static ModelTime Prev;
+static int64_t Offset;
+static int OffsetSet;
+
+PROCESS (TEST_Reader, "Reader");
+
+
+/**
+ * @brief  Read the clock, check it against the one before and the model time.
+ *         Called with the interrupts disabled, a read in between would
+ *         update Prev.
+ */
+static void TEST_Read (void)
+{
+    struct timespec t;
+    ModelTime rt;
+    double err;
+
+    clock_gettime (CLOCK_REALTIME, &t);
+    rt = (ModelTime)t.tv_sec * 1000000000ULL + t.tv_nsec;
+
+    if (!OffsetSet) {
+        Offset = (int64_t)rt - (int64_t)MODEL_Now ();
+        OffsetSet = 1;
+    }
+
+    if (rt < Prev) {
+        Result.backwards++;
+    }
+    Prev = rt;
+
+    err = (double)(int64_t)(rt - MODEL_Now ()) - (double)Offset;
+    if (err < 0) {
+        err = -err;
+    }
+    if (err > Result.max_error) {
+        Result.max_error = err;
+    }
+
+    Result.reads++;
+}
+
+
+static void TEST_Interrupt (void *arg)
+{
+    struct timespec res;
+
+    if (MODEL_Now () + TEST_IRQ_NS < TEST_RUN_NS) {
+        MODEL_Interrupt (MODEL_Now () + TEST_IRQ_NS, TEST_Interrupt, NULL);
+    }
+
+    if (!OffsetSet) {
+        return;
+    }
+
+    TEST_Read ();
+
+    // Between the sleep and the wake of the backend
+    clock_getres (CLOCK_REALTIME, &res);
+    if (res.tv_nsec == (long)TEST_RTC_TICK_NS) {
+        Result.asleep_reads++;
+    }
+}
+
+
+static int TEST_Poll (void *arg)
+{
+    process_poll (&TEST_Reader);
+
+    return 0;
+}
+
+
+PROCESS_THREAD (TEST_Reader, ev, data)
+{
+    PROCESS_BEGIN ();
+
+    static SYSTIMER timer;
+    static uint32_t periods;
+    struct timespec res;
+    int i;
+
+    SYSTIMER_Init (&timer, TEST_PERIOD_MS, TEST_PERIOD_MS, TEST_Poll, NULL);
+    MODEL_Interrupt (MODEL_Now () + TEST_IRQ_NS, TEST_Interrupt, NULL);
+
+    while (1) {
+        PROCESS_WAIT_EVENT_UNTIL (ev == PROCESS_EVENT_POLL);
+
+        if (++periods % TEST_BAND_PERIODS == 0) {
+            CMU_HFRCOBandSet (TestBands[Result.bands++ % (sizeof (TestBands) / sizeof (TestBands[0]))]);
+            SYSTIME_ClockChanged ();
+        }
+
+        clock_getres (CLOCK_REALTIME, &res);
+        if (res.tv_nsec != (long)(1000000000 / CMU_ClockFreqGet (cmuClock_TIMER2))) {
+            Result.bad_res++;
+        }
+
+        for (i = 0; i < TEST_READS; i++) {
+            INT_Disable ();
+            TEST_Read ();
+            INT_Enable ();
+            MODEL_Burn (50 + 37 * i);
+        }
+    }
+
+    PROCESS_END ();
+}
+
+
+/**
+ * @brief  Start-up of platform-main.c.
+ */
+static void TEST_Main (void)
+{
+    CMU_ClockSelectSet (cmuClock_LFA, cmuSelect_LFXO);
+
+    SYSTIME_Init (SysTimeDual);
+    LPM_Init ();
+
+    process_init ();
+    process_start (&SYSTIMER_Process, NULL);
+    process_start (&TEST_Reader, NULL);
+
+    while (1) {
+        while (process_run () > 0);
+        LPM_WaitForEvent ();
+    }
+}
+
+
+int main (void)
+{
+    MODEL_Init ();
+    MODEL_Reset ();
+
+    MODEL_Run (TEST_Main, TEST_RUN_NS);
+
+    TEST_CHECK (MODEL_Stats.unclocked == 0);
+    TEST_CHECK (Result.reads > TEST_RUN_NS / 1000000 / TEST_PERIOD_MS * TEST_READS / 2);
+    TEST_CHECK (Result.backwards == 0);
+    TEST_CHECK (Result.bad_res == 0);
+    TEST_CHECK (Result.bands >= 4);
+    TEST_CHECK (Result.asleep_reads > 100);
+
+    // The offset and a read are each within an RTC tick
+    TEST_NEAR (Result.max_error, 0, 2 * TEST_RTC_TICK_NS);
+
+    // Woke up for every period and handed over
+    TEST_CHECK (MODEL_Stats.em_ns[2] > TEST_RUN_NS / 2);
+
+    return TEST_RESULT ("dual");
+}
@@ -0,0 +1,254 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * Round trip of a hibernate snapshot over a reset: one child process
+ * saves the state of a running system, a second one forked from the
+ * pristine parent restores it and runs on. Both share the address layout,
+ * like the firmware before and after an EM4 wake-up.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <hibernate.h>
+#include <protothreads.h>
+#include <systime.h>
+#include <systimer.h>
+
+#include "systime_sim.h"
+#include "test.h"
+
+#define TEST_IMAGE          0x1234abcdU
+#define TEST_WORDS          256
+#define TEST_TIMEOUT_MS     5000
+#define TEST_SLEEP_S        2
+
+typedef struct {
+    uint32_t        snapshot[TEST_WORDS];
+    int             len;
+    struct timespec saved;      // CLOCK_REALTIME at the save
+    uint32_t        remaining;  // Of the timer at the save, ms
+} TestShared;
+
+static TestShared *Shared;
+
+static SYSTIMER Timer;
+static uint32_t State[5];
+static int Resumed;
+static struct timespec Fired;
+
+PROCESS (TEST_Sleeper, "Sleeper");
+PROCESS (TEST_Idle, "Idle");
+
+
+static int TEST_Expired (void *arg)
+{
+    process_poll (&TEST_Sleeper);
+
+    return 0;
+}
+
+
+PROCESS_THREAD (TEST_Sleeper, ev, data)
+{
+    PROCESS_BEGIN ();
+
+    State[0] = 41;
+    SYSTIMER_Init (&Timer, TEST_TIMEOUT_MS, 0, TEST_Expired, NULL);
+
+    PROCESS_WAIT_EVENT_UNTIL (ev == PROCESS_EVENT_POLL);
+
+    // Only after the restore
+    clock_gettime (CLOCK_MONOTONIC, &Fired);
+    Resumed = State[0] + 1;
+
+    PROCESS_END ();
+}
+
+
+PROCESS_THREAD (TEST_Idle, ev, data)
+{
+    PROCESS_BEGIN ();
+
+    PROCESS_WAIT_EVENT_UNTIL (0);
+
+    PROCESS_END ();
+}
+
+
+/**
+ * @brief  Seal a forged snapshot of len words with a valid checksum, the
+ *         same as hibernate.c computes.
+ */
+static void TEST_Seal (uint32_t *buf, int len)
+{
+    uint32_t sum = HIBERNATE_MAGIC;
+    int i;
+
+    buf[2] = len;
+    for (i = 0; i < len - 1; i++) {
+        sum = ((sum << 5) | (sum >> 27)) ^ buf[i];
+    }
+    buf[len - 1] = sum;
+}
+
+
+static void TEST_Boot (void)
+{
+    SIM_Init (1, 0);
+    SYSTIME_Init (SysTimeSim);
+    process_init ();
+    HIBERNATE_SetImage (TEST_IMAGE);
+    HIBERNATE_AddRegion (State, sizeof (State));
+}
+
+
+/**
+ * @brief  Run for a while and save the snapshot.
+ */
+static int TEST_Save (void)
+{
+    struct timespec now;
+    uint32_t small[8];
+
+    TEST_Boot ();
+
+    process_start (&SYSTIMER_Process, NULL);
+    process_start (&TEST_Sleeper, NULL);
+    process_start (&TEST_Idle, NULL);
+    while (process_run () > 0);
+
+    // A second into the timer
+    SIM_SetTime (SIM_Now () + 1000000000ULL);
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    while (process_run () > 0);
+
+    State[1] = 0xdeadbeef;
+    State[4] = 7;
+
+    TEST_CHECK (HIBERNATE_Save (small, sizeof (small) / sizeof (small[0])) == -1);
+
+    HIBERNATE_SetImage (0);
+    TEST_CHECK (HIBERNATE_Save (Shared->snapshot, TEST_WORDS) == -1);
+    HIBERNATE_SetImage (TEST_IMAGE);
+
+    Shared->len = HIBERNATE_Save (Shared->snapshot, TEST_WORDS);
+    TEST_CHECK (Shared->len > 0);
+    clock_gettime (CLOCK_REALTIME, &Shared->saved);
+    Shared->remaining = TEST_TIMEOUT_MS - 1000;
+
+    return TEST_Failures;
+}
+
+
+/**
+ * @brief  Restore after a reset and run until the timer expires.
+ */
+static int TEST_Restore (void)
+{
+    struct timespec elapsed = { .tv_sec = TEST_SLEEP_S, .tv_nsec = 0 };
+    struct timespec now, start;
+    uint32_t bad[TEST_WORDS];
+    struct process *p;
+
+    TEST_Boot ();
+
+    // Corrupted, from another image or cut short
+    memcpy (bad, Shared->snapshot, sizeof (bad));
+    bad[Shared->len / 2] ^= 1;
+    TEST_CHECK (HIBERNATE_Restore (bad, TEST_WORDS, &elapsed) == -1);
+    HIBERNATE_SetImage (TEST_IMAGE + 1);
+    TEST_CHECK (HIBERNATE_Restore (Shared->snapshot, TEST_WORDS, &elapsed) == -1);
+    HIBERNATE_SetImage (TEST_IMAGE);
+    TEST_CHECK (HIBERNATE_Restore (Shared->snapshot, Shared->len - 1, &elapsed) == -1);
+
+    // Checksum right, but the counts and the region size do not fit the length
+    memcpy (bad, Shared->snapshot, sizeof (bad));
+    bad[5] = 0x40000000;
+    TEST_Seal (bad, Shared->len);
+    TEST_CHECK (HIBERNATE_Restore (bad, TEST_WORDS, &elapsed) == -1);
+    memcpy (bad, Shared->snapshot, sizeof (bad));
+    bad[5]--;
+    TEST_Seal (bad, Shared->len);
+    TEST_CHECK (HIBERNATE_Restore (bad, TEST_WORDS, &elapsed) == -1);
+    memcpy (bad, Shared->snapshot, sizeof (bad));
+    bad[Shared->len - 2 - (int)(sizeof (State) / 4)] = 0xffffffff;
+    TEST_Seal (bad, Shared->len);
+    TEST_CHECK (HIBERNATE_Restore (bad, TEST_WORDS, &elapsed) == -1);
+    TEST_CHECK (PROCESS_LIST () == NULL);
+    TEST_CHECK (SYSTIMER_List () == NULL);
+
+    TEST_CHECK (HIBERNATE_Restore (Shared->snapshot, TEST_WORDS, &elapsed) == 0);
+
+    // Processes in the same order, state and wall clock carried over
+    p = PROCESS_LIST ();
+    TEST_CHECK (p == &TEST_Idle);
+    TEST_CHECK (p != NULL && p->next == &TEST_Sleeper);
+    TEST_CHECK (p != NULL && p->next != NULL && p->next->next == &SYSTIMER_Process);
+    TEST_CHECK (State[0] == 41 && State[1] == 0xdeadbeef && State[4] == 7);
+    TEST_CHECK (Resumed == 0);
+
+    clock_gettime (CLOCK_REALTIME, &now);
+    TEST_NEAR (now.tv_sec - Shared->saved.tv_sec, TEST_SLEEP_S, 0);
+
+    // The timer goes off after what was left minus the hibernation
+    clock_gettime (CLOCK_MONOTONIC, &start);
+    TEST_CHECK (SYSTIMER_List () == &Timer);
+    while (Resumed == 0 && !SIM_Stopped ()) {
+        while (process_run () > 0);
+        if (Resumed == 0 && SIM_Advance () != 0) {
+            break;
+        }
+    }
+    TEST_CHECK (Resumed == 42);
+    TEST_NEAR ((Fired.tv_sec - start.tv_sec) * 1e3 + (Fired.tv_nsec - start.tv_nsec) / 1e6,
+               Shared->remaining - TEST_SLEEP_S * 1000, 1);
+
+    return TEST_Failures;
+}
+
+
+static int TEST_Child (int (*fn) (void))
+{
+    int status;
+    pid_t pid;
+
+    fflush (stdout);
+    pid = fork ();
+    if (pid == 0) {
+        _exit (fn () ? 1 : 0);
+    }
+
+    return pid > 0 && waitpid (pid, &status, 0) == pid && WIFEXITED (status) ? WEXITSTATUS (status) : 1;
+}
+
+
+int main (void)
+{
+    Shared = mmap (NULL, sizeof (TestShared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (Shared == MAP_FAILED) {
+        return 1;
+    }
+
+    TEST_Failures += TEST_Child (TEST_Save);
+    TEST_Failures += TEST_Child (TEST_Restore);
+
+    return TEST_RESULT ("hibernate");
+}
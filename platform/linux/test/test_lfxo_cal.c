@@ -0,0 +1,145 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * LFXO calibration on the register model: the efm32 main loop runs with
+ * the RTC system time and EM2 sleep, LFXO off by TEST_LFXO_PPB. The
+ * calibration has to measure the error and trim CLOCK_REALTIME with it.
+ */
+
+#include <em_device.h>
+#include <em_cmu.h>
+
+#include <lpm.h>
+#include <protothreads.h>
+#include <systime.h>
+#include <systimer.h>
+
+#include "lfxo_cal.h"
+#include "systime_rtc.h"
+
+#include "model/model.h"
+#include "test.h"
+
+TEST_MAIN;
+
+#define TEST_LFXO_PPB       30000
+
+#define TEST_RUN_NS         (4ULL * 3600 * 1000000000ULL)
+
+/** CLOCK_REALTIME is sampled this often */
+#define TEST_SAMPLE_MS      (LFXOCAL_CONF_INTERVAL_S * 1000)
+#define TEST_SAMPLES        64
+
+typedef struct {
+    ModelTime   model;      // Model time
+    ModelTime   realtime;   // CLOCK_REALTIME, ns
+} TestSample;
+
+static TestSample Samples[TEST_SAMPLES];
+static int SampleCount;
+
+PROCESS (TEST_Sampler, "Sampler");
+
+
+static int TEST_Poll (void *arg)
+{
+    process_poll (&TEST_Sampler);
+
+    return 0;
+}
+
+
+PROCESS_THREAD (TEST_Sampler, ev, data)
+{
+    PROCESS_BEGIN ();
+
+    static SYSTIMER timer;
+    struct timespec t;
+
+    SYSTIMER_Init (&timer, TEST_SAMPLE_MS, TEST_SAMPLE_MS, TEST_Poll, NULL);
+
+    while (SampleCount < TEST_SAMPLES) {
+        PROCESS_WAIT_EVENT_UNTIL (ev == PROCESS_EVENT_POLL);
+
+        clock_gettime (CLOCK_REALTIME, &t);
+        Samples[SampleCount].model = MODEL_Now ();
+        Samples[SampleCount].realtime = (ModelTime)t.tv_sec * 1000000000ULL + t.tv_nsec;
+        SampleCount++;
+    }
+
+    PROCESS_END ();
+}
+
+
+/**
+ * @brief  Start-up of platform-main.c.
+ */
+static void TEST_Main (void)
+{
+    CMU_ClockSelectSet (cmuClock_LFA, cmuSelect_LFXO);
+
+    SYSTIME_Init (SysTimeRtc);
+    LPM_Init ();
+
+    process_init ();
+    process_start (&SYSTIMER_Process, NULL);
+    process_start (&LFXOCAL_Process, NULL);
+    process_start (&TEST_Sampler, NULL);
+
+    while (1) {
+        while (process_run () > 0);
+        LPM_WaitForEvent ();
+    }
+}
+
+
+/**
+ * @brief  Rate error of CLOCK_REALTIME between two samples, ppb.
+ */
+static double TEST_Rate (const TestSample *a, const TestSample *b)
+{
+    double model = (double)(b->model - a->model);
+
+    return ((double)(b->realtime - a->realtime) - model) * 1e9 / model;
+}
+
+
+int main (void)
+{
+    int i;
+
+    MODEL_Init ();
+    MODEL_Conf.error_ppb[MODEL_LFXO] = TEST_LFXO_PPB;
+    MODEL_Reset ();
+
+    MODEL_Run (TEST_Main, TEST_RUN_NS);
+
+    // 512 LFXO cycles count 750000 HFXO cycles, a count is 1.3 ppm
+    TEST_CHECK (LFXOCAL_Stats.samples >= TEST_RUN_NS / 1000000000ULL / LFXOCAL_CONF_INTERVAL_S - 1);
+    TEST_CHECK (LFXOCAL_Stats.rejected == 0);
+    TEST_NEAR (LFXOCAL_Stats.estimate_ppb, TEST_LFXO_PPB, 2000);
+    TEST_NEAR (SYSTIME_GetTrim (), -TEST_LFXO_PPB, 2000);
+
+    // Trimmed from the first calibration on, at start-up
+    TEST_CHECK (SampleCount >= 8);
+    for (i = 1; i < SampleCount; i++) {
+        TEST_NEAR (TEST_Rate (&Samples[i - 1], &Samples[i]), 0, 2000);
+    }
+
+    return TEST_RESULT ("lfxo_cal");
+}
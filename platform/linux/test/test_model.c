@@ -0,0 +1,337 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * Self-test of the register model: clocks, oscillator startup, RTC
+ * interrupts, EM2 wake-ups, the cycle counter, TIMER counting and input
+ * capture of GPIO edges through PRS, driven through emlib.
+ */
+
+#include <em_device.h>
+#include <em_cmu.h>
+#include <em_emu.h>
+#include <em_gpio.h>
+#include <em_rtc.h>
+
+#include "model/model.h"
+#include "test.h"
+
+TEST_MAIN;
+
+static volatile int RtcInterrupts;
+static volatile ModelTime RtcTime;
+static volatile int TimerInterrupts;
+static volatile ModelTime TimerTime;
+
+
+void RTC_IRQHandler (void)
+{
+    RTC_IntClear (RTC_IF_COMP0);
+    RtcTime = MODEL_Now ();
+    RtcInterrupts++;
+}
+
+
+void TIMER0_IRQHandler (void)
+{
+    TIMER0->IFC = TIMER0->IF;
+    TimerTime = MODEL_Now ();
+    TimerInterrupts++;
+}
+
+
+static void TEST_Clocks (void)
+{
+    MODEL_Reset ();
+
+    TEST_CHECK (CMU_ClockFreqGet (cmuClock_CORE) == 14000000);
+
+    CMU_HFRCOBandSet (cmuHFRCOBand_28MHz);
+    TEST_CHECK (CMU_ClockFreqGet (cmuClock_CORE) == 28000000);
+    TEST_CHECK (MODEL_CoreFreq () == 28000000ULL * 1000000);
+    TEST_CHECK (MODEL_REG (MSC->READCTRL) & _MSC_READCTRL_MODE_MASK);
+
+    CMU_OscillatorEnable (cmuOsc_HFXO, true, true);
+    CMU_ClockSelectSet (cmuClock_HF, cmuSelect_HFXO);
+    TEST_CHECK (CMU_ClockFreqGet (cmuClock_CORE) == 48000000);
+    TEST_CHECK (MODEL_Now () >= 400000);
+}
+
+
+static void TEST_LfxoStartup (void)
+{
+    MODEL_Reset ();
+
+    CMU_OscillatorEnable (cmuOsc_LFXO, true, true);
+
+    // The polling loop is skipped to the end of the startup
+    TEST_NEAR (MODEL_Now (), 300e6, 1e5);
+    TEST_CHECK (MODEL_Stats.spins > 0);
+    TEST_CHECK (MODEL_Stats.accesses < 1000);
+}
+
+
+static void TEST_RtcWakeUp (void)
+{
+    RTC_Init_TypeDef init = RTC_INIT_DEFAULT;
+    ModelTime start;
+
+    MODEL_Reset ();
+
+    // Dropped, the RTC clock is off
+    RTC->CTRL = RTC_CTRL_EN;
+    TEST_CHECK (MODEL_Stats.unclocked == 1);
+    TEST_CHECK (MODEL_REG (RTC->CTRL) == 0);
+
+    CMU_OscillatorEnable (cmuOsc_LFXO, true, true);
+    CMU_ClockSelectSet (cmuClock_LFA, cmuSelect_LFXO);
+    CMU_ClockEnable (cmuClock_CORELE, true);
+    CMU_ClockEnable (cmuClock_RTC, true);
+
+    init.enable = false;
+    RTC_Init (&init);
+    RTC_CompareSet (0, 32767);
+    RTC_CompareSet (1, 0);
+    RTC_IntClear (_RTC_IF_MASK);
+    RTC_IntEnable (RTC_IF_COMP0);
+    NVIC_ClearPendingIRQ (RTC_IRQn);
+    NVIC_EnableIRQ (RTC_IRQn);
+
+    RtcInterrupts = 0;
+    start = MODEL_Now ();
+    MODEL_Stats.energy_uj = 0;
+    MODEL_Stats.em_ns[2] = 0;
+    RTC_Enable (true);
+
+    while (RtcInterrupts == 0) {
+        EMU_EnterEM2 (true);
+    }
+
+    // COMP0 + 1 ticks per period, the flag is set as the counter reaches COMP0
+    TEST_NEAR (RtcTime - start, 32767e9 / 32768, 1e3);
+    TEST_CHECK (RTC_CounterGet () == 32767);
+    TEST_CHECK (MODEL_Stats.em_ns[2] > 999000000);
+    TEST_NEAR (MODEL_Stats.energy_uj, 3.0 * 1.4, 1.0);
+
+    // Next one a period later
+    while (RtcInterrupts == 1) {
+        EMU_EnterEM2 (true);
+    }
+    TEST_NEAR (RtcTime - start, 32767e9 / 32768 + 1e9, 1e3);
+}
+
+
+static void TEST_CycleCounter (void)
+{
+    ModelTime t;
+    uint32_t start;
+
+    MODEL_Reset ();
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    start = DWT->CYCCNT;
+    t = MODEL_Now ();
+    MODEL_Burn (140000);
+    TEST_NEAR (DWT->CYCCNT - start, 140000, 2 * MODEL_CONF_ACCESS_CYCLES);
+    TEST_NEAR (MODEL_Now () - t, 10e6, 1e3);
+}
+
+
+static void TEST_ClockError (void)
+{
+    RTC_Init_TypeDef init = RTC_INIT_DEFAULT;
+
+    // 100 ppm fast crystal
+    MODEL_Conf.error_ppb[MODEL_LFXO] = 100000;
+    MODEL_Reset ();
+
+    CMU_OscillatorEnable (cmuOsc_LFXO, true, true);
+    CMU_ClockSelectSet (cmuClock_LFA, cmuSelect_LFXO);
+    CMU_ClockEnable (cmuClock_CORELE, true);
+    CMU_ClockEnable (cmuClock_RTC, true);
+    init.comp0Top = false;
+    RTC_Init (&init);
+
+    MODEL_Advance (100000000000ULL);
+    TEST_NEAR (RTC_CounterGet (), 3276800 * 1.0001, 2);
+
+    MODEL_Conf.error_ppb[MODEL_LFXO] = 0;
+}
+
+
+static void TEST_Timer (void)
+{
+    ModelTime start;
+    uint32_t cnt;
+
+    MODEL_Reset ();
+
+    // Dropped, the TIMER0 clock is off
+    TIMER0->TOP = 999;
+    TEST_CHECK (MODEL_Stats.unclocked == 1);
+    TEST_CHECK (MODEL_REG (TIMER0->TOP) == 0xFFFF);
+
+    CMU_ClockEnable (cmuClock_HFPER, true);
+    CMU_ClockEnable (cmuClock_TIMER0, true);
+
+    // 14 MHz / 16, overflow every 1000 ticks
+    TIMER0->CTRL = TIMER_CTRL_MODE_UP | TIMER_CTRL_PRESC_DIV16;
+    TIMER0->TOP = 999;
+    TIMER0->IFC = _TIMER_IF_MASK;
+    TIMER0->IEN = TIMER_IEN_OF;
+    NVIC_ClearPendingIRQ (TIMER0_IRQn);
+    NVIC_EnableIRQ (TIMER0_IRQn);
+
+    TimerInterrupts = 0;
+    start = MODEL_Now ();
+    TIMER0->CMD = TIMER_CMD_START;
+    TEST_CHECK (TIMER0->STATUS & TIMER_STATUS_RUNNING);
+
+    while (TimerInterrupts < 3) {
+        EMU_EnterEM1 ();
+    }
+    TEST_NEAR (TimerTime - start, 3 * 1000 * 16e9 / 14e6, 1e3);
+
+    // Compare match on the way
+    TIMER0->IEN = 0;
+    TIMER0->CC[0].CTRL = TIMER_CC_CTRL_MODE_OUTPUTCOMPARE;
+    TIMER0->CC[0].CCV = 500;
+    TIMER0->IFC = _TIMER_IF_MASK;
+    while (!(TIMER0->IF & TIMER_IF_CC0));
+    cnt = TIMER0->CNT;
+    TEST_CHECK (cnt >= 500 && cnt < 510);
+
+    TIMER0->CMD = TIMER_CMD_STOP;
+    cnt = TIMER0->CNT;
+    MODEL_Advance (1000000);
+    TEST_CHECK (TIMER0->CNT == cnt);
+    TEST_CHECK (!(TIMER0->STATUS & TIMER_STATUS_RUNNING));
+    NVIC_DisableIRQ (TIMER0_IRQn);
+
+    // TIMER3 counts the overflows of TIMER2, a 32-bit counter at 14 MHz
+    CMU_ClockEnable (cmuClock_TIMER2, true);
+    CMU_ClockEnable (cmuClock_TIMER3, true);
+    TIMER2->CTRL = TIMER_CTRL_MODE_UP;
+    TIMER3->CTRL = TIMER_CTRL_MODE_UP | TIMER_CTRL_CLKSEL_TIMEROUF;
+    TIMER3->CMD = TIMER_CMD_START;
+    TIMER2->CMD = TIMER_CMD_START;
+    start = MODEL_Now ();
+
+    MODEL_Advance (1000000000);
+    cnt = (TIMER3->CNT << 16) | TIMER2->CNT;
+    TEST_NEAR (cnt, (MODEL_Now () - start) * 14e6 / 1e9, 2);
+    TEST_CHECK (TIMER2->IF & TIMER_IF_OF);
+
+    // Counting down
+    TIMER2->CMD = TIMER_CMD_STOP;
+    TIMER2->CTRL = TIMER_CTRL_MODE_DOWN;
+    TIMER2->TOP = 99;
+    TIMER2->CNT = 50;
+    TIMER2->IFC = _TIMER_IF_MASK;
+    TIMER2->CMD = TIMER_CMD_START;
+    while (!(TIMER2->IF & TIMER_IF_UF));
+    TEST_CHECK (TIMER2->STATUS & TIMER_STATUS_DIR_DOWN);
+    TEST_CHECK (TIMER2->CNT > 90);
+}
+
+
+static void TestEdge (void *arg)
+{
+    MODEL_GpioSet (gpioPortD, 3, arg != NULL);
+}
+
+
+static void TEST_Capture (void)
+{
+    ModelTime start;
+    uint32_t a, b, c0;
+
+    MODEL_Reset ();
+
+    CMU_ClockEnable (cmuClock_HFPER, true);
+    CMU_ClockEnable (cmuClock_GPIO, true);
+    CMU_ClockEnable (cmuClock_PRS, true);
+    CMU_ClockEnable (cmuClock_TIMER1, true);
+
+    // PD3 through the interrupt routing and PRS channel 2 into TIMER1 CC0
+    GPIO_PinModeSet (gpioPortD, 3, gpioModeInput, 0);
+    GPIO_IntConfig (gpioPortD, 3, true, false, false);
+    PRS->CH[2].CTRL = PRS_CH_CTRL_SOURCESEL_GPIOL | PRS_CH_CTRL_SIGSEL_GPIOPIN3;
+
+    TIMER1->CTRL = TIMER_CTRL_MODE_UP;
+    TIMER1->CC[0].CTRL = TIMER_CC_CTRL_MODE_INPUTCAPTURE | TIMER_CC_CTRL_INSEL |
+                         TIMER_CC_CTRL_PRSSEL_PRSCH2 | TIMER_CC_CTRL_ICEDGE_BOTH;
+    TIMER1->CMD = TIMER_CMD_START;
+    // The read takes an access, the timer counts the core clock
+    c0 = TIMER1->CNT + MODEL_CONF_ACCESS_CYCLES;
+    start = MODEL_Now ();
+
+    // Edges at 1000 and 2000 ticks, both edges captured, the rising one
+    // raises the GPIO interrupt flag
+    MODEL_At (start + 1000 * 1000 / 14, TestEdge, (void *)1);
+    MODEL_At (start + 2000 * 1000 / 14, TestEdge, NULL);
+    MODEL_Advance (3000 * 1000 / 14);
+
+    TEST_CHECK (GPIO_PinInGet (gpioPortD, 3) == 0);
+    TEST_CHECK (GPIO->IF & (1 << 3));
+    TEST_CHECK (TIMER1->IF & TIMER_IF_CC0);
+    TEST_CHECK (TIMER1->STATUS & TIMER_STATUS_ICV0);
+    TEST_CHECK (TIMER1->STATUS & TIMER_STATUS_CCVBV0);
+    a = TIMER1->CC[0].CCV;
+    b = TIMER1->CC[0].CCV;
+    TEST_NEAR (a, c0 + 1000, 1);
+    TEST_NEAR (b, c0 + 2000, 1);
+    TEST_CHECK (!(TIMER1->STATUS & TIMER_STATUS_ICV0));
+    TEST_CHECK (!(TIMER1->IF & TIMER_IF_ICBOF0));
+
+    // A third capture into the full buffer overflows it
+    MODEL_At (MODEL_Now () + 100000, TestEdge, (void *)1);
+    MODEL_At (MODEL_Now () + 200000, TestEdge, NULL);
+    MODEL_At (MODEL_Now () + 300000, TestEdge, (void *)1);
+    MODEL_Advance (400000);
+    TEST_CHECK (TIMER1->IF & TIMER_IF_ICBOF0);
+    a = TIMER1->CC[0].CCV;
+    b = TIMER1->CC[0].CCV;
+    TEST_NEAR ((b - a) & 0xFFFF, 200000 * 14 / 1000, 1);
+
+    // Disabling the pin drops its input to 0, then it is not routed
+    GPIO_PinModeSet (gpioPortD, 3, gpioModeDisabled, 0);
+    TEST_CHECK (TIMER1->STATUS & TIMER_STATUS_ICV0);
+    a = TIMER1->CC[0].CCV;
+    MODEL_Advance (1000);
+    MODEL_GpioSet (gpioPortD, 3, 0);
+    MODEL_GpioSet (gpioPortD, 3, 1);
+    TEST_CHECK (!(TIMER1->STATUS & TIMER_STATUS_ICV0));
+}
+
+
+int main (void)
+{
+    MODEL_Init ();
+
+    TEST_Clocks ();
+    TEST_LfxoStartup ();
+    TEST_RtcWakeUp ();
+    TEST_CycleCounter ();
+    TEST_ClockError ();
+    TEST_Timer ();
+    TEST_Capture ();
+
+    return TEST_RESULT ("model");
+}
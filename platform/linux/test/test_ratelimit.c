@@ -0,0 +1,109 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * Waits on a token bucket in simulated time: more tokens than the burst
+ * end the wait at once with -1, a wait for a token is woken up when the
+ * token is due on CLOCK_MONOTONIC, even though CLOCK_REALTIME is stepped
+ * back an hour while it waits.
+ */
+
+#include <protothreads.h>
+#include <ratelimit.h>
+#include <systime.h>
+#include <systimer.h>
+
+#include "systime_sim.h"
+#include "test.h"
+
+#define TEST_RATE           10
+#define TEST_BURST          2
+
+static RateLimit Bucket;
+static SYSTIMER Stepper;
+static int TooMany, Got;
+static int Done;
+static struct timespec Start, Taken;
+
+PROCESS (TEST_Taker, "Taker");
+
+
+static int TEST_Step (void *arg)
+{
+    struct timespec now;
+
+    clock_gettime (CLOCK_REALTIME, &now);
+    now.tv_sec -= 3600;
+    clock_settime (CLOCK_REALTIME, &now);
+
+    return 0;
+}
+
+
+PROCESS_THREAD (TEST_Taker, ev, data)
+{
+    static int res;
+
+    PROCESS_BEGIN ();
+
+    // Never in the bucket
+    PROCESS_WAIT_TOKENS (&Bucket, TEST_BURST + 1, res);
+    TooMany = res;
+
+    // The full bucket at once, the next token is due in 1 / TEST_RATE
+    PROCESS_WAIT_TOKENS (&Bucket, TEST_BURST, res);
+    clock_gettime (CLOCK_MONOTONIC, &Start);
+
+    // Half way through the wait
+    SYSTIMER_Init (&Stepper, 500 / TEST_RATE, 0, TEST_Step, NULL);
+    PROCESS_WAIT_TOKENS (&Bucket, 1, res);
+    clock_gettime (CLOCK_MONOTONIC, &Taken);
+    Got = res;
+    Done = 1;
+
+    PROCESS_END ();
+}
+
+
+int main (void)
+{
+    SIM_Init (1, 0);
+    SYSTIME_Init (SysTimeSim);
+    process_init ();
+    process_start (&SYSTIMER_Process, NULL);
+
+    // An hour into the simulated time, so that the step keeps it positive
+    SIM_SetTime (7200000000000ULL);
+
+    RATELIMIT_Init (&Bucket, TEST_RATE, TEST_BURST);
+    TooMany = Got = 1;
+    process_start (&TEST_Taker, NULL);
+
+    while (!Done && !SIM_Stopped ()) {
+        while (process_run () > 0);
+        if (!Done && SIM_Advance () != 0) {
+            break;
+        }
+    }
+
+    TEST_CHECK (TooMany == -1);
+    TEST_CHECK (Done && Got == 0);
+    TEST_NEAR ((Taken.tv_sec - Start.tv_sec) * 1e3 + (Taken.tv_nsec - Start.tv_nsec) / 1e6,
+               1000 / TEST_RATE, 2);
+
+    return TEST_RESULT ("ratelimit");
+}
@@ -0,0 +1,355 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * Record a simulated run and replay it. A sensor samples on a periodic
+ * timer and posts the samples, recorded as bytes, to a filter, which
+ * passes averages on to a logger. Frames come in from outside at random
+ * times, like from a radio interrupt. Replayed with the seed of the
+ * recording, the run must come out the same record for record and
+ * microsecond for microsecond. Replayed with another seed, or from a
+ * changed recording, it must not.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <protothreads.h>
+#include <process-record.h>
+#include <systime.h>
+#include <systimer.h>
+
+#include "replay.h"
+#include "systime_sim.h"
+#include "test.h"
+
+#define TEST_RUN_MS         10000
+#define TEST_SAMPLE_MS      10
+#define TEST_AVERAGE        8
+
+/** Largest gap between the frames from outside */
+#define TEST_FRAME_US       5000
+
+typedef struct {
+    uint32_t    seq;
+    int32_t     value;
+    uint32_t    time_ms;
+} TestSample;
+
+typedef struct {
+    uint8_t     len;
+    uint8_t     bytes[15];
+} TestFrame;
+
+static process_event_t TestSampleEvent;
+static process_event_t TestFrameEvent;
+static process_event_t TestAverageEvent;
+
+/** Randomness of the frames, outside of the simulation */
+static uint32_t TestFrameRng = 12345;
+
+static char TestPath[] = "/tmp/test_replay.XXXXXX";
+
+PROCESS (TEST_Sensor, "Sensor");
+PROCESS (TEST_Filter, "Filter");
+PROCESS (TEST_Logger, "Logger");
+
+
+static int TEST_Sample (void *arg)
+{
+    process_poll ((struct process *)arg);
+
+    return 0;
+}
+
+
+PROCESS_THREAD (TEST_Sensor, ev, data)
+{
+    static SYSTIMER timer;
+    static TestSample sample;
+
+    PROCESS_BEGIN ();
+
+    SYSTIMER_Init (&timer, TEST_SAMPLE_MS, TEST_SAMPLE_MS, TEST_Sample, PROCESS_CURRENT ());
+
+    while (1) {
+        PROCESS_WAIT_EVENT_UNTIL (ev == PROCESS_EVENT_POLL);
+
+        sample.seq++;
+        sample.value = (int32_t)(SIM_Random () % 2001) - 1000;
+        sample.time_ms = SIM_Now () / 1000000;
+        process_post (&TEST_Filter, TestSampleEvent, &sample);
+    }
+
+    PROCESS_END ();
+}
+
+
+PROCESS_THREAD (TEST_Filter, ev, data)
+{
+    static int32_t sum;
+    static uint32_t samples;
+
+    PROCESS_BEGIN ();
+
+    while (1) {
+        PROCESS_WAIT_EVENT ();
+
+        if (ev == TestSampleEvent) {
+            sum += ((TestSample *)data)->value;
+            if (++samples % TEST_AVERAGE == 0) {
+                process_post (&TEST_Logger, TestAverageEvent, (void *)(intptr_t)(sum / TEST_AVERAGE));
+                sum = 0;
+            }
+        } else if (ev == TestFrameEvent) {
+            // A frame changes the course of the filter
+            sum += ((TestFrame *)data)->bytes[0];
+        }
+    }
+
+    PROCESS_END ();
+}
+
+
+PROCESS_THREAD (TEST_Logger, ev, data)
+{
+    PROCESS_BEGIN ();
+
+    while (1) {
+        PROCESS_WAIT_EVENT_UNTIL (ev == TestAverageEvent);
+    }
+
+    PROCESS_END ();
+}
+
+
+static uint32_t TEST_FrameRandom (void)
+{
+    TestFrameRng ^= TestFrameRng << 13;
+    TestFrameRng ^= TestFrameRng >> 17;
+    TestFrameRng ^= TestFrameRng << 5;
+
+    return TestFrameRng;
+}
+
+
+static void TEST_Write (const void *buf, size_t len, void *arg)
+{
+    fwrite (buf, len, 1, arg);
+}
+
+
+/**
+ * @brief  Start the kernel and the processes in simulated time.
+ */
+static void TEST_Start (uint64_t seed)
+{
+    SIM_Init (seed, 0);
+    SYSTIME_Init (SysTimeSim);
+    process_init ();
+
+    TestSampleEvent = process_alloc_event ();
+    TestFrameEvent = process_alloc_event ();
+    TestAverageEvent = process_alloc_event ();
+    process_record_payload (TestSampleEvent, sizeof (TestSample));
+    process_record_payload (TestFrameEvent, sizeof (TestFrame));
+
+    process_start (&SYSTIMER_Process, NULL);
+    process_start (&TEST_Sensor, NULL);
+    process_start (&TEST_Filter, NULL);
+    process_start (&TEST_Logger, NULL);
+}
+
+
+/**
+ * @brief  Run and save the recording, in a child process.
+ */
+static int TEST_Record (uint64_t seed)
+{
+    static TestFrame frame;
+    uint64_t next;
+    FILE *file;
+    int i;
+
+    TEST_Start (seed);
+    process_record_seed (seed);
+
+    // The frames come at whole microseconds, the resolution of the records
+    next = (1 + TEST_FrameRandom () % TEST_FRAME_US) * 1000ULL;
+
+    while (SIM_Now () < TEST_RUN_MS * 1000000ULL) {
+        while (process_run () > 0);
+
+        if (next <= SIM_NextTrigger ()) {
+            SIM_SetTime (next);
+            frame.len = 1 + TEST_FrameRandom () % sizeof (frame.bytes);
+            for (i = 0; i < frame.len; i++) {
+                frame.bytes[i] = TEST_FrameRandom ();
+            }
+            process_post (&TEST_Filter, TestFrameEvent, &frame);
+            next += (1 + TEST_FrameRandom () % TEST_FRAME_US) * 1000ULL;
+        } else {
+            SYSTIME_Sleep ();
+            SIM_Advance ();
+            SYSTIME_Wake ();
+        }
+    }
+
+    file = fopen (TestPath, "wb");
+    if (file == NULL) {
+        return -1;
+    }
+    process_record_dump (TEST_Write, file);
+    fclose (file);
+
+    return 0;
+}
+
+
+/**
+ * @brief  Replay the recording, in a child process.
+ */
+static int TEST_Replay (uint64_t seed, ReplayStats *stats)
+{
+    if (REPLAY_Load (TestPath) != 0) {
+        return -1;
+    }
+
+    TEST_Start (seed ? seed : REPLAY_Seed ());
+    if (REPLAY_Run () != 0) {
+        return -1;
+    }
+    REPLAY_GetStats (stats);
+
+    return 0;
+}
+
+
+/**
+ * @brief  Run a phase in a child process, the kernel starts from scratch.
+ */
+static int TEST_Child (int (*phase) (uint64_t, ReplayStats *), uint64_t seed, ReplayStats *stats)
+{
+    int fds[2], status;
+    pid_t pid;
+
+    memset (stats, 0, sizeof (*stats));
+    if (pipe (fds) != 0) {
+        return -1;
+    }
+
+    pid = fork ();
+    if (pid == 0) {
+        close (fds[0]);
+        status = phase (seed, stats);
+        if (write (fds[1], stats, sizeof (*stats)) != sizeof (*stats)) {
+            status = -1;
+        }
+        _exit (status == 0 ? 0 : 1);
+    }
+    close (fds[1]);
+
+    if (pid < 0 || read (fds[0], stats, sizeof (*stats)) != sizeof (*stats)) {
+        status = -1;
+    }
+    close (fds[0]);
+    if (pid > 0 && (waitpid (pid, &status, 0) != pid || !WIFEXITED (status) || WEXITSTATUS (status) != 0)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int TEST_RecordPhase (uint64_t seed, ReplayStats *stats)
+{
+    return TEST_Record (seed);
+}
+
+
+/**
+ * @brief  Change the event of the record halfway.
+ */
+static int TEST_Corrupt (void)
+{
+    struct process_record_header hdr;
+    struct process_record r;
+    FILE *file = fopen (TestPath, "r+b");
+    long pos;
+    int res = -1;
+
+    if (file == NULL) {
+        return -1;
+    }
+
+    if (fread (&hdr, sizeof (hdr), 1, file) == 1) {
+        pos = sizeof (hdr) + (long)(hdr.count / 2) * sizeof (r);
+        // The next kernel record, not the bytes of a payload
+        while (fseek (file, pos, SEEK_SET) == 0 && fread (&r, sizeof (r), 1, file) == 1) {
+            if (r.type != PROCESS_RECORD_PAYLOAD) {
+                r.ev ^= 0x40;
+                fseek (file, pos, SEEK_SET);
+                res = (fwrite (&r, sizeof (r), 1, file) == 1) ? 0 : -1;
+                break;
+            }
+            pos += sizeof (r);
+        }
+    }
+    fclose (file);
+
+    return res;
+}
+
+
+int main (void)
+{
+    ReplayStats stats;
+    int fd;
+
+    fd = mkstemp (TestPath);
+    TEST_CHECK (fd >= 0);
+    if (fd < 0) {
+        return TEST_RESULT ("replay");
+    }
+    close (fd);
+
+    TEST_CHECK (TEST_Child (TEST_RecordPhase, 42, &stats) == 0);
+
+    // With the seed of the recording
+    TEST_CHECK (TEST_Child (TEST_Replay, 0, &stats) == 0);
+    printf ("replay: %u records, %u fed in, %u compared\n",
+            (unsigned)stats.records, (unsigned)stats.injected, (unsigned)stats.checked);
+    TEST_CHECK (stats.records > 10000);
+    TEST_CHECK (stats.injected > 1000);
+    TEST_CHECK (stats.diverged == -1);
+    TEST_CHECK (stats.max_skew_ns == 0);
+
+    // The timers come with other latencies
+    TEST_CHECK (TEST_Child (TEST_Replay, 43, &stats) == 0);
+    TEST_CHECK (stats.diverged >= 0 || stats.max_skew_ns > 0);
+
+    TEST_CHECK (TEST_Corrupt () == 0);
+    TEST_CHECK (TEST_Child (TEST_Replay, 0, &stats) == 0);
+    TEST_CHECK (stats.diverged >= 0);
+
+    unlink (TestPath);
+
+    return TEST_RESULT ("replay");
+}
@@ -0,0 +1,248 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * RTC system time backend on the register model: both compare channels,
+ * cancelling, the pre-wake on COMP1 and the 24-bit counter wrapping every
+ * 512 s.
+ */
+
+#include <em_device.h>
+#include <em_cmu.h>
+#include <em_emu.h>
+#include <em_rtc.h>
+
+#include <systime.h>
+
+#include "systime_rtc.h"
+
+#include "model/model.h"
+#include "test.h"
+
+TEST_MAIN;
+
+/** One RTC tick and the time to read the clock and set the compare */
+#define TEST_TOLERANCE_NS   100000
+
+/** Counter wrap, s */
+#define TEST_WRAP_S         512
+
+static volatile ModelTime Fired[3];
+
+
+static void TEST_Channel0 (void)
+{
+    Fired[0] = MODEL_Now ();
+}
+
+
+static void TEST_Channel1 (void)
+{
+    Fired[1] = MODEL_Now ();
+}
+
+
+static void TEST_Prewake (void)
+{
+    Fired[2] = MODEL_Now ();
+}
+
+
+static void TEST_Boot (void)
+{
+    MODEL_Reset ();
+
+    CMU_ClockSelectSet (cmuClock_LFA, cmuSelect_LFXO);
+    TEST_CHECK (SYSTIME_Init (SysTimeRtc) == 0);
+}
+
+
+/**
+ * @brief  Arm a channel ms from now.
+ */
+static void TEST_Arm (unsigned int channel, uint32_t ms, void (*callback) (void))
+{
+    struct timespec t, d = { .tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000 };
+
+    clock_gettime (CLOCK_REALTIME, &t);
+    SYSTIME_ADD (&t, &t, &d);
+    TEST_CHECK (SYSTIME_TriggerChannel (channel, &t, callback) == 0);
+}
+
+
+static void TEST_Wake (void *arg)
+{
+}
+
+
+/**
+ * @brief  Sleep in EM2 until the model time.
+ */
+static void TEST_SleepUntil (ModelTime t)
+{
+    MODEL_Interrupt (t, TEST_Wake, NULL);
+    while (MODEL_Now () < t) {
+        EMU_EnterEM2 (true);
+    }
+}
+
+
+static void TEST_Channels (void)
+{
+    ModelTime start;
+
+    TEST_Boot ();
+    TEST_CHECK (SYSTIME_Channels () == 2);
+
+    // Independent, the later one on channel 0
+    Fired[0] = Fired[1] = 0;
+    start = MODEL_Now ();
+    TEST_Arm (0, 100, TEST_Channel0);
+    TEST_Arm (1, 50, TEST_Channel1);
+    TEST_SleepUntil (start + 200000000ULL);
+    TEST_NEAR (Fired[0] - start, 100e6, TEST_TOLERANCE_NS);
+    TEST_NEAR (Fired[1] - start, 50e6, TEST_TOLERANCE_NS);
+
+    // Arming channel 0 again leaves channel 1 alone
+    Fired[0] = Fired[1] = 0;
+    start = MODEL_Now ();
+    TEST_Arm (1, 30, TEST_Channel1);
+    TEST_Arm (0, 80, TEST_Channel0);
+    TEST_Arm (0, 20, TEST_Channel0);
+    TEST_SleepUntil (start + 200000000ULL);
+    TEST_NEAR (Fired[0] - start, 20e6, TEST_TOLERANCE_NS);
+    TEST_NEAR (Fired[1] - start, 30e6, TEST_TOLERANCE_NS);
+
+    // Cancelled
+    Fired[0] = Fired[1] = 0;
+    start = MODEL_Now ();
+    TEST_Arm (0, 40, TEST_Channel0);
+    TEST_Arm (1, 40, TEST_Channel1);
+    SYSTIME_Cancel (1);
+    TEST_SleepUntil (start + 200000000ULL);
+    TEST_NEAR (Fired[0] - start, 40e6, TEST_TOLERANCE_NS);
+    TEST_CHECK (Fired[1] == 0);
+
+    // Out of range
+    TEST_CHECK (SYSTIME_TriggerChannel (2, &(struct timespec) { 0, 0 }, TEST_Channel1) == -1);
+}
+
+
+static void TEST_PrewakeChannel (void)
+{
+    struct timespec lead = { .tv_sec = 0, .tv_nsec = 2000000 };
+    ModelTime start;
+
+    TEST_Boot ();
+    TEST_CHECK (SYSTIME_Prewake (&lead, TEST_Prewake) == 0);
+
+    // COMP1 free, pre-wake ahead of the trigger
+    Fired[0] = Fired[2] = 0;
+    start = MODEL_Now ();
+    TEST_Arm (0, 100, TEST_Channel0);
+    TEST_SleepUntil (start + 200000000ULL);
+    TEST_NEAR (Fired[0] - start, 100e6, TEST_TOLERANCE_NS);
+    TEST_NEAR (Fired[2] - start, 98e6, TEST_TOLERANCE_NS);
+
+    // COMP1 taken by channel 1, no pre-wake
+    Fired[0] = Fired[1] = Fired[2] = 0;
+    start = MODEL_Now ();
+    TEST_Arm (1, 150, TEST_Channel1);
+    TEST_Arm (0, 100, TEST_Channel0);
+    TEST_SleepUntil (start + 200000000ULL);
+    TEST_NEAR (Fired[0] - start, 100e6, TEST_TOLERANCE_NS);
+    TEST_NEAR (Fired[1] - start, 150e6, TEST_TOLERANCE_NS);
+    TEST_CHECK (Fired[2] == 0);
+
+    // Too close for the lead
+    Fired[0] = Fired[2] = 0;
+    start = MODEL_Now ();
+    TEST_Arm (0, 1, TEST_Channel0);
+    TEST_SleepUntil (start + 10000000ULL);
+    TEST_CHECK (Fired[0] != 0);
+    TEST_CHECK (Fired[2] == 0);
+}
+
+
+/**
+ * @brief  CLOCK_MONOTONIC, ns.
+ */
+static ModelTime TEST_Monotonic (void)
+{
+    struct timespec t;
+
+    clock_gettime (CLOCK_MONOTONIC, &t);
+    return (ModelTime)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+
+static void TEST_Wrap (void)
+{
+    ModelTime start, clock, armed;
+
+    TEST_Boot ();
+    start = MODEL_Now ();
+    clock = TEST_Monotonic ();
+
+    // Nothing armed, the overflow interrupt keeps the counter extended
+    TEST_SleepUntil (start + 3 * TEST_WRAP_S * 1000000000ULL);
+    TEST_NEAR (TEST_Monotonic () - clock, MODEL_Now () - start, TEST_TOLERANCE_NS);
+
+    // A trigger that is not armed again leaves the overflow interrupt on
+    Fired[0] = 0;
+    TEST_Arm (0, 100, TEST_Channel0);
+    TEST_SleepUntil (MODEL_Now () + 3 * TEST_WRAP_S * 1000000000ULL);
+    TEST_CHECK (Fired[0] != 0);
+    TEST_NEAR (TEST_Monotonic () - clock, MODEL_Now () - start, TEST_TOLERANCE_NS);
+
+    // Further than half a wrap fires early, at half a wrap
+    Fired[0] = 0;
+    start = MODEL_Now ();
+    clock = TEST_Monotonic ();
+    TEST_Arm (0, 1000 * 1000, TEST_Channel0);
+    TEST_SleepUntil (start + 2 * TEST_WRAP_S * 1000000000ULL);
+    TEST_NEAR (Fired[0] - start, TEST_WRAP_S / 2 * 1e9, TEST_TOLERANCE_NS);
+    TEST_NEAR (TEST_Monotonic () - clock, MODEL_Now () - start, TEST_TOLERANCE_NS);
+
+    // Across the wrap, on both channels
+    Fired[0] = Fired[1] = 0;
+    TEST_SleepUntil (MODEL_Now () + (0xFFFFFFULL - RTC_CounterGet ()) * 1000000000ULL / 32768 - 50000000ULL);
+    armed = MODEL_Now ();
+    TEST_Arm (0, 100, TEST_Channel0);
+    TEST_Arm (1, 200, TEST_Channel1);
+    TEST_SleepUntil (armed + 300000000ULL);
+    TEST_NEAR (Fired[0] - armed, 100e6, TEST_TOLERANCE_NS);
+    TEST_NEAR (Fired[1] - armed, 200e6, TEST_TOLERANCE_NS);
+
+    // Cancelled, the overflow interrupt takes over again
+    TEST_Arm (0, 100 * 1000, TEST_Channel0);
+    SYSTIME_Cancel (0);
+    TEST_SleepUntil (MODEL_Now () + 3 * TEST_WRAP_S * 1000000000ULL);
+    TEST_NEAR (TEST_Monotonic () - clock, MODEL_Now () - start, TEST_TOLERANCE_NS);
+}
+
+
+int main (void)
+{
+    MODEL_Init ();
+
+    TEST_Channels ();
+    TEST_PrewakeChannel ();
+    TEST_Wrap ();
+
+    return TEST_RESULT ("rtc");
+}
@@ -0,0 +1,288 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * Torture test of the clock snapshot of systime.c: reader threads read
+ * the clocks while a writer thread keeps replacing the clock state, the
+ * way an ISR reads while the process context writes on the device. The
+ * backend time is a counter every read advances, so that it is strictly
+ * increasing across all threads. The backend yields now and then, in the
+ * middle of the snapshot, so that the writer gets in there also on a
+ * single core.
+ *
+ *   test_seqlock [reads per reader]
+ *
+ * Each of the 3 readers reads TEST_READS = 2M times in each of the two
+ * parts, make check LONG=1 runs 50 times as many. On a single core host
+ * the threads preempt each other like the ISRs do on the device. On
+ * several cores they run alongside, which systime.c does not support;
+ * x86 keeps the loads and the stores in order, so the check still holds
+ * there, other hosts may report torn reads.
+ *
+ * Steps: the writer steps CLOCK_REALTIME forward by a second at a time,
+ * the step a read is on follows from the time. The backend time of the
+ * read must lie between the monotonic reads around it, a torn offset
+ * does not, and must be later than the backend time the writer had when
+ * it made the step, a snapshot pairing an old backend time with a new
+ * offset is not.
+ * Folds: the writer folds the running slew and trim into the offset over
+ * and over, CLOCK_REALTIME must still increase strictly.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include <systime.h>
+
+#include "test.h"
+
+#define TEST_READERS        3
+#define TEST_READS          2000000
+
+/** Backend time advanced by every read, ns */
+#define TEST_TICK_NS        16
+
+/** Reads of a thread between yields */
+#define TEST_YIELD_READS    61
+
+/** CLOCK_REALTIME step of the writer, ns */
+#define TEST_STEP_NS        1000000000ULL
+
+/** Steps remembered for the readers */
+#define TEST_STEPS          (1 << 16)
+
+#define TEST_TRIM_PPB       200000
+
+typedef struct {
+    pthread_t   thread;
+    uint64_t    torn;       // Reads matching no clock state
+    uint64_t    backwards;  // Reads going back
+} TestReader;
+
+typedef struct {
+    uint64_t    step;       // Number of the step
+    uint64_t    base;       // Backend time of the writer at the step
+} TestStep;
+
+static uint64_t Ticks;
+static long Reads = TEST_READS;
+static TestReader Readers[TEST_READERS];
+static TestStep Steps[TEST_STEPS];
+static uint64_t Total;
+
+
+static int TEST_BackendInit (void)
+{
+    Ticks = 0;
+    return 0;
+}
+
+
+static uint32_t TEST_BackendFrequency (void)
+{
+    return 1000000000UL;
+}
+
+
+static void TEST_BackendNanoTime (SysTime *tm)
+{
+    static __thread uint32_t reads;
+    uint64_t ns = __atomic_add_fetch (&Ticks, TEST_TICK_NS, __ATOMIC_SEQ_CST);
+
+    if (++reads % TEST_YIELD_READS == 0) {
+        sched_yield ();
+    }
+
+    tm->tv_sec = (uint32_t)(ns / 1000000000ULL);
+    tm->tv_nsec = (uint32_t)(ns % 1000000000ULL);
+}
+
+
+static uint32_t TEST_BackendTime (void)
+{
+    SysTime tm;
+
+    TEST_BackendNanoTime (&tm);
+    return tm.tv_sec;
+}
+
+
+static void TEST_BackendTrigger (SysTime *tm, void (*callback) (void))
+{
+}
+
+
+static SysTimeBackend TestBackend = {
+    .init               = TEST_BackendInit,
+    .getFrequency       = TEST_BackendFrequency,
+    .getSystemTime      = TEST_BackendTime,
+    .getSystemNanoTime  = TEST_BackendNanoTime,
+    .trigger            = TEST_BackendTrigger,
+};
+
+
+static uint64_t TEST_Read (clockid_t clock)
+{
+    struct timespec t;
+
+    clock_gettime (clock, &t);
+    return (uint64_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+
+static void *TEST_StepReader (void *arg)
+{
+    TestReader *reader = arg;
+    uint64_t prev = 0, m1, r, m2, step, tm;
+    TestStep *s;
+    long i;
+
+    for (i = 0; i < Reads; i++) {
+        m1 = TEST_Read (CLOCK_MONOTONIC);
+        r = TEST_Read (CLOCK_REALTIME);
+        m2 = TEST_Read (CLOCK_MONOTONIC);
+
+        if (m1 <= prev) {
+            reader->backwards++;
+        }
+        prev = m2;
+
+        step = (r - m1) / TEST_STEP_NS;
+        tm = r - step * TEST_STEP_NS;
+        if (tm <= m1 || tm >= m2) {
+            reader->torn++;
+            continue;
+        }
+
+        // Too old to check if the writer has reused the entry since
+        s = &Steps[step % TEST_STEPS];
+        if (__atomic_load_n (&s->step, __ATOMIC_ACQUIRE) == step && tm <= s->base) {
+            reader->torn++;
+        }
+    }
+
+    return NULL;
+}
+
+
+static void *TEST_FoldReader (void *arg)
+{
+    TestReader *reader = arg;
+    uint64_t prev = 0, r;
+    long i;
+
+    for (i = 0; i < Reads; i++) {
+        r = TEST_Read (CLOCK_REALTIME);
+        if (r <= prev) {
+            reader->backwards++;
+        }
+        prev = r;
+    }
+
+    return NULL;
+}
+
+
+/**
+ * @brief  Run the readers while the writer keeps writing.
+ * @retval Writes done.
+ */
+static uint64_t TEST_Run (void *(*reader) (void *), void (*write) (uint64_t n))
+{
+    uint64_t n = 0;
+    int i;
+
+    for (i = 0; i < TEST_READERS; i++) {
+        Readers[i].torn = 0;
+        Readers[i].backwards = 0;
+        pthread_create (&Readers[i].thread, NULL, reader, &Readers[i]);
+    }
+
+    for (i = 0; i < TEST_READERS; ) {
+        write (n++);
+        if (pthread_tryjoin_np (Readers[i].thread, NULL) == 0) {
+            i++;
+        }
+    }
+
+    for (i = 0; i < TEST_READERS; i++) {
+        Total += Reads;
+        TEST_CHECK (Readers[i].torn == 0);
+        TEST_CHECK (Readers[i].backwards == 0);
+    }
+
+    return n;
+}
+
+
+static void TEST_Step (uint64_t n)
+{
+    struct timespec actual, expected;
+    TestStep *s = &Steps[(n + 1) % TEST_STEPS];
+
+    clock_gettime (CLOCK_MONOTONIC, &actual);
+    expected = actual;
+    expected.tv_sec += TEST_STEP_NS / 1000000000ULL;
+
+    // Offset (n + 1) steps from here on
+    __atomic_store_n (&s->step, 0, __ATOMIC_RELEASE);
+    s->base = (uint64_t)actual.tv_sec * 1000000000ULL + actual.tv_nsec;
+    __atomic_store_n (&s->step, n + 1, __ATOMIC_RELEASE);
+
+    SYSTIME_Rebase (&expected, &actual);
+}
+
+
+static void TEST_Fold (uint64_t n)
+{
+    SYSTIME_Trim (TEST_TRIM_PPB);
+}
+
+
+int main (int argc, char *argv[])
+{
+    struct timeval slew = { .tv_sec = 100, .tv_usec = 0 };
+    uint64_t steps, folds, m0, m, r;
+    double expected;
+
+    if (argc > 1) {
+        Reads = atol (argv[1]);
+    }
+
+    // Steps, every read is on one of the two time lines
+    SYSTIME_Init (&TestBackend);
+    steps = TEST_Run (TEST_StepReader, TEST_Step);
+
+    // Folds, CLOCK_REALTIME keeps increasing at the trimmed and slewed rate
+    SYSTIME_Init (&TestBackend);
+    m0 = TEST_Read (CLOCK_MONOTONIC);
+    TEST_CHECK (adjtime (&slew, NULL) == 0);
+    folds = TEST_Run (TEST_FoldReader, TEST_Fold);
+
+    // Each fold truncates the correction by less than 2 ns
+    m = TEST_Read (CLOCK_MONOTONIC);
+    r = TEST_Read (CLOCK_REALTIME);
+    expected = m + (m - m0) * (TEST_TRIM_PPB + SYSTIME_CONF_SLEW_PPM * 1000) / 1e9;
+    TEST_NEAR (r, expected, 2.0 * folds + 1000);
+
+    printf ("seqlock: %llu reads, %llu steps, %llu folds\n",
+            (unsigned long long)Total, (unsigned long long)steps, (unsigned long long)folds);
+
+    return TEST_RESULT ("seqlock");
+}
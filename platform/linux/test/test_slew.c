@@ -0,0 +1,276 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * Slewing and trimming of CLOCK_REALTIME against a drifting oscillator:
+ * the backend runs off the true time by a frequency error the test sets.
+ */
+
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include <systime.h>
+
+#include "test.h"
+
+#define TEST_DRIFT_PPB      50000
+
+/** Interval of the clock discipline, s */
+#define TEST_POLL_S         16
+
+typedef struct {
+    int64_t     true_ns;    // Reference time
+    int64_t     base_ns;    // Backend time at the last drift change
+    int64_t     since_ns;   // Reference time at the last drift change
+    int32_t     drift_ppb;  // Frequency error of the backend
+} TestOscillator;
+
+static TestOscillator Osc;
+
+
+/**
+ * @brief  Backend time of the drifting oscillator, ns.
+ */
+static int64_t TEST_BackendNs (void)
+{
+    int64_t dt = Osc.true_ns - Osc.since_ns;
+
+    return Osc.base_ns + dt + dt / 1000 * Osc.drift_ppb / 1000000;
+}
+
+
+static void TEST_SetDrift (int32_t ppb)
+{
+    Osc.base_ns = TEST_BackendNs ();
+    Osc.since_ns = Osc.true_ns;
+    Osc.drift_ppb = ppb;
+}
+
+
+static int TEST_BackendInit (void)
+{
+    return 0;
+}
+
+
+static uint32_t TEST_BackendFrequency (void)
+{
+    return 1000000000UL;
+}
+
+
+static void TEST_BackendNanoTime (SysTime *tm)
+{
+    int64_t ns = TEST_BackendNs ();
+
+    tm->tv_sec = (uint32_t)(ns / 1000000000);
+    tm->tv_nsec = (uint32_t)(ns % 1000000000);
+}
+
+
+static uint32_t TEST_BackendTime (void)
+{
+    return (uint32_t)(TEST_BackendNs () / 1000000000);
+}
+
+
+static void TEST_BackendTrigger (SysTime *tm, void (*callback) (void))
+{
+}
+
+
+static SysTimeBackend TestBackend = {
+    .init               = TEST_BackendInit,
+    .getFrequency       = TEST_BackendFrequency,
+    .getSystemTime      = TEST_BackendTime,
+    .getSystemNanoTime  = TEST_BackendNanoTime,
+    .trigger            = TEST_BackendTrigger,
+};
+
+
+/**
+ * @brief  Start over with the clocks at zero and the backend drifting.
+ */
+static void TEST_Start (int32_t drift_ppb)
+{
+    struct timespec zero = { 0, 0 };
+
+    Osc.true_ns = 0;
+    Osc.base_ns = 0;
+    Osc.since_ns = 0;
+    Osc.drift_ppb = drift_ppb;
+
+    SYSTIME_Init (&TestBackend);
+    clock_settime (CLOCK_REALTIME, &zero);
+}
+
+
+/**
+ * @brief  CLOCK_REALTIME minus the true time, ns.
+ */
+static int64_t TEST_Error (void)
+{
+    struct timespec t;
+
+    clock_gettime (CLOCK_REALTIME, &t);
+    return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec - Osc.true_ns;
+}
+
+
+/**
+ * @brief  Run for the given time, checking the rate of CLOCK_REALTIME
+ *         every second.
+ * @param  s Seconds to run.
+ * @param  max_ppm Largest rate error allowed.
+ */
+static void TEST_Run (uint32_t s, double max_ppm)
+{
+    int64_t prev = TEST_Error (), err;
+    uint32_t i;
+
+    for (i = 0; i < s; i++) {
+        Osc.true_ns += 1000000000;
+        err = TEST_Error ();
+        TEST_NEAR (err - prev, 0, max_ppm * 1000 + 1);
+        prev = err;
+    }
+}
+
+
+static void TEST_Drift (void)
+{
+    int32_t trim = (int32_t)(-(int64_t)TEST_DRIFT_PPB * 1000000000 / (1000000000 + TEST_DRIFT_PPB));
+
+    // Untrimmed, the error of the oscillator shows
+    TEST_Start (TEST_DRIFT_PPB);
+    TEST_Run (1000, TEST_DRIFT_PPB / 1000.0);
+    TEST_NEAR (TEST_Error (), TEST_DRIFT_PPB * 1000.0, 1000);
+
+    // Trimmed, only the rounding of the trim to ppb is left
+    TEST_Start (TEST_DRIFT_PPB);
+    TEST_CHECK (SYSTIME_Trim (trim) == 0);
+    TEST_CHECK (SYSTIME_GetTrim () == trim);
+    TEST_Run (1000, 0.002);
+    TEST_NEAR (TEST_Error (), 0, 2000);
+
+    // Out of range
+    TEST_CHECK (SYSTIME_Trim (SYSTIME_CONF_TRIM_MAX_PPB + 1) == -1);
+    TEST_CHECK (SYSTIME_GetTrim () == trim);
+}
+
+
+static void TEST_Slew (void)
+{
+    const int64_t offset = 50000000;
+    const uint32_t slew_s = (uint32_t)(offset / (SYSTIME_CONF_SLEW_PPM * 1000));
+    struct timespec t;
+    struct timeval delta, old;
+
+    // A small correction is slewed in at the bounded rate, both ways
+    TEST_Start (0);
+    t.tv_sec = 0;
+    t.tv_nsec = offset;
+    TEST_CHECK (clock_settime (CLOCK_REALTIME, &t) == 0);
+    TEST_NEAR (TEST_Error (), 0, 1);
+    TEST_Run (slew_s / 2, SYSTIME_CONF_SLEW_PPM);
+    TEST_NEAR (TEST_Error (), offset / 2, 1000);
+    TEST_Run (slew_s, SYSTIME_CONF_SLEW_PPM);
+    TEST_NEAR (TEST_Error (), offset, 1000);
+
+    t.tv_sec = 200;
+    t.tv_nsec = 0;
+    Osc.true_ns = (int64_t)t.tv_sec * 1000000000 + offset;
+    TEST_CHECK (clock_settime (CLOCK_REALTIME, &t) == 0);
+    TEST_Run (2 * slew_s, SYSTIME_CONF_SLEW_PPM);
+    TEST_NEAR (TEST_Error (), -offset, 1000);
+
+    // A large one steps
+    t.tv_sec = 1000;
+    t.tv_nsec = 0;
+    TEST_CHECK (clock_settime (CLOCK_REALTIME, &t) == 0);
+    TEST_NEAR (TEST_Error (), 1000000000LL * t.tv_sec - Osc.true_ns, 1);
+
+    // adjtime () reports what is left and replaces it
+    TEST_Start (0);
+    delta.tv_sec = 0;
+    delta.tv_usec = 40000;
+    TEST_CHECK (adjtime (&delta, NULL) == 0);
+    TEST_Run (40, SYSTIME_CONF_SLEW_PPM);
+    TEST_CHECK (adjtime (NULL, &old) == 0);
+    TEST_NEAR (old.tv_sec * 1000000.0 + old.tv_usec, 20000, 1);
+    delta.tv_usec = -10000;
+    TEST_CHECK (adjtime (&delta, &old) == 0);
+    TEST_NEAR (old.tv_usec, 20000, 1);
+    TEST_Run (40, SYSTIME_CONF_SLEW_PPM);
+    TEST_NEAR (TEST_Error (), 10000000, 1000);
+
+    delta.tv_usec = 1000000;
+    TEST_CHECK (adjtime (&delta, NULL) == -1);
+}
+
+
+/**
+ * @brief  Discipline the clock against the true time like a time client
+ *         would: slew the offset out and steer the trim with it.
+ */
+static void TEST_Discipline (void)
+{
+    struct timeval delta;
+    int64_t err = 0;
+    int32_t trim = 0;
+    int i;
+
+    TEST_Start (TEST_DRIFT_PPB);
+
+    for (i = 0; i < 2 * 3600 / TEST_POLL_S; i++) {
+
+        // The oscillator warms up half way
+        if (i == 3600 / TEST_POLL_S) {
+            TEST_CHECK (llabs (err) < 2000);
+            TEST_NEAR (trim, -TEST_DRIFT_PPB, 100);
+            TEST_SetDrift (TEST_DRIFT_PPB - 20000);
+        }
+
+        TEST_Run (TEST_POLL_S, SYSTIME_CONF_SLEW_PPM + SYSTIME_CONF_TRIM_MAX_PPB / 1000.0);
+
+        err = TEST_Error ();
+        trim -= (int32_t)(err / TEST_POLL_S / 4);
+        if (trim > SYSTIME_CONF_TRIM_MAX_PPB) {
+            trim = SYSTIME_CONF_TRIM_MAX_PPB;
+        } else if (trim < -SYSTIME_CONF_TRIM_MAX_PPB) {
+            trim = -SYSTIME_CONF_TRIM_MAX_PPB;
+        }
+        TEST_CHECK (SYSTIME_Trim (trim) == 0);
+
+        delta.tv_sec = 0;
+        delta.tv_usec = (long)(-err / 1000);
+        TEST_CHECK (adjtime (&delta, NULL) == 0);
+    }
+
+    TEST_CHECK (llabs (err) < 2000);
+    TEST_NEAR (trim, 20000 - TEST_DRIFT_PPB, 100);
+}
+
+
+int main (void)
+{
+    TEST_Drift ();
+    TEST_Slew ();
+    TEST_Discipline ();
+
+    return TEST_RESULT ("slew");
+}
@@ -0,0 +1,360 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * Mutexes of process-sync.h: workers taking turns get the mutex in FIFO
+ * order, the waiter gets it with the next events, before anyone who
+ * asks later, also when the owner exits with it or when the event queue
+ * is full at the unlock. A semaphore count handed over to a waiter that
+ * is killed before it runs goes on to the next waiter.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <protothreads.h>
+#include <process-sync.h>
+
+#include "test.h"
+
+#define TEST_WORKERS        4
+#define TEST_ROUNDS         1000
+
+static struct process_mutex Mutex;
+static struct process_sem Sem;
+
+/** Acquisitions in order, by worker */
+static int Order[TEST_WORKERS * TEST_ROUNDS];
+static int Acquired;
+
+/** Events dispatched to the workers, and at the last unlock */
+static uint32_t Dispatched;
+static uint32_t UnlockedAt;
+static uint64_t UnlockedNs;
+static uint32_t HandoffMax;
+static uint64_t HandoffNs;
+
+static int Holding;
+static int Got;
+static int GotAtUnlock;
+static int Left;
+static int SemGot[2];
+
+PROCESS (TEST_Worker0, "Worker 0");
+PROCESS (TEST_Worker1, "Worker 1");
+PROCESS (TEST_Worker2, "Worker 2");
+PROCESS (TEST_Worker3, "Worker 3");
+PROCESS (TEST_Holder, "Holder");
+PROCESS (TEST_Waiter, "Waiter");
+PROCESS (TEST_Leaver, "Leaver");
+PROCESS (TEST_Idle, "Idle");
+PROCESS (TEST_SemWaiter0, "Semaphore waiter 0");
+PROCESS (TEST_SemWaiter1, "Semaphore waiter 1");
+
+static struct process *const Workers[TEST_WORKERS] = {
+    &TEST_Worker0, &TEST_Worker1, &TEST_Worker2, &TEST_Worker3
+};
+
+
+/**
+ * @brief  Host monotonic time, ns. The host clock_gettime () is replaced
+ *         by systime.c, so ask the kernel.
+ */
+static uint64_t TEST_Ns (void)
+{
+    struct timespec t;
+
+    syscall (SYS_clock_gettime, CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+
+/**
+ * @brief  Body of a worker: lock, hold over an event, unlock, and come
+ *         back for more.
+ */
+static PT_THREAD (TEST_Work (struct pt *process_pt, process_event_t ev, process_data_t data, int id))
+{
+    static uint32_t handoff;
+
+    PROCESS_BEGIN ();
+
+    while (Acquired < TEST_WORKERS * TEST_ROUNDS) {
+
+        PROCESS_MUTEX_LOCK (&Mutex);
+
+        if (Acquired > 0) {
+            handoff = Dispatched - UnlockedAt;
+            HandoffMax = handoff > HandoffMax ? handoff : HandoffMax;
+            HandoffNs += TEST_Ns () - UnlockedNs;
+        }
+        if (Acquired < TEST_WORKERS * TEST_ROUNDS) {
+            Order[Acquired] = id;
+        }
+        Acquired++;
+
+        PROCESS_PAUSE ();
+
+        UnlockedAt = Dispatched;
+        UnlockedNs = TEST_Ns ();
+        PROCESS_MUTEX_UNLOCK (&Mutex);
+
+        PROCESS_PAUSE ();
+    }
+
+    PROCESS_END ();
+}
+
+
+#define TEST_WORKER(n)                                                  \
+PROCESS_THREAD (TEST_Worker##n, ev, data)                               \
+{                                                                       \
+    Dispatched++;                                                       \
+    return TEST_Work (process_pt, ev, data, n);                         \
+}
+
+TEST_WORKER (0)
+TEST_WORKER (1)
+TEST_WORKER (2)
+TEST_WORKER (3)
+
+
+PROCESS_THREAD (TEST_Holder, ev, data)
+{
+    PROCESS_BEGIN ();
+
+    PROCESS_MUTEX_LOCK (&Mutex);
+    Holding = 1;
+
+    // Unlock when polled, or exit with the mutex on an exit event
+    PROCESS_WAIT_EVENT_UNTIL (ev == PROCESS_EVENT_POLL);
+    PROCESS_MUTEX_UNLOCK (&Mutex);
+    GotAtUnlock = Got;
+    Holding = 0;
+
+    PROCESS_END ();
+}
+
+
+PROCESS_THREAD (TEST_Waiter, ev, data)
+{
+    PROCESS_BEGIN ();
+
+    PROCESS_MUTEX_LOCK (&Mutex);
+    Got = 1;
+
+    PROCESS_WAIT_EVENT_UNTIL (ev == PROCESS_EVENT_POLL);
+    PROCESS_MUTEX_UNLOCK (&Mutex);
+
+    PROCESS_END ();
+}
+
+
+PROCESS_THREAD (TEST_Leaver, ev, data)
+{
+    PROCESS_BEGIN ();
+
+    PROCESS_MUTEX_LOCK (&Mutex);
+    Left = 1;
+
+    PROCESS_END ();
+}
+
+
+PROCESS_THREAD (TEST_Idle, ev, data)
+{
+    PROCESS_BEGIN ();
+
+    PROCESS_WAIT_EVENT_UNTIL (0);
+
+    PROCESS_END ();
+}
+
+
+#define TEST_SEM_WAITER(n)                                                 \
+PROCESS_THREAD (TEST_SemWaiter##n, ev, data)                               \
+{                                                                          \
+    PROCESS_BEGIN ();                                                      \
+    PROCESS_SEM_WAIT (&Sem);                                               \
+    SemGot[n] = 1;                                                         \
+    PROCESS_END ();                                                        \
+}
+
+TEST_SEM_WAITER (0)
+TEST_SEM_WAITER (1)
+
+
+static void TEST_Fairness (void)
+{
+    int i, n[TEST_WORKERS] = { 0 };
+
+    process_init ();
+    PROCESS_MUTEX_INIT (&Mutex);
+
+    for (i = 0; i < TEST_WORKERS; i++) {
+        process_start (Workers[i], NULL);
+    }
+    while (process_run () > 0);
+
+    // The workers queued at the end take their turn too
+    TEST_CHECK (Acquired >= TEST_WORKERS * TEST_ROUNDS);
+    TEST_CHECK (Acquired < TEST_WORKERS * (TEST_ROUNDS + 1));
+    TEST_CHECK (Mutex.owner == NULL);
+
+    // Strict turns, no worker overtakes the queue
+    for (i = 0; i < TEST_WORKERS * TEST_ROUNDS; i++) {
+        n[Order[i]]++;
+        if (i >= TEST_WORKERS && Order[i] != Order[i - TEST_WORKERS]) {
+            break;
+        }
+    }
+    TEST_CHECK (i == TEST_WORKERS * TEST_ROUNDS);
+    for (i = 0; i < TEST_WORKERS; i++) {
+        TEST_CHECK (n[i] == TEST_ROUNDS);
+    }
+
+    printf ("sync: hand-off within %u events, mean %.0f ns\n",
+            HandoffMax, (double)HandoffNs / (TEST_WORKERS * TEST_ROUNDS - 1));
+
+    // Ahead of the wakeup are only the events of the other workers
+    TEST_CHECK (HandoffMax <= TEST_WORKERS);
+}
+
+
+/**
+ * @brief  The owner exits with the mutex, by an exit event or by
+ *         ending, the waiter gets it.
+ */
+static void TEST_Exit (void)
+{
+    process_init ();
+    PROCESS_MUTEX_INIT (&Mutex);
+    Holding = Got = 0;
+
+    process_start (&TEST_Holder, NULL);
+    process_start (&TEST_Waiter, NULL);
+    while (process_run () > 0);
+    TEST_CHECK (Holding && !Got);
+
+    process_exit (&TEST_Holder);
+    while (process_run () > 0);
+    TEST_CHECK (Got);
+    TEST_CHECK (Mutex.owner == &TEST_Waiter);
+
+    // Nobody waiting, unlocked
+    process_exit (&TEST_Waiter);
+    TEST_CHECK (Mutex.owner == NULL);
+
+    // Ending while holding it, the next in the queue gets it
+    Holding = Got = Left = 0;
+    process_start (&TEST_Holder, NULL);
+    process_start (&TEST_Leaver, NULL);
+    process_start (&TEST_Waiter, NULL);
+    while (process_run () > 0);
+    TEST_CHECK (Holding && !Left && !Got);
+
+    process_poll (&TEST_Holder);
+    while (process_run () > 0);
+    TEST_CHECK (Left && Got);
+    TEST_CHECK (Mutex.owner == &TEST_Waiter);
+
+    process_exit (&TEST_Waiter);
+    TEST_CHECK (Mutex.owner == NULL);
+}
+
+
+/**
+ * @brief  The event queue is full at the unlock, the wakeup is not lost.
+ */
+static void TEST_Full (void)
+{
+    int posted = 0;
+
+    process_init ();
+    PROCESS_MUTEX_INIT (&Mutex);
+    Got = 0;
+
+    process_start (&TEST_Idle, NULL);
+    process_start (&TEST_Holder, NULL);
+    process_start (&TEST_Waiter, NULL);
+    while (process_run () > 0);
+    TEST_CHECK (Holding && !Got);
+
+    while (process_post (&TEST_Idle, PROCESS_EVENT_CONTINUE, NULL) == PROCESS_ERR_OK) {
+        posted++;
+    }
+    TEST_CHECK (posted > 0);
+
+    // Polls do not take the queue, the holder unlocks with it full. The
+    // waiter runs later from the poll, not from within the unlock
+    process_poll (&TEST_Holder);
+    while (process_run () > 0);
+    TEST_CHECK (!Holding);
+    TEST_CHECK (!GotAtUnlock);
+    TEST_CHECK (Got);
+    TEST_CHECK (Mutex.owner == &TEST_Waiter);
+
+    process_exit (&TEST_Waiter);
+    process_exit (&TEST_Idle);
+}
+
+
+/**
+ * @brief  The waiter woken up with the count is killed before it runs,
+ *         the count is not lost.
+ */
+static void TEST_SemExit (void)
+{
+    process_init ();
+    PROCESS_SEM_INIT (&Sem, 0);
+    SemGot[0] = SemGot[1] = 0;
+
+    process_start (&TEST_SemWaiter0, NULL);
+    process_start (&TEST_SemWaiter1, NULL);
+    while (process_run () > 0);
+
+    PROCESS_SEM_SIGNAL (&Sem);
+    TEST_CHECK (TEST_SemWaiter0.granted == &Sem);
+    process_exit (&TEST_SemWaiter0);
+    while (process_run () > 0);
+    TEST_CHECK (!SemGot[0] && SemGot[1]);
+
+    // Taken by the one that resumed, not given back when it ends
+    TEST_CHECK (Sem.count == 0);
+
+    // Nobody else waiting, back to the semaphore
+    process_start (&TEST_SemWaiter0, NULL);
+    while (process_run () > 0);
+    PROCESS_SEM_SIGNAL (&Sem);
+    process_exit (&TEST_SemWaiter0);
+    while (process_run () > 0);
+    TEST_CHECK (!SemGot[0]);
+    TEST_CHECK (Sem.count == 1);
+}
+
+
+int main (void)
+{
+    TEST_Fairness ();
+    TEST_Exit ();
+    TEST_Full ();
+    TEST_SemExit ();
+
+    return TEST_RESULT ("sync");
+}
@@ -0,0 +1,280 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * Two nodes synchronizing their clocks with timesync.c over a pair of
+ * pipes. The server runs in a child process on the true time, the client
+ * on an oscillator with a frequency error and an initial offset.
+ *
+ * The pipes carry the frames with the time they are due at the other
+ * end, the receiver moves its true time on to it and feeds them a byte
+ * at a time like a UART would. The true time is virtual, so the result
+ * does not depend on how late the host schedules the nodes. Every frame
+ * is delayed by TEST_LATENCY_US
+ * plus a random jitter of up to TEST_JITTER_US, the asymmetry of an
+ * exchange shows as offset error of up to half the jitter.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <systime.h>
+#include <timesync.h>
+
+#include "test.h"
+
+#define TEST_LATENCY_US     2000
+#define TEST_JITTER_US      400
+
+/** Frequency error and initial offset of the client */
+#define TEST_DRIFT_PPB      100000
+#define TEST_OFFSET_NS      1000000000LL
+
+#define TEST_EXCHANGES      40
+#define TEST_POLL_MS        100
+
+/** Exchanges to settle before the error is checked */
+#define TEST_SETTLE         4
+
+typedef struct {
+    int64_t     due_ns;     // True time of the delivery
+    int32_t     len;
+} TestRecord;
+
+static int64_t Now;
+static int64_t Offset;
+static int32_t Drift;
+
+
+/**
+ * @brief  True time since the start, ns.
+ */
+static int64_t TEST_TrueNs (void)
+{
+    return Now;
+}
+
+
+static void TEST_SleepUntil (int64_t ns)
+{
+    if (ns > Now) {
+        Now = ns;
+    }
+}
+
+
+static int TEST_BackendInit (void)
+{
+    return 0;
+}
+
+
+static uint32_t TEST_BackendFrequency (void)
+{
+    return 1000000000UL;
+}
+
+
+/**
+ * @brief  Oscillator of the node, the true time with its error.
+ */
+static void TEST_BackendNanoTime (SysTime *tm)
+{
+    int64_t ns = TEST_TrueNs ();
+
+    ns += Offset + ns / 1000 * Drift / 1000000;
+    tm->tv_sec = (uint32_t)(ns / 1000000000);
+    tm->tv_nsec = (uint32_t)(ns % 1000000000);
+}
+
+
+static uint32_t TEST_BackendTime (void)
+{
+    SysTime tm;
+
+    TEST_BackendNanoTime (&tm);
+    return tm.tv_sec;
+}
+
+
+static void TEST_BackendTrigger (SysTime *tm, void (*callback) (void))
+{
+}
+
+
+static SysTimeBackend TestBackend = {
+    .init               = TEST_BackendInit,
+    .getFrequency       = TEST_BackendFrequency,
+    .getSystemTime      = TEST_BackendTime,
+    .getSystemNanoTime  = TEST_BackendNanoTime,
+    .trigger            = TEST_BackendTrigger,
+};
+
+
+/**
+ * @brief  Transport of TimeSync, sends the frame with its delivery time.
+ */
+static int TEST_Write (void *arg, const uint8_t *data, int len)
+{
+    uint8_t buf[sizeof (TestRecord) + TIMESYNC_FRAME_MAX];
+    TestRecord rec;
+
+    rec.due_ns = TEST_TrueNs () + 1000LL * (TEST_LATENCY_US + rand () % (TEST_JITTER_US + 1));
+    rec.len = len;
+    memcpy (buf, &rec, sizeof (rec));
+    memcpy (buf + sizeof (rec), data, len);
+
+    // Below PIPE_BUF, written at once
+    return write (*(int *)arg, buf, sizeof (rec) + len) == (ssize_t)(sizeof (rec) + len) ? len : -1;
+}
+
+
+static int TEST_Read (int fd, void *buf, int len)
+{
+    uint8_t *p = buf;
+    ssize_t n;
+
+    while (len > 0) {
+        n = read (fd, p, len);
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief  Receive the next frame when it is due.
+ * @retval 0 if received, -1 at the end of the stream.
+ */
+static int TEST_Receive (int fd, TimeSync *ts)
+{
+    uint8_t data[TIMESYNC_FRAME_MAX];
+    TestRecord rec;
+    int i;
+
+    if (TEST_Read (fd, &rec, sizeof (rec)) != 0 || rec.len > TIMESYNC_FRAME_MAX ||
+        TEST_Read (fd, data, rec.len) != 0) {
+        return -1;
+    }
+
+    TEST_SleepUntil (rec.due_ns);
+    for (i = 0; i < rec.len; i++) {
+        TIMESYNC_Input (ts, &data[i], 1);
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief  Answer the requests until the client hangs up.
+ */
+static void TEST_Server (int rx, int tx)
+{
+    TimeSync ts;
+
+    srand (2);
+    SYSTIME_Init (&TestBackend);
+    TIMESYNC_Init (&ts, TEST_Write, &tx);
+
+    while (TEST_Receive (rx, &ts) == 0);
+}
+
+
+/**
+ * @brief  CLOCK_REALTIME of the client minus the true time, ns.
+ */
+static int64_t TEST_Error (void)
+{
+    struct timespec t;
+
+    clock_gettime (CLOCK_REALTIME, &t);
+    return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec - TEST_TrueNs ();
+}
+
+
+int main (void)
+{
+    int c2s[2], s2c[2];
+    int64_t err, max = 0, sum = 0;
+    uint64_t delay = 0;
+    TimeSync ts;
+    pid_t pid;
+    int i, status;
+
+    if (pipe (c2s) != 0 || pipe (s2c) != 0) {
+        perror ("pipe");
+        return 1;
+    }
+
+    pid = fork ();
+    if (pid == 0) {
+        close (c2s[1]);
+        close (s2c[0]);
+        TEST_Server (c2s[0], s2c[1]);
+        _exit (0);
+    }
+    close (c2s[0]);
+    close (s2c[1]);
+
+    srand (1);
+    Offset = TEST_OFFSET_NS;
+    Drift = TEST_DRIFT_PPB;
+    SYSTIME_Init (&TestBackend);
+    TIMESYNC_Init (&ts, TEST_Write, &c2s[1]);
+
+    for (i = 0; i < TEST_EXCHANGES; i++) {
+
+        err = TEST_Error ();
+        if (i == 0) {
+            TEST_NEAR (err, TEST_OFFSET_NS, 1000000);
+        } else if (i >= TEST_SETTLE) {
+            max = llabs (err) > max ? llabs (err) : max;
+            sum += llabs (err);
+            delay += ts.delay_ns;
+        }
+
+        TEST_CHECK (TIMESYNC_Request (&ts) >= 0);
+        TEST_CHECK (TEST_Receive (s2c[0], &ts) == 0);
+        TEST_CHECK (!ts.pending);
+
+        TEST_SleepUntil ((i + 1) * TEST_POLL_MS * 1000000LL);
+    }
+
+    close (c2s[1]);
+    TEST_CHECK (waitpid (pid, &status, 0) == pid && WIFEXITED (status) && WEXITSTATUS (status) == 0);
+
+    i = TEST_EXCHANGES - TEST_SETTLE;
+    printf ("timesync: offset error max %lld us, mean %lld us, delay %llu us\n",
+            (long long)max / 1000, (long long)sum / i / 1000, (unsigned long long)delay / i / 1000);
+
+    TEST_CHECK (ts.exchanges == TEST_EXCHANGES);
+    TEST_CHECK (ts.rejected == 0 && ts.errors == 0);
+    TEST_CHECK (delay / i >= 2000ULL * TEST_LATENCY_US);
+
+    // Asymmetry of an exchange and the drift until the next one
+    TEST_CHECK (max < 1000LL * (TEST_JITTER_US / 2) + TEST_DRIFT_PPB / 1000 * TEST_POLL_MS);
+
+    return TEST_RESULT ("timesync");
+}
@@ -0,0 +1,493 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Checks the output of trace2json. The file must be JSON, an object with
+ * a traceEvents array of the Chrome trace format, and make a consistent
+ * timeline: every thread used is named, the time stamps do not go back
+ * and the begins and ends of every thread pair up by name. An end with
+ * no begin is allowed before the first begin of the thread, the begin
+ * was lost with the oldest records of the ring.
+ *
+ * Every kind of trace point must show up: deliveries, posts, polls,
+ * timer expiries and sleeps. The cost of a trace point in otherData must
+ * be within its budget, see PROCESS_TRACE_CONF_BUDGET.
+ *
+ * Usage: trace_check trace.json
+ */
+
+#define CHECK_THREADS       256
+#define CHECK_DEPTH         16
+#define CHECK_NAME          64
+
+/** Thread of the kernel in trace2json */
+#define CHECK_KERNEL_TID    1
+
+/** Kinds of trace points */
+#define CHECK_BEGIN         (1 << 0)
+#define CHECK_END           (1 << 1)
+#define CHECK_POLL          (1 << 2)
+#define CHECK_POST          (1 << 3)
+#define CHECK_TIMER         (1 << 4)
+#define CHECK_SLEEP         (1 << 5)
+#define CHECK_WAKE          (1 << 6)
+#define CHECK_ALL           ((1 << 7) - 1)
+
+typedef struct {
+    char        ph[4];
+    char        name[CHECK_NAME];
+    double      tid;
+    double      ts;
+    int         has_tid;
+    int         has_ts;
+} CheckEvent;
+
+typedef struct {
+    int         named;
+    int         used;
+    int         begun;
+    int         depth;
+    char        open[CHECK_DEPTH][CHECK_NAME];
+} CheckThread;
+
+typedef struct {
+    const char  *p;
+    const char  *end;
+    const char  *error;
+    CheckThread threads[CHECK_THREADS];
+    uint32_t    events;
+    double      last_ts;
+    uint32_t    seen;           // Kinds of trace points
+    double      cost;
+    double      budget;
+    int         has_cost;
+} CheckControl;
+
+static CheckControl CheckCtrl;
+
+
+static void CHECK_Space (void)
+{
+    while (CheckCtrl.p < CheckCtrl.end && isspace ((unsigned char)*CheckCtrl.p)) {
+        CheckCtrl.p++;
+    }
+}
+
+
+static int CHECK_Fail (const char *error)
+{
+    if (CheckCtrl.error == NULL) {
+        CheckCtrl.error = error;
+    }
+
+    return -1;
+}
+
+
+static int CHECK_Char (char c)
+{
+    CHECK_Space ();
+    if (CheckCtrl.p == CheckCtrl.end || *CheckCtrl.p != c) {
+        return CHECK_Fail ("unexpected character");
+    }
+    CheckCtrl.p++;
+
+    return 0;
+}
+
+
+static int CHECK_Peek (char c)
+{
+    CHECK_Space ();
+
+    return CheckCtrl.p < CheckCtrl.end && *CheckCtrl.p == c;
+}
+
+
+/**
+ * @brief  Parse a string, keep as much of it as fits in buf.
+ */
+static int CHECK_String (char *buf, size_t len)
+{
+    size_t n = 0;
+    int i;
+
+    if (CHECK_Char ('"') != 0) {
+        return -1;
+    }
+
+    while (CheckCtrl.p < CheckCtrl.end && *CheckCtrl.p != '"') {
+        char c = *CheckCtrl.p++;
+
+        if ((unsigned char)c < 0x20) {
+            return CHECK_Fail ("control character in a string");
+        }
+        if (c == '\\') {
+            if (CheckCtrl.p == CheckCtrl.end || *CheckCtrl.p == '\0' || strchr ("\"\\/bfnrtu", *CheckCtrl.p) == NULL) {
+                return CHECK_Fail ("invalid escape");
+            }
+            c = *CheckCtrl.p++;
+            if (c == 'u') {
+                for (i = 0; i < 4; i++) {
+                    if (CheckCtrl.p == CheckCtrl.end || !isxdigit ((unsigned char)*CheckCtrl.p++)) {
+                        return CHECK_Fail ("invalid escape");
+                    }
+                }
+                c = '?';
+            }
+        }
+        if (buf != NULL && n + 1 < len) {
+            buf[n++] = c;
+        }
+    }
+
+    if (buf != NULL) {
+        buf[n] = '\0';
+    }
+
+    return CHECK_Char ('"');
+}
+
+
+static int CHECK_Number (double *value)
+{
+    const char *p = CheckCtrl.p;
+    char *end;
+
+    // The grammar of JSON, stricter than strtod ()
+    if (p < CheckCtrl.end && *p == '-') {
+        p++;
+    }
+    if (p == CheckCtrl.end || !isdigit ((unsigned char)*p) || (*p == '0' && p + 1 < CheckCtrl.end && isdigit ((unsigned char)p[1]))) {
+        return CHECK_Fail ("invalid number");
+    }
+
+    *value = strtod (CheckCtrl.p, &end);
+    if (end == CheckCtrl.p || end > CheckCtrl.end) {
+        return CHECK_Fail ("invalid number");
+    }
+    CheckCtrl.p = end;
+
+    return 0;
+}
+
+
+static int CHECK_Value (int depth);
+
+
+static int CHECK_Members (int depth, int (*member) (const char *key, void *arg), void *arg)
+{
+    char key[CHECK_NAME];
+
+    if (CHECK_Char ('{') != 0) {
+        return -1;
+    }
+    if (CHECK_Peek ('}')) {
+        return CHECK_Char ('}');
+    }
+
+    do {
+        if (CHECK_String (key, sizeof (key)) != 0 || CHECK_Char (':') != 0) {
+            return -1;
+        }
+        if (member != NULL ? member (key, arg) != 0 : CHECK_Value (depth + 1) != 0) {
+            return -1;
+        }
+    } while (CHECK_Peek (',') && CHECK_Char (',') == 0);
+
+    return CHECK_Char ('}');
+}
+
+
+/**
+ * @brief  Parse any value.
+ */
+static int CHECK_Value (int depth)
+{
+    double number;
+
+    if (depth > CHECK_DEPTH) {
+        return CHECK_Fail ("nested too deep");
+    }
+
+    CHECK_Space ();
+    if (CheckCtrl.p == CheckCtrl.end) {
+        return CHECK_Fail ("unexpected end");
+    }
+
+    switch (*CheckCtrl.p) {
+        case '{':
+            return CHECK_Members (depth, NULL, NULL);
+        case '[':
+            CheckCtrl.p++;
+            if (CHECK_Peek (']')) {
+                return CHECK_Char (']');
+            }
+            do {
+                if (CHECK_Value (depth + 1) != 0) {
+                    return -1;
+                }
+            } while (CHECK_Peek (',') && CHECK_Char (',') == 0);
+            return CHECK_Char (']');
+        case '"':
+            return CHECK_String (NULL, 0);
+        case 't':
+        case 'f':
+        case 'n':
+            if (CheckCtrl.end - CheckCtrl.p >= 4 && strncmp (CheckCtrl.p, "true", 4) == 0) {
+                CheckCtrl.p += 4;
+            } else if (CheckCtrl.end - CheckCtrl.p >= 5 && strncmp (CheckCtrl.p, "false", 5) == 0) {
+                CheckCtrl.p += 5;
+            } else if (CheckCtrl.end - CheckCtrl.p >= 4 && strncmp (CheckCtrl.p, "null", 4) == 0) {
+                CheckCtrl.p += 4;
+            } else {
+                return CHECK_Fail ("invalid literal");
+            }
+            return 0;
+        default:
+            return CHECK_Number (&number);
+    }
+}
+
+
+static int CHECK_EventMember (const char *key, void *arg)
+{
+    CheckEvent *ev = arg;
+
+    CHECK_Space ();
+    if (strcmp (key, "ph") == 0) {
+        return CHECK_String (ev->ph, sizeof (ev->ph));
+    } else if (strcmp (key, "name") == 0) {
+        return CHECK_String (ev->name, sizeof (ev->name));
+    } else if (strcmp (key, "tid") == 0) {
+        ev->has_tid = 1;
+        return CHECK_Number (&ev->tid);
+    } else if (strcmp (key, "ts") == 0) {
+        ev->has_ts = 1;
+        return CHECK_Number (&ev->ts);
+    }
+
+    return CHECK_Value (2);
+}
+
+
+/**
+ * @brief  Note the kind of trace point the event comes from.
+ */
+static void CHECK_Kind (const CheckEvent *ev)
+{
+    if (ev->tid == CHECK_KERNEL_TID) {
+        if (strcmp (ev->name, "sleep") == 0) {
+            CheckCtrl.seen |= (ev->ph[0] == 'B') ? CHECK_SLEEP : CHECK_WAKE;
+        } else if (strcmp (ev->name, "poll") == 0) {
+            CheckCtrl.seen |= CHECK_POLL;
+        } else if (strcmp (ev->name, "timer") == 0) {
+            CheckCtrl.seen |= CHECK_TIMER;
+        }
+    } else if (ev->ph[0] == 'B') {
+        CheckCtrl.seen |= CHECK_BEGIN;
+    } else if (ev->ph[0] == 'E') {
+        CheckCtrl.seen |= CHECK_END;
+    }
+
+    // Posts from outside the processes are on the kernel thread
+    if (ev->ph[0] == 'i' && strncmp (ev->name, "post ", 5) == 0) {
+        CheckCtrl.seen |= CHECK_POST;
+    }
+}
+
+
+/**
+ * @brief  Check an event of the timeline against the ones before it.
+ */
+static int CHECK_Event (const CheckEvent *ev)
+{
+    CheckThread *t;
+
+    CheckCtrl.events++;
+
+    if (ev->ph[0] == '\0' || ev->ph[1] != '\0') {
+        return CHECK_Fail ("event without a phase");
+    }
+    if (ev->ph[0] == 'M') {
+        if (ev->has_tid && ev->tid >= 0 && ev->tid < CHECK_THREADS && strcmp (ev->name, "thread_name") == 0) {
+            CheckCtrl.threads[(int)ev->tid].named = 1;
+        }
+        return 0;
+    }
+
+    if (!ev->has_ts) {
+        return CHECK_Fail ("event without a time stamp");
+    }
+    if (ev->ts < CheckCtrl.last_ts) {
+        return CHECK_Fail ("time stamp goes back");
+    }
+    CheckCtrl.last_ts = ev->ts;
+
+    // Counters belong to the process
+    if (ev->ph[0] == 'C') {
+        return 0;
+    }
+
+    if (!ev->has_tid || ev->tid < 0 || ev->tid >= CHECK_THREADS || ev->tid != (int)ev->tid) {
+        return CHECK_Fail ("event without a valid thread");
+    }
+    t = &CheckCtrl.threads[(int)ev->tid];
+    if (!t->named) {
+        return CHECK_Fail ("event on a thread without a name");
+    }
+    t->used = 1;
+
+    CHECK_Kind (ev);
+
+    if (ev->ph[0] == 'B') {
+        if (t->depth == CHECK_DEPTH) {
+            return CHECK_Fail ("begins nested too deep");
+        }
+        strcpy (t->open[t->depth++], ev->name);
+        t->begun = 1;
+    } else if (ev->ph[0] == 'E') {
+        if (t->depth == 0) {
+            return t->begun ? CHECK_Fail ("end without a begin") : 0;
+        }
+        if (strcmp (t->open[--t->depth], ev->name) != 0) {
+            return CHECK_Fail ("end does not match the begin");
+        }
+    } else if (ev->ph[0] != 'i') {
+        return CHECK_Fail ("unknown phase");
+    }
+
+    return 0;
+}
+
+
+static int CHECK_OtherMember (const char *key, void *arg)
+{
+    CHECK_Space ();
+    if (strcmp (key, "cost") == 0) {
+        CheckCtrl.has_cost |= 1;
+        return CHECK_Number (&CheckCtrl.cost);
+    } else if (strcmp (key, "budget") == 0) {
+        CheckCtrl.has_cost |= 2;
+        return CHECK_Number (&CheckCtrl.budget);
+    }
+
+    return CHECK_Value (2);
+}
+
+
+static int CHECK_TopMember (const char *key, void *arg)
+{
+    CheckEvent ev;
+
+    if (strcmp (key, "otherData") == 0) {
+        return CHECK_Members (1, CHECK_OtherMember, NULL);
+    }
+    if (strcmp (key, "traceEvents") != 0) {
+        return CHECK_Value (1);
+    }
+
+    *(int *)arg = 1;
+    if (CHECK_Char ('[') != 0) {
+        return -1;
+    }
+    if (CHECK_Peek (']')) {
+        return CHECK_Char (']');
+    }
+
+    do {
+        memset (&ev, 0, sizeof (ev));
+        if (CHECK_Members (2, CHECK_EventMember, &ev) != 0 || CHECK_Event (&ev) != 0) {
+            return -1;
+        }
+    } while (CHECK_Peek (',') && CHECK_Char (',') == 0);
+
+    return CHECK_Char (']');
+}
+
+
+int main (int argc, char *argv[])
+{
+    static const char *kinds[] = { "begin", "end", "poll", "post", "timer", "sleep", "wake" };
+    int events = 0, open = 0, i;
+    char *buf;
+    long len;
+    FILE *file;
+
+    if (argc < 2) {
+        fprintf (stderr, "usage: %s trace.json\n", argv[0]);
+        return 1;
+    }
+
+    file = fopen (argv[1], "rb");
+    if (file == NULL || fseek (file, 0, SEEK_END) != 0 || (len = ftell (file)) < 0 ||
+        fseek (file, 0, SEEK_SET) != 0 || (buf = malloc (len + 1)) == NULL ||
+        fread (buf, 1, len, file) != (size_t)len) {
+        perror (argv[1]);
+        return 1;
+    }
+    fclose (file);
+
+    CheckCtrl.p = buf;
+    CheckCtrl.end = buf + len;
+    CheckCtrl.last_ts = -1;
+
+    if (CHECK_Members (0, CHECK_TopMember, &events) == 0) {
+        CHECK_Space ();
+        if (CheckCtrl.p != CheckCtrl.end) {
+            CHECK_Fail ("trailing data");
+        } else if (!events) {
+            CHECK_Fail ("no traceEvents");
+        } else if (CheckCtrl.has_cost != 3) {
+            CHECK_Fail ("no cost and budget in otherData");
+        }
+    }
+
+    if (CheckCtrl.error != NULL) {
+        fprintf (stderr, "%s: %s at offset %ld\n", argv[1], CheckCtrl.error, (long)(CheckCtrl.p - buf));
+        return 1;
+    }
+
+    for (i = 0; i < (int)(sizeof (kinds) / sizeof (kinds[0])); i++) {
+        if (!(CheckCtrl.seen & (1 << i))) {
+            fprintf (stderr, "%s: no %s trace point\n", argv[1], kinds[i]);
+        }
+    }
+    if (CheckCtrl.seen != CHECK_ALL) {
+        return 1;
+    }
+
+    if (CheckCtrl.cost > CheckCtrl.budget) {
+        fprintf (stderr, "%s: a trace point costs %.0f ticks, over the budget of %.0f\n",
+                 argv[1], CheckCtrl.cost, CheckCtrl.budget);
+        return 1;
+    }
+
+    for (i = 0; i < CHECK_THREADS; i++) {
+        open += CheckCtrl.threads[i].depth;
+    }
+    printf ("%s: %u events, %d begins open at the end, trace point %.0f of %.0f ticks\n",
+            argv[1], (unsigned)CheckCtrl.events, open, CheckCtrl.cost, CheckCtrl.budget);
+
+    return 0;
+}
@@ -0,0 +1,301 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <process-trace.h>
+
+/*
+ * Converts a dump of process_trace_dump () to the Chrome trace format, for
+ * chrome://tracing or ui.perfetto.dev. Every process is a thread of the
+ * timeline with its event deliveries on it; the sleeps, polls and timer
+ * expiries are on the kernel thread, the queue length is a counter. The
+ * otherData of the trace has the cost of a trace point and its budget.
+ *
+ * Usage: trace2json trace.bin > trace.json
+ */
+
+#define TRACE_KERNEL_TID    1
+
+typedef struct {
+    uint32_t    addr;
+    char        name[6 * UINT8_MAX + 1];    // Escaped for a JSON string
+} TraceProcess;
+
+typedef struct {
+    struct process_trace_header hdr;
+    struct process_trace_record *records;
+    TraceProcess                *processes;
+    uint32_t                    nprocesses;
+    uint32_t                    size;
+    int                         first;
+} TraceControl;
+
+static TraceControl TraceCtrl;
+
+
+/**
+ * @brief  Escape a name for a JSON string, dst holds 6 bytes per byte of src.
+ */
+static void TRACE_Escape (char *dst, const uint8_t *src, uint8_t len)
+{
+    uint8_t i;
+
+    for (i = 0; i < len; i++) {
+        if (src[i] == '"' || src[i] == '\\') {
+            *dst++ = '\\';
+            *dst++ = src[i];
+        } else if (src[i] < 0x20 || src[i] >= 0x7f) {
+            dst += sprintf (dst, "\\u%04x", src[i]);
+        } else {
+            *dst++ = src[i];
+        }
+    }
+    *dst = '\0';
+}
+
+
+static int TRACE_Load (const char *path)
+{
+    struct process_trace_header *hdr = &TraceCtrl.hdr;
+    uint8_t name[UINT8_MAX];
+    uint8_t len;
+    uint32_t i;
+    FILE *file;
+
+    file = fopen (path, "rb");
+    if (file == NULL) {
+        return -1;
+    }
+
+    if (fread (hdr, sizeof (*hdr), 1, file) != 1 ||
+        hdr->magic != PROCESS_TRACE_MAGIC ||
+        hdr->version != PROCESS_TRACE_VERSION ||
+        hdr->size != sizeof (struct process_trace_record)) {
+        fclose (file);
+        errno = EINVAL;
+        return -1;
+    }
+
+    TraceCtrl.records = malloc ((hdr->count + 1) * sizeof (struct process_trace_record));
+    TraceCtrl.size = hdr->processes + 16;
+    TraceCtrl.processes = malloc (TraceCtrl.size * sizeof (TraceProcess));
+    if (TraceCtrl.records == NULL || TraceCtrl.processes == NULL) {
+        fclose (file);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    if (fread (TraceCtrl.records, sizeof (struct process_trace_record), hdr->count, file) != hdr->count) {
+        fclose (file);
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (i = 0; i < hdr->processes; i++) {
+        TraceProcess *p = &TraceCtrl.processes[i];
+        if (fread (&p->addr, sizeof (p->addr), 1, file) != 1 ||
+            fread (&len, sizeof (len), 1, file) != 1 ||
+            fread (name, 1, len, file) != len) {
+            fclose (file);
+            errno = EINVAL;
+            return -1;
+        }
+        TRACE_Escape (p->name, name, len);
+    }
+    TraceCtrl.nprocesses = hdr->processes;
+
+    fclose (file);
+
+    return 0;
+}
+
+
+static void TRACE_Event (const char *fmt, ...) __attribute__ ((format (printf, 1, 2)));
+
+static void TRACE_Event (const char *fmt, ...)
+{
+    va_list ap;
+
+    printf (TraceCtrl.first ? "\n  " : ",\n  ");
+    TraceCtrl.first = 0;
+
+    va_start (ap, fmt);
+    vprintf (fmt, ap);
+    va_end (ap);
+}
+
+
+/**
+ * @brief  Thread of a process on the timeline, named after the process.
+ *         Processes exited before the dump get their address as name.
+ */
+static uint32_t TRACE_Thread (uint32_t addr)
+{
+    TraceProcess *p;
+    uint32_t i;
+
+    for (i = 0; i < TraceCtrl.nprocesses; i++) {
+        if (TraceCtrl.processes[i].addr == addr) {
+            return TRACE_KERNEL_TID + 1 + i;
+        }
+    }
+
+    if (TraceCtrl.nprocesses == TraceCtrl.size) {
+        p = realloc (TraceCtrl.processes, 2 * TraceCtrl.size * sizeof (TraceProcess));
+        if (p == NULL) {
+            return TRACE_KERNEL_TID;
+        }
+        TraceCtrl.processes = p;
+        TraceCtrl.size *= 2;
+    }
+
+    p = &TraceCtrl.processes[TraceCtrl.nprocesses];
+    p->addr = addr;
+    snprintf (p->name, sizeof (p->name), "0x%08" PRIx32, addr);
+    TRACE_Event ("{\"ph\":\"M\",\"pid\":1,\"tid\":%" PRIu32 ",\"name\":\"thread_name\",\"args\":{\"name\":\"%s\"}}",
+                 TRACE_KERNEL_TID + 1 + TraceCtrl.nprocesses, p->name);
+
+    return TRACE_KERNEL_TID + 1 + TraceCtrl.nprocesses++;
+}
+
+
+static const char *TRACE_EventName (uint8_t ev, char *buf, size_t len)
+{
+    static const char *names[] = {
+        "none", "init", "poll", "exit", "service removed", "continue",
+        "msg", "exited", "timer", "com", "wakeup"
+    };
+
+    if (ev >= PROCESS_EVENT_NONE && ev < PROCESS_EVENT_MAX) {
+        return names[ev - PROCESS_EVENT_NONE];
+    }
+    snprintf (buf, len, "event %u", ev);
+
+    return buf;
+}
+
+
+static void TRACE_Convert (void)
+{
+    const struct process_trace_header *hdr = &TraceCtrl.hdr;
+    uint64_t tick = 0, base_tick = 0;
+    double base_ns = 0, sleep_ns = 0, ns;
+    const char *name;
+    char buf[16];
+    uint32_t i;
+
+    printf ("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    TraceCtrl.first = 1;
+
+    TRACE_Event ("{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\",\"args\":{\"name\":\"protothreads\"}}");
+    TRACE_Event ("{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":\"kernel\"}}",
+                 TRACE_KERNEL_TID);
+    for (i = 0; i < TraceCtrl.nprocesses; i++) {
+        TRACE_Event ("{\"ph\":\"M\",\"pid\":1,\"tid\":%" PRIu32 ",\"name\":\"thread_name\",\"args\":{\"name\":\"%s\"}}",
+                     TRACE_KERNEL_TID + 1 + i, TraceCtrl.processes[i].name);
+    }
+
+    for (i = 0; i < hdr->count; i++) {
+        const struct process_trace_record *r = &TraceCtrl.records[i];
+
+        // The time stamps wrap around, the records are close enough
+        if (i > 0) {
+            tick += (uint32_t)(r->time - TraceCtrl.records[i - 1].time);
+        }
+        ns = base_ns + (double)(tick - base_tick) * 1e9 / hdr->hz;
+
+        switch (r->type) {
+            case PROCESS_TRACE_BEGIN:
+            case PROCESS_TRACE_END:
+                name = TRACE_EventName (r->ev, buf, sizeof (buf));
+                TRACE_Event ("{\"ph\":\"%c\",\"pid\":1,\"tid\":%" PRIu32 ",\"ts\":%.3f,\"name\":\"%s\"}",
+                             r->type == PROCESS_TRACE_BEGIN ? 'B' : 'E', TRACE_Thread (r->arg), ns / 1000, name);
+                break;
+            case PROCESS_TRACE_POST:
+                name = TRACE_EventName (r->ev, buf, sizeof (buf));
+                TRACE_Event ("{\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%" PRIu32 ",\"ts\":%.3f,\"name\":\"post %s\"}",
+                             r->arg ? TRACE_Thread (r->arg) : TRACE_KERNEL_TID, ns / 1000, name);
+                TRACE_Event ("{\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"name\":\"queue\",\"args\":{\"events\":%u}}",
+                             ns / 1000, r->queue);
+                break;
+            case PROCESS_TRACE_POLL:
+                TRACE_Event ("{\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"name\":\"poll\"}",
+                             TRACE_KERNEL_TID, ns / 1000);
+                break;
+            case PROCESS_TRACE_TIMER:
+                TRACE_Event ("{\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"name\":\"timer\",\"args\":{\"timer\":\"0x%08" PRIx32 "\"}}",
+                             TRACE_KERNEL_TID, ns / 1000, r->arg);
+                break;
+            case PROCESS_TRACE_SLEEP:
+                sleep_ns = ns;
+                TRACE_Event ("{\"ph\":\"B\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"name\":\"sleep\"}",
+                             TRACE_KERNEL_TID, ns / 1000);
+                break;
+            case PROCESS_TRACE_WAKE:
+                // The counter may have stopped, take the time slept
+                if (sleep_ns + (double)r->arg * 1000 > ns) {
+                    ns = sleep_ns + (double)r->arg * 1000;
+                }
+                base_ns = ns;
+                base_tick = tick;
+                TRACE_Event ("{\"ph\":\"E\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"name\":\"sleep\"}",
+                             TRACE_KERNEL_TID, ns / 1000);
+                break;
+            default:
+                break;
+        }
+    }
+
+    printf ("\n],\"otherData\":{\"records\":%" PRIu32 ",\"lost\":%" PRIu32 ",\"cost\":%" PRIu32 ",\"budget\":%" PRIu32 "}}\n",
+            hdr->count, hdr->lost, hdr->cost, hdr->budget);
+}
+
+
+int main (int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf (stderr, "usage: %s trace.bin > trace.json\n", argv[0]);
+        return 1;
+    }
+
+    if (TRACE_Load (argv[1]) != 0) {
+        perror (argv[1]);
+        return 1;
+    }
+
+    if (TraceCtrl.hdr.hz == 0) {
+        fprintf (stderr, "%s: no time stamp frequency\n", argv[1]);
+        return 1;
+    }
+
+    fprintf (stderr, "%" PRIu32 " records, %" PRIu32 " lost, %" PRIu32 " ticks per trace point\n",
+             TraceCtrl.hdr.count, TraceCtrl.hdr.lost, TraceCtrl.hdr.cost);
+    if (TraceCtrl.hdr.cost > TraceCtrl.hdr.budget) {
+        fprintf (stderr, "warning: trace points cost more than the budget of %" PRIu32 " ticks\n",
+                 TraceCtrl.hdr.budget);
+    }
+
+    TRACE_Convert ();
+
+    return 0;
+}
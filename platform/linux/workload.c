@@ -0,0 +1,246 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <protothreads.h>
+#include <process-record.h>
+#include <systimer.h>
+
+#include "platform-conf.h"
+
+#include "workload.h"
+
+#if PLATFORM_CONF_WORKLOAD
+
+/** Readings passed on to the logger at a time */
+#define WORKLOAD_BATCH          16
+
+/** Longest quiet time of the radio, ms */
+#define WORKLOAD_RADIO_MS       2000
+
+/** Most frames in a burst */
+#define WORKLOAD_BURST          8
+
+typedef struct {
+    uint32_t    sensor;
+    uint32_t    seq;
+    int32_t     value;
+} WorkloadReading;
+
+typedef struct {
+    SYSTIMER        timer;
+    uint32_t        period_ms;
+    WorkloadReading reading;
+} WorkloadSensor;
+
+typedef struct {
+    process_event_t sample;
+    process_event_t reading;
+    process_event_t frame;
+    process_event_t batch;
+    SYSTIMER        radio;
+    WorkloadStats   stats;
+} WorkloadControl;
+
+static WorkloadSensor Sensors[] = {
+    { .period_ms = 100 },
+    { .period_ms = 250 },
+    { .period_ms = 1000 },
+    { .period_ms = 5000 },
+    { .period_ms = 60000 },
+};
+
+#define WORKLOAD_SENSORS        (sizeof (Sensors) / sizeof (Sensors[0]))
+
+static WorkloadControl WorkloadCtrl;
+
+PROCESS (WORKLOAD_Sensors, "Sensors");
+PROCESS (WORKLOAD_Collector, "Collector");
+PROCESS (WORKLOAD_Logger, "Logger");
+PROCESS (WORKLOAD_Radio, "Radio");
+
+
+/**
+ * @brief  FNV-1a of the value into the digest.
+ */
+static void WORKLOAD_Fold (uint64_t value)
+{
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        WorkloadCtrl.stats.digest = (WorkloadCtrl.stats.digest ^ (uint8_t)(value >> (8 * i))) * 0x100000001B3ULL;
+    }
+}
+
+
+static int WORKLOAD_Sample (void *arg)
+{
+    process_post (&WORKLOAD_Sensors, WorkloadCtrl.sample, arg);
+
+    return 0;
+}
+
+
+static int WORKLOAD_Wake (void *arg)
+{
+    process_poll (&WORKLOAD_Radio);
+
+    return 0;
+}
+
+
+PROCESS_THREAD (WORKLOAD_Sensors, ev, data)
+{
+    WorkloadSensor *sensor;
+    uint32_t i;
+
+    PROCESS_BEGIN ();
+
+    for (i = 0; i < WORKLOAD_SENSORS; i++) {
+        Sensors[i].reading.sensor = i;
+        SYSTIMER_Init (&Sensors[i].timer, Sensors[i].period_ms, Sensors[i].period_ms, WORKLOAD_Sample, &Sensors[i]);
+    }
+
+    while (1) {
+        PROCESS_WAIT_EVENT_UNTIL (ev == WorkloadCtrl.sample);
+
+        sensor = data;
+        sensor->reading.seq++;
+        sensor->reading.value = (int32_t)(SIM_Random () % 4096) - 2048;
+        process_post (&WORKLOAD_Collector, WorkloadCtrl.reading, &sensor->reading);
+    }
+
+    PROCESS_END ();
+}
+
+
+PROCESS_THREAD (WORKLOAD_Collector, ev, data)
+{
+    static uint32_t pending;
+
+    PROCESS_BEGIN ();
+
+    while (1) {
+        PROCESS_WAIT_EVENT ();
+
+        WORKLOAD_Fold (SIM_Now ());
+        WORKLOAD_Fold (ev);
+
+        if (ev == WorkloadCtrl.reading) {
+            WORKLOAD_Fold (((WorkloadReading *)data)->value);
+            WorkloadCtrl.stats.readings++;
+            if (++pending == WORKLOAD_BATCH) {
+                process_post (&WORKLOAD_Logger, WorkloadCtrl.batch, (void *)(uintptr_t)pending);
+                process_poll (&WORKLOAD_Logger);
+                pending = 0;
+            }
+        } else if (ev == WorkloadCtrl.frame) {
+            WORKLOAD_Fold ((uintptr_t)data);
+            WorkloadCtrl.stats.frames++;
+        }
+    }
+
+    PROCESS_END ();
+}
+
+
+PROCESS_THREAD (WORKLOAD_Logger, ev, data)
+{
+    PROCESS_BEGIN ();
+
+    while (1) {
+        PROCESS_WAIT_EVENT ();
+
+        // The batch is written out at the poll
+        if (ev == PROCESS_EVENT_POLL) {
+            WorkloadCtrl.stats.flushes++;
+        }
+    }
+
+    PROCESS_END ();
+}
+
+
+PROCESS_THREAD (WORKLOAD_Radio, ev, data)
+{
+    static uint32_t burst;
+
+    PROCESS_BEGIN ();
+
+    while (1) {
+        SYSTIMER_Init (&WorkloadCtrl.radio, 1 + SIM_Random () % WORKLOAD_RADIO_MS, 0, WORKLOAD_Wake, NULL);
+        PROCESS_WAIT_EVENT_UNTIL (ev == PROCESS_EVENT_POLL);
+
+        for (burst = 1 + SIM_Random () % WORKLOAD_BURST; burst > 0; burst--) {
+            process_post (&WORKLOAD_Collector, WorkloadCtrl.frame, (void *)(uintptr_t)SIM_Random ());
+            PROCESS_PAUSE ();
+        }
+    }
+
+    PROCESS_END ();
+}
+
+
+/**
+ * @brief  Start the processes of the workload, after the system timer.
+ */
+void WORKLOAD_Init (void)
+{
+    memset (&WorkloadCtrl.stats, 0, sizeof (WorkloadCtrl.stats));
+    WorkloadCtrl.stats.digest = 0xCBF29CE484222325ULL;
+
+    WorkloadCtrl.sample = process_alloc_event ();
+    WorkloadCtrl.reading = process_alloc_event ();
+    WorkloadCtrl.frame = process_alloc_event ();
+    WorkloadCtrl.batch = process_alloc_event ();
+#if PROCESS_CONF_RECORD
+    process_record_payload (WorkloadCtrl.reading, sizeof (WorkloadReading));
+#endif
+
+    process_start (&WORKLOAD_Collector, NULL);
+    process_start (&WORKLOAD_Logger, NULL);
+    process_start (&WORKLOAD_Sensors, NULL);
+    process_start (&WORKLOAD_Radio, NULL);
+}
+
+
+/**
+ * @brief  Totals of the run.
+ * @param  stats Totals.
+ * @retval None.
+ */
+void WORKLOAD_GetStats (WorkloadStats *stats)
+{
+    *stats = WorkloadCtrl.stats;
+}
+
+
+/**
+ * @brief  Print the totals of the run.
+ */
+void WORKLOAD_Report (void)
+{
+    WorkloadStats *stats = &WorkloadCtrl.stats;
+
+    printf ("workload: %llu readings, %llu frames, %llu batches, digest %016llx\n",
+            (unsigned long long)stats->readings, (unsigned long long)stats->frames,
+            (unsigned long long)stats->flushes, (unsigned long long)stats->digest);
+}
+
+#endif /* PLATFORM_CONF_WORKLOAD */
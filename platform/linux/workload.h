@@ -0,0 +1,51 @@
+/**
+ * EFM32 protothreads
+ * Copyright (C) 2014 Erki Aring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef WORKLOAD_H_
+#define WORKLOAD_H_
+
+#include <stdint.h>
+
+#include <protothreads.h>
+
+/**
+ * Workload of the host platform for the simulated runs, started next to
+ * MAIN_Process. Sensors on periodic timers of 100 ms to 60 s post their
+ * readings to a collector, which passes them on to a logger in batches
+ * and polls it to flush. A radio wakes on a one-shot timer of a random
+ * period and receives a burst of frames. All randomness comes from the
+ * seed of the simulated time.
+ *
+ * The collector folds every event and its time into a digest, the same
+ * seed must give the same digest. The readings are recorded as bytes
+ * with PROCESS_CONF_RECORD, so that the runs replay.
+ *
+ * Requires the simulated time, see the Makefile.
+ */
+
+typedef struct {
+    uint64_t    readings;       // Readings of the sensors
+    uint64_t    frames;         // Frames of the radio
+    uint64_t    flushes;        // Batches of the logger
+    uint64_t    digest;         // Of every event and its time
+} WorkloadStats;
+
+void WORKLOAD_Init (void);
+void WORKLOAD_GetStats (WorkloadStats *stats);
+void WORKLOAD_Report (void);
+
+#endif /* WORKLOAD_H_ */
@@ -18,6 +18,10 @@
 #ifndef PLATFORM_H_
 #define PLATFORM_H_
 
+#if PLATFORM_LINUX
+#include "linux/platform-conf.h"
+#else
 #include "efm32/efm32gg-stk3700/platform-conf.h"
+#endif
 
 #endif /* PLATFORM_H_ */